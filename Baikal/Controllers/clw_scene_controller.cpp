@@ -10,15 +10,24 @@
 #include "SceneGraph/uberv2material.h"
 #include "SceneGraph/inputmaps.h"
 #include "Utils/distribution1d.h"
+#include "Utils/distribution2d.h"
+#include "Utils/light_tree.h"
 #include "Utils/log.h"
 #include "Utils/cl_inputmap_generator.h"
 #include "Utils/cl_program_manager.h"
 #include "Utils/cl_uberv2_generator.h"
+#include "Utils/color.h"
 
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <map>
 #include <memory>
 #include <stack>
+#include <unordered_map>
 #include <vector>
 #include <array>
 
@@ -51,11 +60,13 @@ namespace Baikal
     }
 
 
-    ClwSceneController::ClwSceneController(CLWContext context, RadeonRays::IntersectionApi* api, const CLProgramManager *program_manager)
+    ClwSceneController::ClwSceneController(CLWContext context, std::shared_ptr<RadeonRays::IntersectionApi> api, const CLProgramManager *program_manager,
+                                           std::shared_ptr<CLMemoryManager> memory_manager)
     : m_context(context)
     , m_api(api)
     , m_default_material(UberV2Material::Create())
     , m_program_manager(program_manager)
+    , m_memory_manager(memory_manager)
     {
         auto acc_type = "fatbvh";
         auto builder_type = "sah";
@@ -77,6 +88,9 @@ namespace Baikal
 
     ClwSceneController::~ClwSceneController()
     {
+        // Shapes of the current scene are attached, ReleaseScene expects them detached
+        m_api->DetachAll();
+        ReleaseCache();
     }
 
     static void SplitMeshesAndInstances(Iterator& shape_iter, std::set<Mesh::Ptr>& meshes, std::set<Instance::Ptr>& instances, std::set<Mesh::Ptr>& excluded_meshes)
@@ -166,21 +180,6 @@ namespace Baikal
 
     void ClwSceneController::UpdateIntersector(Scene1 const& scene, ClwScene& out) const
     {
-        // Detach and delete all shapes
-        for (auto& shape : out.isect_shapes)
-        {
-            m_api->DetachShape(shape);
-            m_api->DeleteShape(shape);
-        }
-
-        // Clear shapes cache
-        out.isect_shapes.clear();
-        // Only visible shapes are attached to the API.
-        // So excluded meshes are pushed into isect_shapes, but
-        // not to visible_shapes.
-        out.visible_shapes.clear();
-
-        // Create new shapes
         auto shape_iter = scene.CreateShapeIterator();
 
         if (!shape_iter->IsValid())
@@ -196,85 +195,123 @@ namespace Baikal
         std::set<Instance::Ptr> instances;
         SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
 
-        // Keep shape->rr shape association for
-        // instance base shape lookup.
-        std::map<Shape::Ptr, RadeonRays::Shape*> rr_shapes;
+        // Only shapes of the current scene are attached to the API,
+        // other scenes get attached by ReloadIntersector.
+        bool attached = IsCurrentScene(scene);
 
-        // Start from ID 1
-        // Handle meshes
-        int id = 1;
-        for (auto& iter : meshes)
+        // Shapes left in old_shapes after the update are deleted
+        auto old_shapes = std::move(out.intersector_shapes);
+        out.intersector_shapes.clear();
+        out.isect_shapes.clear();
+        // Only visible shapes are attached to the API.
+        // So excluded meshes are pushed into isect_shapes, but
+        // not to visible_shapes.
+        out.visible_shapes.clear();
+
+        // Reuse existing shape or create a new one and attach or detach it
+        // if its visibility changed.
+        auto update_shape = [this, attached, &old_shapes, &out](Shape const& shape, ClwScene::IntersectorShape isect_shape, std::function<RadeonRays::Shape*()> create_shape)
         {
-            auto mesh = iter;
+            auto iter = old_shapes.find(shape.GetId());
+            bool was_visible = false;
+
+            if (iter != old_shapes.cend() &&
+                iter->second.base_shape == isect_shape.base_shape &&
+                iter->second.geometry_version == isect_shape.geometry_version)
+            {
+                isect_shape.shape = iter->second.shape;
+                was_visible = iter->second.visible;
+                old_shapes.erase(iter);
+            }
+            else
+            {
+                isect_shape.shape = create_shape();
+            }
 
-            auto shape = m_api->CreateMesh(
-                                           // Vertices starting from the first one
-                                           (float*)mesh->GetVertices(),
-                                           // Number of vertices
-                                           static_cast<int>(mesh->GetNumVertices()),
-                                           // Stride
-                                           sizeof(float3),
-                                           // TODO: make API signature const
-                                           reinterpret_cast<int const*>(mesh->GetIndices()),
-                                           // Index stride
-                                           0,
-                                           // All triangles
-                                           nullptr,
-                                           // Number of primitives
-                                           static_cast<int>(mesh->GetNumIndices() / 3)
-                                           );
+            if (attached && isect_shape.visible != was_visible)
+            {
+                if (isect_shape.visible)
+                {
+                    m_api->AttachShape(isect_shape.shape);
+                }
+                else
+                {
+                    m_api->DetachShape(isect_shape.shape);
+                }
+            }
 
-            auto transform = mesh->GetTransform();
-            shape->SetTransform(transform, inverse(transform));
-            shape->SetId(id++);
-            shape->SetMask(iter->GetVisibilityMask());
+            auto transform = shape.GetTransform();
+            isect_shape.shape->SetTransform(transform, inverse(transform));
+            // Ids follow shape buffer order starting from 1
+            isect_shape.shape->SetId(static_cast<int>(out.isect_shapes.size()) + 1);
+
+            out.intersector_shapes[shape.GetId()] = isect_shape;
+            out.isect_shapes.push_back(isect_shape.shape);
+
+            if (isect_shape.visible)
+            {
+                out.visible_shapes.push_back(isect_shape.shape);
+            }
 
-            out.isect_shapes.push_back(shape);
-            out.visible_shapes.push_back(shape);
-            rr_shapes[mesh] = shape;
+            return isect_shape.shape;
+        };
+
+        auto create_mesh = [this](Mesh const& mesh)
+        {
+            return m_api->CreateMesh(
+                                     // Vertices starting from the first one
+                                     (float*)mesh.GetVertices(),
+                                     // Number of vertices
+                                     static_cast<int>(mesh.GetNumVertices()),
+                                     // Stride
+                                     sizeof(float3),
+                                     // TODO: make API signature const
+                                     reinterpret_cast<int const*>(mesh.GetIndices()),
+                                     // Index stride
+                                     0,
+                                     // All triangles
+                                     nullptr,
+                                     // Number of primitives
+                                     static_cast<int>(mesh.GetNumIndices() / 3)
+                                     );
+        };
+
+        // Handle meshes
+        for (auto& iter : meshes)
+        {
+            auto mesh = iter;
+            auto shape = update_shape(*mesh, { nullptr, nullptr, mesh->GetGeometryVersion(), true },
+                                      [&create_mesh, &mesh]() { return create_mesh(*mesh); });
+            shape->SetMask(mesh->GetVisibilityMask());
         }
 
         // Handle excluded meshes
         for (auto& iter : excluded_meshes)
         {
             auto mesh = iter;
-
-            auto shape = m_api->CreateMesh(
-                                           // Vertices starting from the first one
-                                           (float*)mesh->GetVertices(),
-                                           // Number of vertices
-                                           static_cast<int>(mesh->GetNumVertices()),
-                                           // Stride
-                                           sizeof(float3),
-                                           // TODO: make API signature const
-                                           reinterpret_cast<int const*>(mesh->GetIndices()),
-                                           // Index stride
-                                           0,
-                                           // All triangles
-                                           nullptr,
-                                           // Number of primitives
-                                           static_cast<int>(mesh->GetNumIndices() / 3)
-                                           );
-
-            auto transform = mesh->GetTransform();
-            shape->SetTransform(transform, inverse(transform));
-            shape->SetId(id++);
-            out.isect_shapes.push_back(shape);
-            rr_shapes[mesh] = shape;
+            update_shape(*mesh, { nullptr, nullptr, mesh->GetGeometryVersion(), false },
+                         [&create_mesh, &mesh]() { return create_mesh(*mesh); });
         }
 
         // Handle instances
-        for (auto& iter: instances)
+        for (auto& iter : instances)
         {
             auto instance = iter;
-            auto rr_mesh = rr_shapes[instance->GetBaseShape()];
-            auto shape = m_api->CreateInstance(rr_mesh);
+            auto rr_mesh = out.intersector_shapes[instance->GetBaseShape()->GetId()].shape;
+            update_shape(*instance, { nullptr, rr_mesh, 0u, true },
+                         [this, rr_mesh]() { return m_api->CreateInstance(rr_mesh); });
+        }
 
-            auto transform = instance->GetTransform();
-            shape->SetTransform(transform, inverse(transform));
-            shape->SetId(id++);
-            out.isect_shapes.push_back(shape);
-            out.visible_shapes.push_back(shape);
+        // Delete shapes removed from the scene or recreated
+        // because of geometry changes
+        for (auto& iter : old_shapes)
+        {
+            if (attached && iter.second.visible)
+            {
+                m_api->DetachShape(iter.second.shape);
+            }
+
+            m_api->DeleteShape(iter.second.shape);
         }
     }
 
@@ -331,17 +368,39 @@ namespace Baikal
 
     void ClwSceneController::UpdateCamera(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, Collector& vol_collector, ClwScene& out) const
     {
-        // TODO: support different camera types here
         auto camera = scene.GetCamera();
 
-        // Create light buffer if needed
-        if (out.camera.GetElementCount() == 0)
+        // Views packed into one output get a camera each, the main one is used otherwise
+        auto view_cameras = scene.GetViewCameras();
+        if (view_cameras.empty())
         {
-            out.camera = m_context.CreateBuffer<ClwScene::Camera>(1, CL_MEM_READ_ONLY);
+            view_cameras.push_back(camera);
         }
 
+        // Create camera buffer if needed
+        m_memory_manager->Reserve(out.camera, view_cameras.size(), CLMemoryManager::Category::kOther);
+
         // TODO: remove this
-        out.camera_type = GetCameraType(*camera);
+        // All views are rendered with the same camera kernel, pinhole views
+        // are handled by the DOF kernel as well (zero aperture)
+        out.camera_type = GetCameraType(*view_cameras.front());
+        for (auto const& view_camera : view_cameras)
+        {
+            auto type = GetCameraType(*view_camera);
+            if (type == out.camera_type)
+            {
+                continue;
+            }
+
+            if (type == CameraType::kOrthographic || out.camera_type == CameraType::kOrthographic)
+            {
+                throw std::runtime_error("ClwSceneController: perspective and orthographic views can't be mixed");
+            }
+
+            out.camera_type = CameraType::kPhysicalPerspective;
+        }
+
+        out.num_cameras = static_cast<int>(view_cameras.size());
 
         // Update camera data
         ClwScene::Camera* data = nullptr;
@@ -349,44 +408,62 @@ namespace Baikal
         // Map GPU camera buffer
         m_context.MapBuffer(0, out.camera, CL_MAP_WRITE, &data).Wait();
 
-        // Copy camera parameters
-        data->forward = camera->GetForwardVector();
-        data->up = camera->GetUpVector();
-        data->right = camera->GetRightVector();
-        data->p = camera->GetPosition();
-        data->aspect_ratio = camera->GetAspectRatio();
-        data->dim = camera->GetSensorSize();
-        data->zcap = camera->GetDepthRange();
-
-        if (out.camera_type == CameraType::kPerspective ||
-            out.camera_type == CameraType::kPhysicalPerspective)
+        for (auto const& view_camera : view_cameras)
         {
-            auto physical_camera = std::static_pointer_cast<PerspectiveCamera>(camera);
-            data->aperture = physical_camera->GetAperture();
-            data->focal_length = physical_camera->GetFocalLength();
-            data->focus_distance = physical_camera->GetFocusDistance();
+            // Copy camera parameters
+            data->forward = view_camera->GetForwardVector();
+            data->up = view_camera->GetUpVector();
+            data->right = view_camera->GetRightVector();
+            data->p = view_camera->GetPosition();
+            data->aspect_ratio = view_camera->GetAspectRatio();
+            data->dim = view_camera->GetSensorSize();
+            data->zcap = view_camera->GetDepthRange();
+
+            if (out.camera_type == CameraType::kPerspective ||
+                out.camera_type == CameraType::kPhysicalPerspective)
+            {
+                auto physical_camera = std::static_pointer_cast<PerspectiveCamera>(view_camera);
+                data->aperture = physical_camera->GetAperture();
+                data->focal_length = physical_camera->GetFocalLength();
+                data->focus_distance = physical_camera->GetFocusDistance();
+            }
+
+            ++data;
         }
 
         // Unmap camera buffer
-        m_context.UnmapBuffer(0, out.camera, data);
+        m_context.UnmapBuffer(0, out.camera, data - view_cameras.size());
 
         // Update volume index
         out.camera_volume_index = GetVolumeIndex(vol_collector, camera->GetVolume());
     }
 
-    void ClwSceneController::UpdateShapes(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, Collector& vol_collector, ClwScene& out) const
+    // Allocate range in geometry buffer growing allocator by doubling if needed
+    static std::size_t AllocateGeometryRange(RangeAllocator& allocator, std::size_t size)
     {
-        std::size_t num_vertices = 0;
-        std::size_t num_normals = 0;
-        std::size_t num_uvs = 0;
-        std::size_t num_indices = 0;
+        std::size_t offset = 0;
+
+        while (!allocator.Allocate(size, offset))
+        {
+            auto capacity = allocator.GetCapacity();
+            allocator.Grow(std::max(2 * capacity, capacity + size));
+        }
 
-        std::size_t num_vertices_written = 0;
-        std::size_t num_normals_written = 0;
-        std::size_t num_uvs_written = 0;
-        std::size_t num_indices_written = 0;
-        std::size_t num_shapes_written = 0;
+        return offset;
+    }
 
+    // Fill shape descriptor common for meshes and instances
+    static void WriteShapeTransform(Shape const& shape, ClwScene::Shape& clw_shape)
+    {
+        auto transform = shape.GetTransform();
+        clw_shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
+        clw_shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
+        clw_shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
+        clw_shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+    }
+
+    void ClwSceneController::UpdateShapes(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, Collector& vol_collector, ClwScene& out) const
+    {
         auto shape_iter = scene.CreateShapeIterator();
 
         // Sort shapes into meshes and instances sets.
@@ -397,169 +474,171 @@ namespace Baikal
         std::set<Instance::Ptr> instances;
         SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
 
-        // Calculate GPU array sizes. Do that only for meshes,
-        // since instances do not occupy space in vertex buffers.
-        // However instances still have their own material ids.
-        for (auto& iter : meshes)
-        {
-            auto mesh = iter;
+        // Meshes occupying space in geometry buffers. Excluded meshes
+        // still occupy space in vertex buffers, instances do not.
+        std::vector<Mesh::Ptr> geometry_meshes(meshes.cbegin(), meshes.cend());
+        geometry_meshes.insert(geometry_meshes.end(), excluded_meshes.cbegin(), excluded_meshes.cend());
 
-            num_vertices += mesh->GetNumVertices();
-            num_normals += mesh->GetNumNormals();
-            num_uvs += mesh->GetNumUVs();
-            num_indices += mesh->GetNumIndices();
-        }
+        // Slots are updated on copies which are stored once buffers fit them,
+        // so the scene stays intact if memory budget is exceeded
+        auto mesh_slots = out.mesh_slots;
+        auto vertex_allocator = out.vertex_allocator;
+        auto index_allocator = out.index_allocator;
 
-        // Excluded meshes still occupy space in vertex buffers.
-        for (auto& iter : excluded_meshes)
+        // Release slots of the meshes which are not in the scene anymore
+        std::unordered_map<std::uint32_t, Mesh::Ptr> mesh_by_id;
+        for (auto& mesh : geometry_meshes)
         {
-            auto mesh = iter;
-
-            num_vertices += mesh->GetNumVertices();
-            num_normals += mesh->GetNumNormals();
-            num_uvs += mesh->GetNumUVs();
-            num_indices += mesh->GetNumIndices();
+            mesh_by_id[mesh->GetId()] = mesh;
         }
 
-        // Instances only occupy material IDs space.
-        for (auto& iter : instances)
+        for (auto iter = mesh_slots.begin(); iter != mesh_slots.end();)
         {
-            auto instance = iter;
-            auto mesh = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
+            if (mesh_by_id.find(iter->first) == mesh_by_id.cend())
+            {
+                vertex_allocator.Free(iter->second.vertex_offset, iter->second.vertex_capacity);
+                index_allocator.Free(iter->second.index_offset, iter->second.index_capacity);
+                iter = mesh_slots.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
         }
 
-        LogInfo("Creating vertex buffer...\n");
-        // Create CL arrays
-        out.vertices = m_context.CreateBuffer<float3>(num_vertices, CL_MEM_READ_ONLY);
-
-        LogInfo("Creating normal buffer...\n");
-        out.normals = m_context.CreateBuffer<float3>(num_normals, CL_MEM_READ_ONLY);
-
-        LogInfo("Creating UV buffer...\n");
-        out.uvs = m_context.CreateBuffer<float2>(num_uvs, CL_MEM_READ_ONLY);
-
-        LogInfo("Creating index buffer...\n");
-        out.indices = m_context.CreateBuffer<int>(num_indices, CL_MEM_READ_ONLY);
+        // Find meshes which geometry needs to be uploaded. Meshes which
+        // outgrew their slots release them and get new ones below.
+        std::vector<Mesh::Ptr> dirty_meshes;
+        for (auto& mesh : geometry_meshes)
+        {
+            auto iter = mesh_slots.find(mesh->GetId());
 
-        // Total number of entries in shapes GPU array
-        auto num_shapes = meshes.size() + excluded_meshes.size() + instances.size();
-        out.shapes = m_context.CreateBuffer<ClwScene::Shape>(num_shapes, CL_MEM_READ_ONLY);
-        out.shapes_additional = m_context.CreateBuffer<ClwScene::ShapeAdditionalData>(num_shapes, CL_MEM_READ_ONLY);
+            if (iter != mesh_slots.cend())
+            {
+                auto& slot = iter->second;
 
-        float3* vertices = nullptr;
-        float3* normals = nullptr;
-        float2* uvs = nullptr;
-        int* indices = nullptr;
-        ClwScene::Shape* shapes = nullptr;
-        ClwScene::ShapeAdditionalData* shapes_additional = nullptr;
+                if (slot.geometry_version == mesh->GetGeometryVersion())
+                {
+                    continue;
+                }
 
-        // Map arrays and prepare to write data
-        LogInfo("Mapping buffers...\n");
-        m_context.MapBuffer(0, out.vertices, CL_MAP_WRITE, &vertices);
-        m_context.MapBuffer(0, out.normals, CL_MAP_WRITE, &normals);
-        m_context.MapBuffer(0, out.uvs, CL_MAP_WRITE, &uvs);
-        m_context.MapBuffer(0, out.indices, CL_MAP_WRITE, &indices);
-        m_context.MapBuffer(0, out.shapes, CL_MAP_WRITE, &shapes).Wait();
-        m_context.MapBuffer(0, out.shapes_additional, CL_MAP_WRITE, &shapes_additional).Wait();
+                if (mesh->GetNumVertices() > slot.vertex_capacity ||
+                    mesh->GetNumIndices() > slot.index_capacity)
+                {
+                    vertex_allocator.Free(slot.vertex_offset, slot.vertex_capacity);
+                    index_allocator.Free(slot.index_offset, slot.index_capacity);
+                    mesh_slots.erase(iter);
+                }
+            }
 
-        // Keep associated shapes data for instance look up.
-        // We retrieve data from here while serializing instances,
-        // using base shape lookup.
-        std::map<Mesh::Ptr, ClwScene::Shape> shape_data;
+            dirty_meshes.push_back(mesh);
+        }
 
-        // Handle meshes
-        //int shape_id = 0;
-        for (auto& iter : meshes)
+        // Allocate slots for new meshes
+        for (auto& mesh : dirty_meshes)
         {
-            auto mesh = iter;
-
-            // Get pointers data
-            auto mesh_vertex_array = mesh->GetVertices();
-            auto mesh_num_vertices = mesh->GetNumVertices();
-
-            auto mesh_normal_array = mesh->GetNormals();
-            auto mesh_num_normals = mesh->GetNumNormals();
-
-            auto mesh_uv_array = mesh->GetUVs();
-            auto mesh_num_uvs = mesh->GetNumUVs();
+            if (mesh_slots.find(mesh->GetId()) != mesh_slots.cend())
+            {
+                continue;
+            }
 
-            auto mesh_index_array = mesh->GetIndices();
-            auto mesh_num_indices = mesh->GetNumIndices();
+            ClwScene::MeshSlot slot;
+            slot.vertex_capacity = mesh->GetNumVertices();
+            slot.vertex_offset = AllocateGeometryRange(vertex_allocator, slot.vertex_capacity);
+            slot.index_capacity = mesh->GetNumIndices();
+            slot.index_offset = AllocateGeometryRange(index_allocator, slot.index_capacity);
+            // Version is updated on upload
+            slot.geometry_version = 0u;
+            mesh_slots[mesh->GetId()] = slot;
+        }
 
-            // Prepare shape descriptor
-            ClwScene::Shape shape;
+        // Grow geometry buffers if allocators have grown, existing data is preserved
+        auto vertex_capacity = std::max(vertex_allocator.GetCapacity(), std::size_t(1));
+        auto index_capacity = std::max(index_allocator.GetCapacity(), std::size_t(1));
 
-            shape.id = iter->GetId();
+        // Vertex buffers are checked together as growing them may have stopped halfway before
+        if (vertex_capacity > std::min({ out.vertices.GetElementCount(), out.normals.GetElementCount(), out.uvs.GetElementCount() }))
+        {
+            LogInfo("Growing vertex buffers to ", vertex_capacity, " elements...\n");
+            m_memory_manager->Grow(out.vertices, vertex_capacity, CLMemoryManager::Category::kGeometry);
+            m_memory_manager->Grow(out.normals, vertex_capacity, CLMemoryManager::Category::kGeometry);
+            m_memory_manager->Grow(out.uvs, vertex_capacity, CLMemoryManager::Category::kGeometry);
+        }
 
-            shape.startvtx = static_cast<int>(num_vertices_written);
-            shape.startidx = static_cast<int>(num_indices_written);
+        if (index_capacity > out.indices.GetElementCount())
+        {
+            LogInfo("Growing index buffer to ", index_capacity, " elements...\n");
+            m_memory_manager->Grow(out.indices, index_capacity, CLMemoryManager::Category::kGeometry);
+        }
 
-            auto transform = mesh->GetTransform();
-            shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+        // Shape descriptors are small, so they are always rewritten
+        auto num_shapes = meshes.size() + excluded_meshes.size() + instances.size();
 
-            shape.linearvelocity = float3(0.0f, 0.f, 0.f);
-            shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
-            shape.material.offset = GetMaterialIndex(mat_collector, mesh->GetMaterial());
-            shape.material.layers = GetMaterialLayers(mesh->GetMaterial());
+        m_memory_manager->Reserve(out.shapes, num_shapes, CLMemoryManager::Category::kGeometry);
+        m_memory_manager->Reserve(out.shapes_additional, num_shapes, CLMemoryManager::Category::kGeometry);
 
-            shape.volume_idx = GetVolumeIndex(vol_collector, mesh->GetVolumeMaterial());
+        out.mesh_slots = std::move(mesh_slots);
+        out.vertex_allocator = std::move(vertex_allocator);
+        out.index_allocator = std::move(index_allocator);
 
-            shape_data[mesh] = shape;
+        // Upload geometry of dirty meshes into their slots only
+        LogInfo("Uploading ", dirty_meshes.size(), " of ", geometry_meshes.size(), " meshes...\n");
+        for (auto& mesh : dirty_meshes)
+        {
+            auto& slot = out.mesh_slots[mesh->GetId()];
 
-            std::copy(mesh_vertex_array, mesh_vertex_array + mesh_num_vertices, vertices + num_vertices_written);
-            num_vertices_written += mesh_num_vertices;
+            auto num_vertices = std::min(mesh->GetNumVertices(), slot.vertex_capacity);
+            auto num_normals = std::min(mesh->GetNumNormals(), slot.vertex_capacity);
+            auto num_uvs = std::min(mesh->GetNumUVs(), slot.vertex_capacity);
+            auto num_indices = std::min(mesh->GetNumIndices(), slot.index_capacity);
 
-            std::copy(mesh_normal_array, mesh_normal_array + mesh_num_normals, normals + num_normals_written);
-            num_normals_written += mesh_num_normals;
+            if (num_vertices > 0)
+            {
+                m_context.WriteBuffer(0, out.vertices, mesh->GetVertices(), slot.vertex_offset, num_vertices);
+            }
 
-            std::copy(mesh_uv_array, mesh_uv_array + mesh_num_uvs, uvs + num_uvs_written);
-            num_uvs_written += mesh_num_uvs;
+            if (num_normals > 0)
+            {
+                m_context.WriteBuffer(0, out.normals, mesh->GetNormals(), slot.vertex_offset, num_normals);
+            }
 
-            std::copy(mesh_index_array, mesh_index_array + mesh_num_indices, indices + num_indices_written);
-            num_indices_written += mesh_num_indices;
+            if (num_uvs > 0)
+            {
+                m_context.WriteBuffer(0, out.uvs, mesh->GetUVs(), slot.vertex_offset, num_uvs);
+            }
 
-            shapes[num_shapes_written] = shape;
+            if (num_indices > 0)
+            {
+                m_context.WriteBuffer(0, out.indices, reinterpret_cast<int const*>(mesh->GetIndices()), slot.index_offset, num_indices);
+            }
 
-            ClwScene::ShapeAdditionalData shape_additional;
-            shape_additional.group_id = mesh->GetGroupId();
-            shapes_additional[num_shapes_written++] = shape_additional;
+            slot.geometry_version = mesh->GetGeometryVersion();
         }
 
-        // Excluded shapes are handled in almost the same way
-        // except materials.
-        for (auto& iter : excluded_meshes)
-        {
-            auto mesh = iter;
-
-            // Get pointers data
-            auto mesh_vertex_array = mesh->GetVertices();
-            auto mesh_num_vertices = mesh->GetNumVertices();
+        std::vector<ClwScene::Shape> shapes;
+        std::vector<ClwScene::ShapeAdditionalData> shapes_additional;
+        shapes.reserve(num_shapes);
+        shapes_additional.reserve(num_shapes);
 
-            auto mesh_normal_array = mesh->GetNormals();
-            auto mesh_num_normals = mesh->GetNumNormals();
-
-            auto mesh_uv_array = mesh->GetUVs();
-            auto mesh_num_uvs = mesh->GetNumUVs();
+        // Keep associated shapes data for instance look up.
+        // We retrieve data from here while serializing instances,
+        // using base shape lookup.
+        std::map<Mesh::Ptr, ClwScene::Shape> shape_data;
 
-            auto mesh_index_array = mesh->GetIndices();
-            auto mesh_num_indices = mesh->GetNumIndices();
+        // Handle meshes and excluded meshes
+        for (auto& mesh : geometry_meshes)
+        {
+            auto const& slot = out.mesh_slots[mesh->GetId()];
 
             // Prepare shape descriptor
             ClwScene::Shape shape;
 
             shape.id = mesh->GetId();
 
-            shape.startvtx = static_cast<int>(num_vertices_written);
-            shape.startidx = static_cast<int>(num_indices_written);
+            shape.startvtx = static_cast<int>(slot.vertex_offset);
+            shape.startidx = static_cast<int>(slot.index_offset);
 
-            auto transform = mesh->GetTransform();
-            shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+            WriteShapeTransform(*mesh, shape);
 
             shape.linearvelocity = float3(0.0f, 0.f, 0.f);
             shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
@@ -569,24 +648,11 @@ namespace Baikal
             shape.volume_idx = GetVolumeIndex(vol_collector, mesh->GetVolumeMaterial());
 
             shape_data[mesh] = shape;
-
-            std::copy(mesh_vertex_array, mesh_vertex_array + mesh_num_vertices, vertices + num_vertices_written);
-            num_vertices_written += mesh_num_vertices;
-
-            std::copy(mesh_normal_array, mesh_normal_array + mesh_num_normals, normals + num_normals_written);
-            num_normals_written += mesh_num_normals;
-
-            std::copy(mesh_uv_array, mesh_uv_array + mesh_num_uvs, uvs + num_uvs_written);
-            num_uvs_written += mesh_num_uvs;
-
-            std::copy(mesh_index_array, mesh_index_array + mesh_num_indices, indices + num_indices_written);
-            num_indices_written += mesh_num_indices;
-
-            shapes[num_shapes_written] = shape;
+            shapes.push_back(shape);
 
             ClwScene::ShapeAdditionalData shape_additional;
             shape_additional.group_id = mesh->GetGroupId();
-            shapes_additional[num_shapes_written++] = shape_additional;
+            shapes_additional.push_back(shape_additional);
         }
 
         // Handle instances
@@ -594,7 +660,6 @@ namespace Baikal
         {
             auto instance = iter;
             auto base_shape = std::static_pointer_cast<Mesh>(instance->GetBaseShape());
-            auto transform = instance->GetTransform();
 
             // Here shape_data is guaranteed to contain
             // info for base_shape since we have serialized it
@@ -604,10 +669,7 @@ namespace Baikal
             shape.id = iter->GetId();
 
             // Instance has its own transform.
-            shape.transform.m0 = { transform.m00, transform.m01, transform.m02, transform.m03 };
-            shape.transform.m1 = { transform.m10, transform.m11, transform.m12, transform.m13 };
-            shape.transform.m2 = { transform.m20, transform.m21, transform.m22, transform.m23 };
-            shape.transform.m3 = { transform.m30, transform.m31, transform.m32, transform.m33 };
+            WriteShapeTransform(*instance, shape);
 
             shape.linearvelocity = float3(0.0f, 0.f, 0.f);
             shape.angularvelocity = float3(0.f, 0.f, 0.f, 1.f);
@@ -616,26 +678,32 @@ namespace Baikal
 
             shape.volume_idx = GetVolumeIndex(vol_collector, instance->GetVolumeMaterial());
 
-            shapes[num_shapes_written] = shape;
+            shapes.push_back(shape);
 
             ClwScene::ShapeAdditionalData shape_additional;
             shape_additional.group_id = iter->GetGroupId();
-            shapes_additional[num_shapes_written++] = shape_additional;
+            shapes_additional.push_back(shape_additional);
         }
 
-        LogInfo("Unmapping buffers...\n");
-        m_context.UnmapBuffer(0, out.vertices, vertices);
-        m_context.UnmapBuffer(0, out.normals, normals);
-        m_context.UnmapBuffer(0, out.uvs, uvs);
-        m_context.UnmapBuffer(0, out.indices, indices);
-        m_context.UnmapBuffer(0, out.shapes, shapes).Wait();
-        m_context.UnmapBuffer(0, out.shapes_additional, shapes_additional).Wait();
+        m_context.WriteBuffer(0, out.shapes, shapes.data(), shapes.size());
+        m_context.WriteBuffer(0, out.shapes_additional, shapes_additional.data(), shapes_additional.size());
+
+        // Host data has to stay alive until writes are complete
+        m_context.Finish(0);
 
         LogInfo("Updating intersector...\n");
 
         UpdateIntersector(scene, out);
 
-        ReloadIntersector(scene, out);
+        // Shapes of the current scene are already attached
+        if (IsCurrentScene(scene))
+        {
+            m_api->Commit();
+        }
+        else
+        {
+            ReloadIntersector(scene, out);
+        }
     }
 
     void ClwSceneController::UpdateShapeProperties(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, Collector& volume_collector, ClwScene& out) const
@@ -650,6 +718,21 @@ namespace Baikal
         std::set<Instance::Ptr> instances;
         SplitMeshesAndInstances(*shape_iter, meshes, instances, excluded_meshes);
 
+        // Geometry changes require an upload into mesh slots,
+        // UpdateShapes only re-uploads meshes which have changed.
+        auto geometry_changed = [&out](Mesh::Ptr const& mesh)
+        {
+            auto iter = out.mesh_slots.find(mesh->GetId());
+            return iter == out.mesh_slots.cend() || iter->second.geometry_version != mesh->GetGeometryVersion();
+        };
+
+        if (std::any_of(meshes.cbegin(), meshes.cend(), geometry_changed) ||
+            std::any_of(excluded_meshes.cbegin(), excluded_meshes.cend(), geometry_changed))
+        {
+            UpdateShapes(scene, mat_collector, tex_collector, volume_collector, out);
+            return;
+        }
+
         ClwScene::Shape* shapes = nullptr;
         ClwScene::ShapeAdditionalData* shapes_additional = nullptr;
 
@@ -744,13 +827,14 @@ namespace Baikal
         // Cleanup material mapping
         m_materialid_to_offset.clear();
 
+        // Input maps are laid out as materials reference them
+        m_input_map_generator = CLInputMapGenerator();
+        m_input_map_optimizer = InputMapOptimizer();
+
         CLUberV2Generator uberv2_generator;
 
         // Serialize materials
         {
-            // Update material bundle first to be able to track differences
-            out.material_bundle.reset(mat_collector.CreateBundle());
-
             // Create material iterator
             auto mat_iter = mat_collector.CreateIterator();
 
@@ -764,16 +848,14 @@ namespace Baikal
 
         }
 
-        std::string uberv2_source = uberv2_generator.BuildSource();
-        m_program_manager->AddHeader("uberv2_generated.cl", uberv2_source);
+        // Recreate material buffer if it needs resize, scene is left intact if it doesn't fit
+        m_memory_manager->Reserve(out.material_attributes, mat_buffer.size(), CLMemoryManager::Category::kMaterials);
 
+        // Update material bundle to be able to track differences
+        out.material_bundle.reset(mat_collector.CreateBundle());
 
-        // Recreate material buffer if it needs resize
-        if (mat_buffer.size() > out.material_attributes.GetElementCount())
-        {
-            // Create material buffer
-            out.material_attributes = m_context.CreateBuffer<int32_t>(mat_buffer.size(), CL_MEM_READ_ONLY);
-        }
+        std::string uberv2_source = uberv2_generator.BuildSource();
+        m_program_manager->AddHeader("uberv2_generated.cl", uberv2_source);
 
         int32_t *materials = nullptr;
 
@@ -795,11 +877,7 @@ namespace Baikal
         std::size_t vol_buffer_size = volume_collector.GetNumItems();
 
         // Recreate material buffer if it needs resize
-        if (vol_buffer_size > out.volumes.GetElementCount())
-        {
-            // Create material buffer
-            out.volumes = m_context.CreateBuffer<ClwScene::Volume>(vol_buffer_size, CL_MEM_READ_ONLY);
-        }
+        m_memory_manager->Reserve(out.volumes, vol_buffer_size, CLMemoryManager::Category::kMaterials);
 
         ClwScene::Volume* volumes = nullptr;
 
@@ -837,28 +915,79 @@ namespace Baikal
         m_api->Commit();
     }
 
+    // Maximum size of tile pool for streamed textures
+    static const std::size_t kTexturePoolSize = 256u * 1024u * 1024u;
+
+    // Size of resident tail of texture mip chain starting from first_level
+    static std::size_t GetResidentDataSize(Texture const& texture, std::uint32_t first_level)
+    {
+        if (first_level == 0)
+        {
+            return texture.GetSizeInBytes() + texture.GetMipDataSizeInBytes();
+        }
+
+        auto mip_end = texture.GetMipData() + texture.GetMipDataSizeInBytes();
+        return static_cast<std::size_t>(mip_end - texture.GetLevelData(first_level));
+    }
+
     void ClwSceneController::UpdateTextures(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, ClwScene& out) const
     {
+        static_assert(TextureStreamer::kTileSizeInBytes == ClwScene::kTextureTileSizeInBytes, "Tile size mismatch");
+
         // Get new buffer size
         std::size_t tex_buffer_size = tex_collector.GetNumItems();
         std::size_t tex_data_buffer_size = 0;
+        std::size_t num_pages = 0;
 
-        if (tex_buffer_size == 0)
+        // Create material iterator
+        std::unique_ptr<Iterator> tex_iter(tex_collector.CreateIterator());
+
+        // Fine levels of large textures are streamed by tiles, only the rest is stored in texture data
+        for (; tex_iter->IsValid(); tex_iter->Next())
         {
-            out.textures = m_context.CreateBuffer<ClwScene::Texture>(1, CL_MEM_READ_ONLY);
-            out.texturedata = m_context.CreateBuffer<char>(1, CL_MEM_READ_ONLY);
-            return;
+            auto tex = tex_iter->ItemAs<Texture>();
+            auto streamed = TextureStreamer::IsStreamable(*tex);
+            auto first_level = streamed ? TextureStreamer::GetResidentLevel(*tex) : 0u;
+
+            tex_data_buffer_size += align16(GetResidentDataSize(*tex, first_level));
+
+            if (streamed)
+            {
+                num_pages += TextureStreamer::GetNumPages(*tex);
+            }
         }
 
-        // Recreate material buffer if it needs resize
-        if (tex_buffer_size > out.textures.GetElementCount())
+        // Tile pool follows resident data, it is large enough to keep all tiles unless
+        // streamed levels exceed kTexturePoolSize
+        auto num_slots = std::min(num_pages, kTexturePoolSize / TextureStreamer::kTileSizeInBytes);
+        auto texture_pool_offset = tex_data_buffer_size;
+        tex_data_buffer_size += num_slots * TextureStreamer::kTileSizeInBytes;
+
+        auto num_feedback_words = (num_pages + 31) / 32;
+
+        // Recreate texture buffers if they need resize (keep at least one element to avoid
+        // empty buffers), scene is left intact if they don't fit
+        m_memory_manager->Reserve(out.textures, std::max<std::size_t>(tex_buffer_size, 1), CLMemoryManager::Category::kTextures);
+        m_memory_manager->Reserve(out.texturedata, std::max<std::size_t>(tex_data_buffer_size, 1), CLMemoryManager::Category::kTextures);
+        m_memory_manager->Reserve(out.texturepages, std::max<std::size_t>(num_pages, 1), CLMemoryManager::Category::kTextures);
+        m_memory_manager->Reserve(out.texturefeedback, std::max<std::size_t>(num_feedback_words, 1), CLMemoryManager::Category::kTextures);
+
+        // Previously streamed tiles are dropped along with the pool
+        out.texture_streamer.Reset();
+
+        if (tex_buffer_size == 0)
         {
-            // Create material buffer
-            out.textures = m_context.CreateBuffer<ClwScene::Texture>(tex_buffer_size, CL_MEM_READ_ONLY);
+            return;
         }
 
         ClwScene::Texture* textures = nullptr;
         std::size_t num_textures_written = 0;
+        std::size_t data_offset = 0;
+        // Memory report data
+        std::size_t num_compressed_textures = 0;
+        std::size_t num_streamed_textures = 0;
+        std::size_t base_level_size = 0;
+        std::size_t uncompressed_size = 0;
 
         // Map GPU materials buffer
         m_context.MapBuffer(0, out.textures, CL_MAP_WRITE, &textures).Wait();
@@ -866,31 +995,53 @@ namespace Baikal
         // Update material bundle first to be able to track differences
         out.texture_bundle.reset(tex_collector.CreateBundle());
 
-        // Create material iterator
-        std::unique_ptr<Iterator> tex_iter(tex_collector.CreateIterator());
+        tex_iter->Reset();
 
         // Iterate and serialize
         for (; tex_iter->IsValid(); tex_iter->Next())
         {
             auto tex = tex_iter->ItemAs<Texture>();
 
-            WriteTexture(*tex, tex_data_buffer_size, textures + num_textures_written);
+            auto streamed = TextureStreamer::IsStreamable(*tex);
+            auto page_offset = streamed ? static_cast<int>(out.texture_streamer.AddTexture(tex)) : -1;
+            auto first_level = streamed ? TextureStreamer::GetResidentLevel(*tex) : 0u;
+
+            WriteTexture(*tex, data_offset, page_offset, textures + num_textures_written);
 
             ++num_textures_written;
 
-            tex_data_buffer_size += align16(tex->GetSizeInBytes());
+            data_offset += align16(GetResidentDataSize(*tex, first_level));
+
+            base_level_size += tex->GetSizeInBytes();
+
+            if (streamed)
+            {
+                ++num_streamed_textures;
+            }
+
+            if (tex->IsCompressed())
+            {
+                ++num_compressed_textures;
+                uncompressed_size += tex->GetUncompressedSizeInBytes();
+            }
+            else
+            {
+                uncompressed_size += tex->GetSizeInBytes();
+            }
         }
 
+        assert(out.texture_streamer.GetNumPages() == num_pages);
+        out.texture_streamer.SetNumSlots(num_slots);
+        out.texture_pool_offset = texture_pool_offset;
+
+        LogInfo("Texture memory: ", tex_data_buffer_size / (1024 * 1024), " MB with mip levels, ",
+            num_compressed_textures, " of ", num_textures_written, " textures block compressed (base levels: ",
+            base_level_size / (1024 * 1024), " MB vs ", uncompressed_size / (1024 * 1024), " MB uncompressed), ",
+            num_streamed_textures, " streamed using ", num_slots, " of ", num_pages, " tiles\n");
+
         // Unmap material buffer
         m_context.UnmapBuffer(0, out.textures, textures);
 
-        // Recreate material buffer if it needs resize
-        if (tex_data_buffer_size > out.texturedata.GetElementCount())
-        {
-            // Create material buffer
-            out.texturedata = m_context.CreateBuffer<char>(tex_data_buffer_size, CL_MEM_READ_ONLY);
-        }
-
         char* data = nullptr;
         std::size_t num_bytes_written = 0;
 
@@ -903,14 +1054,22 @@ namespace Baikal
         for (; tex_iter->IsValid(); tex_iter->Next())
         {
             auto tex = tex_iter->ItemAs<Texture>();
+            auto first_level = TextureStreamer::IsStreamable(*tex) ? TextureStreamer::GetResidentLevel(*tex) : 0u;
 
-            WriteTextureData(*tex, data + num_bytes_written);
+            WriteTextureData(*tex, first_level, data + num_bytes_written);
 
-            num_bytes_written += align16(tex->GetSizeInBytes());
+            num_bytes_written += align16(GetResidentDataSize(*tex, first_level));
         }
 
         // Unmap material buffer
         m_context.UnmapBuffer(0, out.texturedata, data);
+
+        // All tiles start missing, kernels request them through feedback
+        if (num_pages > 0)
+        {
+            m_context.FillBuffer(0, out.texturepages, -1, num_pages);
+            m_context.FillBuffer(0, out.texturefeedback, 0u, num_feedback_words);
+        }
     }
 
 #ifndef NDEBUG
@@ -1009,7 +1168,8 @@ namespace Baikal
                 {
                     auto value = material.GetInputValue(layer_param);
                     assert(value.type == Material::InputType::kInputMap);
-                    material_data.push_back(value.input_map_value ? value.input_map_value->GetId() : -1);
+                    material_data.push_back(value.input_map_value ?
+                        m_input_map_generator.AddInputMap(m_input_map_optimizer.Optimize(value.input_map_value)) : -1);
                 }
             }
         }
@@ -1035,6 +1195,10 @@ namespace Baikal
         {
             return ClwScene::kIbl;
         }
+        else if (dynamic_cast<MeshLight const*>(&light))
+        {
+            return ClwScene::kMesh;
+        }
         else
         {
             return ClwScene::LightType::kArea;
@@ -1110,12 +1274,210 @@ namespace Baikal
                 break;
             }
 
+            case ClwScene::kMesh:
+            {
+                auto shape = static_cast<MeshLight const&>(light).GetShape();
+
+                auto shape_iter = scene.CreateShapeIterator();
+
+                auto idx = GetShapeIdx(*shape_iter, shape);
+
+                clw_light->id = shape->GetId();
+                clw_light->shapeidx = static_cast<int>(idx);
+                clw_light->primidx = -1;
+                // Primitive distribution offset is set by UpdateLights
+                clw_light->distribution = 0;
+                break;
+            }
+
             default:
             assert(false);
             break;
         }
     }
 
+    // Bound emission directions by a cone around world space normals. Kernels check
+    // emission side using interpolated normals, so the cone should contain all vertex normals.
+    static void BoundEmissionNormals(RadeonRays::matrix const& transform, RadeonRays::float3 const* normals,
+                                     std::size_t num_normals, LightTree::LightBounds& bounds)
+    {
+        auto origin = transform * RadeonRays::float3(0.f, 0.f, 0.f);
+
+        RadeonRays::float3 axis;
+        for (std::size_t i = 0; i < num_normals; ++i)
+        {
+            axis += normalize(transform * normals[i] - origin);
+        }
+
+        if (axis.sqnorm() > 0.f)
+        {
+            bounds.axis = normalize(axis);
+            bounds.cos_theta_o = 1.f;
+
+            for (std::size_t i = 0; i < num_normals; ++i)
+            {
+                auto n = normalize(transform * normals[i] - origin);
+                bounds.cos_theta_o = std::min(bounds.cos_theta_o, dot(bounds.axis, n));
+            }
+        }
+
+        // Normals spread over more than a hemisphere
+        if (bounds.cos_theta_o <= 0.f)
+        {
+            bounds.axis = RadeonRays::float3(0.f, 0.f, 1.f);
+            bounds.cos_theta_o = -1.f;
+        }
+    }
+
+    // Compute light tree bounds of a light, returns false for lights at infinity
+    static bool GetLightBounds(Scene1 const& scene, Light const& light, int type, LightTree::LightBounds& bounds)
+    {
+        bounds.power = Luminance(light.GetPower(scene));
+        // Emission over the whole sphere by default
+        bounds.axis = RadeonRays::float3(0.f, 0.f, 1.f);
+        bounds.cos_theta_o = -1.f;
+        bounds.cos_theta_e = 0.f;
+
+        switch (type)
+        {
+            case ClwScene::kPoint:
+            {
+                bounds.bounds = RadeonRays::bbox(light.GetPosition());
+                return true;
+            }
+
+            case ClwScene::kSpot:
+            {
+                // Cone shape holds cosines of inner and outer angles
+                auto cone_shape = static_cast<SpotLight const&>(light).GetConeShape();
+                auto theta_i = std::acos(std::min(std::max(cone_shape.x, -1.f), 1.f));
+                auto theta_o = std::acos(std::min(std::max(cone_shape.y, -1.f), 1.f));
+                bounds.bounds = RadeonRays::bbox(light.GetPosition());
+                bounds.axis = normalize(light.GetDirection());
+                bounds.cos_theta_o = cone_shape.x;
+                bounds.cos_theta_e = std::cos(std::max(theta_o - theta_i, 0.f));
+                return true;
+            }
+
+            case ClwScene::kArea:
+            {
+                auto& area_light = static_cast<AreaLight const&>(light);
+                auto mesh = std::static_pointer_cast<Mesh>(area_light.GetShape());
+                auto transform = mesh->GetTransform();
+                auto indices = mesh->GetIndices() + 3 * area_light.GetPrimitiveIdx();
+                auto vertices = mesh->GetVertices();
+
+                bounds.bounds = RadeonRays::bbox(transform * vertices[indices[0]]);
+                bounds.bounds.grow(transform * vertices[indices[1]]);
+                bounds.bounds.grow(transform * vertices[indices[2]]);
+
+                if (mesh->GetNumNormals() > 0)
+                {
+                    auto normals = mesh->GetNormals();
+                    RadeonRays::float3 n[] = { normals[indices[0]], normals[indices[1]], normals[indices[2]] };
+                    BoundEmissionNormals(transform, n, 3, bounds);
+                }
+
+                return true;
+            }
+
+            case ClwScene::kMesh:
+            {
+                auto mesh = std::static_pointer_cast<Mesh>(static_cast<MeshLight const&>(light).GetShape());
+                auto transform = mesh->GetTransform();
+                auto indices = mesh->GetIndices();
+                auto vertices = mesh->GetVertices();
+
+                bounds.bounds = RadeonRays::bbox();
+                for (std::size_t i = 0; i < mesh->GetNumIndices(); ++i)
+                {
+                    bounds.bounds.grow(transform * vertices[indices[i]]);
+                }
+
+                if (mesh->GetNumNormals() > 0)
+                {
+                    BoundEmissionNormals(transform, mesh->GetNormals(), mesh->GetNumNormals(), bounds);
+                }
+
+                return true;
+            }
+
+            default:
+                return false;
+        }
+    }
+
+    // Append distribution of mesh light primitives proportional to their world space area
+    static void WriteMeshLightDistribution(MeshLight const& light, std::vector<int>& data)
+    {
+        auto mesh = std::static_pointer_cast<Mesh>(light.GetShape());
+        auto transform = mesh->GetTransform();
+        auto indices = mesh->GetIndices();
+        auto vertices = mesh->GetVertices();
+        auto num_prims = mesh->GetNumIndices() / 3;
+
+        std::vector<float> areas(num_prims);
+        for (std::size_t i = 0; i < num_prims; ++i)
+        {
+            auto v0 = transform * vertices[indices[3 * i]];
+            auto v1 = transform * vertices[indices[3 * i + 1]];
+            auto v2 = transform * vertices[indices[3 * i + 2]];
+            areas[i] = 0.5f * std::sqrt(cross(v2 - v0, v1 - v0).sqnorm());
+        }
+
+        Distribution1D distribution(areas.data(), static_cast<std::uint32_t>(num_prims));
+
+        // Count, CDF and PDF values
+        auto offset = data.size();
+        data.resize(offset + 2 * num_prims + 2);
+        WriteDistribution1D(distribution, &data[offset]);
+    }
+
+    // Maximum resolution of environment map sampling distribution.
+    // Larger maps are box-filtered down to keep distribution buffer compact.
+    static const int kEnvMapDistributionMaxWidth = 1024;
+    static const int kEnvMapDistributionMaxHeight = 512;
+
+    // Build importance sampling distribution over lat-long environment map.
+    // Each cell is weighted by luminance and sin(theta) to account for
+    // the area distortion of spherical mapping.
+    static void BuildEnvMapDistribution(Texture const& texture, Distribution2D& distribution)
+    {
+        auto size = texture.GetSize();
+        auto width = std::min(size.x, kEnvMapDistributionMaxWidth);
+        auto height = std::min(size.y, kEnvMapDistributionMaxHeight);
+
+        std::vector<float> values(width * height);
+
+        for (auto y = 0; y < height; ++y)
+        {
+            // Texel rows covered by this distribution row
+            auto y0 = y * size.y / height;
+            auto y1 = std::max((y + 1) * size.y / height, y0 + 1);
+            // Row 0 is at the top of the map which corresponds to theta = 0
+            auto sin_theta = std::sin(PI * (y + 0.5f) / height);
+
+            for (auto x = 0; x < width; ++x)
+            {
+                auto x0 = x * size.x / width;
+                auto x1 = std::max((x + 1) * size.x / width, x0 + 1);
+
+                float luminance = 0.f;
+                for (auto ty = y0; ty < y1; ++ty)
+                {
+                    for (auto tx = x0; tx < x1; ++tx)
+                    {
+                        luminance += Luminance(texture.GetTexel(tx, ty));
+                    }
+                }
+
+                values[y * width + x] = sin_theta * luminance / ((x1 - x0) * (y1 - y0));
+            }
+        }
+
+        distribution.Set(&values[0], width, height);
+    }
+
     void ClwSceneController::UpdateLights(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector, ClwScene& out) const
     {
         std::size_t num_lights_written = 0;
@@ -1123,81 +1485,171 @@ namespace Baikal
         auto env_override = scene.GetEnvironmentOverride();
 
         auto num_lights = scene.GetNumLights();
-        auto distribution_buffer_size = (1 + 1 + num_lights + num_lights);
 
-        // Create light buffer if needed
-        if (num_lights > out.lights.GetElementCount())
-        {
-            out.lights = m_context.CreateBuffer<ClwScene::Light>(num_lights, CL_MEM_READ_ONLY);
-            out.light_distributions = m_context.CreateBuffer<int>(distribution_buffer_size, CL_MEM_READ_ONLY);
-        }
-
-        ClwScene::Light* lights = nullptr;
+        // Lights are serialized on host first, so the scene is left intact if buffers don't fit
+        std::vector<ClwScene::Light> lights(num_lights);
 
-        m_context.MapBuffer(0, out.lights, CL_MAP_WRITE, &lights).Wait();
         std::unique_ptr<Iterator> light_iter(scene.CreateLightIterator());
 
         // Disable IBL by default
-        out.envmapidx = -1;
+        int envmapidx = -1;
+
+        // Light tree is built over lights with finite position,
+        // lights at infinity are selected separately
+        std::vector<LightTree::LightBounds> light_bounds(num_lights, LightTree::LightBounds());
+        std::vector<int> infinite_lights;
 
-        // Allocate intermediate storage for lights power distribution
-        std::vector<float> light_power(num_lights);
-        std::uint32_t k = 0;
+        // Shape index -> area light index for every primitive of emissive shape
+        std::map<int, std::vector<int>> emissive_primitives;
+
+        // Primitive area distributions of mesh lights
+        std::vector<int> mesh_distributions;
+
+        // Environment map importance sampling distribution
+        Distribution2D envmap_distribution;
 
         // Serialize
         {
             for (; light_iter->IsValid(); light_iter->Next())
             {
                 auto light = light_iter->ItemAs<Light>();
-                WriteLight(scene, *light, tex_collector, lights + num_lights_written);
+                auto light_idx = static_cast<int>(num_lights_written);
+
+                // Empty or degenerate meshes can't be sampled, their primitive distribution is undefined
+                auto mesh_light = std::dynamic_pointer_cast<MeshLight>(light);
+                if (mesh_light && !(mesh_light->GetArea() > 0.f))
+                {
+                    LogInfo("Skipping mesh light with zero area\n");
+                    continue;
+                }
 
+                ClwScene::Light clw_light;
+                WriteLight(scene, *light, tex_collector, &clw_light);
+
+                if (clw_light.type == ClwScene::kMesh)
+                {
+                    clw_light.distribution = static_cast<int>(mesh_distributions.size());
+                    WriteMeshLightDistribution(*std::static_pointer_cast<MeshLight>(light), mesh_distributions);
+                }
+
+                lights[num_lights_written] = clw_light;
 
                 // Find and update IBL idx
                 auto ibl = std::dynamic_pointer_cast<ImageBasedLight>(light_iter->ItemAs<Light>());
                 if (ibl)
                 {
-                    out.envmapidx = static_cast<int>(num_lights_written);
+                    envmapidx = light_idx;
+
+                    auto texture = ibl->GetTexture();
+                    if (texture)
+                    {
+                        BuildEnvMapDistribution(*texture, envmap_distribution);
+                    }
                 }
 
-                ++num_lights_written;
+                if (!GetLightBounds(scene, *light, clw_light.type, light_bounds[num_lights_written]))
+                {
+                    light_bounds[num_lights_written].power = 0.f;
+                    infinite_lights.push_back(light_idx);
+                }
 
-                auto power = light->GetPower(scene);
+                if (clw_light.type == ClwScene::kArea && clw_light.shapeidx >= 0)
+                {
+                    auto mesh = std::static_pointer_cast<Mesh>(std::static_pointer_cast<AreaLight>(light)->GetShape());
+                    auto& primitives = emissive_primitives[clw_light.shapeidx];
+                    primitives.resize(mesh->GetNumIndices() / 3, -1);
+                    primitives[clw_light.primidx] = light_idx;
+                }
+                else if (clw_light.type == ClwScene::kMesh && clw_light.shapeidx >= 0)
+                {
+                    auto mesh = std::static_pointer_cast<Mesh>(std::static_pointer_cast<MeshLight>(light)->GetShape());
+                    emissive_primitives[clw_light.shapeidx].assign(mesh->GetNumIndices() / 3, light_idx);
+                }
 
-                // TODO: move luminance calculation into utility function
-                light_power[k++] = 0.2126f * power.x + 0.7152f * power.y + 0.0722f * power.z;
+                ++num_lights_written;
             }
         }
 
-        m_context.UnmapBuffer(0, out.lights, lights);
+        // Drop bounds of skipped lights
+        light_bounds.resize(num_lights_written);
 
-        // Create distribution over light sources based on their power
-        Distribution1D light_distribution(&light_power[0], (std::uint32_t)light_power.size());
+        LightTree light_tree;
+        light_tree.Build(light_bounds);
 
-        // Write distribution data
-        int* distribution_ptr = nullptr;
-        m_context.MapBuffer(0, out.light_distributions, CL_MAP_WRITE, &distribution_ptr).Wait();
-        auto current = distribution_ptr;
+        auto const& nodes = light_tree.GetNodes();
+        static_assert(sizeof(LightTree::Node) == sizeof(ClwScene::LightTreeNode), "Light tree node layout mismatch");
+
+        // Light selection data: header, infinite lights, light -> tree leaf table,
+        // shape -> emissive primitive table followed by area light indices of primitives,
+        // mesh light distributions
+        std::vector<int> selection_data(ClwScene::kLightDistributionHeaderSize, 0);
+        selection_data[ClwScene::kLightDistributionNumInfinite] = static_cast<int>(infinite_lights.size());
+        selection_data[ClwScene::kLightDistributionNumTreeLights] = static_cast<int>(light_tree.GetNumLights());
+
+        selection_data[ClwScene::kLightDistributionInfiniteOffset] = static_cast<int>(selection_data.size());
+        selection_data.insert(selection_data.end(), infinite_lights.cbegin(), infinite_lights.cend());
+
+        selection_data[ClwScene::kLightDistributionLeafOffset] = static_cast<int>(selection_data.size());
+        selection_data.insert(selection_data.end(), light_tree.GetLeafIndices().cbegin(), light_tree.GetLeafIndices().cend());
+
+        auto num_shapes = emissive_primitives.empty() ? 0 : emissive_primitives.crbegin()->first + 1;
+        auto shape_table = selection_data.size();
+        selection_data[ClwScene::kLightDistributionShapeOffset] = static_cast<int>(shape_table);
+        selection_data[ClwScene::kLightDistributionNumShapes] = num_shapes;
+        selection_data.resize(shape_table + num_shapes, -1);
+
+        for (auto const& primitives : emissive_primitives)
+        {
+            selection_data[shape_table + primitives.first] = static_cast<int>(selection_data.size());
+            selection_data.insert(selection_data.end(), primitives.second.cbegin(), primitives.second.cend());
+        }
+
+        selection_data[ClwScene::kLightDistributionMeshOffset] = static_cast<int>(selection_data.size());
+        selection_data.insert(selection_data.end(), mesh_distributions.cbegin(), mesh_distributions.cend());
+
+        // Environment map distribution goes last.
+        // Empty environment map distribution is marked by zero width and height.
+        selection_data[ClwScene::kLightDistributionEnvMapOffset] = static_cast<int>(selection_data.size());
+        auto envmap_distribution_size = envmap_distribution.m_width > 0 ? envmap_distribution.GetSerializedSize() : 2;
+        auto distribution_buffer_size = selection_data.size() + envmap_distribution_size;
+
+        // Create light buffers if needed (keep at least one tree node to avoid empty buffer)
+        m_memory_manager->Reserve(out.lights, num_lights, CLMemoryManager::Category::kLights);
+        m_memory_manager->Reserve(out.light_tree, std::max<std::size_t>(nodes.size(), 1), CLMemoryManager::Category::kLights);
+        m_memory_manager->Reserve(out.light_distributions, distribution_buffer_size, CLMemoryManager::Category::kLights);
 
-        // Write the number of segments first
-        *current++ = (int)light_distribution.m_num_segments;
+        m_context.WriteBuffer(0, out.lights, lights.data(), num_lights_written);
 
-        // Then write num_segments  + 1 CDF values
-        auto values = reinterpret_cast<float*>(current);
-        for (auto i = 0u; i < light_distribution.m_num_segments + 1; ++i)
+        // Write light tree nodes
+        if (!nodes.empty())
         {
-            values[i] = light_distribution.m_cdf[i];
+            ClwScene::LightTreeNode* nodes_ptr = nullptr;
+            m_context.MapBuffer(0, out.light_tree, CL_MAP_WRITE, &nodes_ptr).Wait();
+            std::memcpy(nodes_ptr, nodes.data(), nodes.size() * sizeof(ClwScene::LightTreeNode));
+            m_context.UnmapBuffer(0, out.light_tree, nodes_ptr);
         }
 
-        // Then write num_segments PDF values
-        values += light_distribution.m_num_segments + 1;
+        // Write distribution data
+        int* distribution_ptr = nullptr;
+        m_context.MapBuffer(0, out.light_distributions, CL_MAP_WRITE, &distribution_ptr).Wait();
+        auto current = std::copy(selection_data.cbegin(), selection_data.cend(), distribution_ptr);
 
-        for (auto i = 0u; i < light_distribution.m_num_segments; ++i)
+        if (envmap_distribution.m_width > 0)
         {
-            values[i] = light_distribution.m_func_values[i] / light_distribution.m_func_sum;
+            envmap_distribution.Write(current);
+        }
+        else
+        {
+            *current++ = 0;
+            *current++ = 0;
         }
 
         m_context.UnmapBuffer(0, out.light_distributions, distribution_ptr);
 
+        // Host data has to stay alive until writes are complete
+        m_context.Finish(0);
+
+        out.envmapidx = envmapidx;
         out.num_lights = static_cast<int>(num_lights_written);
     }
 
@@ -1210,11 +1662,15 @@ namespace Baikal
             case Texture::Format::kRgba8: return ClwScene::TextureFormat::RGBA8;
             case Texture::Format::kRgba16: return ClwScene::TextureFormat::RGBA16;
             case Texture::Format::kRgba32: return ClwScene::TextureFormat::RGBA32;
+            case Texture::Format::kBc1: return ClwScene::TextureFormat::BC1;
+            case Texture::Format::kBc4: return ClwScene::TextureFormat::BC4;
+            case Texture::Format::kBc5: return ClwScene::TextureFormat::BC5;
+            case Texture::Format::kBc3: return ClwScene::TextureFormat::BC3;
             default: return ClwScene::TextureFormat::RGBA8;
         }
     }
 
-    void ClwSceneController::WriteTexture(Texture const& texture, std::size_t data_offset, void* data) const
+    void ClwSceneController::WriteTexture(Texture const& texture, std::size_t data_offset, int page_offset, void* data) const
     {
         auto clw_texture = reinterpret_cast<ClwScene::Texture*>(data);
 
@@ -1225,13 +1681,31 @@ namespace Baikal
         clw_texture->d = dim.z;
         clw_texture->fmt = GetTextureFormat(texture);
         clw_texture->dataoffset = static_cast<int>(data_offset);
+        clw_texture->mip_count = static_cast<int>(texture.GetMipLevelCount());
+        clw_texture->pageoffset = page_offset;
+        clw_texture->resident_level = page_offset >= 0 ? static_cast<int>(TextureStreamer::GetResidentLevel(texture)) : 0;
     }
 
-    void ClwSceneController::WriteTextureData(Texture const& texture, void* data) const
+    void ClwSceneController::WriteTextureData(Texture const& texture, std::uint32_t first_level, void* data) const
     {
+        // Streamed levels are uploaded by tiles, resident ones are packed together
+        if (first_level > 0)
+        {
+            auto begin = texture.GetLevelData(first_level);
+            std::copy(begin, begin + GetResidentDataSize(texture, first_level), static_cast<char*>(data));
+            return;
+        }
+
         auto begin = texture.GetData();
         auto end = begin + texture.GetSizeInBytes();
-        std::copy(begin, end, static_cast<char*>(data));
+        auto dst = std::copy(begin, end, static_cast<char*>(data));
+
+        // Mip levels go right after the base one
+        if (texture.GetMipLevelCount() > 1)
+        {
+            auto mip_begin = texture.GetMipData();
+            std::copy(mip_begin, mip_begin + texture.GetMipDataSizeInBytes(), dst);
+        }
     }
 
     void ClwSceneController::WriteVolume(VolumeMaterial const& volume, Collector& tex_collector, void* data) const
@@ -1290,25 +1764,79 @@ namespace Baikal
         out.background_idx = (bg_image) ? tex_collector.GetItemIndex(bg_image) : -1;
     }
 
+    void ClwSceneController::ReleaseScene(ClwScene& scene) const
+    {
+        // Scene isn't current, so its shapes aren't attached
+        for (auto& shape : scene.isect_shapes)
+        {
+            m_api->DeleteShape(shape);
+        }
+
+        scene.intersector_shapes.clear();
+        scene.isect_shapes.clear();
+        scene.visible_shapes.clear();
+
+        m_memory_manager->Release(scene.vertices);
+        m_memory_manager->Release(scene.normals);
+        m_memory_manager->Release(scene.uvs);
+        m_memory_manager->Release(scene.indices);
+        m_memory_manager->Release(scene.shapes);
+        m_memory_manager->Release(scene.shapes_additional);
+        m_memory_manager->Release(scene.material_attributes);
+        m_memory_manager->Release(scene.lights);
+        m_memory_manager->Release(scene.volumes);
+        m_memory_manager->Release(scene.textures);
+        m_memory_manager->Release(scene.texturedata);
+        m_memory_manager->Release(scene.texturepages);
+        m_memory_manager->Release(scene.texturefeedback);
+        m_memory_manager->Release(scene.camera);
+        m_memory_manager->Release(scene.light_distributions);
+        m_memory_manager->Release(scene.light_tree);
+        m_memory_manager->Release(scene.input_map_data);
+    }
+
     void Baikal::ClwSceneController::UpdateInputMaps(const Baikal::Scene1& scene, Baikal::Collector& input_map_collector, Collector& input_map_leafs_collector, ClwScene& out) const
     {
-        CLInputMapGenerator generator;
-        generator.Generate(input_map_collector, input_map_leafs_collector);
-        std::string source = generator.GetGeneratedSource();
-        m_program_manager->AddHeader("inputmaps.cl", source);
+        // Source only depends on distinct graph structures, so program manager
+        // won't invalidate programs unless a new structure appears.
+        // Programs compiled before interpret new structures, so they are used
+        // until programs with generated code are compiled in background.
+        m_input_map_generator.Generate();
+        m_program_manager->AddHeader("inputmaps.cl", m_input_map_generator.GetGeneratedSource(),
+                                     m_input_map_generator.IsInterpretable());
+
+        // Update input map bundle to be able to track differences
+        out.input_map_bundle.reset(input_map_collector.CreateBundle());
+
+        std::size_t headers_size = m_input_map_generator.GetLeafsOffset();
+
+        if (headers_size > 0)
+        {
+            // Leafs data update creates the buffer for both headers and leafs
+            assert(out.input_map_data.GetElementCount() >= headers_size + input_map_leafs_collector.GetNumItems());
+
+            ClwScene::InputMapData *input_map_data = nullptr;
+
+            // Map GPU input map buffer
+            m_context.MapBuffer(0, out.input_map_data, CL_MAP_WRITE, &input_map_data).Wait();
+
+            m_input_map_generator.WriteInputMaps(input_map_leafs_collector, input_map_data);
+
+            //Unmap buffer
+            m_context.UnmapBuffer(0, out.input_map_data, input_map_data);
+        }
     }
 
     void Baikal::ClwSceneController::UpdateLeafsData(Scene1 const& scene, Collector& input_map_leafs_collector, Collector& tex_collector, ClwScene& out) const
     {
+        // Leafs are stored after input map headers
+        std::size_t leafs_offset = m_input_map_generator.GetLeafsOffset();
+
         // Get new buffer size
-        std::size_t buffer_size = input_map_leafs_collector.GetNumItems();
+        std::size_t buffer_size = leafs_offset + input_map_leafs_collector.GetNumItems();
 
         // Recreate input map leafs buffer if it needs resize
-        if (buffer_size > out.input_map_data.GetElementCount())
-        {
-            // Create material buffer
-            out.input_map_data = m_context.CreateBuffer<ClwScene::InputMapData>(buffer_size, CL_MEM_READ_ONLY);
-        }
+        m_memory_manager->Reserve(out.input_map_data, buffer_size, CLMemoryManager::Category::kMaterials);
 
         if (buffer_size > 0)
         {
@@ -1327,7 +1855,7 @@ namespace Baikal
             // Iterate and serialize
             for (; iter->IsValid(); iter->Next())
             {
-                WriteInputMapLeaf(*iter->ItemAs<InputMap>(), tex_collector, input_map_data + num_inputmap_leafs_written);
+                WriteInputMapLeaf(*iter->ItemAs<InputMap>(), tex_collector, input_map_data + leafs_offset + num_inputmap_leafs_written);
                 ++num_inputmap_leafs_written;
             }
 
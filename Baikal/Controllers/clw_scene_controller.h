@@ -32,9 +32,14 @@
 #include "CLW.h"
 
 #include "SceneGraph/clwscene.h"
+#include "Utils/cl_inputmap_generator.h"
+#include "Utils/inputmap_optimizer.h"
+#include "Utils/cl_memory_manager.h"
 
 #include "radeon_rays_cl.h"
 
+#include <memory>
+
 namespace Baikal
 {
     class Scene1;
@@ -58,12 +63,13 @@ namespace Baikal
     {
     public:
         // Constructor
-        ClwSceneController(CLWContext context, RadeonRays::IntersectionApi* api, const CLProgramManager *program_manager);
+        ClwSceneController(CLWContext context, std::shared_ptr<RadeonRays::IntersectionApi> api, const CLProgramManager *program_manager,
+                           std::shared_ptr<CLMemoryManager> memory_manager);
         // Destructor
         virtual ~ClwSceneController();
 
         // Get underlying intersection API.
-        RadeonRays::IntersectionApi* GetIntersectionApi() { return  m_api; }
+        RadeonRays::IntersectionApi* GetIntersectionApi() { return  m_api.get(); }
 
     protected:
         // Clear intersector and load meshes into it.
@@ -94,6 +100,8 @@ namespace Baikal
         void UpdateVolumes(Scene1 const& scene, Collector& volume_collector, Collector& tex_collector, ClwScene& out) const override;
         // If scene attributes changed
         void UpdateSceneAttributes(Scene1 const& scene, Collector& tex_collector, ClwScene& out) const override;
+        // Release buffers and intersector shapes of scene dropped from cache
+        void ReleaseScene(ClwScene& scene) const override;
 
         // Update intersection API
         void UpdateIntersector(Scene1 const& scene, ClwScene& out) const;
@@ -105,10 +113,10 @@ namespace Baikal
         // Collector is required to convert texture pointers into indices.
         void WriteLight(Scene1 const& scene, Light const& light, Collector& tex_collector, void* data) const;
         // Write out single texture header at data pointer.
-        // Header requires texture data offset, so it is passed in.
-        void WriteTexture(Texture const& texture, std::size_t data_offset, void* data) const;
-        // Write out texture data at data pointer.
-        void WriteTextureData(Texture const& texture, void* data) const;
+        // Header requires texture data and page table offsets (-1 if texture isn't streamed), so they are passed in.
+        void WriteTexture(Texture const& texture, std::size_t data_offset, int page_offset, void* data) const;
+        // Write out resident texture data (levels starting from first_level) at data pointer.
+        void WriteTextureData(Texture const& texture, std::uint32_t first_level, void* data) const;
         // Write single volume at data pointer
         void WriteVolume(VolumeMaterial const& volume, Collector& tex_collector, void* data) const;
         // Write single input map leaf at data pointer
@@ -126,13 +134,19 @@ namespace Baikal
 
         // Context
         CLWContext m_context;
-        // Intersection API
-        RadeonRays::IntersectionApi* m_api;
+        // Intersection API, shapes are deleted on destruction so it is shared
+        std::shared_ptr<RadeonRays::IntersectionApi> m_api;
         // Default material
         Material::Ptr m_default_material;
         // CL Program manager
         const CLProgramManager *m_program_manager;
+        // Allocates and accounts scene buffers
+        std::shared_ptr<CLMemoryManager> m_memory_manager;
         // Material to device material map
         mutable std::unordered_map<std::uint32_t, std::int32_t> m_materialid_to_offset;
+        // Input map layout and code generator, filled along with materials
+        mutable CLInputMapGenerator m_input_map_generator;
+        // Simplifies and merges input map graphs before generation
+        mutable InputMapOptimizer m_input_map_optimizer;
     };
 }
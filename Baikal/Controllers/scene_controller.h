@@ -63,9 +63,18 @@ namespace Baikal
 
         CompiledScene& GetCachedScene(Scene1::Ptr scene) const;
 
+        // Drops compiled scenes other than the current one from cache releasing their resources.
+        void ClearCache() const;
+
         static void ResetId();
 
     protected:
+        // Drops all compiled scenes including the current one from cache releasing their resources.
+        // ReleaseScene is virtual, so derived classes call it from their destructors.
+        void ReleaseCache() const;
+        // Check if the scene is current, i.e. its shapes are in use by renderers.
+        bool IsCurrentScene(Scene1 const& scene) const;
+
         // Recompile the scene from scratch, i.e. not loading from cache.
         // All the buffers are recreated and reloaded.
         void RecompileFull(Scene1 const& scene, Collector& mat_collector, Collector& tex_collector,
@@ -101,6 +110,8 @@ namespace Baikal
         virtual void UpdateVolumes(Scene1 const& scene, Collector& volume_collector, Collector& tex_collector, CompiledScene& out) const = 0;
         // If scene attributes changed
         virtual void UpdateSceneAttributes(Scene1 const& scene, Collector& tex_collector, CompiledScene& out) const = 0;
+        // Release resources of scene dropped from cache
+        virtual void ReleaseScene(CompiledScene& scene) const = 0;
 
 
     private:
@@ -8,6 +8,7 @@
 #include "SceneGraph/iterator.h"
 #include "SceneGraph/uberv2material.h"
 
+#include <algorithm>
 #include <chrono>
 #include <memory>
 #include <stack>
@@ -45,6 +46,44 @@ namespace Baikal
         }
     }
 
+    template <typename CompiledScene>
+    inline
+    void SceneController<CompiledScene>::ClearCache() const
+    {
+        for (auto iter = m_scene_cache.begin(); iter != m_scene_cache.end();)
+        {
+            // Current scene stays resident
+            if (iter->first == m_current_scene)
+            {
+                ++iter;
+                continue;
+            }
+
+            ReleaseScene(iter->second);
+            iter = m_scene_cache.erase(iter);
+        }
+    }
+
+    template <typename CompiledScene>
+    inline
+    void SceneController<CompiledScene>::ReleaseCache() const
+    {
+        for (auto& scene : m_scene_cache)
+        {
+            ReleaseScene(scene.second);
+        }
+
+        m_scene_cache.clear();
+        m_current_scene = nullptr;
+    }
+
+    template <typename CompiledScene>
+    inline
+    bool SceneController<CompiledScene>::IsCurrentScene(Scene1 const& scene) const
+    {
+        return m_current_scene.get() == &scene;
+    }
+
     template <typename CompiledScene>
     inline
     CompiledScene& SceneController<CompiledScene>::CompileScene(
@@ -63,30 +102,27 @@ namespace Baikal
         // As soon as we have this mapping we are analyzing dirty flags and
         // updating necessary parts.
 
-        // We need to make sure collectors are empty before proceeding
-        m_material_collector.Clear();
-        m_texture_collector.Clear();
-        m_volume_collector.Clear();
-        m_input_maps_collector.Clear();
-        m_input_map_leafs_collector.Clear();
+        // Start new collection pass, collectors keep objects from previous
+        // compilation so indices of unchanged objects stay the same
+        m_material_collector.StartCollection();
+        m_texture_collector.StartCollection();
+        m_volume_collector.StartCollection();
+        m_input_maps_collector.StartCollection();
+        m_input_map_leafs_collector.StartCollection();
 
         // Create shape and light iterators
         auto shape_iter = scene->CreateShapeIterator();
         auto light_iter = scene->CreateLightIterator();
 
         auto default_material = GetDefaultMaterial();
+        // Material stack (reused between shapes)
+        std::vector<Material::Ptr> material_stack;
         // Collect materials from shapes first
         m_material_collector.Collect(*shape_iter,
-                              // This function adds all materials to resulting map
+                              // This function adds all materials to the collector
                               // recursively via Material dependency API
-                              [default_material](SceneObject::Ptr item) ->
-                              std::set<SceneObject::Ptr>
+                              [default_material, &material_stack](SceneObject::Ptr const& item, Collector& collector)
                               {
-                                  // Resulting material set
-                                  std::set<SceneObject::Ptr> mats;
-                                  // Material stack
-                                  std::stack<Material::Ptr> material_stack;
-
                                   // Get material from current shape
                                   auto shape = std::static_pointer_cast<Shape>(item);
                                   auto material = shape->GetMaterial();
@@ -98,17 +134,20 @@ namespace Baikal
                                   }
 
                                   // Push to stack as an initializer
-                                  material_stack.push(material);
+                                  material_stack.push_back(material);
 
                                   // Drain the stack
                                   while (!material_stack.empty())
                                   {
                                       // Get current material
-                                      auto m = material_stack.top();
-                                      material_stack.pop();
+                                      auto m = std::move(material_stack.back());
+                                      material_stack.pop_back();
 
-                                      // Emplace into the set
-                                      mats.emplace(m);
+                                      // Skip materials already collected during this pass, their dependencies have been pushed already
+                                      if (!collector.Collect(m))
+                                      {
+                                          continue;
+                                      }
 
                                       // Create dependency iterator
                                       auto mat_iter = m->CreateMaterialIterator();
@@ -116,14 +155,11 @@ namespace Baikal
                                       // Push all dependencies into the stack
                                       for (; mat_iter->IsValid(); mat_iter->Next())
                                       {
-                                          material_stack.push(
+                                          material_stack.push_back(
                                             mat_iter->ItemAs<Material>()
                                           );
                                       }
                                   }
-
-                                  // Return resulting set
-                                  return mats;
                               });
 
         // Commit stuff (we can iterate over it after commit has happened)
@@ -133,19 +169,14 @@ namespace Baikal
         shape_iter->Reset();
         // Collect volume materials from shapes first
         m_volume_collector.Collect(*shape_iter,
-                                    [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
+                                    [](SceneObject::Ptr const& item, Collector& collector)
                                     {
-                                        // Resulting material set
-                                        std::set<SceneObject::Ptr> vol_mats;
-
                                         // Get volume material from current shape
                                         auto shape = std::static_pointer_cast<Shape>(item);
                                         auto volume_material = shape->GetVolumeMaterial();
 
                                         if (volume_material)
-                                            vol_mats.emplace(volume_material);
-
-                                        return vol_mats;
+                                            collector.Collect(volume_material);
                                     });
 
         // Commit stuff
@@ -157,24 +188,18 @@ namespace Baikal
 
         // Collect textures from materials
         m_texture_collector.Collect(*mat_iter,
-                                    [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
+                                    [](SceneObject::Ptr const& item, Collector& collector)
                               {
-                                  // Texture set
-                                  std::set<SceneObject::Ptr> textures;
-
                                   auto material = std::static_pointer_cast<Material>(item);
 
                                   // Create texture dependency iterator
                                   auto tex_iter = material->CreateTextureIterator();
 
-                                  // Emplace all dependent textures
+                                  // Collect all dependent textures
                                   for (; tex_iter->IsValid(); tex_iter->Next())
                                   {
-                                      textures.emplace(tex_iter->ItemAs<Texture>());
+                                      collector.Collect(tex_iter->Item());
                                   }
-
-                                  // Return resulting set
-                                  return textures;
                               });
 
         // Now we need to collect textures from volumes
@@ -183,91 +208,67 @@ namespace Baikal
 
         // Collect textures from materials
         m_texture_collector.Collect(*vol_iter,
-            [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
+            [](SceneObject::Ptr const& item, Collector& collector)
         {
-            // Texture set
-            std::set<SceneObject::Ptr> textures;
-
             auto volume = std::static_pointer_cast<VolumeMaterial>(item);
 
             // Create texture dependency iterator
             auto tex_iter = volume->CreateTextureIterator();
 
-            // Emplace all dependent textures
+            // Collect all dependent textures
             for (; tex_iter->IsValid(); tex_iter->Next())
             {
-                textures.emplace(tex_iter->ItemAs<Texture>());
+                collector.Collect(tex_iter->Item());
             }
-
-            // Return resulting set
-            return textures;
         });
 
         // Collect textures from lights
         m_texture_collector.Collect(*light_iter,
-                                    [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
+                                    [](SceneObject::Ptr const& item, Collector& collector)
                               {
-                                  // Resulting set
-                                  std::set<SceneObject::Ptr> textures;
-
                                   auto light = std::static_pointer_cast<Light>(item);
 
                                   // Create texture dependency iterator
                                   auto tex_iter = light->CreateTextureIterator();
 
-                                  // Emplace all dependent textures
+                                  // Collect all dependent textures
                                   for (; tex_iter->IsValid(); tex_iter->Next())
                                   {
-                                      textures.emplace(tex_iter->ItemAs<Texture>());
+                                      collector.Collect(tex_iter->Item());
                                   }
-
-                                  // Return resulting set
-                                  return textures;
                               });
 
         mat_iter->Reset();
         m_input_maps_collector.Collect(*mat_iter,
-                                [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
+                                [](SceneObject::Ptr const& item, Collector& collector)
                                 {
-                                    // Texture set
-                                    std::set<SceneObject::Ptr> input_maps;
-
                                     auto material = std::static_pointer_cast<Material>(item);
 
-                                    // Create texture dependency iterator
+                                    // Create input map dependency iterator
                                     auto input_map_iter = material->CreateInputMapsIterator();
 
-                                    // Emplace all dependent textures
+                                    // Collect all dependent input maps
                                     for (; input_map_iter->IsValid(); input_map_iter->Next())
                                     {
-                                        input_maps.emplace(input_map_iter->ItemAs<InputMap>());
+                                        collector.Collect(input_map_iter->Item());
                                     }
-
-                                    // Return resulting set
-                                    return input_maps;
                                 });
         m_input_maps_collector.Commit();
 
         mat_iter->Reset();
         m_input_map_leafs_collector.Collect(*mat_iter,
-                                [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
+                                [](SceneObject::Ptr const& item, Collector& collector)
                                 {
-                                    // Texture set
-                                    std::set<SceneObject::Ptr> input_maps;
-
                                     auto material = std::static_pointer_cast<Material>(item);
 
-                                    // Create texture dependency iterator
+                                    // Create input map leafs dependency iterator
                                     auto input_map_iter = material->CreateInputMapLeafsIterator();
 
-                                    // Emplace all dependent textures
+                                    // Collect all dependent input map leafs
                                     for (; input_map_iter->IsValid(); input_map_iter->Next())
                                     {
-                                        input_maps.emplace(input_map_iter->ItemAs<InputMap>());
+                                        collector.Collect(input_map_iter->Item());
                                     }
-
-                                    // Return resulting set
-                                    return input_maps;
                                 });
         m_input_map_leafs_collector.Commit();
 
@@ -364,6 +365,16 @@ namespace Baikal
                     return ptr->IsDirty();
                 }));
 
+            // Materials reference input maps by their offsets in input map data
+            // and leafs are stored after input map headers, so layout changes
+            // of any of them require updating all three.
+            if (should_update_materials || should_update_leafs_data || should_update_input_maps)
+            {
+                should_update_materials = true;
+                should_update_leafs_data = m_input_map_leafs_collector.GetNumItems() > 0;
+                should_update_input_maps = m_input_maps_collector.GetNumItems() > 0;
+            }
+
             // Check if we have valid camera
             auto camera = scene->GetCamera();
 
@@ -373,7 +384,12 @@ namespace Baikal
             }
 
             // Check if camera parameters have been changed
-            auto camera_changed = camera->IsDirty();
+            auto const& view_cameras = scene->GetViewCameras();
+            auto camera_changed = camera->IsDirty() ||
+                std::any_of(view_cameras.cbegin(), view_cameras.cend(), [](Camera::Ptr const& view_camera)
+                {
+                    return view_camera->IsDirty();
+                });
 
             // Update camera if needed
             if (dirty & Scene1::kCamera || camera_changed)
@@ -573,6 +589,11 @@ namespace Baikal
             throw std::runtime_error("SceneController::RecompileFull(...): camera was not set");
 
         camera->SetDirty(false);
+
+        for (auto const& view_camera : scene.GetViewCameras())
+        {
+            view_camera->SetDirty(false);
+        }
     }
 
     template <typename CompiledScene>
@@ -24,6 +24,7 @@ THE SOFTWARE.
 #include "radeon_rays.h"
 #include "SceneGraph/clwscene.h"
 #include "Utils/clw_class.h"
+#include "Utils/kernel_profiler.h"
 
 #include "CLW.h"
 
@@ -63,6 +64,14 @@ namespace Baikal
             kSobolLUT
         };
 
+        enum class DispatchMode
+        {
+            // Every bounce launches kernels for the whole ray buffer
+            kFullSize,
+            // Bounce launches are sized by the number of paths alive after the previous one
+            kCompactedCount
+        };
+
         struct RayTracingStats
         {
             float primary_throughput;
@@ -78,6 +87,11 @@ namespace Baikal
             : m_intersector(api)
             , m_max_bounces(5u)
             , m_max_shadow_ray_transmission_steps(2u)
+            , m_dispatch_mode(DispatchMode::kCompactedCount)
+            , m_material_sorting(false)
+            , m_rr_depth(4u)
+            , m_rr_threshold(1.f)
+            , m_profiler(nullptr)
         {
         }
 
@@ -221,6 +235,15 @@ namespace Baikal
             MissedPrimaryRaysHandler missedPrimaryRaysHandler = nullptr
         ) = 0;
 
+        /**
+        \brief Start compiling programs used by Estimate in background.
+
+        Lets compilation overlap with scene loading, Estimate waits for the programs.
+
+        \param atomic_update Same as in Estimate, selects the program permutation to compile.
+        */
+        virtual void Precompile(bool atomic_update = false) = 0;
+
         /**
         \brief Find intersection points for the rays in ray buffer.
 
@@ -289,13 +312,121 @@ namespace Baikal
             return m_max_shadow_ray_transmission_steps;
         }
 
+        /**
+        \brief Set how kernel launches of later bounces are sized.
+
+        In kCompactedCount mode the number of paths left after each bounce is read back
+        asynchronously and bounds the launches of the next one, so deep bounces with few
+        surviving paths are cheaper. The read is waited for right before the next bounce,
+        while the rest of the current bounce is still executing.
+
+        \param mode
+        */
+        void SetDispatchMode(DispatchMode mode) {
+            m_dispatch_mode = mode;
+        }
+
+        /**
+        \brief Get kernel launch sizing mode.
+        */
+        DispatchMode GetDispatchMode() const {
+            return m_dispatch_mode;
+        }
+
+        /**
+        \brief Enable sorting of surface hits by material before shading.
+
+        Reduces divergence of the shading kernel in scenes with many materials
+        at the cost of a radix sort per bounce.
+
+        \param enable
+        */
+        void SetMaterialSorting(bool enable) {
+            m_material_sorting = enable;
+        }
+
+        /**
+        \brief Check if surface hits are sorted by material before shading.
+        */
+        bool GetMaterialSorting() const {
+            return m_material_sorting;
+        }
+
+        /**
+        \brief Set the bounce starting from which paths are terminated by Russian roulette.
+
+        Paths with throughput luminance below the threshold survive with probability
+        proportional to it (but at least 5%), survivors are reweighted to keep the
+        estimate unbiased. Depth >= max bounces disables Russian roulette.
+
+        \param depth
+        */
+        void SetRussianRouletteDepth(std::uint32_t depth) {
+            m_rr_depth = depth;
+        }
+
+        /**
+        \brief Set throughput luminance at and above which paths always survive Russian roulette.
+
+        \param threshold
+        */
+        void SetRussianRouletteThreshold(float threshold) {
+            m_rr_threshold = threshold;
+        }
+
+        /**
+        \brief Get the first bounce Russian roulette is applied at.
+        */
+        std::uint32_t GetRussianRouletteDepth() const {
+            return m_rr_depth;
+        }
+
+        /**
+        \brief Get throughput luminance threshold of Russian roulette.
+        */
+        float GetRussianRouletteThreshold() const {
+            return m_rr_threshold;
+        }
+
+        /**
+        \brief Set profiler to record kernel launches to (not owned, nullptr disables profiling).
+
+        \param profiler
+        */
+        void SetProfiler(KernelProfiler* profiler) {
+            m_profiler = profiler;
+        }
+
+        /**
+        \brief Get profiler kernel launches are recorded to.
+        */
+        KernelProfiler* GetProfiler() const {
+            return m_profiler;
+        }
+
         Estimator(Estimator const&) = delete;
         Estimator& operator = (Estimator const&) = delete;
 
+    protected:
+        /**
+        \brief Record kernel launch if profiling is enabled.
+        */
+        void ProfileLaunch(char const* name, int bounce, CLWEvent const& event) const {
+            if (m_profiler)
+            {
+                m_profiler->Record(name, bounce, event);
+            }
+        }
+
     private:
         std::shared_ptr<RadeonRays::IntersectionApi> m_intersector;
         std::uint32_t m_max_bounces;
         std::uint32_t m_max_shadow_ray_transmission_steps;
+        DispatchMode m_dispatch_mode;
+        bool m_material_sorting;
+        std::uint32_t m_rr_depth;
+        float m_rr_threshold;
+        KernelProfiler* m_profiler;
         std::array<CLWBuffer<float3>, 
             static_cast<size_t>(IntermediateValue::kMax)> m_intermediate_value;
     };
@@ -21,8 +21,8 @@ namespace Baikal
         float4 throughput;
         int volume;
         int flags;
-        int extra0;
-        int extra1;
+        float cone_width;
+        float cone_spread;
     };
 
     struct PathTracingEstimator::RenderData
@@ -47,6 +47,16 @@ namespace Baikal
         CLWBuffer<int> hitcount;
         CLWParallelPrimitives pp;
 
+        // Material sorting
+        CLWBuffer<int> material_keys;
+        CLWBuffer<int> sorted_material_keys;
+        CLWBuffer<int> sorted_indices;
+
+        // Host copy of hitcount after compaction (DispatchMode::kCompactedCount)
+        int active_ray_count;
+        bool active_ray_count_pending;
+        CLWEvent active_ray_count_event;
+
         // RadeonRays stuff
         Buffer* fr_rays[2];
         Buffer* fr_shadowrays;
@@ -59,7 +69,9 @@ namespace Baikal
         Collector tex_collector;
 
         RenderData()
-            : fr_shadowrays(nullptr)
+            : active_ray_count(0)
+            , active_ray_count_pending(false)
+            , fr_shadowrays(nullptr)
             , fr_shadowhits(nullptr)
             , fr_hits(nullptr)
             , fr_intersections(nullptr)
@@ -73,7 +85,8 @@ namespace Baikal
     PathTracingEstimator::PathTracingEstimator(
         CLWContext context,
         std::shared_ptr<RadeonRays::IntersectionApi> api,
-        const CLProgramManager *program_manager
+        const CLProgramManager *program_manager,
+        std::shared_ptr<CLMemoryManager> memory_manager
     ) :
         Estimator(api)
 #ifdef BAIKAL_EMBED_KERNELS
@@ -88,6 +101,7 @@ namespace Baikal
 #else
         , m_uberv2_kernels(context, program_manager, "../Baikal/Kernels/CL/path_tracing_estimator_uberv2.cl", "")
 #endif
+        , m_memory_manager(memory_manager)
     {
         // Create parallel primitives
         m_render_data->pp = CLWParallelPrimitives(context, GetFullBuildOpts().c_str());
@@ -96,7 +110,7 @@ namespace Baikal
 
     PathTracingEstimator::~PathTracingEstimator()
     {
-        // Recreate FR buffers
+        // Release FR buffers
         GetIntersector()->DeleteBuffer(m_render_data->fr_rays[0]);
         GetIntersector()->DeleteBuffer(m_render_data->fr_rays[1]);
         GetIntersector()->DeleteBuffer(m_render_data->fr_shadowrays);
@@ -104,6 +118,26 @@ namespace Baikal
         GetIntersector()->DeleteBuffer(m_render_data->fr_shadowhits);
         GetIntersector()->DeleteBuffer(m_render_data->fr_intersections);
         GetIntersector()->DeleteBuffer(m_render_data->fr_hitcount);
+
+        // Release work buffers
+        m_memory_manager->Release(m_render_data->rays[0]);
+        m_memory_manager->Release(m_render_data->rays[1]);
+        m_memory_manager->Release(m_render_data->hits);
+        m_memory_manager->Release(m_render_data->intersections);
+        m_memory_manager->Release(m_render_data->shadowrays);
+        m_memory_manager->Release(m_render_data->shadowhits);
+        m_memory_manager->Release(m_render_data->lightsamples);
+        m_memory_manager->Release(m_render_data->paths);
+        m_memory_manager->Release(m_render_data->random);
+        m_memory_manager->Release(m_render_data->iota);
+        m_memory_manager->Release(m_render_data->compacted_indices);
+        m_memory_manager->Release(m_render_data->pixelindices[0]);
+        m_memory_manager->Release(m_render_data->pixelindices[1]);
+        m_memory_manager->Release(m_render_data->output_indices);
+        m_memory_manager->Release(m_render_data->hitcount);
+        m_memory_manager->Release(m_render_data->material_keys);
+        m_memory_manager->Release(m_render_data->sorted_material_keys);
+        m_memory_manager->Release(m_render_data->sorted_indices);
     }
 
     std::size_t PathTracingEstimator::GetWorkBufferSize() const
@@ -113,29 +147,30 @@ namespace Baikal
 
     void PathTracingEstimator::SetWorkBufferSize(std::size_t size)
     {
-        m_render_data->rays[0] = GetContext().CreateBuffer<ray>(size, CL_MEM_READ_WRITE);
-        m_render_data->rays[1] = GetContext().CreateBuffer<ray>(size, CL_MEM_READ_WRITE);
-        m_render_data->hits = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
-        m_render_data->intersections = GetContext().CreateBuffer<Intersection>(size, CL_MEM_READ_WRITE);
-        m_render_data->shadowrays = GetContext().CreateBuffer<ray>(size, CL_MEM_READ_WRITE);
-        m_render_data->shadowhits = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
-        m_render_data->lightsamples = GetContext().CreateBuffer<float3>(size, CL_MEM_READ_WRITE);
-        m_render_data->paths = GetContext().CreateBuffer<PathState>(size, CL_MEM_READ_WRITE);
+        // Work buffers are sized exactly, GetWorkBufferSize relies on it
+        m_memory_manager->Create(m_render_data->rays[0], size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->rays[1], size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->hits, size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->intersections, size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->shadowrays, size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->shadowhits, size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->lightsamples, size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->paths, size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
 
         std::vector<std::uint32_t> random_buffer(size);
         std::generate(random_buffer.begin(), random_buffer.end(), [](){return std::rand() + 3;});
 
-        m_render_data->random = GetContext().CreateBuffer<std::uint32_t>(size, CL_MEM_READ_WRITE, &random_buffer[0]);
+        m_memory_manager->Create(m_render_data->random, size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE, &random_buffer[0]);
 
         std::vector<int> initdata(size);
         std::iota(initdata.begin(), initdata.end(), 0);
 
-        m_render_data->iota = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, &initdata[0]);
-        m_render_data->compacted_indices = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
-        m_render_data->pixelindices[0] = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
-        m_render_data->pixelindices[1] = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
-        m_render_data->output_indices = GetContext().CreateBuffer<int>(size, CL_MEM_READ_WRITE);
-        m_render_data->hitcount = GetContext().CreateBuffer<int>(1, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->iota, size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, &initdata[0]);
+        m_memory_manager->Create(m_render_data->compacted_indices, size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->pixelindices[0], size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->pixelindices[1], size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->output_indices, size, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        m_memory_manager->Create(m_render_data->hitcount, 1, CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
 
         // Recreate FR buffers
         GetIntersector()->DeleteBuffer(m_render_data->fr_rays[0]);
@@ -171,6 +206,16 @@ namespace Baikal
         return m_render_data->hitcount;
     }
 
+    void PathTracingEstimator::Precompile(bool atomic_update)
+    {
+        if (atomic_update)
+        {
+            SetDefaultBuildOptions(" -D BAIKAL_ATOMIC_RESOLVE ");
+        }
+
+        PrecompileKernels();
+    }
+
     void PathTracingEstimator::Estimate(
         ClwScene const& scene,
         std::size_t num_estimates,
@@ -181,10 +226,9 @@ namespace Baikal
         MissedPrimaryRaysHandler missedPrimaryRaysHandler
     )
     {
-        if (atomic_update)
-        {
-            SetDefaultBuildOptions(" -D BAIKAL_ATOMIC_RESOLVE ");
-        }
+        // Kick off both programs so uberv2 kernels (which depend on the scene) compile concurrently
+        Precompile(atomic_update);
+        m_uberv2_kernels.PrecompileKernels();
 
         auto has_visibility_buffer = HasIntermediateValueBuffer(IntermediateValue::kVisibility);
         auto visibility_buffer = GetIntermediateValueBuffer(IntermediateValue::kVisibility);
@@ -192,31 +236,58 @@ namespace Baikal
         auto has_opacity_buffer = HasIntermediateValueBuffer(IntermediateValue::kOpacity);
         auto opacity_buffer = GetIntermediateValueBuffer(IntermediateValue::kOpacity);
 
+        // Drop the readback left by an interrupted estimate
+        WaitActiveRayCount(num_estimates);
+
         InitPathData(num_estimates, scene.camera_volume_index);
 
         GetContext().CopyBuffer(0u, m_render_data->iota, m_render_data->pixelindices[0], 0, 0, num_estimates);
         GetContext().CopyBuffer(0u, m_render_data->iota, m_render_data->pixelindices[1], 0, 0, num_estimates);
 
+        // Paths only terminate, so the number of rays alive after a bounce bounds
+        // every launch of the next one (kernels check exact count on the device)
+        auto compacted_dispatch = GetDispatchMode() == DispatchMode::kCompactedCount;
+        auto num_rays = num_estimates;
+
         // Initialize first pass
         for (auto pass = 0u; pass < GetMaxBounces(); ++pass)
         {
+            if (pass > 0 && compacted_dispatch)
+            {
+                num_rays = WaitActiveRayCount(num_rays);
+
+                // No paths left
+                if (num_rays == 0)
+                {
+                    break;
+                }
+            }
+
             // Clear ray hits buffer
             // TODO: make it a kernel
-            GetContext().FillBuffer(
-                0,
-                m_render_data->hits,
-                0,
-                m_render_data->hits.GetElementCount()
-            );
+            {
+                KernelProfiler::Scope scope(GetProfiler(), "ClearHits", pass);
+
+                GetContext().FillBuffer(
+                    0,
+                    m_render_data->hits,
+                    0,
+                    num_rays
+                );
+            }
 
             // Intersect ray batch
-            GetIntersector()->QueryIntersection(
-                m_render_data->fr_rays[pass & 0x1],
-                m_render_data->fr_hitcount, (std::uint32_t)num_estimates,
-                m_render_data->fr_intersections,
-                nullptr,
-                nullptr
-            );
+            {
+                KernelProfiler::Scope scope(GetProfiler(), "QueryIntersection", pass);
+
+                GetIntersector()->QueryIntersection(
+                    m_render_data->fr_rays[pass & 0x1],
+                    m_render_data->fr_hitcount, (std::uint32_t)num_rays,
+                    m_render_data->fr_intersections,
+                    nullptr,
+                    nullptr
+                );
+            }
 
 
             // Apply scattering only if we have volumes
@@ -224,37 +295,65 @@ namespace Baikal
 
             if (has_some_volume)
             {
-                SampleVolume(scene, pass, num_estimates, output, use_output_indices);
+                SampleVolume(scene, pass, num_rays, output, use_output_indices);
             }
 
             bool has_some_environment = scene.envmapidx > -1;
 
             if ((pass > 0) && has_some_environment)
             {
-                ShadeMiss(scene, pass, num_estimates, output, use_output_indices);
+                ShadeMiss(scene, pass, num_rays, output, use_output_indices);
             }
 
             // Convert intersections to predicates
-            FilterPathStream(pass, num_estimates);
+            FilterPathStream(pass, num_rays);
             
             // Gather opacity if we have opacity buffer
             if ((pass > 0) && has_opacity_buffer)
             {
-                GatherOpacity(scene, pass, num_estimates, opacity_buffer, use_output_indices);
+                GatherOpacity(scene, pass, num_rays, opacity_buffer, use_output_indices);
             }
 
             // Compact batch
-            m_render_data->pp.Compact(
-                0,
-                m_render_data->hits,
-                m_render_data->iota,
-                m_render_data->compacted_indices,
-                (std::uint32_t)num_estimates,
-                m_render_data->hitcount
-            );
+            {
+                KernelProfiler::Scope scope(GetProfiler(), "Compact", pass);
+
+                m_render_data->pp.Compact(
+                    0,
+                    m_render_data->hits,
+                    m_render_data->iota,
+                    m_render_data->compacted_indices,
+                    (std::uint32_t)num_rays,
+                    m_render_data->hitcount
+                );
+            }
+
+            // Hit count now holds the number of paths continuing at this bounce
+            if (GetProfiler())
+            {
+                GetProfiler()->RecordActiveRays(pass, m_render_data->hitcount);
+            }
+
+            // Read it back while the rest of the bounce executes
+            if (compacted_dispatch && (pass + 1 < GetMaxBounces() || has_opacity_buffer))
+            {
+                m_render_data->active_ray_count_event = GetContext().ReadBuffer(
+                    0,
+                    m_render_data->hitcount,
+                    &m_render_data->active_ray_count,
+                    1
+                );
+                m_render_data->active_ray_count_pending = true;
+            }
+
+            // Group hits by material, pixel indices follow the order
+            if (GetMaterialSorting())
+            {
+                SortHitsByMaterial(scene, pass, num_rays);
+            }
 
             // Advance indices to keep pixel indices up to date
-            RestorePixelIndices(pass, num_estimates);
+            RestorePixelIndices(pass, num_rays);
 
             // Shade missing rays
             if (pass == 0)
@@ -265,21 +364,21 @@ namespace Baikal
                         m_render_data->intersections,
                         m_render_data->pixelindices[1],
                         use_output_indices ? m_render_data->output_indices : m_render_data->iota,
-                        num_estimates, output);
+                        num_rays, output);
                 else if (scene.envmapidx > -1)
-                    ShadeBackground(scene, 0, num_estimates, output, use_output_indices);
+                    ShadeBackground(scene, 0, num_rays, output, use_output_indices);
                 else
-                    AdvanceIterationCount(0, num_estimates, output, use_output_indices);
+                    AdvanceIterationCount(0, num_rays, output, use_output_indices);
             }
 
             if (has_some_volume)
             {
                 // Shade hits
-                ShadeVolume(scene, pass, num_estimates, output, use_output_indices);
+                ShadeVolume(scene, pass, num_rays, output, use_output_indices);
             }
 
             // Shade hits
-            ShadeSurface(scene, pass, num_estimates, output, use_output_indices);
+            ShadeSurface(scene, pass, num_rays, output, use_output_indices);
 
 
             if (has_some_volume && GetMaxShadowRayTransmissionSteps() > 0)
@@ -287,49 +386,113 @@ namespace Baikal
                 for (auto i = 0u; i < GetMaxShadowRayTransmissionSteps(); ++i)
                 {
                     // Intersect ray batch
-                    GetIntersector()->QueryIntersection(m_render_data->fr_shadowrays,
-                                                        m_render_data->fr_hitcount,
-                                                        (std::uint32_t)num_estimates,
-                                                        m_render_data->fr_intersections,
-                                                        nullptr,
-                                                        nullptr);
-
-                    ApplyVolumeTransmission(scene, pass, num_estimates, output, use_output_indices);
+                    {
+                        KernelProfiler::Scope scope(GetProfiler(), "QueryTransmission", pass);
+
+                        GetIntersector()->QueryIntersection(m_render_data->fr_shadowrays,
+                                                            m_render_data->fr_hitcount,
+                                                            (std::uint32_t)num_rays,
+                                                            m_render_data->fr_intersections,
+                                                            nullptr,
+                                                            nullptr);
+                    }
+
+                    ApplyVolumeTransmission(scene, pass, num_rays, output, use_output_indices);
                 }
             }
 
             // Intersect shadow rays
-            GetIntersector()->QueryOcclusion(
-                m_render_data->fr_shadowrays,
-                m_render_data->fr_hitcount,
-                (std::uint32_t)num_estimates,
-                m_render_data->fr_shadowhits,
-                nullptr,
-                nullptr
-            );
+            {
+                KernelProfiler::Scope scope(GetProfiler(), "QueryOcclusion", pass);
+
+                GetIntersector()->QueryOcclusion(
+                    m_render_data->fr_shadowrays,
+                    m_render_data->fr_hitcount,
+                    (std::uint32_t)num_rays,
+                    m_render_data->fr_shadowhits,
+                    nullptr,
+                    nullptr
+                );
+            }
 
             // Gather light samples and account for visibility
-            GatherLightSamples(scene, pass, num_estimates, output, use_output_indices);
+            GatherLightSamples(scene, pass, num_rays, output, use_output_indices);
 
             if (pass == 0 && has_visibility_buffer)
             {
                 // Run visibility resolve kernel
-                GatherVisibility(scene, pass, num_estimates, visibility_buffer, use_output_indices);
+                GatherVisibility(scene, pass, num_rays, visibility_buffer, use_output_indices);
             }
 
             GetContext().Flush(0);
         }
+        if (compacted_dispatch)
+        {
+            num_rays = WaitActiveRayCount(num_rays);
+        }
+
         // Gather opacity if we have opacity buffer
-        if (has_opacity_buffer)
+        if (has_opacity_buffer && num_rays > 0)
         {
             // Convert intersections to predicates
-            FilterPathStream(GetMaxBounces(), num_estimates);
-            GatherOpacity(scene, GetMaxBounces(), num_estimates, opacity_buffer, use_output_indices);
+            FilterPathStream(GetMaxBounces(), num_rays);
+            GatherOpacity(scene, GetMaxBounces(), num_rays, opacity_buffer, use_output_indices);
             GetContext().Flush(0);
         }
         ++m_sample_counter;
     }
 
+    std::size_t PathTracingEstimator::WaitActiveRayCount(std::size_t max_count)
+    {
+        if (!m_render_data->active_ray_count_pending)
+        {
+            return max_count;
+        }
+
+        m_render_data->active_ray_count_event.Wait();
+        m_render_data->active_ray_count_pending = false;
+
+        auto count = static_cast<std::size_t>(std::max(m_render_data->active_ray_count, 0));
+        return std::min(count, max_count);
+    }
+
+    void PathTracingEstimator::SortHitsByMaterial(ClwScene const& scene, int pass, std::size_t size)
+    {
+        KernelProfiler::Scope scope(GetProfiler(), "SortHitsByMaterial", pass);
+
+        if (m_render_data->material_keys.GetElementCount() < GetWorkBufferSize())
+        {
+            m_memory_manager->Create(m_render_data->material_keys, GetWorkBufferSize(), CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+            m_memory_manager->Create(m_render_data->sorted_material_keys, GetWorkBufferSize(), CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+            m_memory_manager->Create(m_render_data->sorted_indices, GetWorkBufferSize(), CLMemoryManager::Category::kWorkBuffers, CL_MEM_READ_WRITE);
+        }
+
+        auto keys_kernel = GetKernel("GenerateMaterialKeys");
+
+        int argc = 0;
+        keys_kernel.SetArg(argc++, m_render_data->compacted_indices);
+        keys_kernel.SetArg(argc++, m_render_data->hitcount);
+        keys_kernel.SetArg(argc++, m_render_data->intersections);
+        keys_kernel.SetArg(argc++, scene.shapes);
+        keys_kernel.SetArg(argc++, (cl_int)size);
+        keys_kernel.SetArg(argc++, m_render_data->material_keys);
+
+        {
+            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, keys_kernel);
+        }
+
+        m_render_data->pp.SortRadix(
+            0,
+            m_render_data->material_keys,
+            m_render_data->sorted_material_keys,
+            m_render_data->compacted_indices,
+            m_render_data->sorted_indices,
+            (int)size
+        );
+
+        std::swap(m_render_data->compacted_indices, m_render_data->sorted_indices);
+    }
+
     void PathTracingEstimator::InitPathData(std::size_t size, int volume_idx)
     {
         auto init_kernel = GetKernel("InitPathData");
@@ -339,10 +502,11 @@ namespace Baikal
         init_kernel.SetArg(argc++, m_render_data->pixelindices[1]);
         init_kernel.SetArg(argc++, m_render_data->hitcount);
         init_kernel.SetArg(argc++, (cl_int)volume_idx);
+        init_kernel.SetArg(argc++, m_render_data->rays[0]);
         init_kernel.SetArg(argc++, m_render_data->paths);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, init_kernel);
+            ProfileLaunch("InitPathData", KernelProfile::kNoBounce, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, init_kernel));
         }
     }
 
@@ -375,15 +539,20 @@ namespace Baikal
         shadekernel.SetArg(argc++, scene.material_attributes);
         shadekernel.SetArg(argc++, scene.textures);
         shadekernel.SetArg(argc++, scene.texturedata);
+        shadekernel.SetArg(argc++, scene.texturepages);
+        shadekernel.SetArg(argc++, scene.texturefeedback);
         shadekernel.SetArg(argc++, scene.envmapidx);
         shadekernel.SetArg(argc++, scene.lights);
         shadekernel.SetArg(argc++, scene.light_distributions);
+        shadekernel.SetArg(argc++, scene.light_tree);
         shadekernel.SetArg(argc++, scene.num_lights);
         shadekernel.SetArg(argc++, rand_uint());
         shadekernel.SetArg(argc++, m_render_data->random);
         shadekernel.SetArg(argc++, m_render_data->sobolmat);
         shadekernel.SetArg(argc++, pass);
         shadekernel.SetArg(argc++, m_sample_counter);
+        shadekernel.SetArg(argc++, (int)std::min(GetRussianRouletteDepth(), GetMaxBounces()));
+        shadekernel.SetArg(argc++, std::max(GetRussianRouletteThreshold(), 1e-6f));
         shadekernel.SetArg(argc++, scene.volumes);
         shadekernel.SetArg(argc++, m_render_data->shadowrays);
         shadekernel.SetArg(argc++, m_render_data->lightsamples);
@@ -394,7 +563,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, shadekernel);
+            ProfileLaunch("ShadeSurfaceUberV2", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, shadekernel));
         }
     }
 
@@ -427,9 +596,12 @@ namespace Baikal
         shadekernel.SetArg(argc++, scene.material_attributes);
         shadekernel.SetArg(argc++, scene.textures);
         shadekernel.SetArg(argc++, scene.texturedata);
+        shadekernel.SetArg(argc++, scene.texturepages);
+        shadekernel.SetArg(argc++, scene.texturefeedback);
         shadekernel.SetArg(argc++, scene.envmapidx);
         shadekernel.SetArg(argc++, scene.lights);
         shadekernel.SetArg(argc++, scene.light_distributions);
+        shadekernel.SetArg(argc++, scene.light_tree);
         shadekernel.SetArg(argc++, scene.num_lights);
         shadekernel.SetArg(argc++, rand_uint());
         shadekernel.SetArg(argc++, m_render_data->random);
@@ -446,7 +618,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, shadekernel);
+            ProfileLaunch("ShadeVolumeUberV2", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, shadekernel));
         }
     }
 
@@ -472,6 +644,8 @@ namespace Baikal
         sample_kernel.SetArg(argc++, scene.volumes);
         sample_kernel.SetArg(argc++, scene.textures);
         sample_kernel.SetArg(argc++, scene.texturedata);
+        sample_kernel.SetArg(argc++, scene.texturepages);
+        sample_kernel.SetArg(argc++, scene.texturefeedback);
         sample_kernel.SetArg(argc++, rand_uint());
         sample_kernel.SetArg(argc++, m_render_data->random);
         sample_kernel.SetArg(argc++, m_render_data->sobolmat);
@@ -483,7 +657,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, sample_kernel);
+            ProfileLaunch("SampleVolume", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, sample_kernel));
         }
     }
 
@@ -511,12 +685,14 @@ namespace Baikal
         misskernel.SetArg(argc++, scene.envmapidx);
         misskernel.SetArg(argc++, scene.textures);
         misskernel.SetArg(argc++, scene.texturedata);
+        misskernel.SetArg(argc++, scene.texturepages);
+        misskernel.SetArg(argc++, scene.texturefeedback);
         misskernel.SetArg(argc++, m_render_data->paths);
         misskernel.SetArg(argc++, scene.volumes);
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            ProfileLaunch("ShadeBackgroundEnvMap", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel));
         }
     }
 
@@ -545,7 +721,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel);
+            ProfileLaunch("GatherLightSamples", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel));
         }
     }
 
@@ -584,7 +760,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, volumekernel);
+            ProfileLaunch("ApplyVolumeTransmissionUberV2", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, volumekernel));
         }
     }
 
@@ -611,7 +787,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel);
+            ProfileLaunch("GatherVisibility", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel));
         }
     }
 
@@ -638,7 +814,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel);
+            ProfileLaunch("GatherOpacity", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, gatherkernel));
         }
     }
 
@@ -656,7 +832,7 @@ namespace Baikal
 
         // Run shading kernel
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, restorekernel);
+            ProfileLaunch("RestorePixelIndices", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, restorekernel));
         }
     }
 
@@ -672,7 +848,7 @@ namespace Baikal
         restorekernel.SetArg(argc++, m_render_data->hits);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, restorekernel);
+            ProfileLaunch("FilterPathStream", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, restorekernel));
         }
     }
 
@@ -700,12 +876,14 @@ namespace Baikal
         misskernel.SetArg(argc++, scene.envmapidx);
         misskernel.SetArg(argc++, scene.textures);
         misskernel.SetArg(argc++, scene.texturedata);
+        misskernel.SetArg(argc++, scene.texturepages);
+        misskernel.SetArg(argc++, scene.texturefeedback);
         misskernel.SetArg(argc++, m_render_data->paths);
         misskernel.SetArg(argc++, scene.volumes);
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            ProfileLaunch("ShadeMiss", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel));
         }
     }
 
@@ -758,6 +936,8 @@ namespace Baikal
         std::size_t num_estimates
     )
     {
+        KernelProfiler::Scope scope(GetProfiler(), "TraceFirstHit", 0);
+
         // Intersect ray batch
         GetIntersector()->QueryIntersection(
             m_render_data->fr_rays[0],
@@ -912,7 +1092,7 @@ namespace Baikal
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            ProfileLaunch("AdvanceIterationCount", pass, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel));
         }
     }
 }
@@ -25,6 +25,7 @@ THE SOFTWARE.
 #include "estimator.h"
 #include "radeon_rays_cl.h"
 #include "Utils/cl_program_manager.h"
+#include "Utils/cl_memory_manager.h"
 
 #include <memory>
 
@@ -42,7 +43,8 @@ namespace Baikal
         PathTracingEstimator(
             CLWContext context,
             std::shared_ptr<RadeonRays::IntersectionApi> api,
-            const CLProgramManager *program_manager
+            const CLProgramManager *program_manager,
+            std::shared_ptr<CLMemoryManager> memory_manager
         );
         
         ~PathTracingEstimator() override;
@@ -135,6 +137,15 @@ namespace Baikal
             MissedPrimaryRaysHandler missedPrimaryRaysHandler = nullptr
         ) override;
 
+        /**
+        \brief Start compiling programs used by Estimate in background.
+
+        Lets compilation overlap with scene loading, Estimate waits for the programs.
+
+        \param atomic_update Same as in Estimate, selects the program permutation to compile.
+        */
+        void Precompile(bool atomic_update = false) override;
+
         /**
         \brief Find intersection points for the rays in ray buffer.
 
@@ -186,8 +197,15 @@ namespace Baikal
         bool SupportsIntermediateValue(IntermediateValue value) const override;
 
     private:
+        // Wait for the active ray count read after the last compaction,
+        // returns max_count if there is no pending read
+        std::size_t WaitActiveRayCount(std::size_t max_count);
+
         void InitPathData(std::size_t size, int volume_idx);
 
+        // Reorder compacted hits so that hits with the same material are shaded together
+        void SortHitsByMaterial(ClwScene const& scene, int pass, std::size_t size);
+
         void ShadeSurface(
             ClwScene const& scene,
             int pass,
@@ -274,5 +292,7 @@ namespace Baikal
         std::unique_ptr<RenderData> m_render_data;
         mutable std::uint32_t m_sample_counter;
         ClwClass m_uberv2_kernels;
+        // Allocates and accounts work buffers
+        std::shared_ptr<CLMemoryManager> m_memory_manager;
     };
 }
@@ -68,12 +68,15 @@ KERNEL void FillAOVsUberV2(
     // Output size
     int width,
     int height,
+    // View size
+    int view_width,
+    int view_height,
     // Emissives
     GLOBAL Light const* restrict lights,
     // Number of emissive objects
     int num_lights,
-    // camera
-    GLOBAL Camera const* restrict camera,
+    // Cameras (one per view)
+    GLOBAL Camera const* restrict cameras,
     // RNG seed
     uint rngseed,
     // Sampler states
@@ -168,6 +171,9 @@ KERNEL void FillAOVsUberV2(
         Intersection isect = isects[global_id];
         int idx = pixel_idx[global_id];
 
+        int2 view_pixel;
+        GLOBAL Camera const* camera = cameras + GetViewPixel(idx, width, make_int2(view_width, view_height), &view_pixel);
+
         if (shape_ids_enabled)
             aov_shape_ids[idx].x = -1;
 
@@ -175,8 +181,8 @@ KERNEL void FillAOVsUberV2(
         {
             if (background_idx != -1)
             {
-                float x = (float)(idx % width) / (float)width;
-                float y = (float)(idx / width) / (float)height;
+                float x = (float)view_pixel.x / (float)view_width;
+                float y = (float)view_pixel.y / (float)view_height;
                 float2 uv = make_float2(x, y);
                 aov_background[idx].xyz += Texture_Sample2D(uv, TEXTURE_ARGS_IDX(background_idx)).xyz;
             }
@@ -213,6 +219,8 @@ KERNEL void FillAOVsUberV2(
             // Fill surface data
             DifferentialGeometry diffgeo;
             Scene_FillDifferentialGeometry(&scene, &isect, &diffgeo);
+            // Camera kernels put pixel spread angle into ray extra data
+            DifferentialGeometry_SetRayConeWidth(&diffgeo, Ray_GetExtra(&rays[global_id]).y * isect.uvwt.w, wi);
 
             if (world_position_enabled)
             {
@@ -0,0 +1,205 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#ifndef INPUTMAP_INTERPRETER_CL
+#define INPUTMAP_INTERPRETER_CL
+
+// Returns float4 with all components set to selected component of value
+float4 InputMap_SelectComponent(float4 value, int component)
+{
+    switch (component)
+    {
+        case 0: return (float4)(value.x);
+        case 1: return (float4)(value.y);
+        case 2: return (float4)(value.z);
+        default: return (float4)(value.w);
+    }
+}
+
+// Unpacks shuffle mask stored one component per byte
+uint4 InputMap_UnpackMask(int packed)
+{
+    uint mask = (uint)packed;
+    return (uint4)(mask & 0xff, (mask >> 8) & 0xff, (mask >> 16) & 0xff, mask >> 24);
+}
+
+// Reads matrix row stored as raw floats in bytecode
+float4 InputMap_ReadRow(GLOBAL InputMapData const* instruction)
+{
+    return (float4)(
+        as_float(instruction->instruction.op),
+        as_float(instruction->instruction.args[0]),
+        as_float(instruction->instruction.args[1]),
+        as_float(instruction->instruction.args[2]));
+}
+
+/*
+ Evaluates input map bytecode starting at pc on a stack machine. Used for
+ input maps which structure has no generated code in the compiled program
+ yet, so graph edits show up before specialized code is compiled.
+ */
+float4 InterpretInputMap(int pc, DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values, TEXTURE_ARG_LIST)
+{
+    float4 stack[INPUT_MAP_STACK_SIZE];
+    int top = 0;
+
+    for (;;)
+    {
+        GLOBAL InputMapData const* instruction = input_map_values + pc++;
+        int arg = instruction->instruction.args[0];
+
+        switch (instruction->instruction.op)
+        {
+            case kInputMapOpReturn:
+                return top > 0 ? stack[top - 1] : (float4)(0.0f);
+            // Leafs
+            case kInputMapOpConstant:
+                stack[top++] = (float4)(input_map_values[arg].float_value.value, 0.0f);
+                break;
+            case kInputMapOpSampler:
+                stack[top++] = Texture_SampleFootprint(dg->uv, dg->uv_footprint, TEXTURE_ARGS_IDX(input_map_values[arg].int_values.idx));
+                break;
+            case kInputMapOpSamplerBumpmap:
+                stack[top++] = (float4)(Texture_SampleBump(dg->uv, TEXTURE_ARGS_IDX(input_map_values[arg].int_values.idx)), 1.0f);
+                break;
+            // Two operands
+            case kInputMapOpAdd:
+                --top;
+                stack[top - 1] = stack[top - 1] + stack[top];
+                break;
+            case kInputMapOpSub:
+                --top;
+                stack[top - 1] = stack[top - 1] - stack[top];
+                break;
+            case kInputMapOpMul:
+                --top;
+                stack[top - 1] = stack[top - 1] * stack[top];
+                break;
+            case kInputMapOpDiv:
+                --top;
+                stack[top - 1] = stack[top - 1] / stack[top];
+                break;
+            case kInputMapOpMin:
+                --top;
+                stack[top - 1] = min(stack[top - 1], stack[top]);
+                break;
+            case kInputMapOpMax:
+                --top;
+                stack[top - 1] = max(stack[top - 1], stack[top]);
+                break;
+            case kInputMapOpDot3:
+                --top;
+                stack[top - 1] = (float4)(dot(stack[top - 1].xyz, stack[top].xyz), 0.0f, 0.0f, 0.0f);
+                break;
+            case kInputMapOpDot4:
+                --top;
+                stack[top - 1] = (float4)(dot(stack[top - 1], stack[top]), 0.0f, 0.0f, 0.0f);
+                break;
+            case kInputMapOpCross3:
+                --top;
+                stack[top - 1] = (float4)(cross(stack[top - 1].xyz, stack[top].xyz), 0.0f);
+                break;
+            case kInputMapOpCross4:
+                --top;
+                stack[top - 1] = cross(stack[top - 1], stack[top]);
+                break;
+            case kInputMapOpPow:
+                --top;
+                stack[top - 1] = pow(stack[top - 1], (float4)(stack[top].x));
+                break;
+            case kInputMapOpMod:
+                --top;
+                stack[top - 1] = fmod(stack[top - 1], stack[top]);
+                break;
+            // Single operand
+            case kInputMapOpSin:
+                stack[top - 1] = sin(stack[top - 1]);
+                break;
+            case kInputMapOpCos:
+                stack[top - 1] = cos(stack[top - 1]);
+                break;
+            case kInputMapOpTan:
+                stack[top - 1] = tan(stack[top - 1]);
+                break;
+            case kInputMapOpAsin:
+                stack[top - 1] = asin(stack[top - 1]);
+                break;
+            case kInputMapOpAcos:
+                stack[top - 1] = acos(stack[top - 1]);
+                break;
+            case kInputMapOpAtan:
+                stack[top - 1] = atan(stack[top - 1]);
+                break;
+            case kInputMapOpLength3:
+                stack[top - 1] = (float4)(length(stack[top - 1].xyz), 0.0f, 0.0f, 0.0f);
+                break;
+            case kInputMapOpNormalize3:
+                stack[top - 1] = (float4)(normalize(stack[top - 1].xyz), 0.0f);
+                break;
+            case kInputMapOpFloor:
+                stack[top - 1] = floor(stack[top - 1]);
+                break;
+            case kInputMapOpAbs:
+                stack[top - 1] = fabs(stack[top - 1]);
+                break;
+            case kInputMapOpSelect:
+                stack[top - 1] = InputMap_SelectComponent(stack[top - 1], arg);
+                break;
+            case kInputMapOpShuffle:
+                stack[top - 1] = shuffle(stack[top - 1], InputMap_UnpackMask(arg));
+                break;
+            case kInputMapOpShuffle2:
+                --top;
+                stack[top - 1] = shuffle2(stack[top - 1], stack[top], InputMap_UnpackMask(arg));
+                break;
+            // Three operands
+            case kInputMapOpLerp:
+                top -= 2;
+                stack[top - 1] = mix(stack[top - 1], stack[top], stack[top + 1]);
+                break;
+            case kInputMapOpRemap:
+            {
+                // Operands are value, source range and destination range
+                top -= 2;
+                float4 source = stack[top];
+                float4 destination = stack[top + 1];
+                stack[top - 1] = mix((float4)(destination.x), (float4)(destination.y),
+                    (stack[top - 1] - source.x) / (source.y - source.x));
+                break;
+            }
+            case kInputMapOpMatMul:
+            {
+                matrix4x4 m = matrix_from_rows(
+                    InputMap_ReadRow(input_map_values + pc),
+                    InputMap_ReadRow(input_map_values + pc + 1),
+                    InputMap_ReadRow(input_map_values + pc + 2),
+                    InputMap_ReadRow(input_map_values + pc + 3));
+                pc += 4;
+                stack[top - 1] = matrix_mul_vector4(m, stack[top - 1]);
+                break;
+            }
+            default:
+                return 0.0f;
+        }
+    }
+}
+
+#endif // INPUTMAP_INTERPRETER_CL
@@ -173,7 +173,8 @@ KERNEL void GenerateLightVertices(
         my_path->throughput = ke * fabs(dot(n, my_ray->d.xyz)) / selection_pdf * light_pdf;
         my_path->volume = -1;
         my_path->flags = 0;
-        my_path->active = 0xFF;
+        my_path->cone_width = 0.f;
+        my_path->cone_spread = 0.f;
     }
 }
 
@@ -115,6 +115,20 @@ float3 EnvironmentLight_GetLe(// Light
     return light->multiplier * Texture_SampleEnvMap(normalize(*wo), TEXTURE_ARGS_IDX(tex), light->ibl_mirror_x);
 }
 
+/// Get environment map importance sampling distribution,
+/// it is stored after light selection data
+INLINE GLOBAL int const* EnvironmentLight_GetDistribution(Scene const* scene)
+{
+    return scene->light_distribution + scene->light_distribution[kLightDistributionEnvMapOffset];
+}
+
+/// Check if environment map distribution can be used for a given texture,
+/// distribution is only built for the main IBL texture
+INLINE bool EnvironmentLight_HasDistribution(Light const* light, Scene const* scene, int tex)
+{
+    return tex == light->tex && EnvironmentLight_GetDistribution(scene)[0] > 0;
+}
+
 /// Sample direction to the light
 float3 EnvironmentLight_Sample(// Light
                                Light const* light,
@@ -138,7 +152,31 @@ float3 EnvironmentLight_Sample(// Light
 {
     float3 d;
 
-    if (interaction_type != kLightInteractionVolume)
+    int tex = EnvironmentLight_GetTexture(light, bxdf_flags);
+
+    if (tex == -1)
+    {
+        *wo = CRAZY_HIGH_DISTANCE * make_float3(0.f, 1.f, 0.f);
+        *pdf = 0.f;
+        return 0.f;
+    }
+
+    if (EnvironmentLight_HasDistribution(light, scene, tex))
+    {
+        // Importance sample lat-long map proportional to luminance
+        float uv_pdf = 0.f;
+        float2 uv = Distribution2D_Sample(sample, EnvironmentLight_GetDistribution(scene), &uv_pdf);
+
+        float theta = uv.y * PI;
+        float phi = (light->ibl_mirror_x ? (1.f - uv.x) : uv.x) * 2.f * PI;
+        float sin_theta = sin(theta);
+
+        d = make_float3(sin_theta * sin(phi), cos(theta), sin_theta * cos(phi));
+
+        // Convert from image space to solid angle measure
+        *pdf = sin_theta > 0.f ? uv_pdf / (2.f * PI * PI * sin_theta) : 0.f;
+    }
+    else if (interaction_type != kLightInteractionVolume)
     {
         d = Sample_MapToHemisphere(sample, dg->n, 0.f);
         *pdf = 1.f / (2.f * PI);
@@ -152,14 +190,6 @@ float3 EnvironmentLight_Sample(// Light
     // Generate direction
     *wo = CRAZY_HIGH_DISTANCE * d;
 
-    int tex = EnvironmentLight_GetTexture(light, bxdf_flags);
-
-    if (tex == -1)
-    {
-        *pdf = 0.f;
-        return 0.f;
-    }
-
     // Sample envmap
     return light->multiplier * Texture_SampleEnvMap(d, TEXTURE_ARGS_IDX(tex), light->ibl_mirror_x);
 }
@@ -182,6 +212,23 @@ float EnvironmentLight_GetPdf(
                               TEXTURE_ARG_LIST
                               )
 {
+    int tex = EnvironmentLight_GetTexture(light, bxdf_flags);
+
+    if (tex != -1 && EnvironmentLight_HasDistribution(light, scene, tex))
+    {
+        // Map direction to image space the same way Texture_SampleEnvMap does
+        float r, phi, theta;
+        CartesianToSpherical(normalize(wo), &r, &phi, &theta);
+
+        float2 uv;
+        uv.x = light->ibl_mirror_x ? (1.f - phi / (2.f * PI)) : phi / (2.f * PI);
+        uv.y = theta / PI;
+
+        float sin_theta = sin(theta);
+
+        return sin_theta > 0.f ? Distribution2D_GetPdf(uv, EnvironmentLight_GetDistribution(scene)) / (2.f * PI * PI * sin_theta) : 0.f;
+    }
+
     if (interaction_type != kLightInteractionVolume)
     {
         return 1.f / (2.f * PI);
@@ -389,6 +436,175 @@ float3 AreaLight_SampleVertex(
     return ke;
 }
 
+/*
+ Mesh light
+ */
+/// Get primitive area distribution of mesh light
+INLINE GLOBAL int const* MeshLight_GetDistribution(Light const* light, Scene const* scene)
+{
+    GLOBAL int const* data = scene->light_distribution;
+    return data + data[kLightDistributionMeshOffset] + light->distribution;
+}
+
+/// Get probability of sampling a given primitive of mesh light
+INLINE float MeshLight_GetPrimitivePdf(Light const* light, Scene const* scene, int prim_idx)
+{
+    return Distribution1D_GetPdfDiscreet(prim_idx, MeshLight_GetDistribution(light, scene));
+}
+
+/// Sample direction to the light
+float3 MeshLight_Sample(// Emissive object
+                        Light const* light,
+                        // Scene
+                        Scene const* scene,
+                        // Geometry
+                        DifferentialGeometry const* dg,
+                        // Textures
+                        TEXTURE_ARG_LIST,
+                        // Sample
+                        float2 sample,
+                        // Direction to light source
+                        float3* wo,
+                        // PDF
+                        float* pdf)
+{
+    GLOBAL int const* distribution = MeshLight_GetDistribution(light, scene);
+    int num_prims = distribution[0];
+
+    // Select primitive proportionally to its area and reuse the sample within it
+    float prim_pdf = 0.f;
+    float s = Distribution1D_Sample(sample.x, distribution, &prim_pdf) * num_prims;
+    int prim_idx = clamp((int)s, 0, num_prims - 1);
+    sample.x = clamp(s - prim_idx, 0.f, 1.f);
+
+    Light prim_light = *light;
+    prim_light.primidx = prim_idx;
+
+    float3 le = AreaLight_Sample(&prim_light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
+    *pdf *= MeshLight_GetPrimitivePdf(light, scene, prim_idx);
+    return le;
+}
+
+/// Find mesh light primitive closest along the ray, -1 if the ray misses the mesh
+INLINE int MeshLight_FindPrimitive(Light const* light, Scene const* scene, ray const* r)
+{
+    int num_prims = MeshLight_GetDistribution(light, scene)[0];
+    int closest_idx = -1;
+    float closest_t = 0.f;
+
+    for (int i = 0; i < num_prims; ++i)
+    {
+        float3 v0, v1, v2;
+        Scene_GetTriangleVertices(scene, light->shapeidx, i, &v0, &v1, &v2);
+
+        float a, b;
+        if (IntersectTriangle(r, v0, v1, v2, &a, &b))
+        {
+            float3 p = (1.f - a - b) * v0 + a * v1 + b * v2;
+            float t = dot(p - r->o.xyz, r->d.xyz);
+
+            if (t > 0.f && (closest_idx < 0 || t < closest_t))
+            {
+                closest_idx = i;
+                closest_t = t;
+            }
+        }
+    }
+
+    return closest_idx;
+}
+
+/// Get intensity for a given direction
+float3 MeshLight_GetLe(// Emissive object
+                       Light const* light,
+                       // Scene
+                       Scene const* scene,
+                       // Geometry
+                       DifferentialGeometry const* dg,
+                       // Direction to light source
+                       float3* wo,
+                       // Textures
+                       TEXTURE_ARG_LIST
+                       )
+{
+    ray r;
+    r.o.xyz = dg->p;
+    r.d.xyz = *wo;
+
+    Light prim_light = *light;
+    prim_light.primidx = MeshLight_FindPrimitive(light, scene, &r);
+
+    if (prim_light.primidx < 0)
+    {
+        return make_float3(0.f, 0.f, 0.f);
+    }
+
+    return AreaLight_GetLe(&prim_light, scene, dg, wo, TEXTURE_ARGS);
+}
+
+/// Get PDF for a given direction
+float MeshLight_GetPdf(// Emissive object
+                       Light const* light,
+                       // Scene
+                       Scene const* scene,
+                       // Geometry
+                       DifferentialGeometry const* dg,
+                       // Direction to light source
+                       float3 wo,
+                       // Textures
+                       TEXTURE_ARG_LIST
+                       )
+{
+    ray r;
+    r.o.xyz = dg->p;
+    r.d.xyz = wo;
+
+    Light prim_light = *light;
+    prim_light.primidx = MeshLight_FindPrimitive(light, scene, &r);
+
+    if (prim_light.primidx < 0)
+    {
+        return 0.f;
+    }
+
+    return AreaLight_GetPdf(&prim_light, scene, dg, wo, TEXTURE_ARGS) *
+        MeshLight_GetPrimitivePdf(light, scene, prim_light.primidx);
+}
+
+float3 MeshLight_SampleVertex(
+    // Emissive object
+    Light const* light,
+    // Scene
+    Scene const* scene,
+    // Textures
+    TEXTURE_ARG_LIST,
+    // Sample
+    float2 sample0,
+    float2 sample1,
+    // Direction to light source
+    float3* p,
+    float3* n,
+    float3* wo,
+    // PDF
+    float* pdf)
+{
+    GLOBAL int const* distribution = MeshLight_GetDistribution(light, scene);
+    int num_prims = distribution[0];
+
+    // Select primitive proportionally to its area and reuse the sample within it
+    float prim_pdf = 0.f;
+    float s = Distribution1D_Sample(sample0.x, distribution, &prim_pdf) * num_prims;
+    int prim_idx = clamp((int)s, 0, num_prims - 1);
+    sample0.x = clamp(s - prim_idx, 0.f, 1.f);
+
+    Light prim_light = *light;
+    prim_light.primidx = prim_idx;
+
+    float3 ke = AreaLight_SampleVertex(&prim_light, scene, TEXTURE_ARGS, sample0, sample1, p, n, wo, pdf);
+    *pdf *= MeshLight_GetPrimitivePdf(light, scene, prim_idx);
+    return ke;
+}
+
 /*
 Directional light
 */
@@ -623,6 +839,8 @@ float3 Light_GetLe(// Light index
             return EnvironmentLight_GetLe(&light, scene, dg, bxdf_flags, interaction_type, wo, TEXTURE_ARGS);
         case kArea:
             return AreaLight_GetLe(&light, scene, dg, wo, TEXTURE_ARGS);
+        case kMesh:
+            return MeshLight_GetLe(&light, scene, dg, wo, TEXTURE_ARGS);
         case kDirectional:
             return DirectionalLight_GetLe(&light, scene, dg, wo, TEXTURE_ARGS);
         case kPoint:
@@ -662,6 +880,8 @@ float3 Light_Sample(// Light index
             return EnvironmentLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, bxdf_flags, interaction_type, wo, pdf);
         case kArea:
             return AreaLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
+        case kMesh:
+            return MeshLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
         case kDirectional:
             return DirectionalLight_Sample(&light, scene, dg, TEXTURE_ARGS, sample, wo, pdf);
         case kPoint:
@@ -699,6 +919,8 @@ float Light_GetPdf(// Light index
             return EnvironmentLight_GetPdf(&light, scene, dg, bxdf_flags, interaction_type, wo, TEXTURE_ARGS);
         case kArea:
             return AreaLight_GetPdf(&light, scene, dg, wo, TEXTURE_ARGS);
+        case kMesh:
+            return MeshLight_GetPdf(&light, scene, dg, wo, TEXTURE_ARGS);
         case kDirectional:
             return DirectionalLight_GetPdf(&light, scene, dg, wo, TEXTURE_ARGS);
         case kPoint:
@@ -736,6 +958,8 @@ float3 Light_SampleVertex(
     {
         case kArea:
             return AreaLight_SampleVertex(&light, scene, TEXTURE_ARGS, sample0, sample1, p, n, wo, pdf);
+        case kMesh:
+            return MeshLight_SampleVertex(&light, scene, TEXTURE_ARGS, sample0, sample1, p, n, wo, pdf);
         case kPoint:
             return PointLight_SampleVertex(&light, scene, TEXTURE_ARGS, sample0, sample1, p, n, wo, pdf);
     }
@@ -744,6 +968,19 @@ float3 Light_SampleVertex(
     return make_float3(0.f, 0.f, 0.f);
 }
 
+/// Get probability of sampling a given primitive of emissive light
+/// (solid angle PDF of an area light is conditional on its primitive)
+float Light_GetPrimitivePdf(// Light index
+                            int idx,
+                            // Scene
+                            Scene const* scene,
+                            // Primitive index
+                            int prim_idx)
+{
+    Light light = scene->lights[idx];
+    return light.type == kMesh ? MeshLight_GetPrimitivePdf(&light, scene, prim_idx) : 1.f;
+}
+
 /// Check if the light is singular
 bool Light_IsSingular(__global Light const* light)
 {
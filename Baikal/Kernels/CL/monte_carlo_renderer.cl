@@ -38,11 +38,14 @@ THE SOFTWARE.
 // This kernel is being used if aperture value = 0.
 KERNEL
 void PerspectiveCamera_GeneratePaths(
-    // Camera
-    GLOBAL Camera const* restrict camera, 
+    // Cameras (one per view)
+    GLOBAL Camera const* restrict cameras,
     // Image resolution
     int output_width,
     int output_height,
+    // Size of a single view, the output can hold several views
+    int view_width,
+    int view_height,
     // Pixel domain buffer
     GLOBAL int const* restrict pixel_idx,
     // Size of pixel domain buffer
@@ -67,6 +70,9 @@ void PerspectiveCamera_GeneratePaths(
         int y = idx / output_width;
         int x = idx % output_width;
 
+        int2 view_pixel;
+        GLOBAL Camera const* camera = cameras + GetViewPixel(idx, output_width, make_int2(view_width, view_height), &view_pixel);
+
         // Get pointer to ray & path handles
         GLOBAL ray* my_ray = rays + global_id;
 
@@ -99,8 +105,8 @@ void PerspectiveCamera_GeneratePaths(
 
         // Calculate [0..1] image plane sample
         float2 img_sample;
-        img_sample.x = (float)x / output_width + sample0.x / output_width;
-        img_sample.y = (float)y / output_height + sample0.y / output_height;
+        img_sample.x = (float)view_pixel.x / view_width + sample0.x / view_width;
+        img_sample.y = (float)view_pixel.y / view_height + sample0.y / view_height;
 
         // Transform into [-0.5, 0.5]
         float2 h_sample = img_sample - make_float2(0.5f, 0.5f);
@@ -118,7 +124,8 @@ void PerspectiveCamera_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        // Keep pixel cone spread angle in y for texture LOD selection
+        Ray_SetExtra(my_ray, make_float2(1.f, camera->dim.y / (view_height * camera->focal_length)));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
@@ -126,11 +133,14 @@ void PerspectiveCamera_GeneratePaths(
 // Physical camera implemenation.
 // This kernel is being used if aperture > 0.
 KERNEL void PerspectiveCameraDof_GeneratePaths(
-    // Camera
-    GLOBAL Camera const* restrict camera,
+    // Cameras (one per view)
+    GLOBAL Camera const* restrict cameras,
     // Image resolution
     int output_width,
     int output_height,
+    // Size of a single view, the output can hold several views
+    int view_width,
+    int view_height,
     // Pixel domain buffer
     GLOBAL int const* restrict pixel_idx,
     // Size of pixel domain buffer
@@ -155,6 +165,9 @@ KERNEL void PerspectiveCameraDof_GeneratePaths(
         int y = idx / output_width;
         int x = idx % output_width;
 
+        int2 view_pixel;
+        GLOBAL Camera const* camera = cameras + GetViewPixel(idx, output_width, make_int2(view_width, view_height), &view_pixel);
+
         // Get pointer to ray & path handles
         GLOBAL ray* my_ray = rays + global_id;
 
@@ -188,8 +201,8 @@ KERNEL void PerspectiveCameraDof_GeneratePaths(
 
         // Calculate [0..1] image plane sample
         float2 img_sample;
-        img_sample.x = (float)x / output_width + sample0.x / output_width;
-        img_sample.y = (float)y / output_height + sample0.y / output_height;
+        img_sample.x = (float)view_pixel.x / view_width + sample0.x / view_width;
+        img_sample.y = (float)view_pixel.y / view_height + sample0.y / view_height;
 
         // Transform into [-0.5, 0.5]
         float2 h_sample = img_sample - make_float2(0.5f, 0.5f);
@@ -214,7 +227,8 @@ KERNEL void PerspectiveCameraDof_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        // Keep pixel cone spread angle in y for texture LOD selection
+        Ray_SetExtra(my_ray, make_float2(1.f, camera->dim.y / (view_height * camera->focal_length)));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
@@ -330,7 +344,8 @@ void PerspectiveCamera_GenerateVertices(
         my_path->throughput = make_float3(1.f, 1.f, 1.f);
         my_path->volume = -1;
         my_path->flags = 0;
-        my_path->active = 0xFF;
+        my_path->cone_width = 0.f;
+        my_path->cone_spread = 0.f;
     }
 }
 
@@ -451,7 +466,8 @@ void PerspectiveCameraDof_GenerateVertices(
         my_path->throughput = make_float3(1.f, 1.f, 1.f);
         my_path->volume = -1;
         my_path->flags = 0;
-        my_path->active = 0xFF;
+        my_path->cone_width = 0.f;
+        my_path->cone_spread = 0.f;
     }
 }
 
@@ -521,6 +537,7 @@ KERNEL void GenerateTileDomain(
     }
 }
 
+// Generate tile domain along with active (not converged) pixels predicate
 KERNEL void GenerateTileDomain_Adaptive(
     int output_width,
     int output_height,
@@ -528,79 +545,21 @@ KERNEL void GenerateTileDomain_Adaptive(
     int offset_y,
     int width,
     int height,
-    uint rng_seed,
-    uint frame,
-    GLOBAL uint* restrict random,
-    GLOBAL uint const* restrict sobol_mat,
-    GLOBAL int const* restrict tile_distribution,
+    GLOBAL int const* restrict converged,
     GLOBAL int* restrict indices,
-    GLOBAL int* restrict count
+    GLOBAL int* restrict predicate
 )
 {
     int2 global_id;
     global_id.x = get_global_id(0);
     global_id.y = get_global_id(1);
 
-    int2 local_id;
-    local_id.x = get_local_id(0);
-    local_id.y = get_local_id(1);
-
-    int2 group_id;
-    group_id.x = get_group_id(0);
-    group_id.y = get_group_id(1);
-
-    int2 tile_size;
-    tile_size.x = get_local_size(0);
-    tile_size.y = get_local_size(1);
-
-
-    // Initialize sampler  
-    Sampler sampler;
-    int x = global_id.x;
-    int y = global_id.y;
-#if SAMPLER == SOBOL
-    uint scramble = random[x + output_width * y] * 0x1fe3434f;
-
-    if (frame & 0xF)
-    {
-        random[x + output_width * y] = WangHash(scramble);
-    }
-
-    Sampler_Init(&sampler, frame, SAMPLE_DIM_IMG_PLANE_EVALUATE_OFFSET, scramble);
-#elif SAMPLER == RANDOM
-    uint scramble = x + output_width * y * rng_seed;
-    Sampler_Init(&sampler, scramble);
-#elif SAMPLER == CMJ
-    uint rnd = random[group_id.x + output_width *group_id.y];
-    uint scramble = rnd * 0x1fe3434f * ((frame + 133 * rnd) / (CMJ_DIM * CMJ_DIM));
-    Sampler_Init(&sampler, frame % (CMJ_DIM * CMJ_DIM), SAMPLE_DIM_IMG_PLANE_EVALUATE_OFFSET, scramble);
-#endif
-
-    float2 sample = Sampler_Sample2D(&sampler, SAMPLER_ARGS);
-
-    float pdf;
-    int tile = Distribution1D_SampleDiscrete(sample.x, tile_distribution, &pdf);
-
-    int num_tiles_x = output_width / tile_size.x;
-    int num_tiles_y = output_height / tile_size.y;
-
-    int tile_y = clamp(tile / num_tiles_x , 0, num_tiles_y - 1);
-    int tile_x = clamp(tile % num_tiles_x, 0, num_tiles_x - 1);
-
-    int start_idx = output_width * offset_y + offset_x;
-
     if (global_id.x < width && global_id.y < height)
     {
-        int idx = start_idx +
-            (tile_y * tile_size.y + local_id.y) * output_width +
-            (tile_x * tile_size.x + local_id.x);
+        int idx = output_width * (offset_y + global_id.y) + offset_x + global_id.x;
 
         indices[global_id.y * width + global_id.x] = idx;
-    }
-
-    if (global_id.x == 0 && global_id.y == 0)
-    {
-        *count = width * height;
+        predicate[global_id.y * width + global_id.x] = converged[idx] ? 0 : 1;
     }
 }
 
@@ -620,6 +579,23 @@ KERNEL void AccumulateData(
     }
 }
 
+// Accumulate src data into a range of dst starting at dst_offset
+KERNEL void AccumulateDataRegion(
+    GLOBAL float4 const* src_data,
+    int num_elements,
+    int dst_offset,
+    GLOBAL float4* dst_data
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id < num_elements)
+    {
+        float4 v = src_data[global_id];
+        dst_data[dst_offset + global_id] += v;
+    }
+}
+
 //#define ADAPTIVITY_DEBUG
 // Copy data to interop texture if supported
 KERNEL void ApplyGammaAndCopyData(
@@ -652,18 +628,70 @@ KERNEL void ApplyGammaAndCopyData(
 KERNEL void AccumulateSingleSample(
     GLOBAL float4 const* restrict src_sample_data,
     GLOBAL float4* restrict dst_accumulation_data,
+    // Sum of squared sample luminance
+    GLOBAL float* restrict dst_moments_data,
     GLOBAL int* restrict scatter_indices,
-    int num_elements
+    GLOBAL int const* restrict num_elements
 )
 {
     int global_id = get_global_id(0);
 
-    if (global_id < num_elements)
+    if (global_id < *num_elements)
     {
         int idx = scatter_indices[global_id];
         float4 sample = src_sample_data[global_id];
+        float l = luminance(sample.xyz);
         dst_accumulation_data[idx].xyz += sample.xyz;
         dst_accumulation_data[idx].w += 1.f;
+        dst_moments_data[idx] += l * l;
+    }
+}
+
+// Mark pixels with relative standard error of the mean luminance below the
+// threshold as converged and count the remaining ones
+KERNEL void UpdateConvergence(
+    GLOBAL float4 const* restrict accumulation_data,
+    GLOBAL float const* restrict moments_data,
+    int num_pixels,
+    uint min_samples,
+    float threshold,
+    GLOBAL int* restrict converged,
+    GLOBAL int* restrict num_active,
+    // Convergence mask AOV
+    int mask_enabled,
+    GLOBAL float4* restrict mask
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id < num_pixels)
+    {
+        int done = converged[global_id];
+
+        float4 v = accumulation_data[global_id];
+
+        if (!done && v.w >= (float)max(min_samples, 2u))
+        {
+            float n = v.w;
+            float mean = luminance(v.xyz) / n;
+            float variance = max(moments_data[global_id] / n - mean * mean, 0.f) * n / (n - 1.f);
+            // Relative error is too strict for dark pixels, bound the denominator
+            float error = native_sqrt(variance / n) / max(mean, 0.01f);
+
+            done = error < threshold ? 1 : 0;
+            converged[global_id] = done;
+        }
+
+        if (!done)
+        {
+            atomic_inc(num_active);
+        }
+
+        if (mask_enabled)
+        {
+            float c = done ? 1.f : 0.f;
+            mask[global_id] = make_float4(c, c, c, 1.f);
+        }
     }
 }
 
@@ -705,80 +733,16 @@ INLINE void group_reduce_max(__local float* lds, int size, int lid)
 }
 
 
-KERNEL void EstimateVariance(
-    GLOBAL float4 const* restrict image_buffer,
-    GLOBAL float* restrict variance_buffer,
-    int width,
-    int height
-)
-{
-    __local float lds[256];
-
-    int x = get_global_id(0);
-    int y = get_global_id(1);
-    int lx = get_local_id(0);
-    int ly = get_local_id(1);
-    int gx = get_group_id(0);
-    int gy = get_group_id(1);
-    int wx = get_local_size(0);
-    int wy = get_local_size(1);
-    int num_tiles = (width + wx - 1) / wx;
-    int lid = ly * wx + lx;
-
-    float value = 0.f;
-    if (x < width && y < height)
-    {
-        float4 rw = image_buffer[y * width + x]; rw /= rw.w;
-        value = 4*luminance(clamp(rw.xyz, 0.f, 1.f));
-        rw = y + 1 < height ? image_buffer[(y + 1) * width + x] : image_buffer[y * width + x]; rw /= rw.w;
-        value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        rw = y - 1 >= 0 ? image_buffer[(y - 1) * width + x] : image_buffer[y * width + x]; rw /= rw.w;
-        value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        rw = x + 1 < width ? image_buffer[y * width + x + 1] : image_buffer[y * width + x]; rw /= rw.w;
-        value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        rw = x - 1 >= 0 ? image_buffer[y * width + x - 1] : image_buffer[y * width + x]; rw /= rw.w;
-        value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        //rw = y + 1 < height && x + 1 < width ? image_buffer[(y + 1) * width + x + 1] : image_buffer[y * width + x]; rw /= rw.w;
-        //value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        //rw = y - 1 >= 0 && x - 1 >= 0 ? image_buffer[(y - 1) * width + x - 1] : image_buffer[y * width + x]; rw /= rw.w;
-        //value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        //rw = y + 1 < height && x - 1 >= 0 ? image_buffer[(y + 1) * width + x - 1] : image_buffer[y * width + x]; rw /= rw.w;
-        //value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-        //rw = y - 1 >= 0 && x + 1 < width ? image_buffer[(y - 1) * width + x + 1] : image_buffer[y * width + x]; rw /= rw.w;
-        //value -= luminance(clamp(rw.xyz, 0.f, 1.f));
-    }
-
-    value = fabs(value);
-    lds[lid] = value;
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    group_reduce_add(lds, 256, lid);
-
-    float mean = lds[0] / (wx * wy);
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    /*lds[lid] = (mean - value) * (mean - value);
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    group_reduce_add(lds, 256, lid);*/
-
-    if (x < width && y < height)
-    {
-        if (lx == 0 && ly == 0)
-        {
-            //float dev = lds[0] / (wx * wy - 1);
-            variance_buffer[gy * num_tiles + gx] = mean;
-        }
-    }
-}
-
 KERNEL
 void  OrthographicCamera_GeneratePaths(
-                                     // Camera
-                                     GLOBAL Camera const* restrict camera,
+                                     // Cameras (one per view)
+                                     GLOBAL Camera const* restrict cameras,
                                      // Image resolution
                                      int output_width,
                                      int output_height,
+                                     // Size of a single view, the output can hold several views
+                                     int view_width,
+                                     int view_height,
                                      // Pixel domain buffer
                                      GLOBAL int const* restrict pixel_idx,
                                      // Size of pixel domain buffer
@@ -802,6 +766,9 @@ void  OrthographicCamera_GeneratePaths(
         int idx = pixel_idx[global_id];
         int y = idx / output_width;
         int x = idx % output_width;
+
+        int2 view_pixel;
+        GLOBAL Camera const* camera = cameras + GetViewPixel(idx, output_width, make_int2(view_width, view_height), &view_pixel);
         
         // Get pointer to ray & path handles
         GLOBAL ray* my_ray = rays + global_id;
@@ -835,8 +802,8 @@ void  OrthographicCamera_GeneratePaths(
         
         // Calculate [0..1] image plane sample
         float2 img_sample;
-        img_sample.x = (float)x / output_width + sample0.x / output_width;
-        img_sample.y = (float)y / output_height + sample0.y / output_height;
+        img_sample.x = (float)view_pixel.x / view_width + sample0.x / view_width;
+        img_sample.y = (float)view_pixel.y / view_height + sample0.y / view_height;
         
         // Transform into [-0.5, 0.5]
         float2 h_sample = img_sample - make_float2(0.5f, 0.5f);
@@ -854,7 +821,8 @@ void  OrthographicCamera_GeneratePaths(
         // Set ray max
         my_ray->extra.x = 0xFFFFFFFF;
         my_ray->extra.y = 0xFFFFFFFF;
-        Ray_SetExtra(my_ray, 1.f);
+        // Parallel rays do not spread
+        Ray_SetExtra(my_ray, make_float2(1.f, 0.f));
         Ray_SetMask(my_ray, VISIBILITY_MASK_PRIMARY);
     }
 }
@@ -875,6 +843,9 @@ KERNEL void ShadeBackgroundImage(
     // Output size
     int width,
     int height,
+    // View size
+    int view_width,
+    int view_height,
     // Textures
     TEXTURE_ARG_LIST,
     // Output values
@@ -888,8 +859,11 @@ KERNEL void ShadeBackgroundImage(
         int pixel_idx = pixel_indices[global_id];
         int output_index = output_indices[pixel_idx];
 
-        float x = (float)(output_index % width) / (float)width;
-        float y = (float)(output_index / width) / (float)height;
+        int2 view_pixel;
+        GetViewPixel(output_index, width, make_int2(view_width, view_height), &view_pixel);
+
+        float x = (float)view_pixel.x / (float)view_width;
+        float y = (float)view_pixel.y / (float)view_height;
 
         float4 v = make_float4(0.f, 0.f, 0.f, 1.f);
 
@@ -31,8 +31,9 @@ typedef struct _Path
     float3 throughput;
     int volume;
     int flags;
-    int active;
-    int extra1;
+    // Ray cone width at the path vertex and its spread angle
+    float cone_width;
+    float cone_spread;
 } Path;
 
 typedef enum _PathFlags
@@ -114,6 +115,11 @@ INLINE void Path_MulThroughput(__global Path* path, float3 mul)
     path->throughput *= mul;
 }
 
+INLINE void Path_AdvanceCone(__global Path* path, float distance)
+{
+    path->cone_width += path->cone_spread * distance;
+}
+
 INLINE void Path_Kill(__global Path* path)
 {
     path->flags |= kKilled;
@@ -41,6 +41,8 @@ void InitPathData(
     GLOBAL int* restrict dst_index,
     GLOBAL int const* restrict num_elements, 
     int world_volume_idx,
+    // Camera rays
+    GLOBAL ray const* restrict rays,
     GLOBAL Path* restrict paths
 )
 {
@@ -56,7 +58,9 @@ void InitPathData(
         my_path->throughput = make_float3(1.f, 1.f, 1.f);
         my_path->volume = world_volume_idx;
         my_path->flags = 0;
-        my_path->active = 0xFF;
+        // Camera kernels put pixel spread angle into ray extra data
+        my_path->cone_width = 0.f;
+        my_path->cone_spread = Ray_GetExtra(rays + global_id).y;
     }
 }
 
@@ -251,6 +255,40 @@ KERNEL void RestorePixelIndices(
     }
 }
 
+///< Generate sort keys grouping compacted hits by material (layer set first, then input offset)
+KERNEL void GenerateMaterialKeys(
+    // Compacted hit indices
+    GLOBAL int const* restrict hit_indices,
+    // Number of compacted indices
+    GLOBAL int const* restrict num_hits,
+    // Intersections
+    GLOBAL Intersection const* restrict isects,
+    // Shapes
+    GLOBAL Shape const* restrict shapes,
+    // Number of keys to generate
+    int num_items,
+    // Sort keys
+    GLOBAL int* restrict keys
+)
+{
+    int global_id = get_global_id(0);
+
+    if (global_id < num_items)
+    {
+        // Slots past the hit count go to the end
+        int key = 0x7fffffff;
+
+        if (global_id < *num_hits)
+        {
+            int shape_idx = isects[hit_indices[global_id]].shapeid - 1;
+            Material material = shapes[shape_idx].material;
+            key = ((material.layers & 0xff) << 22) | (material.offset & 0x3fffff);
+        }
+
+        keys[global_id] = key;
+    }
+}
+
 ///< Restore pixel indices after compaction
 KERNEL void FilterPathStream(
     // Intersections
@@ -333,12 +371,27 @@ KERNEL void ShadeMiss(
         // In case of a miss
         if (isects[global_id].shapeid < 0 && Path_IsAlive(path))
         {
+            Scene scene =
+            {
+                0,
+                0,
+                0,
+                0,
+                0,
+                0,
+                0,
+                lights,
+                env_light_idx,
+                num_lights,
+                light_distribution
+            };
+
             Light light = lights[env_light_idx];
 
             // Apply MIS
             int bxdf_flags = Path_GetBxdfFlags(path);
-            float selection_pdf = Distribution1D_GetPdfDiscreet(env_light_idx, light_distribution);
-            float light_pdf = EnvironmentLight_GetPdf(&light, 0, 0, bxdf_flags, kLightInteractionSurface, rays[global_id].d.xyz, TEXTURE_ARGS);
+            float selection_pdf = Scene_GetInfiniteLightPdf(&scene);
+            float light_pdf = EnvironmentLight_GetPdf(&light, &scene, 0, bxdf_flags, kLightInteractionSurface, rays[global_id].d.xyz, TEXTURE_ARGS);
             float2 extra = Ray_GetExtra(&rays[global_id]);
             float weight = extra.x > 0.f ? BalanceHeuristic(1, extra.x, 1, light_pdf * selection_pdf) : 1.f;
 
@@ -71,6 +71,8 @@ KERNEL void ShadeVolumeUberV2(
     GLOBAL Light const* restrict lights,
     // Light distribution
     GLOBAL int const* restrict light_distribution,
+    // Light tree
+    GLOBAL LightTreeNode const* restrict light_tree,
     // Number of emissive objects
     int num_lights,
     // RNG seed
@@ -112,7 +114,8 @@ KERNEL void ShadeVolumeUberV2(
         lights,
         env_light_idx,
         num_lights,
-        light_distribution
+        light_distribution,
+        light_tree
     };
 
     if (global_id < *num_hits)
@@ -157,16 +160,18 @@ KERNEL void ShadeVolumeUberV2(
         float selection_pdf = 0.f;
         float3 wo;
 
-        int light_idx = Scene_SampleLight(&scene, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
-
         // Here we need fake differential geometry for light sampling procedure
         DifferentialGeometry dg;
         // put scattering position in there (it is along the current ray at isect.distance
         // since EvaluateVolume has put it there
         dg.p = o - wi * Intersection_GetDistance(isects + hit_idx);
+
+        int light_idx = Scene_SampleLight(&scene, dg.p, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
+
         // Get light sample intencity
         int bxdf_flags = Path_GetBxdfFlags(path); 
-        float3 le = Light_Sample(light_idx, &scene, &dg, TEXTURE_ARGS, Sampler_Sample2D(&sampler, SAMPLER_ARGS), bxdf_flags, kLightInteractionVolume, &wo, &pdf);
+        float2 light_sample = Sampler_Sample2D(&sampler, SAMPLER_ARGS);
+        float3 le = light_idx > -1 ? Light_Sample(light_idx, &scene, &dg, TEXTURE_ARGS, light_sample, bxdf_flags, kLightInteractionVolume, &wo, &pdf) : 0.f;
 
         // Generate shadow ray
         float shadow_ray_length = length(wo); 
@@ -213,6 +218,8 @@ KERNEL void ShadeVolumeUberV2(
 
         // Update path throughput multiplying by phase function.
         Path_MulThroughput(path, phase);
+        // Account for the distance travelled to the scattering point
+        Path_AdvanceCone(path, Intersection_GetDistance(isects + hit_idx));
 #else
         // Single-scattering mode only,
         // kill the path and compact away on next iteration
@@ -258,6 +265,8 @@ KERNEL void ShadeSurfaceUberV2(
     GLOBAL Light const* restrict lights,
     // Light distribution
     GLOBAL int const* restrict light_distribution,
+    // Light tree
+    GLOBAL LightTreeNode const* restrict light_tree,
     // Number of emissive objects
     int num_lights,
     // RNG seed
@@ -270,6 +279,10 @@ KERNEL void ShadeSurfaceUberV2(
     int bounce,
     // Frame
     int frame,
+    // First bounce Russian roulette is applied at
+    int rr_depth,
+    // Throughput luminance below which paths are terminated randomly
+    float rr_threshold,
     // Volume data
     GLOBAL Volume const* restrict volumes,
     // Shadow rays
@@ -299,7 +312,8 @@ KERNEL void ShadeSurfaceUberV2(
         lights,
         env_light_idx,
         num_lights,
-        light_distribution
+        light_distribution,
+        light_tree
     };
 
     // Only applied to active rays after compaction
@@ -338,6 +352,10 @@ KERNEL void ShadeSurfaceUberV2(
         DifferentialGeometry diffgeo;
         Scene_FillDifferentialGeometry(&scene, &isect, &diffgeo);
 
+        // Propagate ray cone to the hit point to select texture LOD
+        Path_AdvanceCone(path, isect.uvwt.w);
+        DifferentialGeometry_SetRayConeWidth(&diffgeo, path->cone_width, wi);
+
         // Check if we are hitting from the inside
         float ngdotwi = dot(diffgeo.ng, wi);
         bool backfacing = ngdotwi < 0.f;
@@ -372,8 +390,11 @@ KERNEL void ShadeSurfaceUberV2(
                     float2 extra = Ray_GetExtra(&rays[hit_idx]);
                     float ld = isect.uvwt.w;
                     float denom = fabs(dot(diffgeo.n, wi)) * diffgeo.area;
-                    // TODO: num_lights should be num_emissies instead, presence of analytical lights breaks this code
-                    float bxdf_light_pdf = denom > 0.f ? (ld * ld / denom / num_lights) : 0.f;
+                    // Probability of selecting this emitter from the previous path vertex
+                    int light_idx = Scene_GetAreaLightIdx(&scene, isect.shapeid - 1, isect.primid);
+                    float selection_pdf = light_idx > -1 ? Scene_GetLightPdf(&scene, light_idx, rays[hit_idx].o.xyz) *
+                        Light_GetPrimitivePdf(light_idx, &scene, isect.primid) : 0.f;
+                    float bxdf_light_pdf = denom > 0.f ? (ld * ld / denom * selection_pdf) : 0.f;
                     weight = extra.x > 0.f ? BalanceHeuristic(1, extra.x, 1, bxdf_light_pdf) : 1.f;
                 }
 
@@ -420,7 +441,7 @@ KERNEL void ShadeSurfaceUberV2(
         float bxdf_weight = 1.f;
         float light_weight = 1.f;
 
-        int light_idx = Scene_SampleLight(&scene, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
+        int light_idx = Scene_SampleLight(&scene, diffgeo.p, Sampler_Sample1D(&sampler, SAMPLER_ARGS), &selection_pdf);
 
         float3 throughput = Path_GetThroughput(path);
 
@@ -468,27 +489,25 @@ KERNEL void ShadeSurfaceUberV2(
             light_samples[global_id] = 0;
         }
 
-        // Apply Russian roulette
-        float q = max(min(0.5f,
-            // Luminance
-            0.2126f * throughput.x + 0.7152f * throughput.y + 0.0722f * throughput.z), 0.01f);
-        // Only if it is 3+ bounce
-        bool rr_apply = bounce > 3;
-        bool rr_stop = Sampler_Sample1D(&sampler, SAMPLER_ARGS) > q && rr_apply;
+        bxdfwo = normalize(bxdfwo);
+        float3 t = bxdf * fabs(dot(diffgeo.n, bxdfwo));
 
-        if (rr_apply)
+        // Apply Russian roulette after rr_depth bounces: paths whose throughput luminance
+        // falls below rr_threshold survive with probability proportional to it
+        bool rr_stop = false;
+        float rr_survival = 1.f;
+        if (bounce >= rr_depth && bxdf_pdf > 0.f)
         {
-            Path_MulThroughput(path, 1.f / q);
+            float3 next_throughput = throughput * t / bxdf_pdf;
+            rr_survival = clamp(luminance(next_throughput) / rr_threshold, 0.05f, 1.f);
+            rr_stop = Sampler_Sample1D(&sampler, SAMPLER_ARGS) >= rr_survival;
         }
 
-        bxdfwo = normalize(bxdfwo);
-        float3 t = bxdf * fabs(dot(diffgeo.n, bxdfwo));
-
         // Only continue if we have non-zero throughput & pdf
         if (NON_BLACK(t) && bxdf_pdf > 0.f && !rr_stop)
         {
-            // Update the throughput
-            Path_MulThroughput(path, t / bxdf_pdf);
+            // Update the throughput, compensating for terminated paths
+            Path_MulThroughput(path, t / (bxdf_pdf * rr_survival));
 
             // Generate ray
             float3 indirect_ray_dir = bxdfwo;
@@ -125,9 +125,62 @@ typedef struct _InputMapData
             int placeholder[2];
             int type; //We can use it since float3 is actually float4
         } int_values;
+        // Input map bytecode instruction (see inputmap_interpreter.cl)
+        struct
+        {
+            int op;
+            int args[3];
+        } instruction;
     };
 } InputMapData;
 
+// Maximum stack depth of input map bytecode
+#define INPUT_MAP_STACK_SIZE 8
+
+// Input map bytecode operations, operands are passed through the stack
+enum InputMapOp
+{
+    kInputMapOpReturn = 0,
+    // Leafs, args[0] is leaf offset in input map data
+    kInputMapOpConstant,
+    kInputMapOpSampler,
+    kInputMapOpSamplerBumpmap,
+    // Two operands
+    kInputMapOpAdd,
+    kInputMapOpSub,
+    kInputMapOpMul,
+    kInputMapOpDiv,
+    kInputMapOpMin,
+    kInputMapOpMax,
+    kInputMapOpDot3,
+    kInputMapOpDot4,
+    kInputMapOpCross3,
+    kInputMapOpCross4,
+    kInputMapOpPow,
+    kInputMapOpMod,
+    // Single operand
+    kInputMapOpSin,
+    kInputMapOpCos,
+    kInputMapOpTan,
+    kInputMapOpAsin,
+    kInputMapOpAcos,
+    kInputMapOpAtan,
+    kInputMapOpLength3,
+    kInputMapOpNormalize3,
+    kInputMapOpFloor,
+    kInputMapOpAbs,
+    // args[0] is component index
+    kInputMapOpSelect,
+    // args[0] holds 4 mask components packed into bytes
+    kInputMapOpShuffle,
+    kInputMapOpShuffle2,
+    // Three operands
+    kInputMapOpLerp,
+    kInputMapOpRemap,
+    // Matrix rows are stored as raw floats in 4 following instructions
+    kInputMapOpMatMul
+};
+
 enum Bxdf
 {
     kZero,
@@ -140,20 +193,24 @@ enum LightType
     kDirectional,
     kSpot,
     kArea,
-    kIbl
+    kIbl,
+    kMesh
 };
 
 typedef struct
 {
     union
     {
-        // Area light
+        // Area and mesh lights
         struct
         {
             int id;
             int shapeidx;
+            // Primitive index of area light, -1 for mesh lights
             int primidx;
-            int padding0;
+            // Offset of mesh primitive area distribution (relative to mesh distributions
+            // in light selection data)
+            int distribution;
         };
 
         // IBL
@@ -184,6 +241,43 @@ typedef struct
     bool ibl_mirror_x;
 } Light;
 
+// Light tree node (see Utils/light_tree.h)
+typedef struct
+{
+    // Spatial bounds of lights below the node
+    float3 pmin;
+    float3 pmax;
+    // Axis of emission normals cone
+    float3 axis;
+    // Total luminance of emitted power
+    float power;
+    // Cosines of emission normals spread and falloff angle beyond it
+    float cos_theta_o;
+    float cos_theta_e;
+    // Second child index for inner nodes (the first one follows the node)
+    int child;
+    // Light index for leaves, -1 for inner nodes
+    int light_idx;
+    // Parent node index, -1 for the root
+    int parent;
+    int padding[2];
+} LightTreeNode;
+
+// Header of light selection data, light tree lookup tables and
+// environment map distribution are stored at given int offsets after it
+enum LightDistributionHeader
+{
+    kLightDistributionNumInfinite = 0,
+    kLightDistributionNumTreeLights,
+    kLightDistributionInfiniteOffset,
+    kLightDistributionLeafOffset,
+    kLightDistributionShapeOffset,
+    kLightDistributionNumShapes,
+    kLightDistributionEnvMapOffset,
+    kLightDistributionMeshOffset,
+    kLightDistributionHeaderSize
+};
+
 typedef enum
     {
         kEmpty,
@@ -215,7 +309,12 @@ enum TextureFormat
     UNKNOWN,
     RGBA8,
     RGBA16,
-    RGBA32
+    RGBA32,
+    // Block compressed formats (4x4 texel blocks)
+    BC1,
+    BC4,
+    BC5,
+    BC3
 };
 
 /// Texture description
@@ -230,9 +329,20 @@ struct _Texture
     int dataoffset;
     // Format
     int fmt;
-    int extra;
+    // Number of mip levels (packed one after another starting from dataoffset)
+    int mip_count;
+    // Offset of the first tile in texture page table, -1 for fully resident textures
+    int pageoffset;
+    // Levels finer than this one are streamed by tiles, the rest starts at dataoffset
+    int resident_level;
 } Texture;
 
+// Streamed textures are split into tiles of this size (see Utils/texture_streamer.h)
+enum TextureTile
+{
+    kTextureTileSizeInBytes = 65536
+};
+
 // Hit data
 typedef struct _DifferentialGeometry
 {
@@ -255,7 +365,10 @@ typedef struct _DifferentialGeometry
     Material mat;
     float  area;
     int transfer_mode;
-    int padding[2];
+    // Ratio of UV space to world space triangle extents
+    float uv_density;
+    // Ray cone footprint in UV space (used for texture LOD selection)
+    float uv_footprint;
 } DifferentialGeometry;
 
 
@@ -433,6 +433,48 @@ float Distribution1D_GetPdfDiscreet(int d, GLOBAL int const* data)
     return pdf_data[d] / num_segments;
 }
 
+/// Sample 2D distribution
+/// Layout: width, height, marginal 1D distribution over rows, height conditional 1D distributions over columns
+float2 Distribution2D_Sample(float2 s, GLOBAL int const* data, float* pdf)
+{
+    int width = data[0];
+    int height = data[1];
+
+    GLOBAL int const* marginal = data + 2;
+
+    // Sample row first
+    float marginal_pdf = 0.f;
+    float v = Distribution1D_Sample(s.y, marginal, &marginal_pdf);
+    int row = clamp((int)(v * height), 0, height - 1);
+
+    // Then sample column within the row
+    GLOBAL int const* conditional = marginal + 2 * height + 2 + row * (2 * width + 2);
+    float conditional_pdf = 0.f;
+    float u = Distribution1D_Sample(s.x, conditional, &conditional_pdf);
+
+    *pdf = marginal_pdf * conditional_pdf;
+
+    return make_float2(u, v);
+}
+
+/// PDF of 2D distribution
+float Distribution2D_GetPdf(float2 uv, GLOBAL int const* data)
+{
+    int width = data[0];
+    int height = data[1];
+
+    int row = clamp((int)(uv.y * height), 0, height - 1);
+    int column = clamp((int)(uv.x * width), 0, width - 1);
+
+    GLOBAL int const* marginal = data + 2;
+    GLOBAL int const* conditional = marginal + 2 * height + 2 + row * (2 * width + 2);
+
+    GLOBAL float const* marginal_pdf = (GLOBAL float const*)&marginal[1] + height + 1;
+    GLOBAL float const* conditional_pdf = (GLOBAL float const*)&conditional[1] + width + 1;
+
+    return marginal_pdf[row] * conditional_pdf[column];
+}
+
 
 
 #endif // SAMPLING_CL
@@ -48,8 +48,10 @@ typedef struct
     int env_light_idx;
     // Number of emissive objects
     int num_lights;
-    // Light distribution 
+    // Light selection data and environment map distribution
     GLOBAL int const* restrict light_distribution;
+    // Light tree nodes
+    GLOBAL LightTreeNode const* restrict light_tree;
 } Scene;
 
 // Get triangle vertices given scene, shape index and prim index
@@ -257,6 +259,11 @@ void Scene_FillDifferentialGeometry(// Scene
     float3 dp2 = v1 - v2;
     float det = du1 * dv2 - dv1 * du2;
 
+    // UV to world space extents ratio, used to map ray cones to texture LOD
+    float world_area = length(cross(dp1, dp2));
+    diffgeo->uv_density = world_area > 0.f ? native_sqrt(fabs(det) / world_area) : 0.f;
+    diffgeo->uv_footprint = 0.f;
+
     if (0 && det != 0.f)
     {
         float invdet = 1.f / det;
@@ -277,6 +284,13 @@ void Scene_FillDifferentialGeometry(// Scene
 }
 
 
+// Project ray cone of a given width onto the surface and find its footprint in UV space
+INLINE void DifferentialGeometry_SetRayConeWidth(DifferentialGeometry* diffgeo, float width, float3 wi)
+{
+    float cos_theta = max(fabs(dot(diffgeo->ng, wi)), 0.01f);
+    diffgeo->uv_footprint = width * diffgeo->uv_density / cos_theta;
+}
+
 // Calculate tangent transform matrices inside differential geometry
 INLINE void DifferentialGeometry_CalculateTangentTransforms(DifferentialGeometry* diffgeo)
 {
@@ -294,21 +308,191 @@ INLINE void DifferentialGeometry_CalculateTangentTransforms(DifferentialGeometry
     diffgeo->tangent_to_world.m2.w = diffgeo->p.z;
 }
 
-#define POWER_SAMPLING
+#define LIGHT_TREE_ONE_MINUS_EPSILON 0x1.fffffep-1f
 
-// Sample light index
-INLINE int Scene_SampleLight(Scene const* scene, float sample, float* pdf)
+/// Check if the light is at infinity, such lights are selected outside of light tree
+INLINE bool Scene_IsInfiniteLight(Scene const* scene, int light_idx)
 {
-#ifndef POWER_SAMPLING
-    int num_lights = scene->num_lights;
-    int light_idx = clamp((int)(sample * num_lights), 0, num_lights - 1);
-    *pdf = 1.f / num_lights;
-    return light_idx;
-#else
-    int num_lights = scene->num_lights;
-    int light_idx = Distribution1D_SampleDiscrete(sample, scene->light_distribution, pdf);
-    return light_idx;
-#endif
+    int type = scene->lights[light_idx].type;
+    return type == kIbl || type == kDirectional;
+}
+
+/// Number of light selection strategies: every infinite light and the light tree
+INLINE int Scene_GetNumLightStrategies(Scene const* scene)
+{
+    GLOBAL int const* data = scene->light_distribution;
+    return data[kLightDistributionNumInfinite] + (data[kLightDistributionNumTreeLights] > 0 ? 1 : 0);
+}
+
+/// Probability of selecting a given infinite light
+INLINE float Scene_GetInfiniteLightPdf(Scene const* scene)
+{
+    int num_strategies = Scene_GetNumLightStrategies(scene);
+    return num_strategies > 0 ? 1.f / num_strategies : 0.f;
+}
+
+/// Estimate contribution of lights below the node to a point
+INLINE float LightTreeNode_GetImportance(GLOBAL LightTreeNode const* node, float3 p)
+{
+    float3 center = 0.5f * (node->pmin + node->pmax);
+    float3 d = p - center;
+    float dist2 = dot(d, d);
+    // Avoid singularity when the point is close to the lights
+    float3 ext = node->pmax - node->pmin;
+    float d2 = max(dist2, 0.25f * dot(ext, ext));
+
+    if (d2 <= 0.f)
+    {
+        return node->power;
+    }
+
+    // Cosine of the angle between emission axis and direction to the point
+    float cos_theta_w = dist2 > 0.f ? clamp(dot(node->axis, d) * native_rsqrt(dist2), -1.f, 1.f) : 1.f;
+    float sin_theta_w = sqrt(max(1.f - cos_theta_w * cos_theta_w, 0.f));
+
+    // Cosine of the angle bounds subtend from the point
+    float3 r = node->pmax - center;
+    float radius2 = dot(r, r);
+    float cos_theta_b = dist2 > radius2 ? sqrt(max(1.f - radius2 / dist2, 0.f)) : -1.f;
+    float sin_theta_b = sqrt(max(1.f - cos_theta_b * cos_theta_b, 0.f));
+
+    // cos(max(0, theta_w - theta_o))
+    float cos_theta_o = node->cos_theta_o;
+    float sin_theta_o = sqrt(max(1.f - cos_theta_o * cos_theta_o, 0.f));
+    float cos_theta_x = cos_theta_w > cos_theta_o ? 1.f : cos_theta_w * cos_theta_o + sin_theta_w * sin_theta_o;
+    float sin_theta_x = cos_theta_w > cos_theta_o ? 0.f : sin_theta_w * cos_theta_o - cos_theta_w * sin_theta_o;
+
+    // cos(max(0, theta_w - theta_o - theta_b))
+    float cos_theta_p = cos_theta_x > cos_theta_b ? 1.f : cos_theta_x * cos_theta_b + sin_theta_x * sin_theta_b;
+
+    if (cos_theta_p <= node->cos_theta_e)
+    {
+        return 0.f;
+    }
+
+    return node->power * cos_theta_p / d2;
+}
+
+/// Sample light index for a point: either one of infinite lights
+/// or a light from the light tree proportionally to its importance.
+/// Returns -1 if there are no lights which can contribute to the point.
+INLINE int Scene_SampleLight(Scene const* scene, float3 p, float sample, float* pdf)
+{
+    GLOBAL int const* data = scene->light_distribution;
+    int num_infinite = data[kLightDistributionNumInfinite];
+    int num_strategies = Scene_GetNumLightStrategies(scene);
+
+    *pdf = 0.f;
+
+    if (num_strategies == 0)
+    {
+        return -1;
+    }
+
+    int strategy = clamp((int)(sample * num_strategies), 0, num_strategies - 1);
+
+    if (strategy < num_infinite)
+    {
+        *pdf = 1.f / num_strategies;
+        return data[data[kLightDistributionInfiniteOffset] + strategy];
+    }
+
+    // Reuse the sample for tree traversal
+    sample = min(sample * num_strategies - strategy, LIGHT_TREE_ONE_MINUS_EPSILON);
+
+    GLOBAL LightTreeNode const* nodes = scene->light_tree;
+
+    if (LightTreeNode_GetImportance(nodes, p) == 0.f)
+    {
+        return -1;
+    }
+
+    int node_idx = 0;
+    float node_pdf = 1.f / num_strategies;
+
+    while (nodes[node_idx].light_idx == -1)
+    {
+        int first = node_idx + 1;
+        int second = nodes[node_idx].child;
+        float importance0 = LightTreeNode_GetImportance(nodes + first, p);
+        float importance1 = LightTreeNode_GetImportance(nodes + second, p);
+
+        if (importance0 == 0.f && importance1 == 0.f)
+        {
+            return -1;
+        }
+
+        float p0 = importance0 / (importance0 + importance1);
+
+        if (sample < p0)
+        {
+            node_idx = first;
+            sample = min(sample / p0, LIGHT_TREE_ONE_MINUS_EPSILON);
+            node_pdf *= p0;
+        }
+        else
+        {
+            node_idx = second;
+            sample = min((sample - p0) / (1.f - p0), LIGHT_TREE_ONE_MINUS_EPSILON);
+            node_pdf *= 1.f - p0;
+        }
+    }
+
+    *pdf = node_pdf;
+    return nodes[node_idx].light_idx;
+}
+
+/// Probability of Scene_SampleLight selecting a given light for a point
+INLINE float Scene_GetLightPdf(Scene const* scene, int light_idx, float3 p)
+{
+    if (Scene_IsInfiniteLight(scene, light_idx))
+    {
+        return Scene_GetInfiniteLightPdf(scene);
+    }
+
+    GLOBAL int const* data = scene->light_distribution;
+    int node_idx = data[data[kLightDistributionLeafOffset] + light_idx];
+
+    GLOBAL LightTreeNode const* nodes = scene->light_tree;
+
+    if (node_idx == -1 || LightTreeNode_GetImportance(nodes, p) == 0.f)
+    {
+        return 0.f;
+    }
+
+    float pdf = 1.f / Scene_GetNumLightStrategies(scene);
+
+    while (nodes[node_idx].parent != -1)
+    {
+        int parent = nodes[node_idx].parent;
+        float importance0 = LightTreeNode_GetImportance(nodes + parent + 1, p);
+        float importance1 = LightTreeNode_GetImportance(nodes + nodes[parent].child, p);
+        float importance = node_idx == parent + 1 ? importance0 : importance1;
+
+        if (importance == 0.f)
+        {
+            return 0.f;
+        }
+
+        pdf *= importance / (importance0 + importance1);
+        node_idx = parent;
+    }
+
+    return pdf;
+}
+
+/// Find area light of an emissive primitive, -1 if there is no such light
+INLINE int Scene_GetAreaLightIdx(Scene const* scene, int shape_idx, int prim_idx)
+{
+    GLOBAL int const* data = scene->light_distribution;
+
+    if (shape_idx < 0 || shape_idx >= data[kLightDistributionNumShapes])
+    {
+        return -1;
+    }
+
+    int offset = data[data[kLightDistributionShapeOffset] + shape_idx];
+    return offset == -1 ? -1 : data[offset + prim_idx];
 }
 
 #endif
@@ -28,21 +28,287 @@ THE SOFTWARE.
 
 
 /// To simplify a bit
-#define TEXTURE_ARG_LIST __global Texture const* textures, __global char const* texturedata
-#define TEXTURE_ARG_LIST_IDX(x) int x, __global Texture const* textures, __global char const* texturedata
-#define TEXTURE_ARGS textures, texturedata
-#define TEXTURE_ARGS_IDX(x) x, textures, texturedata
+/// texturepages holds offsets of streamed tiles in texturedata (-1 for missing ones),
+/// texturefeedback gets a bit set for every sampled tile (see Utils/texture_streamer.h)
+#define TEXTURE_ARG_LIST __global Texture const* textures, __global char const* texturedata, __global int const* texturepages, __global uint* texturefeedback
+#define TEXTURE_ARG_LIST_IDX(x) int x, __global Texture const* textures, __global char const* texturedata, __global int const* texturepages, __global uint* texturefeedback
+#define TEXTURE_ARGS textures, texturedata, texturepages, texturefeedback
+#define TEXTURE_ARGS_IDX(x) x, textures, texturedata, texturepages, texturefeedback
+
+/// Get size in bytes of a single mip level
+inline
+int Texture_GetLevelSize(int width, int height, int fmt)
+{
+    int num_blocks = ((width + 3) >> 2) * ((height + 3) >> 2);
 
-/// Sample 2D texture
+    switch (fmt)
+    {
+        case RGBA32: return width * height * 16;
+        case RGBA16: return width * height * 8;
+        case RGBA8: return width * height * 4;
+        case BC1: return num_blocks * 8;
+        case BC4: return num_blocks * 8;
+        case BC3:
+        case BC5: return num_blocks * 16;
+        default: return 0;
+    }
+}
+
+/// Decode RGB565 color
 inline
-float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
+float3 TextureData_DecodeRgb565(uint c)
+{
+    return make_float3((float)((c >> 11) & 31) / 31.f, (float)((c >> 5) & 63) / 63.f, (float)(c & 31) / 31.f);
+}
+
+/// Decode color of BC1 block (also used for BC3 color)
+inline
+float3 TextureData_DecodeBc1(uint2 block, int texel)
+{
+    uint c0 = block.x & 0xFFFF;
+    uint c1 = block.x >> 16;
+    uint idx = (block.y >> (2 * texel)) & 3;
+
+    float3 p0 = TextureData_DecodeRgb565(c0);
+    float3 p1 = TextureData_DecodeRgb565(c1);
+
+    if (idx == 0) return p0;
+    if (idx == 1) return p1;
+    if (c0 > c1) return (idx == 2) ? (2.f * p0 + p1) / 3.f : (p0 + 2.f * p1) / 3.f;
+    return (idx == 2) ? 0.5f * (p0 + p1) : make_float3(0.f, 0.f, 0.f);
+}
+
+/// Decode single channel value of BC4 block (also used for BC5 channels and BC3 alpha)
+inline
+float TextureData_DecodeBc4(ulong block, int texel)
+{
+    uint r0 = (uint)(block & 0xFF);
+    uint r1 = (uint)((block >> 8) & 0xFF);
+    uint idx = (uint)((block >> (16 + 3 * texel)) & 7);
+
+    if (idx == 0) return (float)r0 / 255.f;
+    if (idx == 1) return (float)r1 / 255.f;
+
+    if (r0 > r1)
+    {
+        return (float)((8 - idx) * r0 + (idx - 1) * r1) / (7.f * 255.f);
+    }
+
+    // Six value mode with explicit 0 and 1
+    if (idx == 6) return 0.f;
+    if (idx == 7) return 1.f;
+    return (float)((6 - idx) * r0 + (idx - 1) * r1) / (5.f * 255.f);
+}
+
+/// Fetch single texel of block compressed image
+inline
+float4 TextureData_FetchBlockTexel(__global char const* mydata, int fmt, int width, int x, int y)
+{
+    int block_idx = (y >> 2) * ((width + 3) >> 2) + (x >> 2);
+    int texel = (y & 3) * 4 + (x & 3);
+
+    switch (fmt)
+    {
+        case BC1:
+        {
+            float3 c = TextureData_DecodeBc1(((__global uint2 const*)mydata)[block_idx], texel);
+            return make_float4(c.x, c.y, c.z, 1.f);
+        }
+
+        case BC3:
+        {
+            // Alpha block followed by BC1 color block
+            __global ulong const* block = (__global ulong const*)mydata + 2 * block_idx;
+            float a = TextureData_DecodeBc4(block[0], texel);
+            float3 c = TextureData_DecodeBc1(*((__global uint2 const*)(block + 1)), texel);
+            return make_float4(c.x, c.y, c.z, a);
+        }
+
+        case BC4:
+        {
+            float v = TextureData_DecodeBc4(((__global ulong const*)mydata)[block_idx], texel);
+            return make_float4(v, v, v, 1.f);
+        }
+
+        case BC5:
+        {
+            // Two channel normal map, reconstruct z from unit length
+            ulong2 block = ((__global ulong2 const*)mydata)[block_idx];
+            float nx = TextureData_DecodeBc4(block.x, texel);
+            float ny = TextureData_DecodeBc4(block.y, texel);
+            float x2 = 2.f * nx - 1.f;
+            float y2 = 2.f * ny - 1.f;
+            float nz = native_sqrt(max(1.f - x2 * x2 - y2 * y2, 0.f));
+            return make_float4(nx, ny, 0.5f * nz + 0.5f, 1.f);
+        }
+
+        default:
+        {
+            return make_float4(0.f, 0.f, 0.f, 0.f);
+        }
+    }
+}
+
+/// Fetch single texel of an image in any supported format
+inline
+float4 TextureData_FetchTexel(__global char const* mydata, int fmt, int width, int x, int y)
+{
+    switch (fmt)
+    {
+        case RGBA32:
+        {
+            return *((__global float4 const*)mydata + width * y + x);
+        }
+
+        case RGBA16:
+        {
+            return vload_half4(width * y + x, (__global half const*)mydata);
+        }
+
+        case RGBA8:
+        {
+            uchar4 valu = *((__global uchar4 const*)mydata + width * y + x);
+            return make_float4((float)valu.x / 255.f, (float)valu.y / 255.f, (float)valu.z / 255.f, (float)valu.w / 255.f);
+        }
+
+        default:
+        {
+            return TextureData_FetchBlockTexel(mydata, fmt, width, x, y);
+        }
+    }
+}
+
+/// Get dimensions of streamed texture tile in texels, tiles take
+/// kTextureTileSizeInBytes (keep in sync with TextureStreamer::GetTileSize)
+inline
+int2 Texture_GetTileSize(int fmt)
+{
+    switch (fmt)
+    {
+        case RGBA32: return make_int2(64, 64);
+        case RGBA16: return make_int2(128, 64);
+        case RGBA8: return make_int2(128, 128);
+        case BC1: return make_int2(512, 256);
+        case BC4: return make_int2(512, 256);
+        case BC3:
+        case BC5: return make_int2(256, 256);
+        default: return make_int2(1, 1);
+    }
+}
+
+/// Single mip level: either an image in texture data or a grid of streamed tiles
+typedef struct
 {
+    // Level data (resident levels only)
+    __global char const* data;
+    int width;
+    int height;
+    int fmt;
+    // Offset of level tiles in page table, -1 for resident levels
+    int pages;
+    // Tile dimensions and number of tiles in a row
+    int2 tile_size;
+    int tiles_x;
+} TextureLevel;
+
+/// Find mip level of a texture
+inline
+TextureLevel Texture_GetLevel(int level, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    TextureLevel mip;
+    mip.width = textures[texidx].w;
+    mip.height = textures[texidx].h;
+    mip.fmt = textures[texidx].fmt;
+    mip.data = texturedata + textures[texidx].dataoffset;
+    mip.pages = textures[texidx].pageoffset;
+    mip.tile_size = Texture_GetTileSize(mip.fmt);
+
+    int resident_level = mip.pages >= 0 ? textures[texidx].resident_level : 0;
+
+    // Skip preceding mip levels: streamed ones take consecutive pages,
+    // resident ones are packed one after another
+    for (int i = 0; i < level; ++i)
+    {
+        if (i < resident_level)
+        {
+            mip.pages += ((mip.width + mip.tile_size.x - 1) / mip.tile_size.x) *
+                ((mip.height + mip.tile_size.y - 1) / mip.tile_size.y);
+        }
+        else
+        {
+            mip.data += Texture_GetLevelSize(mip.width, mip.height, mip.fmt);
+        }
+
+        mip.width = max(mip.width >> 1, 1);
+        mip.height = max(mip.height >> 1, 1);
+    }
+
+    mip.pages = level < resident_level ? mip.pages : -1;
+    mip.tiles_x = (mip.width + mip.tile_size.x - 1) / mip.tile_size.x;
+    return mip;
+}
+
+/// Fetch single texel of a mip level, tiles of streamed levels have to be resident
+inline
+float4 TextureLevel_FetchTexel(TextureLevel const* mip, int x, int y, TEXTURE_ARG_LIST)
+{
+    if (mip->pages < 0)
+    {
+        return TextureData_FetchTexel(mip->data, mip->fmt, mip->width, x, y);
+    }
+
+    int tile_x = x / mip->tile_size.x;
+    int tile_y = y / mip->tile_size.y;
+    __global char const* tiledata = texturedata + texturepages[mip->pages + tile_y * mip->tiles_x + tile_x];
+
+    return TextureData_FetchTexel(tiledata, mip->fmt, mip->tile_size.x,
+        x - tile_x * mip->tile_size.x, y - tile_y * mip->tile_size.y);
+}
+
+/// Check if tiles covering [x0, x1] x [y0, y1] texels are resident,
+/// if requested report them as sampled so the missing ones get streamed in
+inline
+bool TextureLevel_IsResident(TextureLevel const* mip, int x0, int y0, int x1, int y1, bool report, TEXTURE_ARG_LIST)
+{
+    if (mip->pages < 0)
+    {
+        return true;
+    }
+
+    bool resident = true;
+
+    for (int tile_y = y0 / mip->tile_size.y; tile_y <= y1 / mip->tile_size.y; ++tile_y)
+    {
+        for (int tile_x = x0 / mip->tile_size.x; tile_x <= x1 / mip->tile_size.x; ++tile_x)
+        {
+            int page = mip->pages + tile_y * mip->tiles_x + tile_x;
+            resident = resident && texturepages[page] >= 0;
+
+            // Most pages are already reported by other work items, skip atomics for them
+            uint bit = 1u << (page & 31);
+            if (report && !(texturefeedback[page >> 5] & bit))
+            {
+                atomic_or(texturefeedback + (page >> 5), bit);
+            }
+        }
+    }
+
+    return resident;
+}
+
+/// Sample resident mip level of 2D texture
+inline
+float4 Texture_Sample2DResident(float2 uv, int level, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    TextureLevel mip = Texture_GetLevel(level, TEXTURE_ARGS_IDX(texidx));
+
     // Get width and height
-    int width = textures[texidx].w;
-    int height = textures[texidx].h;
+    int width = mip.width;
+    int height = mip.height;
 
     // Find the origin of the data in the pool
-    __global char const* mydata = texturedata + textures[texidx].dataoffset;
+    __global char const* mydata = mip.data;
+    int fmt = mip.fmt;
 
     // Handle UV wrap
     // TODO: need UV mode support
@@ -65,7 +331,7 @@ float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
     float wx = uv.x * width - floor(uv.x * width);
     float wy = uv.y * height - floor(uv.y * height);
 
-    switch (textures[texidx].fmt)
+    switch (fmt)
     {
         case RGBA32:
         {
@@ -114,6 +380,21 @@ float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
             return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
         }
 
+        case BC1:
+        case BC3:
+        case BC4:
+        case BC5:
+        {
+            // Decode 4 values
+            float4 val00 = TextureData_FetchBlockTexel(mydata, fmt, width, x0, y0);
+            float4 val01 = TextureData_FetchBlockTexel(mydata, fmt, width, x1, y0);
+            float4 val10 = TextureData_FetchBlockTexel(mydata, fmt, width, x0, y1);
+            float4 val11 = TextureData_FetchBlockTexel(mydata, fmt, width, x1, y1);
+
+            // Filter and return the result
+            return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
+        }
+
         default:
         {
             return make_float4(0.f, 0.f, 0.f, 0.f);
@@ -121,6 +402,102 @@ float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
     }
 }
 
+/// Sample streamed mip level of 2D texture, while tiles are missing
+/// coarser levels are sampled instead
+inline
+float4 Texture_Sample2DStreamed(float2 uv, int level, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    int resident_level = textures[texidx].resident_level;
+
+    // Handle UV wrap and reverse Y (see Texture_Sample2DResident)
+    float2 st = uv - floor(uv);
+    st.y = 1.f - st.y;
+
+    for (int i = level; i < resident_level; ++i)
+    {
+        TextureLevel mip = Texture_GetLevel(i, TEXTURE_ARGS_IDX(texidx));
+
+        // Calculate integer coordinates
+        int x0 = clamp((int)floor(st.x * mip.width), 0, mip.width - 1);
+        int y0 = clamp((int)floor(st.y * mip.height), 0, mip.height - 1);
+
+        // Calculate samples for linear filtering
+        int x1 = clamp(x0 + 1, 0, mip.width - 1);
+        int y1 = clamp(y0 + 1, 0, mip.height - 1);
+
+        // Only tiles of requested level are streamed, coarser ones are a fallback
+        if (!TextureLevel_IsResident(&mip, x0, y0, x1, y1, i == level, TEXTURE_ARGS))
+        {
+            continue;
+        }
+
+        // Calculate weights for linear filtering
+        float wx = st.x * mip.width - floor(st.x * mip.width);
+        float wy = st.y * mip.height - floor(st.y * mip.height);
+
+        // Get 4 values
+        float4 val00 = TextureLevel_FetchTexel(&mip, x0, y0, TEXTURE_ARGS);
+        float4 val01 = TextureLevel_FetchTexel(&mip, x1, y0, TEXTURE_ARGS);
+        float4 val10 = TextureLevel_FetchTexel(&mip, x0, y1, TEXTURE_ARGS);
+        float4 val11 = TextureLevel_FetchTexel(&mip, x1, y1, TEXTURE_ARGS);
+
+        // Filter and return the result
+        return lerp(lerp(val00, val01, wx), lerp(val10, val11, wx), wy);
+    }
+
+    return Texture_Sample2DResident(uv, resident_level, TEXTURE_ARGS_IDX(texidx));
+}
+
+/// Sample specified mip level of 2D texture
+inline
+float4 Texture_Sample2DLevel(float2 uv, int level, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    if (textures[texidx].pageoffset >= 0 && level < textures[texidx].resident_level)
+    {
+        return Texture_Sample2DStreamed(uv, level, TEXTURE_ARGS_IDX(texidx));
+    }
+
+    return Texture_Sample2DResident(uv, level, TEXTURE_ARGS_IDX(texidx));
+}
+
+/// Sample base level of 2D texture
+inline
+float4 Texture_Sample2D(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    return Texture_Sample2DLevel(uv, 0, TEXTURE_ARGS_IDX(texidx));
+}
+
+/// Sample 2D texture blending two nearest mip levels for fractional LOD
+inline
+float4 Texture_Sample2DLod(float2 uv, float lod, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    int max_level = max(textures[texidx].mip_count - 1, 0);
+    lod = clamp(lod, 0.f, (float)max_level);
+
+    int level = (int)floor(lod);
+    float w = lod - (float)level;
+
+    float4 val0 = Texture_Sample2DLevel(uv, level, TEXTURE_ARGS_IDX(texidx));
+
+    if (w == 0.f || level == max_level)
+    {
+        return val0;
+    }
+
+    float4 val1 = Texture_Sample2DLevel(uv, level + 1, TEXTURE_ARGS_IDX(texidx));
+    return lerp(val0, val1, w);
+}
+
+/// Sample 2D texture choosing LOD from a footprint size in UV space
+inline
+float4 Texture_SampleFootprint(float2 uv, float footprint, TEXTURE_ARG_LIST_IDX(texidx))
+{
+    // Footprint size in base level texels
+    float texels = footprint * native_sqrt((float)textures[texidx].w * (float)textures[texidx].h);
+    float lod = texels > 1.f ? native_log2(texels) : 0.f;
+    return Texture_Sample2DLod(uv, lod, TEXTURE_ARGS_IDX(texidx));
+}
+
 /// Sample lattitue-longitude environment map using 3d vector
 inline
 float3 Texture_SampleEnvMap(float3 d, TEXTURE_ARG_LIST_IDX(texidx), bool mirror_x)
@@ -290,17 +667,60 @@ inline float3 TextureData_SampleNormalFromBump_float4(__global float4 const* myd
 	return n;
 }
 
+inline float3 TextureData_SampleNormalFromBump_block(__global char const* mydata, int fmt, int width, int height, int t0, int s0)
+{
+	int t0minus = clamp(t0 - 1, 0, height - 1);
+	int t0plus = clamp(t0 + 1, 0, height - 1);
+	int s0minus = clamp(s0 - 1, 0, width - 1);
+	int s0plus = clamp(s0 + 1, 0, width - 1);
+
+	const float tex00 = TextureData_FetchBlockTexel(mydata, fmt, width, s0minus, t0minus).x;
+	const float tex10 = TextureData_FetchBlockTexel(mydata, fmt, width, s0, t0minus).x;
+	const float tex20 = TextureData_FetchBlockTexel(mydata, fmt, width, s0plus, t0minus).x;
+
+	const float tex01 = TextureData_FetchBlockTexel(mydata, fmt, width, s0minus, t0).x;
+	const float tex21 = TextureData_FetchBlockTexel(mydata, fmt, width, s0plus, t0).x;
+
+	const float tex02 = TextureData_FetchBlockTexel(mydata, fmt, width, s0minus, t0plus).x;
+	const float tex12 = TextureData_FetchBlockTexel(mydata, fmt, width, s0, t0plus).x;
+	const float tex22 = TextureData_FetchBlockTexel(mydata, fmt, width, s0plus, t0plus).x;
+
+	const float Gx = tex00 - tex20 + 2.0f * tex01 - 2.0f * tex21 + tex02 - tex22;
+	const float Gy = tex00 + 2.0f * tex10 + tex20 - tex02 - 2.0f * tex12 - tex22;
+	const float3 n = make_float3(Gx, Gy, 1.f);
+
+	return n;
+}
+
+inline float3 TextureLevel_SampleNormalFromBump(TextureLevel const* mip, int t0, int s0, TEXTURE_ARG_LIST)
+{
+	int t0minus = clamp(t0 - 1, 0, mip->height - 1);
+	int t0plus = clamp(t0 + 1, 0, mip->height - 1);
+	int s0minus = clamp(s0 - 1, 0, mip->width - 1);
+	int s0plus = clamp(s0 + 1, 0, mip->width - 1);
+
+	const float tex00 = TextureLevel_FetchTexel(mip, s0minus, t0minus, TEXTURE_ARGS).x;
+	const float tex10 = TextureLevel_FetchTexel(mip, s0, t0minus, TEXTURE_ARGS).x;
+	const float tex20 = TextureLevel_FetchTexel(mip, s0plus, t0minus, TEXTURE_ARGS).x;
+
+	const float tex01 = TextureLevel_FetchTexel(mip, s0minus, t0, TEXTURE_ARGS).x;
+	const float tex21 = TextureLevel_FetchTexel(mip, s0plus, t0, TEXTURE_ARGS).x;
+
+	const float tex02 = TextureLevel_FetchTexel(mip, s0minus, t0plus, TEXTURE_ARGS).x;
+	const float tex12 = TextureLevel_FetchTexel(mip, s0, t0plus, TEXTURE_ARGS).x;
+	const float tex22 = TextureLevel_FetchTexel(mip, s0plus, t0plus, TEXTURE_ARGS).x;
+
+	const float Gx = tex00 - tex20 + 2.0f * tex01 - 2.0f * tex21 + tex02 - tex22;
+	const float Gy = tex00 + 2.0f * tex10 + tex20 - tex02 - 2.0f * tex12 - tex22;
+	const float3 n = make_float3(Gx, Gy, 1.f);
+
+	return n;
+}
+
 /// Sample 2D texture
 inline
 float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
 {
-    // Get width and height
-    int width = textures[texidx].w;
-    int height = textures[texidx].h;
-
-    // Find the origin of the data in the pool
-    __global char const* mydata = texturedata + textures[texidx].dataoffset;
-
     // Handle UV wrap
     // TODO: need UV mode support
     uv -= floor(uv);
@@ -310,6 +730,50 @@ float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
     // and our axis goes from down to top
     uv.y = 1.f - uv.y;
 
+    // Streamed textures use coarser levels while base level tiles are missing
+    int level = 0;
+
+    if (textures[texidx].pageoffset >= 0)
+    {
+        for (; level < textures[texidx].resident_level; ++level)
+        {
+            TextureLevel mip = Texture_GetLevel(level, TEXTURE_ARGS_IDX(texidx));
+
+            int s0 = clamp((int)floor(uv.x * mip.width), 0, mip.width - 1);
+            int t0 = clamp((int)floor(uv.y * mip.height), 0, mip.height - 1);
+            int s1 = clamp(s0 + 1, 0, mip.width - 1);
+            int t1 = clamp(t0 + 1, 0, mip.height - 1);
+
+            // Filter footprint includes neighbours of both samples
+            if (!TextureLevel_IsResident(&mip, max(s0 - 1, 0), max(t0 - 1, 0),
+                min(s1 + 1, mip.width - 1), min(t1 + 1, mip.height - 1), level == 0, TEXTURE_ARGS))
+            {
+                continue;
+            }
+
+            float wx = uv.x * mip.width - floor(uv.x * mip.width);
+            float wy = uv.y * mip.height - floor(uv.y * mip.height);
+
+            float3 n00 = TextureLevel_SampleNormalFromBump(&mip, t0, s0, TEXTURE_ARGS);
+            float3 n01 = TextureLevel_SampleNormalFromBump(&mip, t0, s1, TEXTURE_ARGS);
+            float3 n10 = TextureLevel_SampleNormalFromBump(&mip, t1, s0, TEXTURE_ARGS);
+            float3 n11 = TextureLevel_SampleNormalFromBump(&mip, t1, s1, TEXTURE_ARGS);
+
+            float3 n = lerp3(lerp3(n00, n01, wx), lerp3(n10, n11, wx), wy);
+
+            return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
+        }
+    }
+
+    TextureLevel mip = Texture_GetLevel(level, TEXTURE_ARGS_IDX(texidx));
+
+    // Get width and height
+    int width = mip.width;
+    int height = mip.height;
+
+    // Find the origin of the data in the pool
+    __global char const* mydata = mip.data;
+
     // Calculate integer coordinates
     int s0 = clamp((int)floor(uv.x * width), 0, width - 1);
     int t0 = clamp((int)floor(uv.y * height), 0, height - 1);
@@ -365,6 +829,23 @@ float3 Texture_SampleBump(float2 uv, TEXTURE_ARG_LIST_IDX(texidx))
 		return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
     }
 
+    case BC1:
+    case BC3:
+    case BC4:
+    case BC5:
+    {
+        int fmt = textures[texidx].fmt;
+
+		float3 n00 = TextureData_SampleNormalFromBump_block(mydata, fmt, width, height, t0, s0);
+		float3 n01 = TextureData_SampleNormalFromBump_block(mydata, fmt, width, height, t0, s1);
+		float3 n10 = TextureData_SampleNormalFromBump_block(mydata, fmt, width, height, t1, s0);
+		float3 n11 = TextureData_SampleNormalFromBump_block(mydata, fmt, width, height, t1, s1);
+
+		float3 n = lerp3(lerp3(n00, n01, wx), lerp3(n10, n11, wx), wy);
+
+		return 0.5f * normalize(n) + make_float3(0.5f, 0.5f, 0.5f);
+    }
+
     default:
     {
         return make_float3(0.f, 0.f, 0.f);
@@ -237,5 +237,18 @@ void add_float4(__global float4* ptr, float4 value)
     *ptr += value;
 }
 
+// Several views of view_size can be packed into an output row by row,
+// returns the index of the view containing the pixel and pixel position within the view
+int GetViewPixel(int idx, int output_width, int2 view_size, int2* view_pixel)
+{
+    int x = idx % output_width;
+    int y = idx / output_width;
+
+    view_pixel->x = x % view_size.x;
+    view_pixel->y = y % view_size.y;
+
+    return (y / view_size.y) * (output_width / view_size.x) + x / view_size.x;
+}
+
 
 #endif // UTILS_CL
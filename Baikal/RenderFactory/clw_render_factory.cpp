@@ -18,6 +18,7 @@ namespace Baikal
     : m_context(context)
     , m_cache_path(cache_path)
     , m_program_manager(cache_path)
+    , m_memory_manager(std::make_shared<CLMemoryManager>(context))
     , m_intersector(
         CreateFromOpenClContext(
             context, 
@@ -41,7 +42,14 @@ namespace Baikal
                     new MonteCarloRenderer(
                         m_context, 
                         &m_program_manager,
-                        std::make_unique<PathTracingEstimator>(m_context, m_intersector, &m_program_manager)
+                        std::make_unique<PathTracingEstimator>(m_context, m_intersector, &m_program_manager, m_memory_manager)
+                        ));
+            case RendererType::kAdaptivePathTracer:
+                return std::unique_ptr<Renderer>(
+                    new AdaptiveRenderer(
+                        m_context,
+                        &m_program_manager,
+                        std::make_unique<PathTracingEstimator>(m_context, m_intersector, &m_program_manager, m_memory_manager)
                         ));
             default:
                 throw std::runtime_error("Renderer not supported");
@@ -77,6 +85,6 @@ namespace Baikal
 
     std::unique_ptr<SceneController<ClwScene>> ClwRenderFactory::CreateSceneController() const
     {
-        return std::make_unique<ClwSceneController>(m_context, m_intersector.get(), &m_program_manager);
+        return std::make_unique<ClwSceneController>(m_context, m_intersector, &m_program_manager, m_memory_manager);
     }
 }
@@ -28,6 +28,7 @@
 
 #include "SceneGraph/clwscene.h"
 #include "Utils/cl_program_manager.h"
+#include "Utils/cl_memory_manager.h"
 
 #include <memory>
 #include <string>
@@ -60,10 +61,15 @@ namespace Baikal
         std::unique_ptr<SceneController<ClwScene>>
             CreateSceneController() const override;
 
+        // Memory manager shared by entities created with the factory
+        CLMemoryManager* GetMemoryManager() const { return m_memory_manager.get(); }
+
     private:
         CLWContext m_context;
         std::string m_cache_path;
         CLProgramManager m_program_manager;
+        // Entities release their buffers on destruction, so they share the manager
+        std::shared_ptr<CLMemoryManager> m_memory_manager;
 
         using RadeonRaysInstanceDelete = decltype(RadeonRays::IntersectionApi::Delete);
 
@@ -45,7 +45,9 @@ namespace Baikal
     public:
         enum class RendererType
         {
-            kUnidirectionalPathTracer
+            kUnidirectionalPathTracer,
+            // Path tracer which stops sampling converged pixels
+            kAdaptivePathTracer
         };
         
         enum class PostEffectType
@@ -1,17 +1,28 @@
 #include "adaptive_renderer.h"
 #include "Output/clwoutput.h"
 
+#include <algorithm>
+
 namespace Baikal
 {
+    // Test pixels convergence every kConvergenceCheckInterval samples
+    std::uint32_t constexpr kConvergenceCheckInterval = 8u;
     
     AdaptiveRenderer::AdaptiveRenderer(
         CLWContext context,
         const CLProgramManager *program_manager,
         std::unique_ptr<Estimator> estimator
-    ) : MonteCarloRenderer(context, program_manager, std::move(estimator))
+    ) : MonteCarloRenderer(context, program_manager, std::move(estimator), true)
+        , m_pp(context, GetFullBuildOpts().c_str())
+        , m_num_active_pixels(0)
+        , m_num_active_pending(false)
+        , m_noise_threshold(0.01f)
+        , m_min_samples(32u)
     {
         auto samples_buffer_size = GetEstimator().GetWorkBufferSize();
         m_sample_buffer = GetContext().CreateBuffer<float3>(samples_buffer_size, CL_MEM_READ_WRITE);
+        m_num_active_buffer = GetContext().CreateBuffer<int>(1, CL_MEM_READ_WRITE);
+        m_sample_count_buffer = GetContext().CreateBuffer<int>(1, CL_MEM_READ_WRITE);
     }
 
     void AdaptiveRenderer::Clear(RadeonRays::float3 const& val,
@@ -19,7 +30,27 @@ namespace Baikal
     {
         MonteCarloRenderer::Clear(val, output);
 
-        GetContext().FillBuffer(0u, m_variance_buffer, 0.f, m_variance_buffer.GetElementCount()).Wait();
+        // Drop the count of the previous render
+        GetNumActivePixels();
+
+        if (m_moments_buffer.GetElementCount() > 0)
+        {
+            GetContext().FillBuffer(0u, m_moments_buffer, 0.f, m_moments_buffer.GetElementCount()).Wait();
+            GetContext().FillBuffer(0u, m_converged_buffer, 0, m_converged_buffer.GetElementCount()).Wait();
+        }
+
+        m_num_active_pixels = static_cast<int>(m_converged_buffer.GetElementCount());
+    }
+
+    std::uint32_t AdaptiveRenderer::GetNumActivePixels() const
+    {
+        if (m_num_active_pending)
+        {
+            m_num_active_event.Wait();
+            m_num_active_pending = false;
+        }
+
+        return static_cast<std::uint32_t>(std::max(m_num_active_pixels, 0));
     }
 
     // Render single tile
@@ -29,27 +60,34 @@ namespace Baikal
     {
         // Number of rays to generate
         auto output = static_cast<ClwOutput*>(GetOutput(OutputType::kColor));
-        auto width = output->width();
-        auto height = output->height();
-
-        GetContext().FillBuffer(0u, m_sample_buffer, float3(), m_sample_buffer.GetElementCount()).Wait();
 
-        if (output)
+        // Skip sampling once every pixel is known to be converged
+        if (output && (m_num_active_pending || m_num_active_pixels > 0))
         {
+            auto width = output->width();
+            auto height = output->height();
             auto num_rays = tile_size.x * tile_size.y;
             auto output_size = int2(width, height);
 
-            if (m_sample_counter < 32)
+            // Bring in tiles requested by previous launches
+            StreamTextures(scene);
+
+            GetContext().FillBuffer(0u, m_sample_buffer, float3(), m_sample_buffer.GetElementCount());
+
+            if (m_sample_counter < m_min_samples)
             {
                 MonteCarloRenderer::GenerateTileDomain(output_size, tile_origin, tile_size);
             }
             else
             {
-                GenerateTileDomain(output_size, tile_origin, tile_size);
+                GenerateActiveTileDomain(output_size, tile_origin, tile_size);
             }
 
             GeneratePrimaryRays(scene, *output, tile_size);
 
+            // Estimate overwrites ray count with the number of paths alive after the last bounce
+            GetContext().CopyBuffer(0u, m_estimator->GetRayCountBuffer(), m_sample_count_buffer, 0, 0, 1);
+
             m_estimator->Estimate(
                 scene,
                 num_rays,
@@ -61,20 +99,15 @@ namespace Baikal
 
             AccumulateSamples(m_sample_buffer, output->data(), num_rays);
 
-            if (m_sample_counter > 0 && m_sample_counter % 32 == 0)
-            {
-                auto variance_buffer_size = m_variance_buffer.GetElementCount();
-                EstimateVariance(output->data(), output->width(), output->height());
-
-                std::vector<float> probabilities(variance_buffer_size);
-                GetContext().ReadBuffer(0u, m_variance_buffer, &probabilities[0], variance_buffer_size).Wait();
-
-                m_tile_distribution.Set(&probabilities[0],
-                                        (std::uint32_t)variance_buffer_size);
+            // Test convergence once the last tile of the frame is done
+            bool last_tile = (tile_origin.x + tile_size.x == output_size.x) &&
+                (tile_origin.y + tile_size.y == output_size.y);
 
-                UpdateTileDistribution();
+            if (last_tile && m_sample_counter + 1 >= m_min_samples &&
+                (m_sample_counter + 1) % kConvergenceCheckInterval == 0)
+            {
+                UpdateConvergence(output->data(), width * height);
             }
-
         }
 
         // Check if we have other outputs, than color
@@ -97,93 +130,77 @@ namespace Baikal
         int argc = 0;
         accumulate_kernel.SetArg(argc++, sample_buffer);
         accumulate_kernel.SetArg(argc++, accumulation_buffer);
+        accumulate_kernel.SetArg(argc++, m_moments_buffer);
         accumulate_kernel.SetArg(argc++, m_estimator->GetOutputIndexBuffer());
-        accumulate_kernel.SetArg(argc++, num_elements);
+        accumulate_kernel.SetArg(argc++, m_sample_count_buffer);
 
         {
-            GetContext().Launch1D(0, ((num_elements + 63) / 64) * 64, 64, accumulate_kernel);
+            GetProfiler().Record("AccumulateSingleSample", KernelProfile::kNoBounce,
+                GetContext().Launch1D(0, ((num_elements + 63) / 64) * 64, 64, accumulate_kernel));
         }
     }
 
-    void AdaptiveRenderer::EstimateVariance(
+    void AdaptiveRenderer::UpdateConvergence(
         CLWBuffer<float3> accumulation_buffer,
-        std::uint32_t width,
-        std::uint32_t height
+        std::uint32_t num_pixels
     )
     {
-        auto estimate_kernel = GetKernel("EstimateVariance");
+        // Previous count is read into the same location
+        GetNumActivePixels();
+
+        GetContext().FillBuffer(0u, m_num_active_buffer, 0, 1);
+
+        auto update_kernel = GetKernel("UpdateConvergence");
+        auto mask_output = static_cast<ClwOutput*>(GetOutput(OutputType::kConvergence));
 
         int argc = 0;
-        estimate_kernel.SetArg(argc++, accumulation_buffer);
-        estimate_kernel.SetArg(argc++, m_variance_buffer);
-        estimate_kernel.SetArg(argc++, width);
-        estimate_kernel.SetArg(argc++, height);
+        update_kernel.SetArg(argc++, accumulation_buffer);
+        update_kernel.SetArg(argc++, m_moments_buffer);
+        update_kernel.SetArg(argc++, num_pixels);
+        update_kernel.SetArg(argc++, m_min_samples);
+        update_kernel.SetArg(argc++, m_noise_threshold);
+        update_kernel.SetArg(argc++, m_converged_buffer);
+        update_kernel.SetArg(argc++, m_num_active_buffer);
+        update_kernel.SetArg(argc++, mask_output ? 1 : 0);
+        // Mask output is optional, accumulation buffer is simply a dummy one
+        update_kernel.SetArg(argc++, mask_output ? mask_output->data() : accumulation_buffer);
 
-        // Run shading kernel
         {
-            size_t gs[] = { static_cast<size_t>((width + 15) / 16 * 16), static_cast<size_t>((width + 15) / 16 * 16) };
-            size_t ls[] = { 16, 16 };
-
-            GetContext().Launch2D(0, gs, ls, estimate_kernel);
+            GetProfiler().Record("UpdateConvergence", KernelProfile::kNoBounce,
+                GetContext().Launch1D(0, ((num_pixels + 63) / 64) * 64, 64, update_kernel));
         }
+
+        // Read the count back without stalling, it is waited for on the next test
+        m_num_active_event = GetContext().ReadBuffer(0, m_num_active_buffer, &m_num_active_pixels, 1);
+        m_num_active_pending = true;
     }
 
     void AdaptiveRenderer::SetOutput(OutputType type, Output* output)
     {
-        // Intermediate variance buffer
         MonteCarloRenderer::SetOutput(type, output);
 
-        if (output)
+        // Per-pixel convergence data
+        if (type == OutputType::kColor && output)
         {
-            auto width = output->width();
-            auto height = output->height();
-
-            auto variance_buffer_size = ((width + 15) / 16) * ((height + 15) / 16);
-            m_variance_buffer = GetContext().CreateBuffer<float>(variance_buffer_size, CL_MEM_READ_WRITE);
-
-            std::vector<float> probabilities(variance_buffer_size, 1.f);
-            m_tile_distribution.Set(&probabilities[0], variance_buffer_size);
-
-            UpdateTileDistribution();
-        }
-    }
-
-    void AdaptiveRenderer::UpdateTileDistribution()
-    {
-        // Write distribution data
-        int* distribution_ptr = nullptr;
-        auto num_tiles = m_variance_buffer.GetElementCount();
-        auto required_size = (1 + 1 + num_tiles + num_tiles);
-        if (m_tile_distribution_buffer.GetElementCount() < required_size)
-        {
-            m_tile_distribution_buffer = GetContext().CreateBuffer<int>(required_size, CL_MEM_READ_ONLY);
-        }
+            GetNumActivePixels();
 
-        GetContext().MapBuffer(0, m_tile_distribution_buffer, CL_MAP_WRITE, &distribution_ptr).Wait();
-        auto current = distribution_ptr;
+            auto num_pixels = output->width() * output->height();
 
-        // Write the number of segments first
-        *current++ = (int)m_tile_distribution.m_num_segments;
-
-        // Then write num_segments  + 1 CDF values
-        auto values = reinterpret_cast<float*>(current);
-        for (auto i = 0u; i < m_tile_distribution.m_num_segments + 1; ++i)
-        {
-            values[i] = m_tile_distribution.m_cdf[i];
-        }
-
-        // Then write num_segments PDF values
-        values += m_tile_distribution.m_num_segments + 1;
+            if (m_converged_buffer.GetElementCount() != num_pixels)
+            {
+                m_moments_buffer = GetContext().CreateBuffer<float>(num_pixels, CL_MEM_READ_WRITE);
+                m_converged_buffer = GetContext().CreateBuffer<int>(num_pixels, CL_MEM_READ_WRITE);
+                m_tile_indices = GetContext().CreateBuffer<int>(num_pixels, CL_MEM_READ_WRITE);
+                m_tile_predicate = GetContext().CreateBuffer<int>(num_pixels, CL_MEM_READ_WRITE);
+            }
 
-        for (auto i = 0u; i < m_tile_distribution.m_num_segments; ++i)
-        {
-            values[i] = m_tile_distribution.m_func_values[i] / m_tile_distribution.m_func_sum;
+            GetContext().FillBuffer(0u, m_moments_buffer, 0.f, num_pixels).Wait();
+            GetContext().FillBuffer(0u, m_converged_buffer, 0, num_pixels).Wait();
+            m_num_active_pixels = static_cast<int>(num_pixels);
         }
-
-        GetContext().UnmapBuffer(0, m_tile_distribution_buffer, distribution_ptr);
     }
 
-    void AdaptiveRenderer::GenerateTileDomain(
+    void AdaptiveRenderer::GenerateActiveTileDomain(
         int2 const& output_size,
         int2 const& tile_origin,
         int2 const& tile_size
@@ -200,20 +217,30 @@ namespace Baikal
         generate_kernel.SetArg(argc++, tile_origin.y);
         generate_kernel.SetArg(argc++, tile_size.x);
         generate_kernel.SetArg(argc++, tile_size.y);
-        generate_kernel.SetArg(argc++, rand_uint());
-        generate_kernel.SetArg(argc++, m_sample_counter);
-        generate_kernel.SetArg(argc++, m_estimator->GetRandomBuffer(Estimator::RandomBufferType::kRandomSeed));
-        generate_kernel.SetArg(argc++, m_estimator->GetRandomBuffer(Estimator::RandomBufferType::kSobolLUT));
-        generate_kernel.SetArg(argc++, m_tile_distribution_buffer);
-        generate_kernel.SetArg(argc++, m_estimator->GetOutputIndexBuffer());
-        generate_kernel.SetArg(argc++, m_estimator->GetRayCountBuffer());
+        generate_kernel.SetArg(argc++, m_converged_buffer);
+        generate_kernel.SetArg(argc++, m_tile_indices);
+        generate_kernel.SetArg(argc++, m_tile_predicate);
 
         // Run shading kernel
         {
             size_t gs[] = { static_cast<size_t>((tile_size.x + 15) / 16 * 16), static_cast<size_t>((tile_size.y + 15) / 16 * 16) };
             size_t ls[] = { 16, 16 };
 
-            GetContext().Launch2D(0, gs, ls, generate_kernel);
+            GetProfiler().Record("GenerateTileDomain_Adaptive", KernelProfile::kNoBounce, GetContext().Launch2D(0, gs, ls, generate_kernel));
+        }
+
+        // Compact active pixels into the output indices, ray count is written on device
+        {
+            KernelProfiler::Scope scope(&GetProfiler(), "CompactActivePixels", KernelProfile::kNoBounce);
+
+            m_pp.Compact(
+                0,
+                m_tile_predicate,
+                m_tile_indices,
+                m_estimator->GetOutputIndexBuffer(),
+                static_cast<std::uint32_t>(tile_size.x * tile_size.y),
+                m_estimator->GetRayCountBuffer()
+            );
         }
     }
     
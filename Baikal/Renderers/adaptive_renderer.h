@@ -24,7 +24,6 @@ THE SOFTWARE.
 #include "math/int2.h"
 #include "monte_carlo_renderer.h"
 #include "CLW.h"
-#include "Utils/distribution1d.h"
 
 #include <memory>
 
@@ -35,7 +34,9 @@ namespace Baikal
     class ClwOutput;
     struct ClwScene;
     
-    ///< Renderer implementation
+    ///< Renderer implementation which stops sampling pixels once their noise
+    ///< estimate falls below the threshold. Converged pixels are compacted out
+    ///< of the ray generation domain on device.
     class AdaptiveRenderer : public MonteCarloRenderer
     {
     public:
@@ -59,8 +60,20 @@ namespace Baikal
         // Set output
         void SetOutput(OutputType type, Output* output) override;
 
-        // DEBUG STUFF
-        CLWBuffer<float> GetVarianceBuffer() const { return m_variance_buffer; }
+        // Relative standard error of the pixel mean luminance below which
+        // the pixel is considered converged
+        void SetNoiseThreshold(float threshold) { m_noise_threshold = threshold; }
+        float GetNoiseThreshold() const { return m_noise_threshold; }
+
+        // Number of samples every pixel gets before convergence is tested
+        void SetMinSamples(std::uint32_t min_samples) { m_min_samples = min_samples; }
+        std::uint32_t GetMinSamples() const { return m_min_samples; }
+
+        // Number of pixels still being sampled (as of the last convergence test)
+        std::uint32_t GetNumActivePixels() const;
+        // True when every pixel is below the noise threshold
+        bool IsConverged() const { return GetNumActivePixels() == 0; }
+
     protected:
         void AccumulateSamples(
             CLWBuffer<float3> sample_buffer,
@@ -68,25 +81,37 @@ namespace Baikal
             std::uint32_t num_elements
         );
 
-        void EstimateVariance(
+        void UpdateConvergence(
             CLWBuffer<float3> accumulation_buffer,
-            std::uint32_t width,
-            std::uint32_t height
+            std::uint32_t num_pixels
         );
 
-        void GenerateTileDomain(
+        // Generate domain of the tile pixels which are not converged yet
+        void GenerateActiveTileDomain(
             int2 const& output_size,
             int2 const& tile_origin,
             int2 const& tile_size
-        ) override;
-
-        void UpdateTileDistribution();
+        );
 
     private:
-        mutable CLWBuffer<float> m_variance_buffer;
+        CLWParallelPrimitives m_pp;
         mutable CLWBuffer<float3> m_sample_buffer;
-        CLWBuffer<int> m_tile_distribution_buffer;
-        Distribution1D m_tile_distribution;
+        // Per-pixel sum of squared sample luminance
+        mutable CLWBuffer<float> m_moments_buffer;
+        // Per-pixel convergence flags
+        mutable CLWBuffer<int> m_converged_buffer;
+        // Tile domain and its active pixels predicate before compaction
+        CLWBuffer<int> m_tile_indices;
+        CLWBuffer<int> m_tile_predicate;
+        // Number of samples in the tile, estimator reuses its ray count buffer for compaction
+        CLWBuffer<int> m_sample_count_buffer;
+        // Number of active pixels counted by the last convergence test
+        mutable CLWBuffer<int> m_num_active_buffer;
+        mutable int m_num_active_pixels;
+        mutable bool m_num_active_pending;
+        mutable CLWEvent m_num_active_event;
+        float m_noise_threshold;
+        std::uint32_t m_min_samples;
     };
     
 }
@@ -30,6 +30,7 @@
 #include <cstdint>
 #include <random>
 #include <algorithm>
+#include <vector>
 
 #include "math/int2.h"
 
@@ -45,6 +46,8 @@ namespace Baikal
 
     int constexpr kTileSizeX = 1920;
     int constexpr kTileSizeY = 1080;
+    // Max number of times the first sample is redone to bring in texture tiles it sampled
+    std::uint32_t constexpr kMaxStreamingPrepasses = 8u;
 
     // Constructor
     MonteCarloRenderer::MonteCarloRenderer(
@@ -52,20 +55,38 @@ namespace Baikal
         const CLProgramManager *program_manager,
         std::unique_ptr<Estimator> estimator
     )
+        : MonteCarloRenderer(context, program_manager, std::move(estimator), false)
+    {
+    }
+
+    MonteCarloRenderer::MonteCarloRenderer(
+        CLWContext context,
+        const CLProgramManager *program_manager,
+        std::unique_ptr<Estimator> estimator,
+        bool atomic_update
+    )
 #ifdef BAIKAL_EMBED_KERNELS
         : Baikal::ClwClass(context, program_manager, "monte_carlo_renderer", g_monte_carlo_renderer_opencl, g_monte_carlo_renderer_opencl_headers, "")
 #else
         : Baikal::ClwClass(context, program_manager, "../Baikal/Kernels/CL/monte_carlo_renderer.cl", "")
 #endif
-        , m_estimator(std::move(estimator))
         , m_sample_counter(0u)
+        , m_estimator(std::move(estimator))
 #ifdef BAIKAL_EMBED_KERNELS
         , m_uberv2_kernels(context, program_manager, "fill_aovs_uberv2", g_fill_aovs_uberv2_opencl, g_fill_aovs_uberv2_opencl_headers, "")
 #else
         , m_uberv2_kernels(context, program_manager, "../Baikal/Kernels/CL/fill_aovs_uberv2.cl", "")
 #endif
+        , m_view_size(0, 0)
+        , m_profiler(context)
     {
+        // Programs compile in background while the scene is loaded, pixel center
+        // ray generation is compiled once an AOV needing it is set
+        PrecompileKernels();
+        m_estimator->Precompile(atomic_update);
+
         m_estimator->SetWorkBufferSize(kTileSizeX * kTileSizeY);
+        m_estimator->SetProfiler(&m_profiler);
     }
 
     void MonteCarloRenderer::Clear(RadeonRays::float3 const& val, Output& output) const
@@ -84,6 +105,40 @@ namespace Baikal
 
         auto output_size = int2(output->width(), output->height());
 
+        RenderFrame(scene, [&]() { RenderTiles(scene, output_size); });
+    }
+
+    void MonteCarloRenderer::RenderFrame(ClwScene const& scene, std::function<void()> const& render_tiles)
+    {
+        {
+            KernelProfiler::Scope frame_scope(&m_profiler, "Frame", KernelProfile::kNoBounce);
+
+            render_tiles();
+
+            // Texels of missing tiles come from coarser levels, so samples taken before the tiles
+            // are resident would stay in the accumulated result. The first sample is used as a
+            // feedback pass instead and redone while it requests new tiles.
+            if (m_sample_counter == 0u)
+            {
+                for (auto i = 0u; i < kMaxStreamingPrepasses && StreamTextures(scene); ++i)
+                {
+                    ClearOutputs();
+                    render_tiles();
+                }
+            }
+        }
+
+        ++m_sample_counter;
+
+        // Collect finished timings without waiting so pending events don't pile up
+        if (m_profiler.IsEnabled())
+        {
+            m_profiler.Resolve(false);
+        }
+    }
+
+    void MonteCarloRenderer::RenderTiles(ClwScene const& scene, int2 const& output_size)
+    {
         if (output_size.x > kTileSizeX || output_size.y > kTileSizeY)
         {
             auto num_tiles_x = (output_size.x + kTileSizeX - 1) / kTileSizeX;
@@ -103,13 +158,80 @@ namespace Baikal
         {
             RenderTile(scene, int2(), output_size);
         }
+    }
 
-        ++m_sample_counter;
+    void MonteCarloRenderer::ClearOutputs()
+    {
+        for (std::size_t i = 0; i < static_cast<std::size_t>(OutputType::kMax); ++i)
+        {
+            auto output = GetOutput(static_cast<OutputType>(i));
+
+            if (output)
+            {
+                Clear(float3(0.f, 0.f, 0.f, 0.f), *output);
+            }
+        }
+    }
+
+    bool MonteCarloRenderer::StreamTextures(ClwScene const& scene)
+    {
+        auto& streamer = scene.texture_streamer;
+        auto num_pages = streamer.GetNumPages();
+
+        if (num_pages == 0)
+        {
+            return false;
+        }
+
+        // Collect tiles sampled by previous launches and start over
+        auto num_feedback_words = (num_pages + 31) / 32;
+        std::vector<std::uint32_t> feedback(num_feedback_words);
+        GetContext().ReadBuffer(0, scene.texturefeedback, feedback.data(), num_feedback_words).Wait();
+        GetContext().FillBuffer(0, scene.texturefeedback, 0u, num_feedback_words);
+
+        std::vector<TextureStreamer::TileUpload> uploads;
+        streamer.Update(feedback.data(), uploads);
+
+        if (uploads.empty())
+        {
+            return false;
+        }
+
+        // Upload tiles into their pool slots, staging data has to stay alive until
+        // page table write below completes (the queue is in-order)
+        std::vector<char> tiles(uploads.size() * TextureStreamer::kTileSizeInBytes);
+
+        for (std::size_t i = 0; i < uploads.size(); ++i)
+        {
+            auto tile = tiles.data() + i * TextureStreamer::kTileSizeInBytes;
+            streamer.ReadTile(uploads[i].page, tile);
+
+            GetContext().WriteBuffer(0, scene.texturedata, tile,
+                scene.texture_pool_offset + uploads[i].slot * TextureStreamer::kTileSizeInBytes,
+                TextureStreamer::kTileSizeInBytes);
+        }
+
+        // Evicted tiles have their slots reused by uploads, so the whole page table is rewritten
+        std::vector<int> pages(num_pages);
+
+        for (std::size_t page = 0; page < num_pages; ++page)
+        {
+            auto slot = streamer.GetSlot(page);
+            pages[page] = slot == TextureStreamer::kInvalidSlot ? -1 :
+                static_cast<int>(scene.texture_pool_offset + slot * TextureStreamer::kTileSizeInBytes);
+        }
+
+        GetContext().WriteBuffer(0, scene.texturepages, pages.data(), num_pages).Wait();
+
+        return true;
     }
 
     // Render the scene into the output
     void MonteCarloRenderer::RenderTile(ClwScene const& scene, int2 const& tile_origin, int2 const& tile_size)
     {
+        // Bring in tiles requested by previous launches
+        StreamTextures(scene);
+
         // Number of rays to generate
         auto color_output = static_cast<ClwOutput*>(GetOutput(OutputType::kColor));
 
@@ -117,6 +239,7 @@ namespace Baikal
         {
             auto num_rays = tile_size.x * tile_size.y;
             auto output_size = int2(color_output->width(), color_output->height());
+            auto view_size = GetViewSize(scene, *color_output);
 
             GenerateTileDomain(output_size, tile_origin, tile_size);
             GeneratePrimaryRays(scene, *color_output, tile_size);
@@ -132,7 +255,7 @@ namespace Baikal
                     false,
                     std::bind(&MonteCarloRenderer::HandleMissedRays, this, std::ref(scene), output_size.x, output_size.y,
                         std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4,
-                        std::placeholders::_5, std::placeholders::_6));
+                        std::placeholders::_5, std::placeholders::_6, view_size));
             }
             else
                 m_estimator->Estimate(
@@ -192,7 +315,7 @@ namespace Baikal
             size_t gs[] = { static_cast<size_t>((tile_size.x + 15) / 16 * 16), static_cast<size_t>((tile_size.y + 15) / 16 * 16) };
             size_t ls[] = { 16, 16 };
 
-            GetContext().Launch2D(0, gs, ls, generate_kernel);
+            m_profiler.Record("GenerateTileDomain", KernelProfile::kNoBounce, GetContext().Launch2D(0, gs, ls, generate_kernel));
         }
     }
 
@@ -247,6 +370,12 @@ namespace Baikal
             }
         }
 
+        // Single pass AOVs are filled from rays through pixel centers (see FillAOVs)
+        if (output && type > OutputType::kMaxMultiPassOutput)
+        {
+            PrecompileKernels("-D BAIKAL_GENERATE_SAMPLE_AT_PIXEL_CENTER ");
+        }
+
         Renderer::SetOutput(type, output);
     }
 
@@ -256,6 +385,7 @@ namespace Baikal
         // Find first non-zero AOV to get buffer dimensions
         auto output = FindFirstNonZeroOutput(false);
         auto output_size = int2(output->width(), output->height());
+        auto view_size = GetViewSize(scene, *output);
 
         // Generate tile domain
         GenerateTileDomain(output_size, tile_origin, tile_size);
@@ -284,10 +414,14 @@ namespace Baikal
         fill_kernel.SetArg(argc++, scene.material_attributes);
         fill_kernel.SetArg(argc++, scene.textures);
         fill_kernel.SetArg(argc++, scene.texturedata);
+        fill_kernel.SetArg(argc++, scene.texturepages);
+        fill_kernel.SetArg(argc++, scene.texturefeedback);
         fill_kernel.SetArg(argc++, scene.envmapidx);
         fill_kernel.SetArg(argc++, scene.background_idx);
         fill_kernel.SetArg(argc++, output_size.x);
         fill_kernel.SetArg(argc++, output_size.y);
+        fill_kernel.SetArg(argc++, view_size.x);
+        fill_kernel.SetArg(argc++, view_size.y);
         fill_kernel.SetArg(argc++, scene.lights);
         fill_kernel.SetArg(argc++, scene.num_lights);
         fill_kernel.SetArg(argc++, scene.camera);
@@ -315,7 +449,7 @@ namespace Baikal
         // Run AOV kernel
         {
             int globalsize = tile_size.x * tile_size.y;
-            GetContext().Launch1D(0, ((globalsize + 63) / 64) * 64, 64, fill_kernel);
+            m_profiler.Record("FillAOVsUberV2", KernelProfile::kNoBounce, GetContext().Launch1D(0, ((globalsize + 63) / 64) * 64, 64, fill_kernel));
         }
     }
     
@@ -345,11 +479,15 @@ namespace Baikal
         auto kernel_name = GetCameraKernelName(scene.camera_type);
         auto genkernel = GetKernel(kernel_name, generate_at_pixel_center ? "-D BAIKAL_GENERATE_SAMPLE_AT_PIXEL_CENTER " : "");
 
+        auto view_size = GetViewSize(scene, output);
+
         // Set kernel parameters
         int argc = 0;
         genkernel.SetArg(argc++, scene.camera);
         genkernel.SetArg(argc++, output.width());
         genkernel.SetArg(argc++, output.height());
+        genkernel.SetArg(argc++, view_size.x);
+        genkernel.SetArg(argc++, view_size.y);
         genkernel.SetArg(argc++, m_estimator->GetOutputIndexBuffer());
         genkernel.SetArg(argc++, m_estimator->GetRayCountBuffer());
         genkernel.SetArg(argc++, (int)rand_uint());
@@ -360,7 +498,7 @@ namespace Baikal
 
         {
             int globalsize = tile_size.x * tile_size.y;
-            GetContext().Launch1D(0, ((globalsize + 63) / 64) * 64, 64, genkernel);
+            m_profiler.Record(kernel_name.c_str(), KernelProfile::kNoBounce, GetContext().Launch1D(0, ((globalsize + 63) / 64) * 64, 64, genkernel));
         }
     }
 
@@ -374,6 +512,11 @@ namespace Baikal
         return GetKernel("AccumulateData");
     }
 
+    CLWKernel MonteCarloRenderer::GetAccumulateRegionKernel()
+    {
+        return GetKernel("AccumulateDataRegion");
+    }
+
     void MonteCarloRenderer::SetRandomSeed(std::uint32_t seed)
     {
         m_estimator->SetRandomSeed(seed);
@@ -397,9 +540,58 @@ namespace Baikal
         m_estimator->SetMaxBounces(max_bounces);
     }
 
+    void MonteCarloRenderer::SetMaterialSorting(bool enable)
+    {
+        m_estimator->SetMaterialSorting(enable);
+    }
+
+    void MonteCarloRenderer::SetRussianRouletteDepth(std::uint32_t depth)
+    {
+        m_estimator->SetRussianRouletteDepth(depth);
+    }
+
+    void MonteCarloRenderer::SetRussianRouletteThreshold(float threshold)
+    {
+        m_estimator->SetRussianRouletteThreshold(threshold);
+    }
+
+    void MonteCarloRenderer::SetViewSize(int2 const& view_size)
+    {
+        m_view_size = view_size;
+    }
+
+    void MonteCarloRenderer::SetProfilingEnabled(bool enabled)
+    {
+        m_profiler.SetEnabled(enabled);
+    }
+
+    int2 MonteCarloRenderer::GetViewSize(ClwScene const& scene, Output const& output) const
+    {
+        auto output_size = int2(output.width(), output.height());
+
+        if (m_view_size.x <= 0 || m_view_size.y <= 0)
+        {
+            return output_size;
+        }
+
+        if (output_size.x % m_view_size.x != 0 || output_size.y % m_view_size.y != 0)
+        {
+            throw std::runtime_error("MonteCarloRenderer: output size should be a multiple of the view size");
+        }
+
+        auto num_views = (output_size.x / m_view_size.x) * (output_size.y / m_view_size.y);
+        if (num_views > scene.num_cameras)
+        {
+            throw std::runtime_error("MonteCarloRenderer: not enough view cameras for the output");
+        }
+
+        return m_view_size;
+    }
+
     void MonteCarloRenderer::HandleMissedRays(const ClwScene &scene , uint32_t w, uint32_t h,
         CLWBuffer<ray> rays, CLWBuffer<Intersection> intersections, CLWBuffer<int> pixel_indices,
-        CLWBuffer<int> output_indices, std::size_t size, CLWBuffer<RadeonRays::float3> output)
+        CLWBuffer<int> output_indices, std::size_t size, CLWBuffer<RadeonRays::float3> output,
+        int2 const& view_size)
     {
         // Fetch kernel
         auto misskernel = GetKernel("ShadeBackgroundImage") ;
@@ -414,12 +606,16 @@ namespace Baikal
         misskernel.SetArg(argc++, scene.background_idx);
         misskernel.SetArg(argc++, w);
         misskernel.SetArg(argc++, h);
+        misskernel.SetArg(argc++, view_size.x);
+        misskernel.SetArg(argc++, view_size.y);
         misskernel.SetArg(argc++, scene.textures);
         misskernel.SetArg(argc++, scene.texturedata);
+        misskernel.SetArg(argc++, scene.texturepages);
+        misskernel.SetArg(argc++, scene.texturefeedback);
         misskernel.SetArg(argc++, output);
 
         {
-            GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel);
+            m_profiler.Record("ShadeBackgroundImage", 0, GetContext().Launch1D(0, ((size + 63) / 64) * 64, 64, misskernel));
         }
     }
     
@@ -28,9 +28,11 @@ THE SOFTWARE.
 #include "Controllers/clw_scene_controller.h"
 #include "Utils/clw_class.h"
 #include "Estimators/estimator.h"
+#include "Utils/kernel_profiler.h"
 
 #include "CLW.h"
 
+#include <functional>
 #include <memory>
 
 
@@ -65,6 +67,13 @@ namespace Baikal
                         RadeonRays::int2 const& tile_origin,
                         RadeonRays::int2 const& tile_size) override;
 
+        // Render a frame whose tiles are rendered by render_tiles (RenderTile calls
+        // made by the caller, e.g. to split the frame between devices). Does the
+        // per-frame work of Render: the first sample is redone while it requests new
+        // texture tiles, then the sample counter is advanced. Devices sharing a frame
+        // call it for every frame (with no tiles if they got none) to stay in sync.
+        virtual void RenderFrame(ClwScene const& scene, std::function<void()> const& render_tiles);
+
         // Set output
         void SetOutput(OutputType type, Output* output) override;
 
@@ -74,13 +83,42 @@ namespace Baikal
         CLWKernel GetCopyKernel();
         // Add function
         CLWKernel GetAccumulateKernel();
+        // Add function writing into a range of the destination
+        CLWKernel GetAccumulateRegionKernel();
         // Run render benchmark
         void Benchmark(ClwScene const& scene, Estimator::RayTracingStats& stats);
 
         // Set max number of light bounces
         void SetMaxBounces(std::uint32_t max_bounces);
+
+        // Sort surface hits by material before shading
+        void SetMaterialSorting(bool enable);
+
+        // Russian roulette parameters (see Estimator::SetRussianRouletteDepth)
+        void SetRussianRouletteDepth(std::uint32_t depth);
+        void SetRussianRouletteThreshold(float threshold);
+
+        // Pack several views into the outputs: views of view_size are laid out
+        // row by row and each one is rendered with its own camera (Scene1::SetViewCameras),
+        // so a single estimator launch covers all of them. Zero size renders a single view.
+        void SetViewSize(RadeonRays::int2 const& view_size);
+
+        // Record GPU time of every launch made by the renderer and its estimator,
+        // throws if the context queue was created without profiling support
+        void SetProfilingEnabled(bool enabled);
+        // Recorded timings, aggregated per kernel and bounce
+        KernelProfiler& GetProfiler() { return m_profiler; }
         
     protected:
+        // Renderers updating outputs atomically (see Estimator::Estimate) precompile that
+        // estimator program permutation instead
+        MonteCarloRenderer(
+            CLWContext context,
+            const CLProgramManager *program_manager,
+            std::unique_ptr<Estimator> estimator,
+            bool atomic_update
+        );
+
         void GeneratePrimaryRays(
             ClwScene const& scene,
             Output const& output,
@@ -102,20 +140,38 @@ namespace Baikal
 
         Estimator& GetEstimator() { return *m_estimator;  }
 
+        // Render all tiles of the output
+        void RenderTiles(ClwScene const& scene, int2 const& output_size);
+
+        // Clear every output set (to zero)
+        void ClearOutputs();
+
+        // Upload texture tiles sampled by previous launches and update page table,
+        // returns true if any tile was uploaded
+        bool StreamTextures(ClwScene const& scene);
+
+        // Size of a single view in the output, checks the scene has a camera per view
+        int2 GetViewSize(ClwScene const& scene, Output const& output) const;
+
         // Find non-zero AOV
         Output* FindFirstNonZeroOutput(bool include_multipass = true, bool include_singlepass = true) const;
 
+        // Number of samples accumulated in the outputs since the last Clear
+        mutable std::uint32_t m_sample_counter;
+
         // Handler for missed rays used when scene have background override with plain image
         void HandleMissedRays(const ClwScene &scene, uint32_t w, uint32_t h,
             CLWBuffer<ray> rays, CLWBuffer<Intersection> intersections, CLWBuffer<int> pixel_indices,
-            CLWBuffer<int> output_indices, std::size_t size, CLWBuffer<RadeonRays::float3> output);
+            CLWBuffer<int> output_indices, std::size_t size, CLWBuffer<RadeonRays::float3> output,
+            int2 const& view_size);
 
     public:
         std::unique_ptr<Estimator> m_estimator;
-        mutable std::uint32_t m_sample_counter;
 
     private:
         ClwClass m_uberv2_kernels;
+        int2 m_view_size;
+        KernelProfiler m_profiler;
     };
 
 }
@@ -56,6 +56,8 @@ namespace Baikal
             kColor = 0,
             kOpacity,
             kVisibility,
+            // Converged pixels mask (AdaptiveRenderer only)
+            kConvergence,
             kMaxMultiPassOutput,
             // Single-pass outputs that will
             // be rendered in AOV kernel
@@ -1,154 +1,284 @@
 #include "collector.h"
-#include "SceneGraph/clwscene.h"
 #include "SceneGraph/iterator.h"
 #include <vector>
 #include <cassert>
-#include <unordered_map>
+#include <atomic>
+#include <stdexcept>
 
 namespace Baikal
 {
-    struct IdCompare
+    namespace
     {
-        bool operator() (const SceneObject::Ptr& lhs, const SceneObject::Ptr& rhs) const
+        std::uint32_t const kEmptySlot = 0xFFFFFFFFu;
+
+        // Versions are unique across collectors, so bundles can be validated by version only
+        std::atomic<std::uint64_t> g_next_version(1u);
+
+        inline std::uint64_t NextVersion()
         {
-            return lhs->GetId() < rhs->GetId();
+            return g_next_version++;
         }
-    };
-    using ItemMap = std::unordered_map<uint32_t, int>;
-    using ItemSet = std::set<SceneObject::Ptr, IdCompare>;
-    
+
+        inline std::size_t HashPointer(SceneObject const* ptr)
+        {
+            // Fibonacci hashing of the pointer (low bits are zero due to alignment)
+            auto value = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(ptr));
+            return static_cast<std::size_t>((value * 0x9E3779B97F4A7C15ull) >> 32);
+        }
+    }
+
+    using ItemArray = std::vector<SceneObject::Ptr>;
+
     class BundleImpl : public Bundle
     {
     public:
-        BundleImpl(ItemMap const& map, ItemSet const& set)
-        : m_map(map)
-        , m_set(set)
+        BundleImpl(std::uint64_t version, ItemArray const& items)
+        : m_version(version)
+        , m_items(items)
         {
         }
-        
-        ItemMap m_map;
-        ItemSet m_set;
+
+        std::uint64_t m_version;
+        ItemArray m_items;
     };
-    
+
     struct Collector::CollectorImpl
     {
-        ItemMap m_map;
-        ItemSet m_set;
+        // Collected objects, position in the array is an object index
+        ItemArray m_items;
+        // Collection pass each object has been collected last time
+        std::vector<std::uint32_t> m_passes;
+        // Open addressing table (linear probing) of object indices, size is a power of 2
+        std::vector<std::uint32_t> m_table;
+        // Current collection pass
+        std::uint32_t m_pass = 0;
+        // Changes each time objects or their indices change
+        std::uint64_t m_version = NextVersion();
+
+        // Returns table slot of the object or empty slot where it should be inserted
+        std::size_t FindSlot(SceneObject const* ptr) const
+        {
+            auto mask = m_table.size() - 1;
+            auto slot = HashPointer(ptr) & mask;
+
+            while (m_table[slot] != kEmptySlot && m_items[m_table[slot]].get() != ptr)
+            {
+                slot = (slot + 1) & mask;
+            }
+
+            return slot;
+        }
+
+        void Rehash(std::size_t capacity)
+        {
+            m_table.assign(capacity, kEmptySlot);
+
+            for (std::uint32_t i = 0; i < m_items.size(); ++i)
+            {
+                m_table[FindSlot(m_items[i].get())] = i;
+            }
+        }
+
+        // Removes table slot keeping probe sequences intact (backward shift deletion)
+        void EraseSlot(std::size_t slot)
+        {
+            auto mask = m_table.size() - 1;
+            auto hole = slot;
+            auto next = slot;
+
+            for (;;)
+            {
+                next = (next + 1) & mask;
+
+                if (m_table[next] == kEmptySlot)
+                {
+                    break;
+                }
+
+                auto home = HashPointer(m_items[m_table[next]].get()) & mask;
+
+                // Move the entry into the hole if its home slot is not within (hole, next]
+                bool in_range = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+
+                if (!in_range)
+                {
+                    m_table[hole] = m_table[next];
+                    hole = next;
+                }
+            }
+
+            m_table[hole] = kEmptySlot;
+        }
+
+        // Removes object at index, the last object takes its place
+        void Remove(std::uint32_t index)
+        {
+            EraseSlot(FindSlot(m_items[index].get()));
+
+            auto last = static_cast<std::uint32_t>(m_items.size() - 1);
+
+            if (index != last)
+            {
+                m_table[FindSlot(m_items[last].get())] = index;
+                m_items[index] = std::move(m_items[last]);
+                m_passes[index] = m_passes[last];
+            }
+
+            m_items.pop_back();
+            m_passes.pop_back();
+        }
     };
-    
+
     Collector::Collector()
     : m_impl (new CollectorImpl)
     {
+        m_impl->Rehash(16u);
     }
-    
+
     Collector::~Collector() = default;
-    
+
     void Collector::Clear()
     {
-        m_impl->m_map.clear();
-        m_impl->m_set.clear();
+        m_impl->m_items.clear();
+        m_impl->m_passes.clear();
+        m_impl->Rehash(16u);
+        m_impl->m_version = NextVersion();
+    }
+
+    void Collector::StartCollection()
+    {
+        ++m_impl->m_pass;
     }
-    
+
     std::unique_ptr<Iterator> Collector::CreateIterator() const
     {
         return std::unique_ptr<Iterator>(
-            new IteratorImpl<ItemSet::const_iterator>(m_impl->m_set.cbegin(),
-                                                      m_impl->m_set.cend()));
+            new IteratorImpl<ItemArray::const_iterator>(m_impl->m_items.cbegin(),
+                                                        m_impl->m_items.cend()));
     }
-    
+
     void Collector::Collect(Iterator& iter, ExpandFunc expand_func)
     {
         for(;iter.IsValid(); iter.Next())
         {
             // Expand current item
-            auto cur_items = expand_func(iter.Item());
-            
-            // Insert items
-            m_impl->m_set.insert(cur_items.cbegin(), cur_items.cend());
+            expand_func(iter.Item(), *this);
         }
     }
 
-    void Collector::Collect(std::shared_ptr < Baikal::SceneObject > object)
+    bool Collector::Collect(SceneObject::Ptr const& object)
     {
-        m_impl->m_set.insert(object);
+        assert(object);
+
+        auto slot = m_impl->FindSlot(object.get());
+        auto index = m_impl->m_table[slot];
+
+        if (index != kEmptySlot)
+        {
+            if (m_impl->m_passes[index] == m_impl->m_pass)
+            {
+                return false;
+            }
+
+            m_impl->m_passes[index] = m_impl->m_pass;
+            return true;
+        }
+
+        // Keep load factor below 1/2
+        if ((m_impl->m_items.size() + 1) * 2 > m_impl->m_table.size())
+        {
+            m_impl->Rehash(m_impl->m_table.size() * 2);
+            slot = m_impl->FindSlot(object.get());
+        }
+
+        m_impl->m_table[slot] = static_cast<std::uint32_t>(m_impl->m_items.size());
+        m_impl->m_items.push_back(object);
+        m_impl->m_passes.push_back(m_impl->m_pass);
+        m_impl->m_version = NextVersion();
+        return true;
     }
 
     void Collector::Commit()
     {
-        m_impl->m_map.clear();
-        
-        int idx = 0;
-        for (auto& i : m_impl->m_set)
+        bool removed = false;
+
+        // Walk backwards so objects moved into holes are always already checked
+        for (auto i = static_cast<std::uint32_t>(m_impl->m_items.size()); i-- > 0;)
         {
-            m_impl->m_map[i->GetId()] = idx++;
+            if (m_impl->m_passes[i] != m_impl->m_pass)
+            {
+                m_impl->Remove(i);
+                removed = true;
+            }
+        }
+
+        if (removed)
+        {
+            m_impl->m_version = NextVersion();
         }
     }
-    
+
     void Collector::Finalize(FinalizeFunc finalize_func)
     {
-        for (auto& i : m_impl->m_set)
+        for (auto& i : m_impl->m_items)
         {
             finalize_func(i);
         }
     }
-    
+
     bool Collector::NeedsUpdate(Bundle const* bundle, ChangedFunc changed_func) const
     {
         auto bundle_impl = static_cast<BundleImpl const*>(bundle);
-        
+
         // Check if:
-        // 0) bundle and our map sizes match.
-        // 1) All the objects collector has are in the bundle.
+        // 0) bundle and our array sizes match.
+        // 1) All the objects collector has are in the bundle at the same indices.
         // 2) They have not changed.
-        if (bundle_impl->m_set.size() != m_impl->m_set.size())
+        if (bundle_impl->m_items.size() != m_impl->m_items.size())
         {
             return true;
         }
-        
-        for (auto& i : m_impl->m_set)
+
+        // Same version means the same objects at the same indices,
+        // otherwise the collection might still be equal (e.g. after a pass over other scene)
+        if (bundle_impl->m_version != m_impl->m_version &&
+            bundle_impl->m_items != m_impl->m_items)
+        {
+            // Case 1: we have an object which is not serialized as a part of bundle.
+            return true;
+        }
+
+        for (auto& i : m_impl->m_items)
         {
             if (changed_func(i))
             {
                 // Case 2: we have the object which is changed.
                 return true;
             }
-            
-            auto iter = bundle_impl->m_set.find(i);
-            
-            if (iter == bundle_impl->m_set.cend())
-            {
-                // Case 1: we have an object which is not serialized as a part of bundle.
-                return true;
-            }
-
-            // Here we know that bundle_impl->m_map[i] == m_impl->m_map[i]
-            // since it is defined by set traversal order.
         }
-        
+
         return false;
     }
-    
+
     std::size_t Collector::GetNumItems() const
     {
-        return m_impl->m_set.size();
+        return m_impl->m_items.size();
     }
-    
+
     Bundle* Collector::CreateBundle() const
     {
-        return new BundleImpl { m_impl->m_map, m_impl->m_set };
+        return new BundleImpl { m_impl->m_version, m_impl->m_items };
     }
-    
+
     std::uint32_t Collector::GetItemIndex(SceneObject::Ptr item) const
     {
-        auto iter = m_impl->m_map.find(item->GetId());
-        
-        if (iter == m_impl->m_map.cend())
+        auto index = m_impl->m_table[m_impl->FindSlot(item.get())];
+
+        if (index == kEmptySlot)
         {
             throw std::runtime_error("No such item in the collector");
         }
-        
-        return iter->second;
+
+        return index;
     }
-    
-    
 }
@@ -28,8 +28,6 @@
  */
 #pragma once
 #include <memory>
-#include <map>
-#include <set>
 #include <functional>
 
 #include "../scene_object.h"
@@ -56,11 +54,18 @@ namespace Baikal
 
      Collector iterates over collection of objects collecting objects and their dependecies into random access bundle.
      The engine uses collectors in order to resolve material-texture or shape-material dependecies for GPU serialization.
+
+     Objects are kept in a flat array indexed through an open addressing hash table, so collecting does not allocate
+     per object. Collector is meant to be reused between scene compilations: StartCollection begins a new pass,
+     objects which were not collected again are removed on Commit. New objects are appended to the array and
+     removal moves the last object into the freed slot, so only objects moved into freed slots change their
+     indices. Index changes bump collection version, so bundles created earlier need an update.
      */
     class Collector
     {
     public:
-        using ExpandFunc = std::function<std::set<SceneObject::Ptr>(SceneObject::Ptr)>;
+        // Expand function collects dependencies of an item into the collector
+        using ExpandFunc = std::function<void(SceneObject::Ptr const& item, Collector& collector)>;
         using ChangedFunc = std::function<bool(SceneObject::Ptr)>;
         using FinalizeFunc = std::function<void(SceneObject::Ptr)>;
 
@@ -71,16 +76,16 @@ namespace Baikal
 
         // Clear collector state (CreateIterator returns invalid iterator if the collector is empty)
         void Clear();
+        // Start new collection pass keeping current objects
+        void StartCollection();
         // Create an iterator of objects
         std::unique_ptr<Iterator> CreateIterator() const;
         // Collect objects and their dependencies
         void Collect(Iterator& iter, ExpandFunc expand_func);
-        // Adds single object to collection
-        void Collect(std::shared_ptr<Baikal::SceneObject> object);
-        // Commit collected objects
+        // Adds single object to collection, returns false if it has been already collected during current pass
+        bool Collect(SceneObject::Ptr const& object);
+        // Commit collected objects (drops objects not collected during current pass)
         void Commit();
-        // Commit collected objects with order based on object id.
-        //void CommitOrderedById();
         // Given a budnle check if all collected objects are in the bundle and do not require update
         bool NeedsUpdate(Bundle const* bundle, ChangedFunc cahnged_func) const;
         // Get number of objects in the collection
@@ -105,5 +110,3 @@ namespace Baikal
     {
     }
 }
-
-
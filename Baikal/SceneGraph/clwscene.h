@@ -5,6 +5,10 @@
 #include "SceneGraph/scene1.h"
 #include "radeon_rays.h"
 #include "SceneGraph/Collector/collector.h"
+#include "Utils/range_allocator.h"
+#include "Utils/texture_streamer.h"
+
+#include <unordered_map>
 
 
 namespace Baikal
@@ -24,6 +28,31 @@ namespace Baikal
     {
         #include "Kernels/CL/payload.cl"
 
+        // Placement of a mesh inside shared geometry buffers
+        struct MeshSlot
+        {
+            // Range in vertex, normal and UV buffers
+            std::size_t vertex_offset;
+            std::size_t vertex_capacity;
+            // Range in index buffer
+            std::size_t index_offset;
+            std::size_t index_capacity;
+            // Version of mesh geometry uploaded into the slot
+            std::uint32_t geometry_version;
+        };
+
+        // Intersection API shape created for a scene shape
+        struct IntersectorShape
+        {
+            RadeonRays::Shape* shape;
+            // Base mesh shape for instances, nullptr for meshes
+            RadeonRays::Shape* base_shape;
+            // Version of mesh geometry the shape was created from
+            std::uint32_t geometry_version;
+            // Visible shapes are attached to the intersection API
+            bool visible;
+        };
+
         CLWBuffer<RadeonRays::float3> vertices;
         CLWBuffer<RadeonRays::float3> normals;
         CLWBuffer<RadeonRays::float2> uvs;
@@ -37,9 +66,14 @@ namespace Baikal
         CLWBuffer<Volume> volumes;
         CLWBuffer<Texture> textures;
         CLWBuffer<char> texturedata;
+        // Streamed tile offsets in texture data (-1 for missing tiles)
+        CLWBuffer<int> texturepages;
+        // One bit per page set by kernels for sampled tiles
+        CLWBuffer<std::uint32_t> texturefeedback;
 
         CLWBuffer<Camera> camera;
         CLWBuffer<int> light_distributions;
+        CLWBuffer<LightTreeNode> light_tree;
         CLWBuffer<InputMapData> input_map_data;
 
         std::unique_ptr<Bundle> material_bundle;
@@ -53,8 +87,23 @@ namespace Baikal
         int envmapidx;
         int background_idx;
         int camera_volume_index;
+        // Number of cameras in camera buffer (one per view)
+        int num_cameras;
         CameraType camera_type;
 
+        // Mesh id -> slot in geometry buffers
+        std::unordered_map<std::uint32_t, MeshSlot> mesh_slots;
+        // Sub-allocators for vertex (shared by vertices, normals and UVs) and index buffers
+        RangeAllocator vertex_allocator;
+        RangeAllocator index_allocator;
+
+        // Tile residency of streamed textures, updated by renderers between launches
+        mutable TextureStreamer texture_streamer;
+        // Offset of tile pool in texture data
+        std::size_t texture_pool_offset;
+
+        // Shape id -> intersection API shape
+        std::unordered_map<std::uint32_t, IntersectorShape> intersector_shapes;
         std::vector<RadeonRays::Shape*> isect_shapes;
         std::vector<RadeonRays::Shape*> visible_shapes;
     };
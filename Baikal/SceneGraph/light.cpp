@@ -10,6 +10,11 @@ namespace Baikal
     {
     }
 
+    MeshLight::MeshLight(Shape::Ptr shape)
+        : m_shape(shape)
+    {
+    }
+
     RadeonRays::float3 Light::GetPosition() const
     {
         return m_p;
@@ -80,6 +85,11 @@ namespace Baikal
         return m_shape;
     }
 
+    Shape::Ptr MeshLight::GetShape() const
+    {
+        return m_shape;
+    }
+
     ImageBasedLight::ImageBasedLight()
         : m_texture(nullptr)
         , m_reflection_texture(nullptr)
@@ -258,6 +268,31 @@ namespace Baikal
         float area = 0.5f * std::sqrt(cross(v2 - v0, v1 - v0).sqnorm());
         return PI * GetEmittedRadiance() * area;
     }
+
+    float MeshLight::GetArea() const
+    {
+        auto mesh = std::static_pointer_cast<Mesh>(m_shape);
+        auto transform = mesh->GetTransform();
+        auto indices = mesh->GetIndices();
+        auto vertices = mesh->GetVertices();
+
+        float area = 0.f;
+        for (std::size_t i = 0; i + 2 < mesh->GetNumIndices(); i += 3)
+        {
+            auto v0 = transform * vertices[indices[i]];
+            auto v1 = transform * vertices[indices[i + 1]];
+            auto v2 = transform * vertices[indices[i + 2]];
+
+            area += 0.5f * std::sqrt(cross(v2 - v0, v1 - v0).sqnorm());
+        }
+
+        return area;
+    }
+
+    RadeonRays::float3 MeshLight::GetPower(Scene1 const& scene) const
+    {
+        return PI * GetEmittedRadiance() * GetArea();
+    }
     
     namespace {
         struct PointLightConcrete : public PointLight {
@@ -272,6 +307,10 @@ namespace Baikal
             AreaLightConcrete(Shape::Ptr shape, std::size_t idx) :
             AreaLight(shape, idx) {}
         };
+        struct MeshLightConcrete: public MeshLight {
+            MeshLightConcrete(Shape::Ptr shape) :
+            MeshLight(shape) {}
+        };
     }
     
     PointLight::Ptr PointLight::Create() {
@@ -293,4 +332,8 @@ namespace Baikal
     AreaLight::Ptr AreaLight::Create(Shape::Ptr shape, std::size_t idx) {
         return std::make_shared<AreaLightConcrete>(shape, idx);
     }
+    
+    MeshLight::Ptr MeshLight::Create(Shape::Ptr shape) {
+        return std::make_shared<MeshLightConcrete>(shape);
+    }
 }
@@ -245,4 +245,31 @@ namespace Baikal
         // Parent primitive index
         std::size_t m_prim_idx;
     };
+
+    /**
+     \brief Emissive mesh light.
+
+     Represents all primitives of an emissive mesh as a single light,
+     primitives are sampled proportionally to their area.
+     */
+    class MeshLight: public Light
+    {
+    public:
+        using Ptr = std::shared_ptr<MeshLight>;
+        static Ptr Create(Shape::Ptr shape);
+
+        // Get parent shape
+        Shape::Ptr GetShape() const;
+        // Get world space area of the shape
+        float GetArea() const;
+
+        RadeonRays::float3 GetPower(Scene1 const& scene) const override;
+
+    protected:
+        MeshLight(Shape::Ptr shape);
+
+    private:
+        // Parent shape
+        Shape::Ptr m_shape;
+    };
 }
@@ -4,6 +4,7 @@
 #include "iterator.h"
 
 #include <vector>
+#include <algorithm>
 #include <list>
 #include <cassert>
 #include <set>
@@ -21,6 +22,7 @@ namespace Baikal
         ShapeList m_shapes;
         LightList m_lights;
         Camera::Ptr m_camera;
+        std::vector<Camera::Ptr> m_view_cameras;
         Baikal::Texture::Ptr m_background_texture;
         EnvironmentOverride m_environment_override;
 
@@ -63,6 +65,19 @@ namespace Baikal
         return m_impl->m_camera;
     }
 
+    void Scene1::SetViewCameras(std::vector<Camera::Ptr> const& cameras)
+    {
+        assert(std::find(cameras.cbegin(), cameras.cend(), nullptr) == cameras.cend());
+
+        m_impl->m_view_cameras = cameras;
+        SetDirtyFlag(kCamera);
+    }
+
+    std::vector<Camera::Ptr> const& Scene1::GetViewCameras() const
+    {
+        return m_impl->m_view_cameras;
+    }
+
     void Scene1::AttachLight(Light::Ptr light)
     {
         assert(light);
@@ -29,6 +29,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include "math/bbox.h"
 
 #include "light.h"
@@ -100,6 +101,11 @@ namespace Baikal
         void SetCamera(Camera::Ptr camera);
         Camera::Ptr GetCamera() const;
 
+        // Set and get cameras of views rendered side by side into one output
+        // (see MonteCarloRenderer::SetViewSize), the main camera is used if empty
+        void SetViewCameras(std::vector<Camera::Ptr> const& cameras);
+        std::vector<Camera::Ptr> const& GetViewCameras() const;
+
         // Get state change since last clear
         DirtyFlags GetDirtyFlags() const;
         // Set specified flag in dirty state
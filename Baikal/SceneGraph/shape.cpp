@@ -5,6 +5,7 @@ namespace Baikal
 {
     Mesh::Mesh() :
     m_aabb_cached(false)
+    , m_geometry_version(0u)
     {
     }
     
@@ -18,12 +19,14 @@ namespace Baikal
         
         std::copy(indices, indices + num_indices, &m_indices[0]);
         
+        ++m_geometry_version;
         SetDirty(true);
     }
 
     void Mesh::SetIndices(std::vector<std::uint32_t>&& indices)
     {
         m_indices = std::move(indices);
+        ++m_geometry_version;
     }
 
     std::size_t Mesh::GetNumIndices() const
@@ -46,6 +49,7 @@ namespace Baikal
 
         std::copy(vertices, vertices + num_vertices, &m_vertices[0]);
 
+        ++m_geometry_version;
         SetDirty(true);
     }
     
@@ -65,12 +69,14 @@ namespace Baikal
             m_vertices[i].w = 1;
         }
 
+        ++m_geometry_version;
         SetDirty(true);
     }
 
     void Mesh::SetVertices(std::vector<RadeonRays::float3>&& vertices)
     {
         m_vertices = std::move(vertices);
+        ++m_geometry_version;
     }
 
     
@@ -94,6 +100,7 @@ namespace Baikal
 
         std::copy(normals, normals + num_normals, &m_normals[0]);
 
+        ++m_geometry_version;
         SetDirty(true);
     }
     
@@ -113,12 +120,14 @@ namespace Baikal
             m_normals[i].w = 0;
         }
 
+        ++m_geometry_version;
         SetDirty(true);
     }
 
     void Mesh::SetNormals(std::vector<RadeonRays::float3>&& normals)
     {
         m_normals = std::move(normals);
+        ++m_geometry_version;
     }
 
     
@@ -142,6 +151,7 @@ namespace Baikal
 
         std::copy(uvs, uvs + num_uvs, &m_uvs[0]);
 
+        ++m_geometry_version;
         SetDirty(true);
     }
     
@@ -159,12 +169,14 @@ namespace Baikal
             m_uvs[i].y = uvs[2 * i + 1];
         }
 
+        ++m_geometry_version;
         SetDirty(true);
     }
 
     void Mesh::SetUVs(std::vector<RadeonRays::float2>&& uvs)
     {
         m_uvs = std::move(uvs);
+        ++m_geometry_version;
     }
 
     std::size_t Mesh::GetNumUVs() const
@@ -177,6 +189,11 @@ namespace Baikal
         return &m_uvs[0];
     }
 
+    std::uint32_t Mesh::GetGeometryVersion() const
+    {
+        return m_geometry_version;
+    }
+
     RadeonRays::bbox Shape::GetWorldAABB() const
     {
         RadeonRays::bbox result;
@@ -164,6 +164,11 @@ namespace Baikal
         // Local space AABB
         RadeonRays::bbox GetLocalAABB() const override;
 
+        // Geometry version is incremented on every change of
+        // vertices, normals, UVs or indices. It allows to distinguish
+        // geometry changes from property changes (transform, material, etc).
+        std::uint32_t GetGeometryVersion() const;
+
         // We need to override it since mesh changes trigger
         // m_aabb_cached flag reset
         void SetDirty(bool dirty) const override;
@@ -183,6 +188,8 @@ namespace Baikal
 
         mutable RadeonRays::bbox m_aabb;
         mutable bool m_aabb_cached;
+
+        std::uint32_t m_geometry_version;
     };
     
     inline Shape::~Shape()
@@ -1,9 +1,40 @@
 #include "texture.h"
 
 #include "Utils/half.h"
+#include "Utils/block_compression.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
 
 namespace Baikal
 {
+    // Size of a single texel in bytes (uncompressed formats only)
+    static std::size_t GetTexelSize(Texture::Format format)
+    {
+        switch (format) {
+        case Texture::Format::kRgba8:
+            return 4;
+        case Texture::Format::kRgba16:
+            return 8;
+        case Texture::Format::kRgba32:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    // Size of a single 2D image (or mip level) in bytes
+    static std::size_t GetLevelSizeInBytes(Texture::Format format, int width, int height)
+    {
+        if (IsBlockCompressed(format))
+        {
+            return GetBlockCompressedSizeInBytes(format, width, height);
+        }
+
+        return static_cast<std::size_t>(width) * height * GetTexelSize(format);
+    }
+
     RadeonRays::float3 Texture::ComputeAverageValue() const
     {
         auto avg = RadeonRays::float3();
@@ -65,6 +96,28 @@ namespace Baikal
             avg *= (1.f / num_elements);
             break;
         }
+        case Format::kBc1:
+        case Format::kBc3:
+        case Format::kBc4:
+        case Format::kBc5:
+        {
+            auto num_elements = m_size.x * m_size.y * m_size.z;
+
+            for (auto z = 0; z < m_size.z; ++z)
+            {
+                for (auto y = 0; y < m_size.y; ++y)
+                {
+                    for (auto x = 0; x < m_size.x; ++x)
+                    {
+                        auto texel = GetTexel(x, y, z);
+                        avg += RadeonRays::float3(texel.x, texel.y, texel.z);
+                    }
+                }
+            }
+
+            avg *= (1.f / num_elements);
+            break;
+        }
         default:
             break;
         }
@@ -72,6 +125,277 @@ namespace Baikal
         return avg;
     }
 
+    RadeonRays::float3 Texture::GetTexel(int x, int y, int z) const
+    {
+        if (IsCompressed())
+        {
+            auto level_data = m_data.get() + z * GetLevelSizeInBytes(m_format, m_size.x, m_size.y);
+            return DecompressTexel(m_format, level_data, m_size.x, x, y);
+        }
+
+        auto idx = (z * m_size.y + y) * m_size.x + x;
+
+        switch (m_format) {
+        case Format::kRgba8:
+        {
+            auto data = reinterpret_cast<std::uint8_t*>(m_data.get()) + 4 * idx;
+            return RadeonRays::float3(data[0] / 255.f, data[1] / 255.f, data[2] / 255.f, data[3] / 255.f);
+        }
+        case Format::kRgba16:
+        {
+            auto data = reinterpret_cast<std::uint16_t*>(m_data.get()) + 4 * idx;
+
+            half hr, hg, hb, ha;
+            hr.setBits(data[0]);
+            hg.setBits(data[1]);
+            hb.setBits(data[2]);
+            ha.setBits(data[3]);
+
+            return RadeonRays::float3(hr, hg, hb, ha);
+        }
+        case Format::kRgba32:
+        {
+            auto data = reinterpret_cast<float*>(m_data.get()) + 4 * idx;
+            return RadeonRays::float3(data[0], data[1], data[2], data[3]);
+        }
+        default:
+            return RadeonRays::float3();
+        }
+    }
+
+    std::size_t Texture::GetSizeInBytes() const
+    {
+        return GetLevelSizeInBytes(m_format, m_size.x, m_size.y) * m_size.z;
+    }
+
+    std::size_t Texture::GetUncompressedSizeInBytes() const
+    {
+        return 4u * m_size.x * m_size.y * m_size.z;
+    }
+
+    bool Texture::IsCompressed() const
+    {
+        return IsBlockCompressed(m_format);
+    }
+
+    void Texture::Compress(Format format)
+    {
+        if (!IsBlockCompressed(format))
+        {
+            throw std::runtime_error("Texture: only block compressed formats are supported");
+        }
+
+        if (m_size.z > 1)
+        {
+            throw std::runtime_error("Texture: volume textures can't be block compressed");
+        }
+
+        if (format == m_format)
+        {
+            return;
+        }
+
+        // Decode the original data once, it is also used to build the mip chain
+        std::vector<RadeonRays::float3> texels(static_cast<std::size_t>(m_size.x) * m_size.y);
+
+        for (auto y = 0; y < m_size.y; ++y)
+        {
+            for (auto x = 0; x < m_size.x; ++x)
+            {
+                texels[y * m_size.x + x] = GetTexel(x, y);
+            }
+        }
+
+        auto data = new char[GetLevelSizeInBytes(format, m_size.x, m_size.y)];
+        CompressBlocks(format, texels.data(), m_size.x, m_size.y, data);
+
+        SetData(data, m_size, format);
+
+        if (GetMipLevelCount() > 1)
+        {
+            GenerateMipmaps(std::move(texels));
+        }
+    }
+
+    // Store normalized value (alpha in w component) in a given format
+    static void EncodeTexel(Texture::Format format, RadeonRays::float3 const& value, char* dst)
+    {
+        switch (format) {
+        case Texture::Format::kRgba8:
+        {
+            auto data = reinterpret_cast<std::uint8_t*>(dst);
+            float v[4] = { value.x, value.y, value.z, value.w };
+
+            for (auto i = 0; i < 4; ++i)
+            {
+                data[i] = static_cast<std::uint8_t>(std::min(std::max(v[i], 0.f), 1.f) * 255.f + 0.5f);
+            }
+            break;
+        }
+        case Texture::Format::kRgba16:
+        {
+            auto data = reinterpret_cast<std::uint16_t*>(dst);
+            data[0] = half(value.x).bits();
+            data[1] = half(value.y).bits();
+            data[2] = half(value.z).bits();
+            data[3] = half(value.w).bits();
+            break;
+        }
+        case Texture::Format::kRgba32:
+        {
+            auto data = reinterpret_cast<float*>(dst);
+            data[0] = value.x;
+            data[1] = value.y;
+            data[2] = value.z;
+            data[3] = value.w;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    std::uint32_t Texture::GetMipLevelCount() const
+    {
+        // Volume textures are not mipmapped
+        if (!m_mipmap_enabled || m_size.z > 1)
+        {
+            return 1u;
+        }
+
+        std::uint32_t num_levels = 1u;
+
+        for (auto w = m_size.x, h = m_size.y; w > 1 || h > 1; ++num_levels)
+        {
+            w = std::max(w >> 1, 1);
+            h = std::max(h >> 1, 1);
+        }
+
+        return num_levels;
+    }
+
+    std::size_t Texture::GetMipDataSizeInBytes() const
+    {
+        auto num_levels = GetMipLevelCount();
+        std::size_t size = 0;
+        auto w = m_size.x;
+        auto h = m_size.y;
+
+        for (auto level = 1u; level < num_levels; ++level)
+        {
+            w = std::max(w >> 1, 1);
+            h = std::max(h >> 1, 1);
+            size += GetLevelSizeInBytes(m_format, w, h);
+        }
+
+        return size;
+    }
+
+    char const* Texture::GetLevelData(std::uint32_t level) const
+    {
+        if (level == 0)
+        {
+            return GetData();
+        }
+
+        if (level >= GetMipLevelCount())
+        {
+            throw std::runtime_error("Texture: mip level is out of range");
+        }
+
+        auto data = GetMipData();
+        auto w = m_size.x;
+        auto h = m_size.y;
+
+        for (auto i = 1u; i < level; ++i)
+        {
+            w = std::max(w >> 1, 1);
+            h = std::max(h >> 1, 1);
+            data += GetLevelSizeInBytes(m_format, w, h);
+        }
+
+        return data;
+    }
+
+    void Texture::SetMipData(char* data)
+    {
+        m_mip_data.reset(data);
+    }
+
+    void Texture::GenerateMipmaps() const
+    {
+        std::vector<RadeonRays::float3> base_level(static_cast<std::size_t>(m_size.x) * m_size.y);
+
+        for (auto y = 0; y < m_size.y; ++y)
+        {
+            for (auto x = 0; x < m_size.x; ++x)
+            {
+                base_level[y * m_size.x + x] = GetTexel(x, y);
+            }
+        }
+
+        GenerateMipmaps(std::move(base_level));
+    }
+
+    void Texture::GenerateMipmaps(std::vector<RadeonRays::float3> base_level) const
+    {
+        auto num_levels = GetMipLevelCount();
+        auto texel_size = GetTexelSize(m_format);
+
+        m_mip_data.reset(new char[GetMipDataSizeInBytes()]);
+
+        auto width = m_size.x;
+        auto height = m_size.y;
+
+        // Filter in floating point not to accumulate quantization errors
+        auto dst = m_mip_data.get();
+        std::vector<RadeonRays::float3> src = std::move(base_level);
+        std::vector<RadeonRays::float3> next;
+
+        for (auto level = 1u; level < num_levels; ++level)
+        {
+            auto level_width = std::max(width >> 1, 1);
+            auto level_height = std::max(height >> 1, 1);
+
+            next.resize(static_cast<std::size_t>(level_width) * level_height);
+
+            for (auto y = 0; y < level_height; ++y)
+            {
+                auto y0 = std::min(2 * y, height - 1);
+                auto y1 = std::min(2 * y + 1, height - 1);
+
+                for (auto x = 0; x < level_width; ++x)
+                {
+                    auto x0 = std::min(2 * x, width - 1);
+                    auto x1 = std::min(2 * x + 1, width - 1);
+
+                    auto value = src[y0 * width + x0] + src[y0 * width + x1] +
+                        src[y1 * width + x0] + src[y1 * width + x1];
+                    value *= 0.25f;
+
+                    next[y * level_width + x] = value;
+                }
+            }
+
+            if (IsCompressed())
+            {
+                CompressBlocks(m_format, next.data(), level_width, level_height, dst);
+            }
+            else
+            {
+                for (std::size_t i = 0; i < next.size(); ++i)
+                {
+                    EncodeTexel(m_format, next[i], dst + i * texel_size);
+                }
+            }
+
+            dst += GetLevelSizeInBytes(m_format, level_width, level_height);
+            src.swap(next);
+            width = level_width;
+            height = level_height;
+        }
+    }
+
     namespace {
         struct TextureConcrete : public Texture {
             TextureConcrete() = default;
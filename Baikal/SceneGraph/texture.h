@@ -33,6 +33,7 @@
 #include "math/int3.h"
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "scene_object.h"
 
@@ -52,7 +53,16 @@ namespace Baikal
         {
             kRgba8,
             kRgba16,
-            kRgba32
+            kRgba32,
+            // Block compressed formats (4x4 texel blocks):
+            // RGB, 4 bits per texel
+            kBc1,
+            // Single channel, 4 bits per texel
+            kBc4,
+            // Two channels (normal maps), 8 bits per texel
+            kBc5,
+            // RGB with alpha, 8 bits per texel
+            kBc3
         };
 
         using Ptr = std::shared_ptr<Texture>;
@@ -73,9 +83,34 @@ namespace Baikal
         Format GetFormat() const;
         // Get data size in bytes
         std::size_t GetSizeInBytes() const;
+        // Get size of the base level if stored as uncompressed RGBA8
+        std::size_t GetUncompressedSizeInBytes() const;
+        // Check if texture is stored in one of block compressed formats
+        bool IsCompressed() const;
+
+        // Convert texture data into block compressed format (kBc1, kBc3, kBc4 or kBc5)
+        void Compress(Format format);
 
         // Average normalized value
         RadeonRays::float3 ComputeAverageValue() const;
+        // Normalized value of a single texel (alpha goes into w component)
+        RadeonRays::float3 GetTexel(int x, int y, int z = 0) const;
+
+        // Enable or disable mip chain generation (enabled by default)
+        void SetMipmapEnabled(bool enabled);
+        bool IsMipmapEnabled() const;
+        // Number of mip levels including the base one
+        std::uint32_t GetMipLevelCount() const;
+        // Mip levels following the base one packed together,
+        // the chain is generated on first access
+        char const* GetMipData() const;
+        // Mip data size in bytes (base level is not included)
+        std::size_t GetMipDataSizeInBytes() const;
+        // Data of a single mip level (level 0 is the base one)
+        char const* GetLevelData(std::uint32_t level) const;
+        // Set previously generated mip chain, texture takes ownership of the data
+        // which has to be GetMipDataSizeInBytes() long
+        void SetMipData(char* data);
 
         // Disallow copying
         Texture(Texture const&) = delete;
@@ -88,18 +123,27 @@ namespace Baikal
         Texture(char* data, RadeonRays::int3 size, Format format);
 
     private:
+        // Box filter mip levels from the base one
+        void GenerateMipmaps() const;
+        void GenerateMipmaps(std::vector<RadeonRays::float3> base_level) const;
+
         // Image data
         std::unique_ptr<char[]> m_data;
         // Image dimensions
         RadeonRays::int3 m_size;
         // Format
         Format m_format;
+        // Mip chain without the base level (lazily generated)
+        mutable std::unique_ptr<char[]> m_mip_data;
+        // Mip chain generation flag
+        bool m_mipmap_enabled;
     };
 
     inline Texture::Texture()
         : m_data(new char[16])
         , m_size(2, 2, 1)
         , m_format(Format::kRgba8)
+        , m_mipmap_enabled(true)
     {
         // Create checkerboard by default
         m_data[0] = m_data[1] = m_data[2] = m_data[3] = (char)0xFF;
@@ -112,6 +156,7 @@ namespace Baikal
         : m_data(data)
         , m_size(size)
         , m_format(format)
+        , m_mipmap_enabled(true)
     {
         if (size.z == 0)
         {
@@ -130,9 +175,37 @@ namespace Baikal
         }
 
         m_format = format;
+        m_mip_data.reset();
+        SetDirty(true);
+    }
+
+    inline void Texture::SetMipmapEnabled(bool enabled)
+    {
+        m_mipmap_enabled = enabled;
+
+        if (!enabled)
+        {
+            m_mip_data.reset();
+        }
+
         SetDirty(true);
     }
 
+    inline bool Texture::IsMipmapEnabled() const
+    {
+        return m_mipmap_enabled;
+    }
+
+    inline char const* Texture::GetMipData() const
+    {
+        if (!m_mip_data && GetMipLevelCount() > 1)
+        {
+            GenerateMipmaps();
+        }
+
+        return m_mip_data.get();
+    }
+
     inline RadeonRays::int3 Texture::GetSize() const
     {
         return m_size;
@@ -147,25 +220,4 @@ namespace Baikal
     {
         return m_format;
     }
-
-    inline std::size_t Texture::GetSizeInBytes() const
-    {
-        std::uint32_t component_size = 1;
-
-        switch (m_format) {
-        case Format::kRgba8:
-            component_size = 1;
-            break;
-        case Format::kRgba16:
-            component_size = 2;
-            break;
-        case Format::kRgba32:
-            component_size = 4;
-            break;
-        default:
-            break;
-        }
-
-        return 4 * component_size * m_size.x * m_size.y * m_size.z;
-    }
 }
@@ -0,0 +1,508 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "block_compression.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+namespace Baikal
+{
+    static float Saturate(float v)
+    {
+        return std::min(std::max(v, 0.f), 1.f);
+    }
+
+    static std::uint16_t EncodeRgb565(float r, float g, float b)
+    {
+        auto r5 = static_cast<std::uint16_t>(Saturate(r) * 31.f + 0.5f);
+        auto g6 = static_cast<std::uint16_t>(Saturate(g) * 63.f + 0.5f);
+        auto b5 = static_cast<std::uint16_t>(Saturate(b) * 31.f + 0.5f);
+        return static_cast<std::uint16_t>((r5 << 11) | (g6 << 5) | b5);
+    }
+
+    static void DecodeRgb565(std::uint16_t c, float rgb[3])
+    {
+        rgb[0] = ((c >> 11) & 31) / 31.f;
+        rgb[1] = ((c >> 5) & 63) / 63.f;
+        rgb[2] = (c & 31) / 31.f;
+    }
+
+    // Build BC1 palette from endpoints the same way the decoder does
+    static void GetBc1Palette(std::uint16_t c0, std::uint16_t c1, float palette[4][3])
+    {
+        DecodeRgb565(c0, palette[0]);
+        DecodeRgb565(c1, palette[1]);
+
+        for (auto i = 0; i < 3; ++i)
+        {
+            if (c0 > c1)
+            {
+                palette[2][i] = (2.f * palette[0][i] + palette[1][i]) / 3.f;
+                palette[3][i] = (palette[0][i] + 2.f * palette[1][i]) / 3.f;
+            }
+            else
+            {
+                palette[2][i] = 0.5f * (palette[0][i] + palette[1][i]);
+                palette[3][i] = 0.f;
+            }
+        }
+    }
+
+    // Pick nearest palette entries for block texels, returns squared error
+    static float FindBc1Indices(RadeonRays::float3 const block[16], std::uint16_t c0, std::uint16_t c1, std::uint32_t& indices)
+    {
+        float palette[4][3];
+        GetBc1Palette(c0, c1, palette);
+
+        indices = 0;
+        auto error = 0.f;
+
+        for (auto i = 0; i < 16; ++i)
+        {
+            auto best = 0u;
+            auto best_dist = 0.f;
+
+            for (auto j = 0u; j < 4u; ++j)
+            {
+                float dr = Saturate(block[i].x) - palette[j][0];
+                float dg = Saturate(block[i].y) - palette[j][1];
+                float db = Saturate(block[i].z) - palette[j][2];
+                float dist = dr * dr + dg * dg + db * db;
+
+                if (j == 0 || dist < best_dist)
+                {
+                    best = j;
+                    best_dist = dist;
+                }
+            }
+
+            indices |= best << (2 * i);
+            error += best_dist;
+        }
+
+        return error;
+    }
+
+    // Least squares fit of endpoints for given palette indices (four color mode).
+    // Returns false if the system is degenerate.
+    static bool RefineBc1Endpoints(RadeonRays::float3 const block[16], std::uint32_t indices, std::uint16_t& c0, std::uint16_t& c1)
+    {
+        static float const kWeights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+
+        float a00 = 0.f, a01 = 0.f, a11 = 0.f;
+        float b0[3] = { 0.f, 0.f, 0.f };
+        float b1[3] = { 0.f, 0.f, 0.f };
+
+        for (auto i = 0; i < 16; ++i)
+        {
+            auto w0 = kWeights[(indices >> (2 * i)) & 3];
+            auto w1 = 1.f - w0;
+            float c[3] = { Saturate(block[i].x), Saturate(block[i].y), Saturate(block[i].z) };
+
+            a00 += w0 * w0;
+            a01 += w0 * w1;
+            a11 += w1 * w1;
+
+            for (auto k = 0; k < 3; ++k)
+            {
+                b0[k] += w0 * c[k];
+                b1[k] += w1 * c[k];
+            }
+        }
+
+        auto det = a00 * a11 - a01 * a01;
+
+        if (std::fabs(det) < 1e-6f)
+        {
+            return false;
+        }
+
+        float e0[3], e1[3];
+        for (auto k = 0; k < 3; ++k)
+        {
+            e0[k] = (a11 * b0[k] - a01 * b1[k]) / det;
+            e1[k] = (a00 * b1[k] - a01 * b0[k]) / det;
+        }
+
+        c0 = EncodeRgb565(e0[0], e0[1], e0[2]);
+        c1 = EncodeRgb565(e1[0], e1[1], e1[2]);
+        return true;
+    }
+
+    static void EncodeBc1Block(RadeonRays::float3 const block[16], char* dst)
+    {
+        // Find principal axis of block colors using a few power iterations
+        float mean[3] = { 0.f, 0.f, 0.f };
+        for (auto i = 0; i < 16; ++i)
+        {
+            mean[0] += Saturate(block[i].x) / 16.f;
+            mean[1] += Saturate(block[i].y) / 16.f;
+            mean[2] += Saturate(block[i].z) / 16.f;
+        }
+
+        float cov[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+        for (auto i = 0; i < 16; ++i)
+        {
+            float r = Saturate(block[i].x) - mean[0];
+            float g = Saturate(block[i].y) - mean[1];
+            float b = Saturate(block[i].z) - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+
+        // Start from covariance column of the channel with the largest variance,
+        // a fixed start vector might be orthogonal to the principal axis
+        float axis[3] = { cov[0], cov[1], cov[2] };
+        if (cov[3] > cov[0] && cov[3] >= cov[5])
+        {
+            axis[0] = cov[1]; axis[1] = cov[3]; axis[2] = cov[4];
+        }
+        else if (cov[5] > cov[0] && cov[5] > cov[3])
+        {
+            axis[0] = cov[2]; axis[1] = cov[4]; axis[2] = cov[5];
+        }
+
+        for (auto iter = 0; iter < 4; ++iter)
+        {
+            float r = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+            float g = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+            float b = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+            float len = std::max(std::max(std::fabs(r), std::fabs(g)), std::fabs(b));
+
+            if (len == 0.f)
+            {
+                break;
+            }
+
+            axis[0] = r / len;
+            axis[1] = g / len;
+            axis[2] = b / len;
+        }
+
+        // Take extreme colors along the axis as initial endpoints
+        auto min_idx = 0, max_idx = 0;
+        float min_proj = 0.f, max_proj = 0.f;
+        for (auto i = 0; i < 16; ++i)
+        {
+            float proj = (Saturate(block[i].x) - mean[0]) * axis[0] +
+                (Saturate(block[i].y) - mean[1]) * axis[1] +
+                (Saturate(block[i].z) - mean[2]) * axis[2];
+
+            if (i == 0 || proj < min_proj) { min_proj = proj; min_idx = i; }
+            if (i == 0 || proj > max_proj) { max_proj = proj; max_idx = i; }
+        }
+
+        auto c0 = EncodeRgb565(block[max_idx].x, block[max_idx].y, block[max_idx].z);
+        auto c1 = EncodeRgb565(block[min_idx].x, block[min_idx].y, block[min_idx].z);
+
+        std::uint32_t indices = 0;
+
+        if (c0 != c1)
+        {
+            // Four color mode requires c0 > c1
+            if (c0 < c1)
+            {
+                std::swap(c0, c1);
+            }
+
+            auto error = FindBc1Indices(block, c0, c1, indices);
+
+            // Refine endpoints once and keep them if they are better
+            std::uint16_t r0 = 0, r1 = 0;
+            if (RefineBc1Endpoints(block, indices, r0, r1) && r0 != r1)
+            {
+                if (r0 < r1)
+                {
+                    std::swap(r0, r1);
+                }
+
+                std::uint32_t refined_indices = 0;
+                if (FindBc1Indices(block, r0, r1, refined_indices) < error)
+                {
+                    c0 = r0;
+                    c1 = r1;
+                    indices = refined_indices;
+                }
+            }
+        }
+
+        std::memcpy(dst, &c0, 2);
+        std::memcpy(dst + 2, &c1, 2);
+        std::memcpy(dst + 4, &indices, 4);
+    }
+
+    // Single channel block, used by both BC4 and BC5
+    static void EncodeBc4Block(float const values[16], char* dst)
+    {
+        auto min_value = 1.f, max_value = 0.f;
+        for (auto i = 0; i < 16; ++i)
+        {
+            min_value = std::min(min_value, Saturate(values[i]));
+            max_value = std::max(max_value, Saturate(values[i]));
+        }
+
+        auto r0 = static_cast<std::uint32_t>(max_value * 255.f + 0.5f);
+        auto r1 = static_cast<std::uint32_t>(min_value * 255.f + 0.5f);
+
+        std::uint64_t block = r0 | (r1 << 8);
+
+        // Eight value mode (r0 > r1): index 0 is r0, 1 is r1, 2..7 are interpolated
+        if (r0 > r1)
+        {
+            for (auto i = 0; i < 16; ++i)
+            {
+                // Position of the value between endpoints in 1/7 steps
+                float t = (r0 - Saturate(values[i]) * 255.f) / (r0 - r1) * 7.f;
+                auto step = static_cast<std::uint64_t>(std::min(std::max(t + 0.5f, 0.f), 7.f));
+                std::uint64_t index = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+                block |= index << (16 + 3 * i);
+            }
+        }
+
+        std::memcpy(dst, &block, 8);
+    }
+
+    static float DecodeBc4Value(char const* data, int texel)
+    {
+        std::uint64_t block = 0;
+        std::memcpy(&block, data, 8);
+
+        auto r0 = static_cast<std::uint32_t>(block & 0xFF);
+        auto r1 = static_cast<std::uint32_t>((block >> 8) & 0xFF);
+        auto index = static_cast<std::uint32_t>((block >> (16 + 3 * texel)) & 7);
+
+        if (index == 0) return r0 / 255.f;
+        if (index == 1) return r1 / 255.f;
+
+        if (r0 > r1)
+        {
+            return ((8 - index) * r0 + (index - 1) * r1) / (7.f * 255.f);
+        }
+
+        // Six value mode with explicit 0 and 1
+        if (index == 6) return 0.f;
+        if (index == 7) return 1.f;
+        return ((6 - index) * r0 + (index - 1) * r1) / (5.f * 255.f);
+    }
+
+    static RadeonRays::float3 DecodeBc1Color(char const* data, int texel)
+    {
+        std::uint16_t c0 = 0, c1 = 0;
+        std::uint32_t indices = 0;
+        std::memcpy(&c0, data, 2);
+        std::memcpy(&c1, data + 2, 2);
+        std::memcpy(&indices, data + 4, 4);
+
+        float palette[4][3];
+        GetBc1Palette(c0, c1, palette);
+
+        auto index = (indices >> (2 * texel)) & 3;
+        return RadeonRays::float3(palette[index][0], palette[index][1], palette[index][2]);
+    }
+
+    bool IsBlockCompressed(Texture::Format format)
+    {
+        return GetBlockSizeInBytes(format) != 0;
+    }
+
+    std::size_t GetBlockSizeInBytes(Texture::Format format)
+    {
+        switch (format)
+        {
+        case Texture::Format::kBc1:
+        case Texture::Format::kBc4:
+            return 8;
+        case Texture::Format::kBc3:
+        case Texture::Format::kBc5:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    std::size_t GetBlockCompressedSizeInBytes(Texture::Format format, int width, int height)
+    {
+        std::size_t num_blocks_x = (width + 3) / 4;
+        std::size_t num_blocks_y = (height + 3) / 4;
+        return num_blocks_x * num_blocks_y * GetBlockSizeInBytes(format);
+    }
+
+    static void CompressBlockRow(Texture::Format format, RadeonRays::float3 const* texels, int width, int height, int block_y, char* dst)
+    {
+        auto block_size = GetBlockSizeInBytes(format);
+        auto num_blocks_x = (width + 3) / 4;
+
+        RadeonRays::float3 block[16];
+        float channel[16];
+
+        for (auto block_x = 0; block_x < num_blocks_x; ++block_x)
+        {
+            for (auto i = 0; i < 16; ++i)
+            {
+                auto x = std::min(block_x * 4 + (i & 3), width - 1);
+                auto y = std::min(block_y * 4 + (i >> 2), height - 1);
+                block[i] = texels[y * width + x];
+            }
+
+            auto block_dst = dst + block_x * block_size;
+
+            switch (format)
+            {
+            case Texture::Format::kBc1:
+                EncodeBc1Block(block, block_dst);
+                break;
+            case Texture::Format::kBc3:
+                // Alpha block followed by BC1 color block
+                for (auto i = 0; i < 16; ++i) channel[i] = block[i].w;
+                EncodeBc4Block(channel, block_dst);
+                EncodeBc1Block(block, block_dst + 8);
+                break;
+            case Texture::Format::kBc4:
+                for (auto i = 0; i < 16; ++i) channel[i] = block[i].x;
+                EncodeBc4Block(channel, block_dst);
+                break;
+            case Texture::Format::kBc5:
+                for (auto i = 0; i < 16; ++i) channel[i] = block[i].x;
+                EncodeBc4Block(channel, block_dst);
+                for (auto i = 0; i < 16; ++i) channel[i] = block[i].y;
+                EncodeBc4Block(channel, block_dst + 8);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void CompressBlocks(Texture::Format format, RadeonRays::float3 const* texels, int width, int height, char* dst)
+    {
+        if (!IsBlockCompressed(format))
+        {
+            throw std::runtime_error("CompressBlocks: format is not block compressed");
+        }
+
+        auto num_blocks_y = (height + 3) / 4;
+        auto row_size = ((width + 3) / 4) * GetBlockSizeInBytes(format);
+
+        // Encoder threads are shared by all calls (mip levels of all textures)
+        static ThreadPool thread_pool;
+
+        // Interleave block rows between pool threads and the calling one
+        auto num_threads = std::max(1, std::min(static_cast<int>(thread_pool.GetThreadCount()) + 1, num_blocks_y));
+        auto worker = [=](int thread_idx)
+        {
+            for (auto block_y = thread_idx; block_y < num_blocks_y; block_y += num_threads)
+            {
+                CompressBlockRow(format, texels, width, height, block_y, dst + block_y * row_size);
+            }
+        };
+
+        std::vector<std::future<void>> tasks;
+        for (auto i = 1; i < num_threads; ++i)
+        {
+            tasks.push_back(thread_pool.Submit([worker, i]() { worker(i); }));
+        }
+
+        worker(0);
+
+        for (auto& task : tasks)
+        {
+            task.get();
+        }
+    }
+
+    RadeonRays::float3 DecompressTexel(Texture::Format format, char const* data, int width, int x, int y)
+    {
+        auto block_idx = (y / 4) * ((width + 3) / 4) + x / 4;
+        auto texel = (y & 3) * 4 + (x & 3);
+        auto block = data + block_idx * GetBlockSizeInBytes(format);
+
+        switch (format)
+        {
+        case Texture::Format::kBc1:
+        {
+            auto color = DecodeBc1Color(block, texel);
+            color.w = 1.f;
+            return color;
+        }
+        case Texture::Format::kBc3:
+        {
+            auto color = DecodeBc1Color(block + 8, texel);
+            color.w = DecodeBc4Value(block, texel);
+            return color;
+        }
+        case Texture::Format::kBc4:
+        {
+            auto v = DecodeBc4Value(block, texel);
+            return RadeonRays::float3(v, v, v, 1.f);
+        }
+        case Texture::Format::kBc5:
+        {
+            // Two channel normal map, reconstruct z from unit length
+            auto nx = DecodeBc4Value(block, texel);
+            auto ny = DecodeBc4Value(block + 8, texel);
+            auto x2 = 2.f * nx - 1.f;
+            auto y2 = 2.f * ny - 1.f;
+            auto nz = std::sqrt(std::max(1.f - x2 * x2 - y2 * y2, 0.f));
+            return RadeonRays::float3(nx, ny, 0.5f * nz + 0.5f, 1.f);
+        }
+        default:
+            return RadeonRays::float3();
+        }
+    }
+
+    Texture::Format ChooseCompressedFormat(Texture const& texture)
+    {
+        auto size = texture.GetSize();
+
+        // Single channel images are replicated into all channels including alpha
+        auto grayscale = true;
+        auto has_alpha = false;
+
+        for (auto z = 0; z < size.z; ++z)
+        {
+            for (auto y = 0; y < size.y; ++y)
+            {
+                for (auto x = 0; x < size.x; ++x)
+                {
+                    auto texel = texture.GetTexel(x, y, z);
+
+                    grayscale = grayscale && texel.x == texel.y && texel.x == texel.z &&
+                        (texel.w == texel.x || texel.w == 1.f);
+                    has_alpha = has_alpha || texel.w < 1.f;
+                }
+            }
+        }
+
+        if (grayscale)
+        {
+            return Texture::Format::kBc4;
+        }
+
+        return has_alpha ? Texture::Format::kBc3 : Texture::Format::kBc1;
+    }
+}
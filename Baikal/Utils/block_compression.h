@@ -0,0 +1,57 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "SceneGraph/texture.h"
+#include "math/float3.h"
+
+#include <cstddef>
+
+namespace Baikal
+{
+    ///< Block compression of texture data (BC1, BC3, BC4 and BC5 layouts).
+    ///< Images are split into 4x4 texel blocks, partial blocks at image
+    ///< borders replicate edge texels. Texel values are normalized RGBA
+    ///< with alpha in w component, same as Texture::GetTexel returns.
+    ///<
+
+    // True for formats stored as 4x4 blocks
+    bool IsBlockCompressed(Texture::Format format);
+
+    // Size in bytes of a single 4x4 block
+    std::size_t GetBlockSizeInBytes(Texture::Format format);
+
+    // Size in bytes of width x height image stored in block compressed format
+    std::size_t GetBlockCompressedSizeInBytes(Texture::Format format, int width, int height);
+
+    // Encode width x height texels (row-major) into dst, block rows are
+    // distributed among the calling thread and a shared thread pool
+    void CompressBlocks(Texture::Format format, RadeonRays::float3 const* texels, int width, int height, char* dst);
+
+    // Decode a single texel of width x height block compressed image
+    RadeonRays::float3 DecompressTexel(Texture::Format format, char const* data, int width, int x, int y);
+
+    // Choose block compressed format keeping the channels texture data uses:
+    // BC4 for grayscale data, BC3 if alpha is used and BC1 otherwise.
+    // Normal maps can't be told from color data, they request BC5 explicitly.
+    Texture::Format ChooseCompressedFormat(Texture const& texture);
+}
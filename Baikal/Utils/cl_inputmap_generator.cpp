@@ -22,11 +22,15 @@ THE SOFTWARE.
 
 #include <assert.h>
 
+#include <algorithm>
 #include <array>
+#include <cstdio>
+#include <cstring>
 
 #include "cl_inputmap_generator.h"
 #include "SceneGraph/uberv2material.h"
 #include "SceneGraph/inputmaps.h"
+#include "hash.h"
 
 
 using namespace Baikal;
@@ -36,95 +40,405 @@ const std::string footer = "#endif\n\n";
 
 const std::string float4_selector_header =
     "float4 GetInputMapFloat4(uint input_id, DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values, TEXTURE_ARG_LIST)\n{\n"
-    "\tswitch(input_id)\n\t{\n";
-const std::string float4_selector_footer = "\t}\n\treturn 0.0f;\n}\n";
+    "\tswitch((uint)input_map_values[input_id].int_values.idx)\n\t{\n";
+// Structures without generated function are interpreted
+const std::string float4_selector_footer =
+    "\t\tdefault:\n\t\t{\n"
+    "\t\t\tint bytecode = input_map_values[input_id].int_values.placeholder[0];\n"
+    "\t\t\treturn bytecode >= 0 ? InterpretInputMap(bytecode, dg, input_map_values, TEXTURE_ARGS) : (float4)(0.0f);\n"
+    "\t\t}\n\t}\n}\n";
 
 const std::string float_selector_header =
     "float GetInputMapFloat(uint input_id, DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values, TEXTURE_ARG_LIST)\n{\n"
     "\treturn GetInputMapFloat4(input_id, dg, input_map_values, TEXTURE_ARGS).x;\n"
     "}\n";
 
-void CLInputMapGenerator::Generate(const Collector& input_map_collector, const Collector& input_map_leaf_collector)
+std::int32_t CLInputMapGenerator::AddInputMap(std::shared_ptr<Baikal::InputMap> input)
 {
-    m_source_code = header;
-    m_read_functions.clear();
-    m_float4_selector = float4_selector_header;
-    m_float_selector = float_selector_header;
+    auto iter = m_instances.find(input->GetId());
+    if (iter != m_instances.end())
+    {
+        return iter->second.offset;
+    }
 
-    m_generated_inputs.clear();
+    m_structure_source.clear();
+    m_structure_leafs.clear();
+    GenerateInputSource(input);
 
-    // We need to guarantee order. So sort it by id using map
-    std::map <uint32_t, InputMap::Ptr> inputs;
+    auto structure = m_structure_indices.find(m_structure_source);
+    if (structure == m_structure_indices.end())
+    {
+        structure = m_structure_indices.emplace(m_structure_source, m_structures.size()).first;
+        m_structures.push_back(m_structure_source);
+        m_structure_hashes.push_back(static_cast<std::uint32_t>(ComputeHash128(m_structure_source).lo));
+    }
 
-    auto mat_iter = input_map_collector.CreateIterator();
-    for (; mat_iter->IsValid(); mat_iter->Next())
+    Instance instance;
+    instance.structure = structure->second;
+    instance.offset = static_cast<std::int32_t>(m_instances_size);
+    instance.leafs = std::move(m_structure_leafs);
+
+    if (GenerateBytecode(input, instance) <= INPUT_MAP_STACK_SIZE)
+    {
+        instance.bytecode.push_back({ ClwScene::kInputMapOpReturn, { 0, 0, 0 } });
+    }
+    else
     {
-        auto input = mat_iter->ItemAs<InputMap>();
-        inputs.insert(std::make_pair(input->GetId(), input));
+        instance.bytecode.clear();
+        instance.bytecode_leafs.clear();
+        m_interpretable = false;
     }
 
-    for (auto &input : inputs)
+    // Bytecode reads the same leafs as generated code
+    for (auto const& leaf : instance.leafs)
     {
-        GenerateSingleInput(input.second, input_map_leaf_collector);
+        AddConstant(leaf);
     }
 
-    m_source_code += m_read_functions;
-    m_source_code += m_float4_selector + float4_selector_footer;
+    // Header followed by leaf references and bytecode
+    m_instances_size += 1 + instance.leafs.size() + instance.bytecode.size();
+
+    auto offset = instance.offset;
+    m_instances.emplace(input->GetId(), std::move(instance));
+    return offset;
+}
+
+void CLInputMapGenerator::Generate()
+{
+    // Order structures by hash to make generated code independent
+    // of the order input maps were added in
+    std::vector<std::size_t> order(m_structures.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+
+    std::sort(order.begin(), order.end(), [this](std::size_t a, std::size_t b)
+    {
+        return m_structure_hashes[a] < m_structure_hashes[b] ||
+            (m_structure_hashes[a] == m_structure_hashes[b] && m_structures[a] < m_structures[b]);
+    });
+
+    std::string read_functions;
+    std::string float4_selector = float4_selector_header;
+
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        auto hash = m_structure_hashes[order[i]];
+
+        // Structures with colliding hashes are left to the interpreter
+        bool collides = (i > 0 && m_structure_hashes[order[i - 1]] == hash) ||
+            (i + 1 < order.size() && m_structure_hashes[order[i + 1]] == hash);
+
+        if (collides)
+        {
+            continue;
+        }
+
+        char structure_id[16];
+        std::snprintf(structure_id, sizeof(structure_id), "0x%08x", hash);
+
+        float4_selector += std::string("\t\tcase ") + structure_id + "u: return ReadInputMap_" + (structure_id + 2) + "(input_id + 1, dg, input_map_values, TEXTURE_ARGS);\n";
+
+        read_functions += std::string("float4 ReadInputMap_") + (structure_id + 2) + "(uint offset, DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values, TEXTURE_ARG_LIST)\n{\n"
+            "\treturn (float4)(\n\t";
+        read_functions += m_structures[order[i]];
+        read_functions += "\t);\n}\n";
+    }
+
+    m_source_code = header;
+    m_source_code += read_functions;
+    m_source_code += float4_selector + float4_selector_footer;
     m_source_code += float_selector_header;
     m_source_code += footer;
 }
 
-void CLInputMapGenerator::GenerateSingleInput(std::shared_ptr<Baikal::InputMap> input, const Collector& input_map_leaf_collector)
+void CLInputMapGenerator::WriteInputMaps(const Collector& input_map_leaf_collector, ClwScene::InputMapData* data) const
+{
+    for (auto const& instance : m_instances)
+    {
+        auto const& leafs = instance.second.leafs;
+        auto const& bytecode = instance.second.bytecode;
+
+        auto instance_header = data + instance.second.offset;
+        auto bytecode_offset = instance.second.offset + 1 + static_cast<std::int32_t>(leafs.size());
+
+        instance_header->int_values.idx = static_cast<int>(m_structure_hashes[instance.second.structure]);
+        instance_header->int_values.placeholder[0] = bytecode.empty() ? -1 : bytecode_offset;
+        instance_header->int_values.type = ClwScene::InputMapDataType::kInt;
+
+        for (std::size_t i = 0; i < leafs.size(); ++i)
+        {
+            instance_header[1 + i].int_values.idx = GetLeafOffset(input_map_leaf_collector, leafs[i]);
+            instance_header[1 + i].int_values.type = ClwScene::InputMapDataType::kInt;
+        }
+
+        auto instructions = data + bytecode_offset;
+        for (std::size_t i = 0; i < bytecode.size(); ++i)
+        {
+            instructions[i].instruction.op = bytecode[i].op;
+            instructions[i].instruction.args[0] = bytecode[i].args[0];
+            instructions[i].instruction.args[1] = bytecode[i].args[1];
+            instructions[i].instruction.args[2] = bytecode[i].args[2];
+        }
+
+        for (auto const& leaf : instance.second.bytecode_leafs)
+        {
+            instructions[leaf.first].instruction.args[0] = GetLeafOffset(input_map_leaf_collector, leaf.second);
+        }
+    }
+
+    auto constants = data + m_instances_size;
+    for (std::size_t i = 0; i < m_constants.size(); ++i)
+    {
+        constants[i].float_value.value = m_constants[i];
+        constants[i].int_values.type = ClwScene::InputMapDataType::kFloat3;
+    }
+}
+
+void CLInputMapGenerator::AddConstant(std::shared_ptr<Baikal::InputMap> leaf)
 {
-    if (m_generated_inputs.find(input->GetId()) != m_generated_inputs.end()) return;
+    RadeonRays::float3 value;
 
-    std::string input_id = std::to_string(input->GetId());
+    // Float constants are read as float3 holding the same value in all components
+    if (leaf->m_type == InputMap::InputMapType::kConstantFloat3)
+    {
+        value = static_cast<InputMap_ConstantFloat3 const&>(*leaf).GetValue();
+    }
+    else if (leaf->m_type == InputMap::InputMapType::kConstantFloat)
+    {
+        auto v = static_cast<InputMap_ConstantFloat const&>(*leaf).GetValue();
+        value = RadeonRays::float3(v, v, v);
+    }
+    else
+    {
+        return;
+    }
+
+    std::array<std::uint32_t, 3> key;
+    std::memcpy(&key[0], &value.x, sizeof(std::uint32_t));
+    std::memcpy(&key[1], &value.y, sizeof(std::uint32_t));
+    std::memcpy(&key[2], &value.z, sizeof(std::uint32_t));
+
+    auto iter = m_constant_indices.find(key);
+    if (iter == m_constant_indices.end())
+    {
+        iter = m_constant_indices.emplace(key, m_constants.size()).first;
+        m_constants.push_back(value);
+    }
 
-    //Generate code for selectors
-    m_float4_selector += "\t\tcase " + input_id + ": return ReadInputMap" + input_id + "(dg, input_map_values, TEXTURE_ARGS);\n";
-    m_float_selector += "\t\tcase " + input_id + ": return ReadInputMap" + input_id + "(dg, input_map_values, TEXTURE_ARGS).x;\n";
+    m_constant_leafs[leaf->GetId()] = iter->second;
+}
 
-    m_read_functions += "float4 ReadInputMap" + input_id + "(DifferentialGeometry const* dg, GLOBAL InputMapData const* restrict input_map_values, TEXTURE_ARG_LIST)\n{\n"
-        "\treturn (float4)(\n\t";
+int CLInputMapGenerator::GetLeafOffset(const Collector& input_map_leaf_collector, std::shared_ptr<Baikal::InputMap> leaf) const
+{
+    auto iter = m_constant_leafs.find(leaf->GetId());
+    if (iter != m_constant_leafs.end())
+    {
+        return static_cast<int>(m_instances_size + iter->second);
+    }
 
-    GenerateInputSource(input, input_map_leaf_collector);
+    return static_cast<int>(GetLeafsOffset() + input_map_leaf_collector.GetItemIndex(leaf));
+}
 
-    m_read_functions += "\t);\n}\n";
+template <typename T>
+std::uint32_t CLInputMapGenerator::GenerateUnary(T const& input, std::int32_t op, Instance& instance) const
+{
+    auto depth = GenerateBytecode(input.GetArg(), instance);
+    instance.bytecode.push_back({ op, { 0, 0, 0 } });
+    return depth;
+}
 
-    m_generated_inputs.insert(input->GetId());
+template <typename T>
+std::uint32_t CLInputMapGenerator::GenerateBinary(T const& input, std::int32_t op, Instance& instance) const
+{
+    auto depth_a = GenerateBytecode(input.GetA(), instance);
+    auto depth_b = GenerateBytecode(input.GetB(), instance);
+    instance.bytecode.push_back({ op, { 0, 0, 0 } });
+    return std::max(depth_a, depth_b + 1);
+}
+
+// Packs shuffle mask one component per byte
+static std::int32_t PackShuffleMask(std::array<uint32_t, 4> const& mask)
+{
+    return static_cast<std::int32_t>(mask[0] | (mask[1] << 8) | (mask[2] << 16) | (mask[3] << 24));
+}
+
+// Reinterprets float as int to store it in bytecode
+static std::int32_t FloatBits(float value)
+{
+    std::int32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+std::uint32_t CLInputMapGenerator::GenerateBytecode(std::shared_ptr<Baikal::InputMap> input, Instance& instance) const
+{
+    switch (input->m_type)
+    {
+        // Leafs
+        case InputMap::InputMapType::kConstantFloat:
+        case InputMap::InputMapType::kConstantFloat3:
+        case InputMap::InputMapType::kSampler:
+        case InputMap::InputMapType::kSamplerBumpmap:
+        {
+            std::int32_t op = ClwScene::kInputMapOpConstant;
+            if (input->m_type == InputMap::InputMapType::kSampler)
+            {
+                op = ClwScene::kInputMapOpSampler;
+            }
+            else if (input->m_type == InputMap::InputMapType::kSamplerBumpmap)
+            {
+                op = ClwScene::kInputMapOpSamplerBumpmap;
+            }
+
+            instance.bytecode_leafs.push_back(std::make_pair(instance.bytecode.size(), input));
+            instance.bytecode.push_back({ op, { 0, 0, 0 } });
+            return 1;
+        }
+        // Two inputs
+        case InputMap::InputMapType::kAdd:
+            return GenerateBinary(static_cast<InputMap_Add const&>(*input), ClwScene::kInputMapOpAdd, instance);
+        case InputMap::InputMapType::kSub:
+            return GenerateBinary(static_cast<InputMap_Sub const&>(*input), ClwScene::kInputMapOpSub, instance);
+        case InputMap::InputMapType::kMul:
+            return GenerateBinary(static_cast<InputMap_Mul const&>(*input), ClwScene::kInputMapOpMul, instance);
+        case InputMap::InputMapType::kDiv:
+            return GenerateBinary(static_cast<InputMap_Div const&>(*input), ClwScene::kInputMapOpDiv, instance);
+        case InputMap::InputMapType::kMin:
+            return GenerateBinary(static_cast<InputMap_Min const&>(*input), ClwScene::kInputMapOpMin, instance);
+        case InputMap::InputMapType::kMax:
+            return GenerateBinary(static_cast<InputMap_Max const&>(*input), ClwScene::kInputMapOpMax, instance);
+        case InputMap::InputMapType::kDot3:
+            return GenerateBinary(static_cast<InputMap_Dot3 const&>(*input), ClwScene::kInputMapOpDot3, instance);
+        case InputMap::InputMapType::kDot4:
+            return GenerateBinary(static_cast<InputMap_Dot4 const&>(*input), ClwScene::kInputMapOpDot4, instance);
+        case InputMap::InputMapType::kCross3:
+            return GenerateBinary(static_cast<InputMap_Cross3 const&>(*input), ClwScene::kInputMapOpCross3, instance);
+        case InputMap::InputMapType::kCross4:
+            return GenerateBinary(static_cast<InputMap_Cross4 const&>(*input), ClwScene::kInputMapOpCross4, instance);
+        case InputMap::InputMapType::kPow:
+            return GenerateBinary(static_cast<InputMap_Pow const&>(*input), ClwScene::kInputMapOpPow, instance);
+        case InputMap::InputMapType::kMod:
+            return GenerateBinary(static_cast<InputMap_Mod const&>(*input), ClwScene::kInputMapOpMod, instance);
+        // Single input
+        case InputMap::InputMapType::kSin:
+            return GenerateUnary(static_cast<InputMap_Sin const&>(*input), ClwScene::kInputMapOpSin, instance);
+        case InputMap::InputMapType::kCos:
+            return GenerateUnary(static_cast<InputMap_Cos const&>(*input), ClwScene::kInputMapOpCos, instance);
+        case InputMap::InputMapType::kTan:
+            return GenerateUnary(static_cast<InputMap_Tan const&>(*input), ClwScene::kInputMapOpTan, instance);
+        case InputMap::InputMapType::kAsin:
+            return GenerateUnary(static_cast<InputMap_Asin const&>(*input), ClwScene::kInputMapOpAsin, instance);
+        case InputMap::InputMapType::kAcos:
+            return GenerateUnary(static_cast<InputMap_Acos const&>(*input), ClwScene::kInputMapOpAcos, instance);
+        case InputMap::InputMapType::kAtan:
+            return GenerateUnary(static_cast<InputMap_Atan const&>(*input), ClwScene::kInputMapOpAtan, instance);
+        case InputMap::InputMapType::kLength3:
+            return GenerateUnary(static_cast<InputMap_Length3 const&>(*input), ClwScene::kInputMapOpLength3, instance);
+        case InputMap::InputMapType::kNormalize3:
+            return GenerateUnary(static_cast<InputMap_Normalize3 const&>(*input), ClwScene::kInputMapOpNormalize3, instance);
+        case InputMap::InputMapType::kFloor:
+            return GenerateUnary(static_cast<InputMap_Floor const&>(*input), ClwScene::kInputMapOpFloor, instance);
+        case InputMap::InputMapType::kAbs:
+            return GenerateUnary(static_cast<InputMap_Abs const&>(*input), ClwScene::kInputMapOpAbs, instance);
+        // Specials
+        case InputMap::InputMapType::kLerp:
+        {
+            auto const& i = static_cast<InputMap_Lerp const&>(*input);
+            auto depth_a = GenerateBytecode(i.GetA(), instance);
+            auto depth_b = GenerateBytecode(i.GetB(), instance);
+            auto depth_control = GenerateBytecode(i.GetControl(), instance);
+            instance.bytecode.push_back({ ClwScene::kInputMapOpLerp, { 0, 0, 0 } });
+            return std::max(depth_a, std::max(depth_b + 1, depth_control + 2));
+        }
+        case InputMap::InputMapType::kSelect:
+        {
+            auto const& i = static_cast<InputMap_Select const&>(*input);
+            auto depth = GenerateBytecode(i.GetArg(), instance);
+            instance.bytecode.push_back({ ClwScene::kInputMapOpSelect, { static_cast<std::int32_t>(i.GetSelection()), 0, 0 } });
+            return depth;
+        }
+        case InputMap::InputMapType::kShuffle:
+        {
+            auto const& i = static_cast<InputMap_Shuffle const&>(*input);
+            auto depth = GenerateBytecode(i.GetArg(), instance);
+            instance.bytecode.push_back({ ClwScene::kInputMapOpShuffle, { PackShuffleMask(i.GetMask()), 0, 0 } });
+            return depth;
+        }
+        case InputMap::InputMapType::kShuffle2:
+        {
+            auto const& i = static_cast<InputMap_Shuffle2 const&>(*input);
+            auto depth_a = GenerateBytecode(i.GetA(), instance);
+            auto depth_b = GenerateBytecode(i.GetB(), instance);
+            instance.bytecode.push_back({ ClwScene::kInputMapOpShuffle2, { PackShuffleMask(i.GetMask()), 0, 0 } });
+            return std::max(depth_a, depth_b + 1);
+        }
+        case InputMap::InputMapType::kMatMul:
+        {
+            auto const& i = static_cast<InputMap_MatMul const&>(*input);
+            auto depth = GenerateBytecode(i.GetArg(), instance);
+            auto mat4 = i.GetMatrix();
+            instance.bytecode.push_back({ ClwScene::kInputMapOpMatMul, { 0, 0, 0 } });
+            instance.bytecode.push_back({ FloatBits(mat4.m00), { FloatBits(mat4.m01), FloatBits(mat4.m02), FloatBits(mat4.m03) } });
+            instance.bytecode.push_back({ FloatBits(mat4.m10), { FloatBits(mat4.m11), FloatBits(mat4.m12), FloatBits(mat4.m13) } });
+            instance.bytecode.push_back({ FloatBits(mat4.m20), { FloatBits(mat4.m21), FloatBits(mat4.m22), FloatBits(mat4.m23) } });
+            instance.bytecode.push_back({ FloatBits(mat4.m30), { FloatBits(mat4.m31), FloatBits(mat4.m32), FloatBits(mat4.m33) } });
+            return depth;
+        }
+        case InputMap::InputMapType::kRemap:
+        {
+            auto const& i = static_cast<InputMap_Remap const&>(*input);
+            auto depth_data = GenerateBytecode(i.GetData(), instance);
+            auto depth_source = GenerateBytecode(i.GetSourceRange(), instance);
+            auto depth_destination = GenerateBytecode(i.GetDestinationRange(), instance);
+            instance.bytecode.push_back({ ClwScene::kInputMapOpRemap, { 0, 0, 0 } });
+            return std::max(depth_data, std::max(depth_source + 1, depth_destination + 2));
+        }
+    }
+
+    // Unknown input map, make sure it isn't interpreted
+    return INPUT_MAP_STACK_SIZE + 1;
+}
+
+std::string CLInputMapGenerator::ReadLeaf(std::shared_ptr<Baikal::InputMap> leaf)
+{
+    std::string slot = std::to_string(m_structure_leafs.size());
+    m_structure_leafs.push_back(leaf);
+    return "input_map_values[input_map_values[offset + " + slot + "].int_values.idx]";
 }
 
-void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap> input, const Collector& input_map_leaf_collector)
+void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap> input)
 {
     switch (input->m_type)
     {
 
         case InputMap::InputMapType::kConstantFloat:
         {
-            int32_t index = input_map_leaf_collector.GetItemIndex(input);
+            std::string leaf = ReadLeaf(input);
 
-            m_read_functions += "((float4)(input_map_values[" + std::to_string(index) + "].float_value.value, 0.0f))\n";
+            m_structure_source += "((float4)(" + leaf + ".float_value.value, 0.0f))\n";
             break;
         }
         case InputMap::InputMapType::kConstantFloat3:
         {
-            int32_t index = input_map_leaf_collector.GetItemIndex(input);
+            std::string leaf = ReadLeaf(input);
 
-            m_read_functions += "((float4)(input_map_values[" + std::to_string(index) + "].float_value.value, 0.0f))\n";
+            m_structure_source += "((float4)(" + leaf + ".float_value.value, 0.0f))\n";
             break;
         }
         case InputMap::InputMapType::kSampler:
         {
-            int32_t index = input_map_leaf_collector.GetItemIndex(input);
+            std::string leaf = ReadLeaf(input);
 
-            m_read_functions += "Texture_Sample2D(dg->uv, TEXTURE_ARGS_IDX(input_map_values[" + std::to_string(index) + "].int_values.idx))\n";
+            m_structure_source += "Texture_SampleFootprint(dg->uv, dg->uv_footprint, TEXTURE_ARGS_IDX(" + leaf + ".int_values.idx))\n";
             break;
         }
         case InputMap::InputMapType::kSamplerBumpmap:
         {
-            int32_t index = input_map_leaf_collector.GetItemIndex(input);
+            std::string leaf = ReadLeaf(input);
 
-            m_read_functions += "(float4)(Texture_SampleBump(dg->uv, TEXTURE_ARGS_IDX(input_map_values[" + std::to_string(index) + "].int_values.idx)), 1.0f)\n";
+            m_structure_source += "(float4)(Texture_SampleBump(dg->uv, TEXTURE_ARGS_IDX(" + leaf + ".int_values.idx)), 1.0f)\n";
             break;
         }
         // Two inputs
@@ -132,132 +446,132 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
         {
             InputMap_Add *i = static_cast<InputMap_Add*>(input.get());
 
-            m_read_functions += "(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t)\n\t + \n\t(\n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t)\n\t + \n\t(\n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kSub:
         {
             InputMap_Sub *i = static_cast<InputMap_Sub*>(input.get());
 
-            m_read_functions += "(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t)\n\t - \n\t(\n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t)\n\t - \n\t(\n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kMul:
         {
             InputMap_Mul *i = static_cast<InputMap_Mul*>(input.get());
 
-            m_read_functions += "(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t)\n\t * \n\t(\n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t)\n\t * \n\t(\n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kDiv:
         {
             InputMap_Div *i = static_cast<InputMap_Div*>(input.get());
 
-            m_read_functions += "(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t)\n\t / \n\t(\n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t)\n\t / \n\t(\n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kMin:
         {
             InputMap_Min *i = static_cast<InputMap_Min*>(input.get());
 
-            m_read_functions += "min(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "min(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t, \n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kMax:
         {
             InputMap_Max *i = static_cast<InputMap_Max*>(input.get());
 
-            m_read_functions += "max(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "max(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t, \n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kDot3:
         {
             InputMap_Dot3 *i = static_cast<InputMap_Dot3*>(input.get());
 
-            m_read_functions += "((float4)(dot(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  ".xyz\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += ".xyz\t), 0.0f, 0.0f, 0.0f))\n";
+            m_structure_source += "((float4)(dot(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  ".xyz\t, \n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += ".xyz\t), 0.0f, 0.0f, 0.0f))\n";
             break;
         }
         case InputMap::InputMapType::kDot4:
         {
             InputMap_Dot4 *i = static_cast<InputMap_Dot4*>(input.get());
 
-            m_read_functions += "((float4)(dot(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += "\t), 0.0f, 0.0f, 0.0f))\n";
+            m_structure_source += "((float4)(dot(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t, \n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += "\t), 0.0f, 0.0f, 0.0f))\n";
             break;
         }
         case InputMap::InputMapType::kCross3:
         {
             InputMap_Cross3 *i = static_cast<InputMap_Cross3*>(input.get());
 
-            m_read_functions += "((float4)(cross(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  ".xyz\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += ".xyz\t), 0.0f))\n";
+            m_structure_source += "((float4)(cross(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  ".xyz\t, \n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += ".xyz\t), 0.0f))\n";
             break;
         }
         case InputMap::InputMapType::kCross4:
         {
             InputMap_Cross4 *i = static_cast<InputMap_Cross4*>(input.get());
 
-            m_read_functions += "cross(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "cross(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t, \n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kPow:
         {
             InputMap_Pow *i = static_cast<InputMap_Pow*>(input.get());
 
-            m_read_functions += "pow(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += ".x\t)\n";
+            m_structure_source += "pow(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t, \n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += ".x\t)\n";
             break;
         }
         case InputMap::InputMapType::kMod:
         {
             InputMap_Mod *i = static_cast<InputMap_Mod*>(input.get());
 
-            m_read_functions += "fmod(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "fmod(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t, \n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += "\t)\n";
             break;
         }
         //Single input
@@ -265,90 +579,90 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
         {
             InputMap_Sin *i = static_cast<InputMap_Sin*>(input.get());
 
-            m_read_functions += "sin(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "sin(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kCos:
         {
             InputMap_Cos *i = static_cast<InputMap_Cos*>(input.get());
 
-            m_read_functions += "cos(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "cos(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kTan:
         {
             InputMap_Tan *i = static_cast<InputMap_Tan*>(input.get());
 
-            m_read_functions += "tan(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "tan(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kAsin:
         {
             InputMap_Asin *i = static_cast<InputMap_Asin*>(input.get());
 
-            m_read_functions += "asin(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "asin(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kAcos:
         {
             InputMap_Acos *i = static_cast<InputMap_Acos*>(input.get());
 
-            m_read_functions += "acos(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "acos(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kAtan:
         {
             InputMap_Atan *i = static_cast<InputMap_Atan*>(input.get());
 
-            m_read_functions += "atan(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "atan(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kLength3:
         {
             InputMap_Length3 *i = static_cast<InputMap_Length3*>(input.get());
 
-            m_read_functions += "(float4)(length(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += ".xyz\t), 0.0f, 0.0f, 0.0f)\n";
+            m_structure_source += "(float4)(length(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += ".xyz\t), 0.0f, 0.0f, 0.0f)\n";
             break;
         }
         case InputMap::InputMapType::kNormalize3:
         {
             InputMap_Normalize3 *i = static_cast<InputMap_Normalize3*>(input.get());
 
-            m_read_functions += "(float4)(normalize(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += ".xyz\t), 0.0f)\n";
+            m_structure_source += "(float4)(normalize(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += ".xyz\t), 0.0f)\n";
             break;
         }
         case InputMap::InputMapType::kFloor:
         {
             InputMap_Floor *i = static_cast<InputMap_Floor*>(input.get());
 
-            m_read_functions += "floor(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "floor(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kAbs:
         {
             InputMap_Abs *i = static_cast<InputMap_Abs*>(input.get());
 
-            m_read_functions += "fabs(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "fabs(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += "\t)\n";
             break;
         }
         // Specials
@@ -356,13 +670,13 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
         {
             InputMap_Lerp *i = static_cast<InputMap_Lerp*>(input.get());
 
-            m_read_functions += "mix(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions +=  "\t, \n\t\t";
-            GenerateInputSource(i->GetControl(), input_map_leaf_collector);
-            m_read_functions += "\t)\n";
+            m_structure_source += "mix(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source +=  "\t, \n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source +=  "\t, \n\t\t";
+            GenerateInputSource(i->GetControl());
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kSelect:
@@ -371,10 +685,10 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             static const std::vector<std::string> selection_to_text = { ".x", ".y", ".z", ".w" };
             assert(static_cast<uint32_t>(i->GetSelection()) < selection_to_text.size());
 
-            m_read_functions += "(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions +=  selection_to_text[static_cast<uint32_t>(i->GetSelection())];
-            m_read_functions += "\n\t)\n";
+            m_structure_source += "(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source +=  selection_to_text[static_cast<uint32_t>(i->GetSelection())];
+            m_structure_source += "\n\t)\n";
             break;
         }
         case InputMap::InputMapType::kShuffle:
@@ -382,11 +696,11 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Shuffle *i = static_cast<InputMap_Shuffle*>(input.get());
             auto mask = i->GetMask();
 
-            m_read_functions += "shuffle(\n\t\t";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions += "\t, \n\t\t";
-            m_read_functions += "(uint4)(" + std::to_string(mask[0]) + ", " + std::to_string(mask[1]) + ", " + std::to_string(mask[2]) + ", " + std::to_string(mask[3]) + ")\n";
-            m_read_functions += "\t)\n";
+            m_structure_source += "shuffle(\n\t\t";
+            GenerateInputSource(i->GetArg());
+            m_structure_source += "\t, \n\t\t";
+            m_structure_source += "(uint4)(" + std::to_string(mask[0]) + ", " + std::to_string(mask[1]) + ", " + std::to_string(mask[2]) + ", " + std::to_string(mask[3]) + ")\n";
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kShuffle2:
@@ -394,13 +708,13 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
             InputMap_Shuffle2 *i = static_cast<InputMap_Shuffle2*>(input.get());
             auto mask = i->GetMask();
 
-            m_read_functions += "shuffle2(\n\t\t";
-            GenerateInputSource(i->GetA(), input_map_leaf_collector);
-            m_read_functions += "\t, \n\t\t";
-            GenerateInputSource(i->GetB(), input_map_leaf_collector);
-            m_read_functions += "\t, \n\t\t";
-            m_read_functions += "(uint4)(" + std::to_string(mask[0]) + ", " + std::to_string(mask[1]) + ", " + std::to_string(mask[2]) + ", " + std::to_string(mask[3]) + ")\n";
-            m_read_functions += "\t)\n";
+            m_structure_source += "shuffle2(\n\t\t";
+            GenerateInputSource(i->GetA());
+            m_structure_source += "\t, \n\t\t";
+            GenerateInputSource(i->GetB());
+            m_structure_source += "\t, \n\t\t";
+            m_structure_source += "(uint4)(" + std::to_string(mask[0]) + ", " + std::to_string(mask[1]) + ", " + std::to_string(mask[2]) + ", " + std::to_string(mask[3]) + ")\n";
+            m_structure_source += "\t)\n";
             break;
         }
         case InputMap::InputMapType::kMatMul:
@@ -409,50 +723,50 @@ void CLInputMapGenerator::GenerateInputSource(std::shared_ptr<Baikal::InputMap>
 
             auto mat4 = i->GetMatrix();
 
-            m_read_functions += "matrix_mul_vector4(\n\t\t";
+            m_structure_source += "matrix_mul_vector4(\n\t\t";
             //Generate matrix
-            m_read_functions += "matrix_from_rows(\n\t\t\t";
-            m_read_functions += "make_float4(" +
+            m_structure_source += "matrix_from_rows(\n\t\t\t";
+            m_structure_source += "make_float4(" +
                 std::to_string(mat4.m00) + ", " +
                 std::to_string(mat4.m01) + ", " +
                 std::to_string(mat4.m02) + ", " +
                 std::to_string(mat4.m03) + "), \n\t\t\t";
-            m_read_functions += "make_float4(" +
+            m_structure_source += "make_float4(" +
                 std::to_string(mat4.m10) + ", " +
                 std::to_string(mat4.m11) + ", " +
                 std::to_string(mat4.m12) + ", " +
                 std::to_string(mat4.m13) + "), \n\t\t\t";
-            m_read_functions += "make_float4(" +
+            m_structure_source += "make_float4(" +
                 std::to_string(mat4.m20) + ", " +
                 std::to_string(mat4.m21) + ", " +
                 std::to_string(mat4.m22) + ", " +
                 std::to_string(mat4.m23) + "), \n\t\t\t";
-            m_read_functions += "make_float4(" +
+            m_structure_source += "make_float4(" +
                 std::to_string(mat4.m30) + ", " +
                 std::to_string(mat4.m31) + ", " +
                 std::to_string(mat4.m32) + ", " +
                 std::to_string(mat4.m33) + ")),\n\t\t(";
-            GenerateInputSource(i->GetArg(), input_map_leaf_collector);
-            m_read_functions +=  "\t)\n\t)";
+            GenerateInputSource(i->GetArg());
+            m_structure_source +=  "\t)\n\t)";
             break;
         }
         case InputMap::InputMapType::kRemap:
         {
             InputMap_Remap *i = static_cast<InputMap_Remap*>(input.get());
             //mix(float3(dest.x), float3(dest.y), (val - src.x) / (src.y - src.x))
-            m_read_functions += "mix((float4)(\n\t\t";
-            GenerateInputSource(i->GetDestinationRange(), input_map_leaf_collector);
-            m_read_functions += ".x)\t, \n\t\t(float4)(\n\t\t";
-            GenerateInputSource(i->GetDestinationRange(), input_map_leaf_collector);
-            m_read_functions += ".y)\t, \n\t\t((\n\t\t";
-            GenerateInputSource(i->GetData(), input_map_leaf_collector);
-            m_read_functions += ") - \n\t\t(\n\t\t";
-            GenerateInputSource(i->GetSourceRange(), input_map_leaf_collector);
-            m_read_functions += ".x)) / \n\t\t((\n\t\t";
-            GenerateInputSource(i->GetSourceRange(), input_map_leaf_collector);
-            m_read_functions += ".y)  - \n\t\t(\n\t\t";
-            GenerateInputSource(i->GetSourceRange(), input_map_leaf_collector);
-            m_read_functions += ".x)))\t\n";
+            m_structure_source += "mix((float4)(\n\t\t";
+            GenerateInputSource(i->GetDestinationRange());
+            m_structure_source += ".x)\t, \n\t\t(float4)(\n\t\t";
+            GenerateInputSource(i->GetDestinationRange());
+            m_structure_source += ".y)\t, \n\t\t((\n\t\t";
+            GenerateInputSource(i->GetData());
+            m_structure_source += ") - \n\t\t(\n\t\t";
+            GenerateInputSource(i->GetSourceRange());
+            m_structure_source += ".x)) / \n\t\t((\n\t\t";
+            GenerateInputSource(i->GetSourceRange());
+            m_structure_source += ".y)  - \n\t\t(\n\t\t";
+            GenerateInputSource(i->GetSourceRange());
+            m_structure_source += ".x)))\t\n";
             break;
         }
 
@@ -23,7 +23,10 @@ THE SOFTWARE.
 
 #pragma once
 
-#include <set>
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 #include "SceneGraph/scene1.h"
 #include "SceneGraph/Collector/collector.h"
@@ -36,16 +39,43 @@ namespace Baikal
     {
     public:
         /**
-        * @brief Generates source code for input maps. 
+        * @brief Registers input map graph for generation.
+        *
+        * Graphs are canonicalized by structure: identical graphs share single
+        * generated function no matter which objects they are built of, leafs are
+        * referenced through per input map table in input map data.
+        * Each input map is also compiled into bytecode evaluated by
+        * InterpretInputMap when the program has no generated code for its structure.
+        * Input map data layout is:
+        *   [input map 0 header][leaf references][bytecode]...[input map N ...][constants][leafs]
+        * Header holds structure hash and bytecode offset (-1 if graph is too deep
+        * for interpreter stack), leaf references hold offsets of leafs.
+        * Constant leafs are written by generator itself, equal values share single item.
+        *
+        * @param input input map to add
+        * @return offset of input map header in input map data
+        */
+        std::int32_t AddInputMap(std::shared_ptr<Baikal::InputMap> input);
+
+        /**
+        * @brief Generates source code for registered input maps.
         *
         * Code stored inside Generator object.
-        * Makes lookups into leaf collectors to get parameters
-        * Each input map will create single function that will output float4 value
+        * Each distinct structure will create single function that will output float4 value.
+        * Functions are selected by structure hash, so the code doesn't depend
+        * on object ids or scene order and changes only when new structure appears.
+        * Programs compiled with previous code keep working on new data,
+        * unknown structures fall back to the interpreter.
+        */
+        void Generate();
+
+        /**
+        * @brief Writes input map headers, leaf references and bytecode.
         *
-        * @param input_map_collector set of input maps for generation
         * @param input_map_leaf_collector list of leaf nodes that holds values
+        * @param data input map data to write headers and constants to (GetLeafsOffset() items)
         */
-        void Generate(const Collector& input_map_collector, const Collector& input_map_leaf_collector);
+        void WriteInputMaps(const Collector& input_map_leaf_collector, ClwScene::InputMapData* data) const;
 
         // Returns generated source
         const std::string& GetGeneratedSource() const
@@ -53,15 +83,72 @@ namespace Baikal
             return m_source_code;
         }
 
+        // Checks if every registered input map can be evaluated by interpreter
+        bool IsInterpretable() const
+        {
+            return m_interpretable;
+        }
+
+        // Returns offset of collector leafs in input map data
+        std::size_t GetLeafsOffset() const
+        {
+            return m_instances_size + m_constants.size();
+        }
+
     private:
-        // Proceed single input, writes function header and function call
-        void GenerateSingleInput(std::shared_ptr<Baikal::InputMap> input, const Collector& input_map_leaf_collector);
+        // Mirrors ClwScene::InputMapData::instruction
+        struct Instruction
+        {
+            std::int32_t op;
+            std::int32_t args[3];
+        };
+
+        struct Instance
+        {
+            // Index into m_structures
+            std::size_t structure;
+            // Offset of header in input map data
+            std::int32_t offset;
+            // Referenced leafs in the order of generated reads
+            std::vector<std::shared_ptr<Baikal::InputMap>> leafs;
+            // Bytecode, empty if graph doesn't fit interpreter stack
+            std::vector<Instruction> bytecode;
+            // Leaf instructions and leafs they read, args[0] is patched with leaf offset
+            std::vector<std::pair<std::size_t, std::shared_ptr<Baikal::InputMap>>> bytecode_leafs;
+        };
+
+        // Adds constant leaf value to constant pool
+        void AddConstant(std::shared_ptr<Baikal::InputMap> leaf);
+        // Returns offset of leaf in input map data
+        int GetLeafOffset(const Collector& input_map_leaf_collector, std::shared_ptr<Baikal::InputMap> leaf) const;
         // Writes source code for single input map. Called recursively.
-        void GenerateInputSource(std::shared_ptr<Baikal::InputMap> input, const Collector& input_map_leaf_collector);
+        void GenerateInputSource(std::shared_ptr<Baikal::InputMap> input);
+        // Adds leaf reference to current structure and returns its read expression
+        std::string ReadLeaf(std::shared_ptr<Baikal::InputMap> leaf);
+        // Writes bytecode for single input map and returns its stack depth. Called recursively.
+        std::uint32_t GenerateBytecode(std::shared_ptr<Baikal::InputMap> input, Instance& instance) const;
+        // Writes bytecode for operations with one, two or three inputs
+        template <typename T>
+        std::uint32_t GenerateUnary(T const& input, std::int32_t op, Instance& instance) const;
+        template <typename T>
+        std::uint32_t GenerateBinary(T const& input, std::int32_t op, Instance& instance) const;
+
         std::string m_source_code;
-        std::string m_read_functions;
-        std::string m_float4_selector;
-        std::string m_float_selector;
-        std::set<uint32_t> m_generated_inputs;
+        // Source of the structure being generated and leafs it references
+        std::string m_structure_source;
+        std::vector<std::shared_ptr<Baikal::InputMap>> m_structure_leafs;
+        // Distinct structure sources
+        std::vector<std::string> m_structures;
+        std::unordered_map<std::string, std::size_t> m_structure_indices;
+        // Hash of each structure, selects generated function in kernels
+        std::vector<std::uint32_t> m_structure_hashes;
+        // Registered input maps by id
+        std::map<std::uint32_t, Instance> m_instances;
+        std::size_t m_instances_size = 0;
+        // Constant pool values, pool indices by value bits and by constant leaf id
+        std::vector<RadeonRays::float3> m_constants;
+        std::map<std::array<std::uint32_t, 3>, std::size_t> m_constant_indices;
+        std::unordered_map<std::uint32_t, std::size_t> m_constant_leafs;
+        bool m_interpretable = true;
     };
 }
@@ -0,0 +1,144 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "cl_memory_manager.h"
+
+#include <algorithm>
+#include <string>
+
+namespace Baikal
+{
+    CLMemoryManager::CLMemoryManager(CLWContext context)
+        : m_context(context)
+        , m_budget(0)
+    {
+        m_usage.fill(0);
+    }
+
+    void CLMemoryManager::SetBudget(std::size_t budget)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget = budget;
+    }
+
+    std::size_t CLMemoryManager::GetBudget() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_budget;
+    }
+
+    std::size_t CLMemoryManager::GetUsage(Category category) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_usage[static_cast<std::size_t>(category)];
+    }
+
+    std::size_t CLMemoryManager::GetUsage() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::size_t usage = 0;
+        for (auto size : m_usage)
+        {
+            usage += size;
+        }
+
+        return usage;
+    }
+
+    std::size_t CLMemoryManager::GetMaxAllocation() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::size_t max_allocation = 0;
+        for (auto const& allocation : m_allocations)
+        {
+            max_allocation = std::max(max_allocation, allocation.second.size);
+        }
+
+        return max_allocation;
+    }
+
+    std::size_t CLMemoryManager::GetDeviceMemorySize() const
+    {
+        return static_cast<std::size_t>(m_context.GetDevice(0).GetGlobalMemSize());
+    }
+
+    std::size_t CLMemoryManager::GetCapacity(void const* owner, std::size_t preferred, std::size_t required, std::size_t element_size) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_budget == 0)
+        {
+            return preferred;
+        }
+
+        // Buffer being replaced doesn't count
+        std::size_t usage = 0;
+        for (auto size : m_usage)
+        {
+            usage += size;
+        }
+
+        auto iter = m_allocations.find(owner);
+        if (iter != m_allocations.cend())
+        {
+            usage -= iter->second.size;
+        }
+
+        if (usage + preferred * element_size <= m_budget)
+        {
+            return preferred;
+        }
+
+        if (usage + required * element_size <= m_budget)
+        {
+            return required;
+        }
+
+        throw MemoryBudgetError("CLMemoryManager: allocation of " + std::to_string(required * element_size) +
+                                " bytes exceeds memory budget of " + std::to_string(m_budget) + " bytes");
+    }
+
+    void CLMemoryManager::Track(void const* owner, std::size_t size, Category category)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto& allocation = m_allocations[owner];
+        m_usage[static_cast<std::size_t>(allocation.category)] -= allocation.size;
+
+        allocation.size = size;
+        allocation.category = category;
+        m_usage[static_cast<std::size_t>(category)] += size;
+    }
+
+    void CLMemoryManager::Untrack(void const* owner)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto iter = m_allocations.find(owner);
+        if (iter != m_allocations.end())
+        {
+            m_usage[static_cast<std::size_t>(iter->second.category)] -= iter->second.size;
+            m_allocations.erase(iter);
+        }
+    }
+}
@@ -0,0 +1,191 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include "CLW.h"
+
+namespace Baikal
+{
+    // Thrown when allocation doesn't fit memory budget
+    class MemoryBudgetError : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * @brief Allocates and accounts device buffers of a single CL context.
+     *
+     * Buffers are tracked by the CLWBuffer object they are stored in and accounted
+     * per category. Growing buffers reuse existing storage if it is large enough
+     * and double their capacity otherwise (at most kMaxSlackSize bytes over the
+     * requested size, so large texture pools don't double). If memory budget is set, allocations
+     * that don't fit it throw MemoryBudgetError before anything is allocated.
+     * Buffers have to be released through the manager before their owner is destroyed
+     * unless the manager is destroyed first. All methods are thread safe.
+     */
+    class CLMemoryManager
+    {
+    public:
+        enum class Category
+        {
+            kGeometry = 0,
+            kTextures,
+            kMaterials,
+            kLights,
+            kWorkBuffers,
+            kOther,
+            kCount
+        };
+
+        explicit CLMemoryManager(CLWContext context);
+
+        // Creates buffer of exactly size elements replacing the previous one
+        template <typename T>
+        void Create(CLWBuffer<T>& buffer, std::size_t size, Category category,
+                    cl_mem_flags flags = CL_MEM_READ_ONLY, T* data = nullptr);
+        // Makes buffer hold at least size elements, contents are discarded if it is reallocated
+        template <typename T>
+        void Reserve(CLWBuffer<T>& buffer, std::size_t size, Category category,
+                     cl_mem_flags flags = CL_MEM_READ_ONLY);
+        // Makes buffer hold at least size elements preserving its contents
+        template <typename T>
+        void Grow(CLWBuffer<T>& buffer, std::size_t size, Category category,
+                  cl_mem_flags flags = CL_MEM_READ_ONLY);
+        // Releases buffer
+        template <typename T>
+        void Release(CLWBuffer<T>& buffer);
+
+        // Sets memory budget in bytes, 0 means no limit
+        void SetBudget(std::size_t budget);
+        std::size_t GetBudget() const;
+        // Returns number of bytes allocated for category
+        std::size_t GetUsage(Category category) const;
+        // Returns number of bytes allocated for all categories
+        std::size_t GetUsage() const;
+        // Returns size of the largest allocation in bytes
+        std::size_t GetMaxAllocation() const;
+        // Returns global memory size of the device
+        std::size_t GetDeviceMemorySize() const;
+
+    private:
+        // Maximum number of bytes growing buffers get over requested size
+        static constexpr std::size_t kMaxSlackSize = 64u * 1024u * 1024u;
+
+        struct Allocation
+        {
+            std::size_t size;
+            Category category;
+        };
+
+        // Returns grown capacity in elements for buffer of count elements to hold size elements
+        static std::size_t GetGrownSize(std::size_t count, std::size_t size, std::size_t element_size)
+        {
+            return std::max(size, std::min(2 * count, size + kMaxSlackSize / element_size));
+        }
+        // Returns capacity in elements for buffer to be reallocated with,
+        // preferred capacity is used if it fits the budget, required one otherwise
+        std::size_t GetCapacity(void const* owner, std::size_t preferred, std::size_t required, std::size_t element_size) const;
+        // Records allocation of owner replacing previous one
+        void Track(void const* owner, std::size_t size, Category category);
+        // Drops allocation of owner
+        void Untrack(void const* owner);
+
+        CLWContext m_context;
+        mutable std::mutex m_mutex;
+        std::size_t m_budget;
+        std::array<std::size_t, static_cast<std::size_t>(Category::kCount)> m_usage;
+        // Allocations by owning buffer object
+        std::map<void const*, Allocation> m_allocations;
+    };
+
+    template <typename T>
+    inline void CLMemoryManager::Create(CLWBuffer<T>& buffer, std::size_t size, Category category,
+                                        cl_mem_flags flags, T* data)
+    {
+        GetCapacity(&buffer, size, size, sizeof(T));
+
+        // Drop previous buffer first so its memory can be reused
+        buffer = CLWBuffer<T>();
+        Untrack(&buffer);
+
+        buffer = data ? m_context.CreateBuffer<T>(size, flags, data) : m_context.CreateBuffer<T>(size, flags);
+        Track(&buffer, size * sizeof(T), category);
+    }
+
+    template <typename T>
+    inline void CLMemoryManager::Reserve(CLWBuffer<T>& buffer, std::size_t size, Category category,
+                                         cl_mem_flags flags)
+    {
+        auto count = buffer.GetElementCount();
+
+        if (size <= count)
+        {
+            return;
+        }
+
+        auto capacity = GetCapacity(&buffer, GetGrownSize(count, size, sizeof(T)), size, sizeof(T));
+
+        buffer = CLWBuffer<T>();
+        Untrack(&buffer);
+
+        buffer = m_context.CreateBuffer<T>(capacity, flags);
+        Track(&buffer, capacity * sizeof(T), category);
+    }
+
+    template <typename T>
+    inline void CLMemoryManager::Grow(CLWBuffer<T>& buffer, std::size_t size, Category category,
+                                      cl_mem_flags flags)
+    {
+        auto count = buffer.GetElementCount();
+
+        if (size <= count)
+        {
+            return;
+        }
+
+        auto capacity = GetCapacity(&buffer, GetGrownSize(count, size, sizeof(T)), size, sizeof(T));
+        auto new_buffer = m_context.CreateBuffer<T>(capacity, flags);
+
+        if (count > 0)
+        {
+            m_context.CopyBuffer(0, buffer, new_buffer, 0, 0, count).Wait();
+        }
+
+        buffer = new_buffer;
+        Track(&buffer, capacity * sizeof(T), category);
+    }
+
+    template <typename T>
+    inline void CLMemoryManager::Release(CLWBuffer<T>& buffer)
+    {
+        buffer = CLWBuffer<T>();
+        Untrack(&buffer);
+    }
+}
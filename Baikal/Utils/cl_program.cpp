@@ -27,87 +27,36 @@ THE SOFTWARE.
 #include <iostream>
 #include <algorithm>
 #include <fstream>
-#include <sstream>
-#include <regex>
 
 #include "cl_program_manager.h"
+#include "cl_program_cache.h"
 #include "version.h"
-#include "Utils/mkpath.h"
 
 //#define DUMP_PROGRAM_SOURCE 1
 
 using namespace Baikal;
 
-inline std::uint32_t jenkins_one_at_a_time_hash(char const *key, size_t len)
+namespace
 {
-    std::uint32_t hash, i;
-    for (hash = i = 0; i < len; ++i)
+    std::string GetDriverVersion(CLWDevice const& device)
     {
-        hash += key[i];
-        hash += (hash << 10);
-        hash ^= (hash >> 6);
-    }
-    hash += (hash << 3);
-    hash ^= (hash >> 11);
-    hash += (hash << 15);
-    return hash;
-}
-
-// Computting check sum algo
-// Copy from here: https://codereview.stackexchange.com/questions/104948/32-bit-checksum-of-a-file
-inline std::uint32_t CheckSum(const std::string &source)
-{
-    std::uint32_t check_sum = 0;
-    unsigned shift = 0;
-    for (uint32_t ch : source)
-    {
-        check_sum += (ch << shift);
-        shift += 8;
-        if (shift == 32) {
-            shift = 0;
+        std::size_t size = 0;
+        if (clGetDeviceInfo(device.GetID(), CL_DRIVER_VERSION, 0, nullptr, &size) != CL_SUCCESS || size == 0)
+        {
+            return "";
         }
-    }
-    return check_sum;
-}
-
-inline bool LoadBinaries(std::string const& name, std::vector<std::uint8_t>& data)
-{
-    std::ifstream in(name, std::ios::in | std::ios::binary);
-    if (in)
-    {
-        data.clear();
-        std::streamoff beg = in.tellg();
-        in.seekg(0, std::ios::end);
-        std::streamoff fileSize = in.tellg() - beg;
-        in.seekg(0, std::ios::beg);
-        data.resize(static_cast<unsigned>(fileSize));
-        in.read((char*)&data[0], fileSize);
-        return true;
-    }
-    else
-    {
-        return false;
-    }
-}
 
-inline void SaveBinaries(std::string const& name, std::vector<std::uint8_t>& data)
-{
-    mkfilepath(name);
-
-    std::ofstream out(name, std::ios::out | std::ios::binary);
-
-    if (out)
-    {
-        out.write((char*)&data[0], data.size());
+        std::vector<char> version(size);
+        clGetDeviceInfo(device.GetID(), CL_DRIVER_VERSION, size, version.data(), nullptr);
+        return std::string(version.data());
     }
 }
 
-
 CLProgram::CLProgram(const CLProgramManager *program_manager, uint32_t id, CLWContext context,
-                     const std::string &program_name, const std::string &cache_path) :
+                     const std::string &program_name, CLProgramCache *cache) :
     m_program_manager(program_manager),
     m_program_name(program_name),
-    m_cache_path(cache_path),
+    m_cache(cache),
     m_id(id),
     m_context(context)
 {
@@ -117,6 +66,7 @@ void CLProgram::SetSource(const std::string &source)
 {
     m_compiled_source.reserve(1024 * 1024); //Just reserve 1M for now
     m_program_source = source;
+    m_source_hash = ComputeHash128(m_program_source);
     ParseSource(m_program_source);
 }
 
@@ -174,7 +124,73 @@ void CLProgram::BuildSource(const std::string &source)
     m_compiled_source += source.substr(offset);
 }
 
+void CLProgram::CollectHeaders(const std::string &source, std::set<std::string> &headers) const
+{
+    std::string::size_type offset = 0;
+    std::string::size_type position = 0;
+    std::string find_str("#include");
+    while ((position = source.find(find_str, offset)) != std::string::npos)
+    {
+        std::string::size_type end_position = source.find(">", position);
+        assert(end_position != std::string::npos);
+        std::string fname = source.substr(position, end_position - position);
+        position = fname.find("<");
+        assert(position != std::string::npos);
+        fname = fname.substr(position + 1, fname.length() - position);
+        offset = end_position;
+
+        if (headers.insert(fname).second)
+        {
+            CollectHeaders(m_program_manager->ReadHeader(fname), headers);
+        }
+    }
+}
+
+void CLProgram::ResetIfDirty()
+{
+    if (m_is_dirty)
+    {
+        if (m_keep_stale)
+        {
+            for (auto const& program : m_programs)
+            {
+                m_stale_programs[program.first] = program.second;
+            }
+        }
+        else
+        {
+            m_stale_programs.clear();
+        }
+
+        m_programs.clear();
+        m_pending.clear();
+        m_compiled_source.clear();
+        m_included_headers.clear();
+        m_is_dirty = false;
+        ++m_generation;
+    }
+}
+
+void CLProgram::UpdateCompiledSource()
+{
+    ResetIfDirty();
+
+    if (m_compiled_source.empty())
+    {
+        BuildSource(m_program_source);
+    }
+}
+
 CLWProgram CLProgram::Compile(const std::string &opts)
+{
+    UpdateCompiledSource();
+    auto program = CompileSource(m_compiled_source, opts);
+
+    m_is_dirty = false;
+    return program;
+}
+
+CLWProgram CLProgram::CompileSource(const std::string &source, const std::string &opts) const
 {
     std::chrono::time_point<std::chrono::high_resolution_clock> start, end;
     start = std::chrono::high_resolution_clock::now();
@@ -182,14 +198,14 @@ CLWProgram CLProgram::Compile(const std::string &opts)
     CLWProgram compiled_program;
     try
     {
-        compiled_program = CLWProgram::CreateFromSource(m_compiled_source.c_str(), m_compiled_source.size(), opts.c_str(), m_context);
+        compiled_program = CLWProgram::CreateFromSource(source.c_str(), source.size(), opts.c_str(), m_context);
         /*
          * Code below usable for cache debugging
          */
 #ifdef DUMP_PROGRAM_SOURCE
         auto e = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
         std::ofstream file(m_program_name + std::to_string(e) + ".cl");
-        file << m_compiled_source;
+        file << source;
         file.close();
 #endif
     }
@@ -199,16 +215,15 @@ CLWProgram CLProgram::Compile(const std::string &opts)
         std::cerr << "Dumping source to file:" << m_program_name << ".cl.failed" << std::endl;
         std::string fname = m_program_name + ".cl.failed";
         std::ofstream file(fname);
-        file << m_compiled_source;
+        file << source;
         file.close();
         throw;
     }
 
     end = std::chrono::high_resolution_clock::now();
     int elapsed_ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-    std::cerr << "Program compilation time: " << elapsed_ms << " ms" << std::endl;
+    std::cerr << "Program compilation time (" << m_program_name << "): " << elapsed_ms << " ms" << std::endl;
 
-    m_is_dirty = false;
     return compiled_program;
 }
 
@@ -219,87 +234,170 @@ bool CLProgram::IsHeaderNeeded(const std::string &header_name) const
 
 CLWProgram CLProgram::GetCLWProgram(const std::string &opts)
 {
-    // global dirty flag
-    if (m_is_dirty)
-    {
-        m_programs.clear();
-        m_compiled_source.clear();
-        m_included_headers.clear();
-        BuildSource(m_program_source);
-    }
+    return m_program_manager->GetProgram(m_id, opts);
+}
+
+std::shared_future<CLWProgram> CLProgram::GetCLWProgramAsync(const std::string &opts)
+{
+    // global dirty flag, full source is rebuilt lazily only if we need to compile
+    ResetIfDirty();
 
     auto it = m_programs.find(opts);
     if (it != m_programs.end())
     {
-        return it->second;
+        std::promise<CLWProgram> ready;
+        ready.set_value(it->second);
+        return ready.get_future().share();
     }
 
-    CLWProgram result;
-    //check if we can get it from cache
-    if (!m_cache_path.empty())
+    // Returns stale program while compilation is in progress
+    auto with_stale = [this, &opts](std::shared_future<CLWProgram> future)
     {
-        std::string filename = GetFilenameHash(opts);
-
-        auto cached_program_path = m_cache_path;
-        cached_program_path.append("/");
-        cached_program_path.append(filename);
-        cached_program_path.append(".bin");
-
-        std::vector<std::uint8_t> binary;
-        if (LoadBinaries(cached_program_path, binary))
+        auto stale = m_stale_programs.find(opts);
+        if (stale == m_stale_programs.end())
         {
-            // Create from binary
-            std::size_t size = binary.size();
-            auto binaries = &binary[0];
-            result = CLWProgram::CreateFromBinary(&binaries, &size, m_context);
-            m_programs[opts] = result;
+            return future;
         }
-        else
-        {
-            result = Compile(opts);
-            m_programs[opts] = result;
 
-            // Save binaries
-            result.GetBinaries(0, binary);
-            SaveBinaries(cached_program_path, binary);
+        if (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            m_stale_programs.erase(stale);
+            return future;
         }
-    }
 
-    m_is_dirty = false;
-    return result;
-}
+        std::promise<CLWProgram> ready;
+        ready.set_value(stale->second);
+        return ready.get_future().share();
+    };
 
-std::string CLProgram::GetFilenameHash(std::string const& opts) const
-{
-    auto name = m_program_name;
-    auto device_name = m_context.GetDevice(0).GetName();
+    auto pending = m_pending.find(opts);
+    if (pending != m_pending.end())
+    {
+        return with_stale(pending->second);
+    }
 
-    std::regex forbidden("(\\\\)|[\\./:<>\\\"\\|\\?\\*]");
+    //check if we can get it from cache
+    Hash128 key;
+    bool has_binary = false;
+    if (m_cache)
+    {
+        key = GetCacheKey(opts);
+        has_binary = m_cache->Contains(key);
+    }
 
-    device_name = std::regex_replace(device_name, forbidden, "_");
-    device_name.erase(
-        std::remove_if(device_name.begin(), device_name.end(), isspace),
-                      device_name.end());
+    // Full source is only needed on cache miss, headers can't be safely read from worker threads
+    std::string source;
+    if (!has_binary)
+    {
+        UpdateCompiledSource();
+        source = m_compiled_source;
+    }
 
-    name.append("_");
-    name.append(device_name);
+    auto generation = m_generation;
+    auto future = m_program_manager->m_thread_pool->Submit([this, opts, key, source, generation]()
+    {
+        return Build(opts, key, source, generation);
+    }).share();
 
-    auto extra = m_context.GetDevice(0).GetVersion();
-    extra.append(opts);
+    m_pending[opts] = future;
+    return with_stale(future);
+}
 
-    std::ostringstream oss;
-    oss << jenkins_one_at_a_time_hash(extra.c_str(), extra.size());
+CLWProgram CLProgram::Build(const std::string &opts, Hash128 const& key, const std::string &source, uint32_t generation)
+{
+    CLWProgram result;
 
-    name.append("_");
-    name.append(oss.str());
+    try
+    {
+        bool loaded = false;
+        if (m_cache && source.empty())
+        {
+            std::vector<std::uint8_t> binary;
+            if (m_cache->Load(key, binary))
+            {
+                try
+                {
+                    // Create from binary
+                    std::size_t size = binary.size();
+                    auto binaries = &binary[0];
+                    result = CLWProgram::CreateFromBinary(&binaries, &size, m_context);
+                    loaded = true;
+                }
+                catch (CLWException&)
+                {
+                    // Binary rejected by the driver, recompile
+                    m_cache->Remove(key);
+                }
+            }
+        }
 
+        if (!loaded)
+        {
+            auto compiled_source = source;
+            // Source might change after the key was computed, don't cache binaries in this case
+            bool store = m_cache && !source.empty();
+
+            if (compiled_source.empty())
+            {
+                std::lock_guard<std::recursive_mutex> lock(m_program_manager->m_mutex);
+                UpdateCompiledSource();
+                compiled_source = m_compiled_source;
+            }
+
+            result = CompileSource(compiled_source, opts);
+
+            if (store)
+            {
+                // Save binaries
+                std::vector<std::uint8_t> binary;
+                result.GetBinaries(0, binary);
+                m_cache->Store(key, m_program_name + " " + m_context.GetDevice(0).GetName(), binary);
+            }
+        }
+    }
+    catch (...)
+    {
+        // Allow retrying failed compilation
+        std::lock_guard<std::recursive_mutex> lock(m_program_manager->m_mutex);
+        if (generation == m_generation)
+        {
+            m_pending.erase(opts);
+        }
+        throw;
+    }
 
-    std::uint32_t file_hash = CheckSum(m_compiled_source);
+    std::lock_guard<std::recursive_mutex> lock(m_program_manager->m_mutex);
+    if (generation == m_generation)
+    {
+        m_programs[opts] = result;
+        m_pending.erase(opts);
+        m_stale_programs.erase(opts);
+    }
 
-    name.append("_");
-    name.append(std::to_string(file_hash));
+    return result;
+}
 
-    name.append(BAIKAL_VERSION);
+Hash128 CLProgram::GetCacheKey(std::string const& opts) const
+{
+    auto device = m_context.GetDevice(0);
+
+    Hasher hasher;
+    hasher.Append(BAIKAL_VERSION)
+          .Append(device.GetName())
+          .Append(device.GetVersion())
+          .Append(GetDriverVersion(device))
+          .Append(opts)
+          .Append(m_program_name)
+          .Append(m_source_hash);
+
+    // Headers are hashed in name order to get a stable key
+    std::set<std::string> headers;
+    CollectHeaders(m_program_source, headers);
+
+    for (auto const& header : headers)
+    {
+        hasher.Append(header).Append(m_program_manager->GetHeaderHash(header));
+    }
 
-    return name;
+    return hasher.GetHash();
 }
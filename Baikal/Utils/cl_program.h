@@ -25,24 +25,37 @@ THE SOFTWARE.
 #include <string>
 #include <vector>
 #include <set>
+#include <future>
 #include <unordered_map>
 #include <unordered_set>
 #include "CLWProgram.h"
 #include "CLWContext.h"
+#include "hash.h"
 
 namespace Baikal
 {
     class CLProgramManager;
+    class CLProgramCache;
     class CLProgram
     {
     public:
         CLProgram() = default;
         // Constructs CLProgram empty object
-        CLProgram(const CLProgramManager *program_manager, uint32_t id, CLWContext context, const std::string &program_name, const std::string &cache_path);
+        CLProgram(const CLProgramManager *program_manager, uint32_t id, CLWContext context, const std::string &program_name, CLProgramCache *cache);
         // Check if program should be recompiled
         bool IsDirty() const { return m_is_dirty; }
-        // Sets dirty flag on program
-        void SetDirty() { m_is_dirty = true; }
+        /**
+         * @brief Sets dirty flag on program
+         *
+         * If keep_stale is set, previously compiled programs are returned until
+         * programs with the new source are compiled in background. Callers must
+         * make sure stale programs stay valid with the new data.
+         */
+        void SetDirty(bool keep_stale = false)
+        {
+            m_keep_stale = m_is_dirty ? (m_keep_stale && keep_stale) : keep_stale;
+            m_is_dirty = true;
+        }
         // Returns program id
         uint32_t GetId() const { return m_id; }
         /**
@@ -59,9 +72,18 @@ namespace Baikal
          * This function will build program and compile it if it's durty.
          * This function respronsible for shader cache handling. If required program
          * already exists in disk or in-memory cache returns it.
-         * For caching uses simple uint32 crc of source code.
+         * Disk cache is keyed by a 128-bit hash of program and header sources, options
+         * and device, so lookups don't require building full program source.
          */
         CLWProgram GetCLWProgram(const std::string &opts);
+        /**
+         * @brief returns future for CLWProgram object
+         *
+         * Same as GetCLWProgram, but cache loading and compilation are done on
+         * CLProgramManager worker threads. Repeated requests for the same options
+         * share a single compilation. Must be called under CLProgramManager lock.
+         */
+        std::shared_future<CLWProgram> GetCLWProgramAsync(const std::string &opts);
 
         // Checks if specified header required by program
         bool IsHeaderNeeded(const std::string &header_name) const;
@@ -78,19 +100,38 @@ namespace Baikal
          * Duplicate includes removed.
          */
         void BuildSource(const std::string &source);
-        // Returns hash for file name
-        std::string GetFilenameHash(std::string const& opts) const;
+        // Recursively collects headers included by source (headers are not loaded)
+        void CollectHeaders(const std::string &source, std::set<std::string> &headers) const;
+        // Drops compiled programs and full source if program is dirty
+        void ResetIfDirty();
+        // Builds full program source if it is not built yet
+        void UpdateCompiledSource();
+        // Returns disk cache key
+        Hash128 GetCacheKey(std::string const& opts) const;
+        // Compiles provided full source
+        CLWProgram CompileSource(const std::string &source, const std::string &opts) const;
+        /**
+         * Loads program from disk cache (if source is empty) or compiles it.
+         * Called on worker thread, result is dropped if program became dirty
+         * after the request (generation changed).
+         */
+        CLWProgram Build(const std::string &opts, Hash128 const& key, const std::string &source, uint32_t generation);
 
-        const CLProgramManager *m_program_manager;
+        const CLProgramManager *m_program_manager = nullptr;
         std::string m_program_name;    ///< Program name
-        std::string m_cache_path;      ///< Cache folder path
+        CLProgramCache *m_cache = nullptr; ///< Disk cache (optional)
+        Hash128 m_source_hash;         ///< Hash of program source code
         std::string m_compiled_source; ///< Final program source with all headers
         std::string m_program_source;  ///< Program source code without modifications
         std::unordered_set<std::string> m_required_headers; ///< Set of required headers
 
         std::unordered_map<std::string, CLWProgram> m_programs; ///< In-memory cache for compiled programs
+        std::unordered_map<std::string, std::shared_future<CLWProgram>> m_pending; ///< Programs being compiled
+        std::unordered_map<std::string, CLWProgram> m_stale_programs; ///< Programs used while their replacements compile
+        uint32_t m_generation = 0; ///< Incremented each time program is reset
 
         bool m_is_dirty = true;
+        bool m_keep_stale = false;
         uint32_t m_id;
         CLWContext m_context;
         std::set<std::string> m_included_headers; ///< Set of included headers
@@ -0,0 +1,328 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "cl_program_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "Utils/mkpath.h"
+#include "Utils/log.h"
+
+namespace Baikal
+{
+    namespace
+    {
+        char const kIndexFileName[] = "index.txt";
+        char const kIndexHeader[] = "# Baikal program cache index v1";
+
+        bool ParseKey(std::string const& str, Hash128& key)
+        {
+            if (str.size() != 32)
+            {
+                return false;
+            }
+
+            std::uint64_t parts[2] = { 0, 0 };
+            for (std::size_t i = 0; i < 32; ++i)
+            {
+                auto c = str[i];
+                std::uint64_t digit = 0;
+                if (c >= '0' && c <= '9') digit = c - '0';
+                else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+                else return false;
+
+                parts[i / 16] = (parts[i / 16] << 4) | digit;
+            }
+
+            key.hi = parts[0];
+            key.lo = parts[1];
+            return true;
+        }
+
+        bool ReadFile(std::string const& name, std::vector<std::uint8_t>& data)
+        {
+            std::ifstream in(name, std::ios::in | std::ios::binary);
+            if (!in)
+            {
+                return false;
+            }
+
+            in.seekg(0, std::ios::end);
+            auto size = static_cast<std::size_t>(in.tellg());
+            in.seekg(0, std::ios::beg);
+
+            data.resize(size);
+            in.read(reinterpret_cast<char*>(data.data()), size);
+            return size > 0 && static_cast<bool>(in);
+        }
+
+        std::size_t GetFileSize(std::string const& name)
+        {
+            std::ifstream in(name, std::ios::in | std::ios::binary | std::ios::ate);
+            return in ? static_cast<std::size_t>(in.tellg()) : 0u;
+        }
+    }
+
+    CLProgramCache::CLProgramCache(std::string const& path, std::size_t max_size)
+        : m_path(path)
+        , m_max_size(max_size)
+        , m_total_size(0)
+        , m_access_counter(0)
+        , m_index_dirty(false)
+    {
+        ReadIndex(m_entries, m_access_counter);
+
+        for (auto const& entry : m_entries)
+        {
+            m_total_size += entry.second.size;
+        }
+    }
+
+    CLProgramCache::~CLProgramCache()
+    {
+        SaveIndex();
+    }
+
+    std::string CLProgramCache::GetBinaryPath(Hash128 const& key) const
+    {
+        return m_path + "/" + key.ToString() + ".bin";
+    }
+
+    std::string CLProgramCache::GetIndexPath() const
+    {
+        return m_path + "/" + kIndexFileName;
+    }
+
+    std::size_t CLProgramCache::GetSizeInBytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_total_size;
+    }
+
+    bool CLProgramCache::Contains(Hash128 const& key) const
+    {
+        return GetFileSize(GetBinaryPath(key)) > 0;
+    }
+
+    bool CLProgramCache::Load(Hash128 const& key, std::vector<std::uint8_t>& binary)
+    {
+        // Reading the file is done outside of the lock, binaries are immutable once written
+        if (!ReadFile(GetBinaryPath(key), binary))
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto iter = m_entries.find(key);
+        if (iter == m_entries.end())
+        {
+            // Stored by another cache instance sharing the folder
+            iter = m_entries.emplace(key, Entry{ binary.size(), 0, "" }).first;
+            m_total_size += binary.size();
+        }
+
+        iter->second.last_access = ++m_access_counter;
+        m_index_dirty = true;
+        return true;
+    }
+
+    void CLProgramCache::Store(Hash128 const& key, std::string const& description, std::vector<std::uint8_t> const& binary)
+    {
+        if (binary.empty())
+        {
+            return;
+        }
+
+        auto name = GetBinaryPath(key);
+        mkfilepath(name);
+
+        // Write to a temporary file first so concurrent readers never see partial binaries
+        auto tmp_name = name + ".tmp" + std::to_string(reinterpret_cast<std::uintptr_t>(this));
+        {
+            std::ofstream out(tmp_name, std::ios::out | std::ios::binary);
+            if (!out)
+            {
+                return;
+            }
+            out.write(reinterpret_cast<char const*>(binary.data()), binary.size());
+        }
+
+        std::remove(name.c_str());
+        if (std::rename(tmp_name.c_str(), name.c_str()) != 0)
+        {
+            std::remove(tmp_name.c_str());
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto iter = m_entries.find(key);
+            if (iter != m_entries.end())
+            {
+                m_total_size -= iter->second.size;
+            }
+
+            m_entries[key] = Entry{ binary.size(), ++m_access_counter, description };
+            m_total_size += binary.size();
+            m_index_dirty = true;
+
+            Evict();
+        }
+
+        SaveIndex();
+    }
+
+    void CLProgramCache::Remove(Hash128 const& key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto iter = m_entries.find(key);
+        if (iter != m_entries.end())
+        {
+            m_total_size -= iter->second.size;
+            m_entries.erase(iter);
+            m_index_dirty = true;
+        }
+
+        std::remove(GetBinaryPath(key).c_str());
+    }
+
+    void CLProgramCache::Evict()
+    {
+        if (m_max_size == 0 || m_total_size <= m_max_size)
+        {
+            return;
+        }
+
+        std::vector<std::pair<std::uint64_t, Hash128>> lru;
+        lru.reserve(m_entries.size());
+        for (auto const& entry : m_entries)
+        {
+            lru.emplace_back(entry.second.last_access, entry.first);
+        }
+
+        std::sort(lru.begin(), lru.end());
+
+        // Always keep the most recent binary even if it alone exceeds the limit
+        for (std::size_t i = 0; i + 1 < lru.size() && m_total_size > m_max_size; ++i)
+        {
+            auto iter = m_entries.find(lru[i].second);
+            LogInfo("Program cache: evicting ", iter->second.description, " (", iter->second.size, " bytes)\n");
+
+            m_total_size -= iter->second.size;
+            std::remove(GetBinaryPath(iter->first).c_str());
+            m_entries.erase(iter);
+        }
+
+        m_index_dirty = true;
+    }
+
+    void CLProgramCache::ReadIndex(EntryMap& entries, std::uint64_t& access_counter) const
+    {
+        std::ifstream in(GetIndexPath());
+        if (!in)
+        {
+            return;
+        }
+
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+
+            // <key> <size> <last access> <description>
+            std::istringstream iss(line);
+            std::string key_str;
+            Entry entry;
+            if (!(iss >> key_str >> entry.size >> entry.last_access))
+            {
+                continue;
+            }
+            std::getline(iss >> std::ws, entry.description);
+
+            Hash128 key;
+            if (!ParseKey(key_str, key))
+            {
+                continue;
+            }
+
+            // Skip binaries removed behind our back
+            if (GetFileSize(GetBinaryPath(key)) != entry.size)
+            {
+                continue;
+            }
+
+            access_counter = std::max(access_counter, entry.last_access);
+            entries[key] = entry;
+        }
+    }
+
+    void CLProgramCache::SaveIndex()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_index_dirty)
+        {
+            return;
+        }
+
+        // Merge entries stored by other caches sharing the folder
+        EntryMap disk_entries;
+        std::uint64_t disk_counter = 0;
+        ReadIndex(disk_entries, disk_counter);
+
+        for (auto const& entry : disk_entries)
+        {
+            if (m_entries.find(entry.first) == m_entries.end())
+            {
+                m_entries.emplace(entry.first, entry.second);
+                m_total_size += entry.second.size;
+            }
+        }
+        m_access_counter = std::max(m_access_counter, disk_counter);
+
+        Evict();
+
+        auto name = GetIndexPath();
+        mkfilepath(name);
+
+        std::ofstream out(name);
+        if (!out)
+        {
+            return;
+        }
+
+        out << kIndexHeader << "\n";
+        for (auto const& entry : m_entries)
+        {
+            out << entry.first.ToString() << " " << entry.second.size << " "
+                << entry.second.last_access << " " << entry.second.description << "\n";
+        }
+
+        m_index_dirty = false;
+    }
+}
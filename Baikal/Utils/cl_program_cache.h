@@ -0,0 +1,94 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "hash.h"
+
+namespace Baikal
+{
+    ///< On-disk cache of compiled program binaries.
+    ///< Binaries are content addressed: each one is stored in <path>/<key>.bin where key is
+    ///< a 128-bit hash of everything affecting compilation (sources, options, device, driver).
+    ///< An index file keeps binary sizes and access order, least recently used binaries
+    ///< are evicted once the total size exceeds the limit. Several caches may share a folder,
+    ///< index is merged with the one on disk when saved. All methods are thread safe.
+    ///<
+    class CLProgramCache
+    {
+    public:
+        static std::size_t const kDefaultMaxSize = 256u * 1024u * 1024u;
+
+        // max_size of 0 disables eviction
+        explicit CLProgramCache(std::string const& path, std::size_t max_size = kDefaultMaxSize);
+        // Flushes index
+        ~CLProgramCache();
+
+        CLProgramCache(CLProgramCache const&) = delete;
+        CLProgramCache& operator = (CLProgramCache const&) = delete;
+
+        // Checks if binary for the key exists (without loading it)
+        bool Contains(Hash128 const& key) const;
+        // Loads binary, returns false if there is no binary for the key
+        bool Load(Hash128 const& key, std::vector<std::uint8_t>& binary);
+        // Stores binary, description is kept in the index for diagnostics only
+        void Store(Hash128 const& key, std::string const& description, std::vector<std::uint8_t> const& binary);
+        // Removes binary (e.g. if it was rejected by the driver)
+        void Remove(Hash128 const& key);
+
+        // Writes index to disk
+        void SaveIndex();
+
+        std::string const& GetPath() const { return m_path; }
+        // Total size of cached binaries
+        std::size_t GetSizeInBytes() const;
+
+    private:
+        struct Entry
+        {
+            std::size_t size;
+            std::uint64_t last_access;
+            std::string description;
+        };
+
+        using EntryMap = std::unordered_map<Hash128, Entry, Hash128Hasher>;
+
+        std::string GetBinaryPath(Hash128 const& key) const;
+        std::string GetIndexPath() const;
+        void ReadIndex(EntryMap& entries, std::uint64_t& access_counter) const;
+        // Drops least recently used binaries until the cache fits max size
+        void Evict();
+
+        std::string m_path;
+        std::size_t m_max_size;
+        std::size_t m_total_size;
+        std::uint64_t m_access_counter;
+        EntryMap m_entries;
+        bool m_index_dirty;
+        mutable std::mutex m_mutex;
+    };
+}
@@ -47,9 +47,13 @@ std::string ReadFile(const std::string &fname)
     return str;
 }
 CLProgramManager::CLProgramManager(const std::string &cache_path) :
-    m_cache_path(cache_path)
+    m_cache_path(cache_path),
+    m_thread_pool(std::make_unique<ThreadPool>())
 {
-
+    if (!m_cache_path.empty())
+    {
+        m_cache = std::make_unique<CLProgramCache>(m_cache_path);
+    }
 }
 
 uint32_t CLProgramManager::CreateProgramFromFile(CLWContext context, const std::string &fname) const
@@ -76,24 +80,29 @@ uint32_t CLProgramManager::CreateProgramFromFile(CLWContext context, const std::
 
 uint32_t CLProgramManager::CreateProgramFromSource(CLWContext context, const std::string &name, const std::string &source) const
 {
-    CLProgram prg(this, m_next_program_id++, context, name, m_cache_path);
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+    CLProgram prg(this, m_next_program_id++, context, name, m_cache.get());
     prg.SetSource(source);
     m_programs.insert(std::make_pair(prg.GetId(), prg));
     return prg.GetId();
 }
 
-void CLProgramManager::AddHeader(const std::string &header, const std::string &source) const
+void CLProgramManager::AddHeader(const std::string &header, const std::string &source, bool keep_stale) const
 {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
     std::string currect_header_code = m_headers[header];
     if (currect_header_code != source)
     {
         m_headers[header] = source;
+        m_header_hashes[header] = ComputeHash128(source);
 
         for (auto &program : m_programs)
         {
             if (program.second.IsHeaderNeeded(header))
             {
-                program.second.SetDirty();
+                program.second.SetDirty(keep_stale);
             }
         }
     }
@@ -107,17 +116,41 @@ void CLProgramManager::LoadHeader(const std::string &header) const
 
 const std::string& CLProgramManager::ReadHeader(const std::string &header) const
 {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
     return m_headers[header];
 }
 
+Hash128 CLProgramManager::GetHeaderHash(const std::string &header) const
+{
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+
+    auto iter = m_header_hashes.find(header);
+    if (iter != m_header_hashes.end())
+    {
+        return iter->second;
+    }
+
+    auto hash = ComputeHash128(ReadHeader(header));
+    m_header_hashes[header] = hash;
+    return hash;
+}
+
 CLWProgram CLProgramManager::GetProgram(uint32_t id, const std::string &opts) const
 {
+    // Wait outside of the lock, worker threads need it to finish
+    return GetProgramAsync(id, opts).get();
+}
+
+std::shared_future<CLWProgram> CLProgramManager::GetProgramAsync(uint32_t id, const std::string &opts) const
+{
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
     CLProgram &program = m_programs[id];
-    return program.GetCLWProgram(opts);
+    return program.GetCLWProgramAsync(opts);
 }
 
 void CLProgramManager::CompileProgram(uint32_t id, const std::string &opts) const
 {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
     CLProgram &program = m_programs[id];
     program.Compile(opts);
 }
@@ -25,19 +25,31 @@ THE SOFTWARE.
 #include <string>
 #include <stdint.h>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <future>
 #include <vector>
 
 #include "CLWProgram.h"
 #include "CLWContext.h"
 #include "cl_program.h"
+#include "cl_program_cache.h"
+#include "thread_pool.h"
 
 
 namespace Baikal
 {
+    /**
+     * @brief Owns OpenCL programs and headers they include.
+     *
+     * Programs are compiled on a pool of worker threads, so independent programs
+     * and option permutations can be requested upfront with GetProgramAsync and
+     * compile concurrently. All methods are thread safe.
+     */
     class CLProgramManager
     {
     public:
-        // Constructor
+        // Constructor, empty cache path disables disk cache
         explicit CLProgramManager(const std::string &cache_path);
         // Creates program from file and returns its id
         uint32_t CreateProgramFromFile(CLWContext context, const std::string &fname) const;
@@ -45,19 +57,35 @@ namespace Baikal
         uint32_t CreateProgramFromSource(CLWContext context, const std::string &name, const std::string &source) const;
         // Loads header from file into map of headers
         void LoadHeader(const std::string &header) const;
-        // Adds header to map from source
-        void AddHeader(const std::string &header, const std::string &source) const;
+        /**
+         * @brief Adds header to map from source
+         *
+         * Programs including the header are recompiled if the source changes.
+         * If keep_stale is set, they keep returning previously compiled programs
+         * until new ones are compiled on worker threads.
+         */
+        void AddHeader(const std::string &header, const std::string &source, bool keep_stale = false) const;
         // Reads header from disk and returns its source
         const std::string& ReadHeader(const std::string &header) const;
-        // Returns compiled program
+        // Returns hash of header source
+        Hash128 GetHeaderHash(const std::string &header) const;
+        // Returns compiled program, blocks until compilation is finished
         CLWProgram GetProgram(uint32_t id, const std::string &opts) const;
+        // Starts program loading or compilation on a worker thread
+        std::shared_future<CLWProgram> GetProgramAsync(uint32_t id, const std::string &opts) const;
         // Compiles program
         void CompileProgram(uint32_t id, const std::string &opts) const;
 
     private:
+        friend class CLProgram;
+
         mutable std::string m_cache_path; ///< Path to cache folder
         mutable std::map<uint32_t, CLProgram> m_programs; ///< Cache of programs by id
         mutable std::map<std::string, std::string> m_headers; ///< Headers map
+        mutable std::map<std::string, Hash128> m_header_hashes; ///< Header source hashes
+        std::unique_ptr<CLProgramCache> m_cache; ///< Disk cache for compiled programs
+        mutable std::recursive_mutex m_mutex; ///< Guards programs and headers
+        std::unique_ptr<ThreadPool> m_thread_pool; ///< Compilation threads, destroyed first to finish pending compilations
         static uint32_t m_next_program_id;
     };
 }
@@ -37,6 +37,8 @@ namespace Baikal
 
         CLWContext GetContext() const { return m_context; }
         CLWKernel GetKernel(std::string const& name, std::string const& opts = "");
+        // Starts program compilation on program manager threads, GetKernel waits for it
+        void PrecompileKernels(std::string const& opts = "");
         void SetDefaultBuildOptions(std::string const& opts);
         std::string GetDefaultBuildOpts() const { return m_default_opts; }
         std::string GetFullBuildOpts() const;
@@ -98,6 +100,13 @@ namespace Baikal
     }
 
 
+    inline void ClwClass::PrecompileKernels(std::string const& opts)
+    {
+        std::string options = opts.empty() ? m_default_opts : opts;
+        AddCommonOptions(options);
+        m_program_manager->GetProgramAsync(m_program_id, options);
+    }
+
     inline void ClwClass::AddCommonOptions(std::string& opts) const
     {
         opts.append(" -cl-mad-enable -cl-fast-relaxed-math "
@@ -0,0 +1,152 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "distribution2d.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace Baikal
+{
+    Distribution2D::Distribution2D()
+        : m_width(0u)
+        , m_height(0u)
+    {
+    }
+
+    Distribution2D::Distribution2D(float const* values, std::uint32_t width, std::uint32_t height)
+    {
+        Set(values, width, height);
+    }
+
+    void Distribution2D::Set(float const* values, std::uint32_t width, std::uint32_t height)
+    {
+        assert(width > 0 && height > 0);
+        m_width = width;
+        m_height = height;
+        m_conditional.resize(height);
+
+        std::vector<float> row_values(width);
+        std::vector<float> marginal_values(height);
+
+        for (auto y = 0u; y < height; ++y)
+        {
+            auto row = values + y * width;
+
+            // Rows without any energy get a uniform conditional
+            // distribution to keep CDF well defined
+            auto row_sum = std::accumulate(row, row + width, 0.f);
+
+            if (row_sum > 0.f)
+            {
+                std::copy(row, row + width, row_values.begin());
+            }
+            else
+            {
+                std::fill(row_values.begin(), row_values.end(), 1.f);
+            }
+
+            m_conditional[y].Set(&row_values[0], width);
+            marginal_values[y] = row_sum / width;
+        }
+
+        // Fully black distribution degenerates to uniform one
+        if (std::accumulate(marginal_values.cbegin(), marginal_values.cend(), 0.f) <= 0.f)
+        {
+            std::fill(marginal_values.begin(), marginal_values.end(), 1.f);
+        }
+
+        m_marginal.Set(&marginal_values[0], height);
+    }
+
+    RadeonRays::float2 Distribution2D::Sample2D(RadeonRays::float2 const& sample, float& pdf) const
+    {
+        assert(m_width > 0 && m_height > 0);
+
+        float marginal_pdf = 0.f;
+        float v = m_marginal.Sample1D(sample.y, marginal_pdf);
+
+        auto row = std::min((std::uint32_t)(v * m_height), m_height - 1);
+
+        float conditional_pdf = 0.f;
+        float u = m_conditional[row].Sample1D(sample.x, conditional_pdf);
+
+        pdf = marginal_pdf * conditional_pdf;
+
+        return RadeonRays::float2(u, v);
+    }
+
+    float Distribution2D::pdf(RadeonRays::float2 const& uv) const
+    {
+        auto row = std::min((std::uint32_t)(std::max(uv.y, 0.f) * m_height), m_height - 1);
+        auto column = std::min((std::uint32_t)(std::max(uv.x, 0.f) * m_width), m_width - 1);
+
+        auto const& conditional = m_conditional[row];
+
+        return (m_marginal.m_func_values[row] / m_marginal.m_func_sum) *
+            (conditional.m_func_values[column] / conditional.m_func_sum);
+    }
+
+    std::size_t Distribution2D::GetSerializedSize() const
+    {
+        // Header + marginal + conditionals
+        return 2 + (2 * m_height + 2) + m_height * (2 * m_width + 2);
+    }
+
+    int* Distribution2D::Write(int* data) const
+    {
+        *data++ = static_cast<int>(m_width);
+        *data++ = static_cast<int>(m_height);
+
+        data = WriteDistribution1D(m_marginal, data);
+
+        for (auto const& conditional : m_conditional)
+        {
+            data = WriteDistribution1D(conditional, data);
+        }
+
+        return data;
+    }
+
+    int* WriteDistribution1D(Distribution1D const& distribution, int* data)
+    {
+        // Write the number of segments first
+        *data++ = static_cast<int>(distribution.m_num_segments);
+
+        // Then write num_segments  + 1 CDF values
+        auto values = reinterpret_cast<float*>(data);
+        for (auto i = 0u; i < distribution.m_num_segments + 1; ++i)
+        {
+            values[i] = distribution.m_cdf[i];
+        }
+
+        // Then write num_segments PDF values
+        values += distribution.m_num_segments + 1;
+
+        for (auto i = 0u; i < distribution.m_num_segments; ++i)
+        {
+            values[i] = distribution.m_func_values[i] / distribution.m_func_sum;
+        }
+
+        return data + 2 * distribution.m_num_segments + 1;
+    }
+}
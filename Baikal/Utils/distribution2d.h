@@ -0,0 +1,73 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "distribution1d.h"
+#include "math/float2.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Baikal
+{
+    ///< The class represents 2D piecewise constant distribution over [0,1]x[0,1].
+    ///< It is built as a marginal distribution over rows and a set of conditional
+    ///< distributions over columns (one per row), see Pharr & Humphreys.
+    ///<
+    struct Distribution2D
+    {
+    public:
+        // values are function values in row-major order, width values per row
+        Distribution2D();
+        Distribution2D(float const* values, std::uint32_t width, std::uint32_t height);
+
+        void Set(float const* values, std::uint32_t width, std::uint32_t height);
+
+        // Sample (u, v) pair using this distribution
+        // sample is uniformely distributed random var
+        RadeonRays::float2 Sample2D(RadeonRays::float2 const& sample, float& pdf) const;
+
+        // PDF
+        float pdf(RadeonRays::float2 const& uv) const;
+
+        // Size in ints of the serialized representation (see Write)
+        std::size_t GetSerializedSize() const;
+
+        // Write distribution data in a format expected by Distribution2D_* kernel functions:
+        // width, height, marginal distribution, height conditional distributions.
+        // Returns pointer past the last written value.
+        int* Write(int* data) const;
+
+        // Conditional distributions, one per row
+        std::vector<Distribution1D> m_conditional;
+        // Marginal distribution over rows
+        Distribution1D m_marginal;
+        // Number of columns
+        std::uint32_t m_width;
+        // Number of rows
+        std::uint32_t m_height;
+    };
+
+    // Serialize 1D distribution: number of segments, num_segments + 1 CDF values, num_segments PDF values.
+    // Returns pointer past the last written value.
+    int* WriteDistribution1D(Distribution1D const& distribution, int* data);
+}
@@ -0,0 +1,151 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "hash.h"
+
+#include <cstring>
+
+namespace Baikal
+{
+    namespace
+    {
+        inline std::uint64_t Rotl64(std::uint64_t x, int r)
+        {
+            return (x << r) | (x >> (64 - r));
+        }
+
+        inline std::uint64_t Fmix64(std::uint64_t k)
+        {
+            k ^= k >> 33;
+            k *= 0xff51afd7ed558ccdull;
+            k ^= k >> 33;
+            k *= 0xc4ceb9fe1a85ec53ull;
+            k ^= k >> 33;
+            return k;
+        }
+
+        inline std::uint64_t ReadBlock(std::uint8_t const* p)
+        {
+            std::uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+    }
+
+    std::string Hash128::ToString() const
+    {
+        static char const digits[] = "0123456789abcdef";
+
+        std::string result(32, '0');
+        for (int i = 0; i < 16; ++i)
+        {
+            result[i] = digits[(hi >> (60 - 4 * i)) & 0xf];
+            result[16 + i] = digits[(lo >> (60 - 4 * i)) & 0xf];
+        }
+        return result;
+    }
+
+    Hash128 ComputeHash128(void const* data, std::size_t size, std::uint64_t seed)
+    {
+        auto bytes = static_cast<std::uint8_t const*>(data);
+        auto num_blocks = size / 16;
+
+        std::uint64_t h1 = seed;
+        std::uint64_t h2 = seed;
+
+        std::uint64_t const c1 = 0x87c37b91114253d5ull;
+        std::uint64_t const c2 = 0x4cf5ad432745937full;
+
+        // Body
+        for (std::size_t i = 0; i < num_blocks; ++i)
+        {
+            auto k1 = ReadBlock(bytes + i * 16);
+            auto k2 = ReadBlock(bytes + i * 16 + 8);
+
+            k1 *= c1; k1 = Rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+            h1 = Rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+            k2 *= c2; k2 = Rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+            h2 = Rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+        }
+
+        // Tail
+        auto tail = bytes + num_blocks * 16;
+        std::uint64_t k1 = 0;
+        std::uint64_t k2 = 0;
+
+        switch (size & 15)
+        {
+        case 15: k2 ^= std::uint64_t(tail[14]) << 48;
+        case 14: k2 ^= std::uint64_t(tail[13]) << 40;
+        case 13: k2 ^= std::uint64_t(tail[12]) << 32;
+        case 12: k2 ^= std::uint64_t(tail[11]) << 24;
+        case 11: k2 ^= std::uint64_t(tail[10]) << 16;
+        case 10: k2 ^= std::uint64_t(tail[9]) << 8;
+        case 9:  k2 ^= std::uint64_t(tail[8]);
+            k2 *= c2; k2 = Rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        case 8:  k1 ^= std::uint64_t(tail[7]) << 56;
+        case 7:  k1 ^= std::uint64_t(tail[6]) << 48;
+        case 6:  k1 ^= std::uint64_t(tail[5]) << 40;
+        case 5:  k1 ^= std::uint64_t(tail[4]) << 32;
+        case 4:  k1 ^= std::uint64_t(tail[3]) << 24;
+        case 3:  k1 ^= std::uint64_t(tail[2]) << 16;
+        case 2:  k1 ^= std::uint64_t(tail[1]) << 8;
+        case 1:  k1 ^= std::uint64_t(tail[0]);
+            k1 *= c1; k1 = Rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        default:
+            break;
+        }
+
+        // Finalization
+        h1 ^= size;
+        h2 ^= size;
+
+        h1 += h2;
+        h2 += h1;
+
+        h1 = Fmix64(h1);
+        h2 = Fmix64(h2);
+
+        h1 += h2;
+        h2 += h1;
+
+        Hash128 result;
+        result.lo = h1;
+        result.hi = h2;
+        return result;
+    }
+
+    Hasher& Hasher::Append(void const* data, std::size_t size)
+    {
+        // Chain previous state through the seeds of both halves
+        auto lo = ComputeHash128(data, size, m_hash.lo);
+        auto hi = ComputeHash128(data, size, m_hash.hi ^ 0x9e3779b97f4a7c15ull);
+        m_hash.lo = lo.lo ^ hi.hi;
+        m_hash.hi = lo.hi ^ hi.lo;
+        return *this;
+    }
+
+    Hasher& Hasher::Append(Hash128 const& hash)
+    {
+        return Append(&hash, sizeof(Hash128));
+    }
+}
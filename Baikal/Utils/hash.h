@@ -0,0 +1,80 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Baikal
+{
+    ///< 128-bit hash value
+    struct Hash128
+    {
+        std::uint64_t lo = 0;
+        std::uint64_t hi = 0;
+
+        bool operator == (Hash128 const& rhs) const { return lo == rhs.lo && hi == rhs.hi; }
+        bool operator != (Hash128 const& rhs) const { return !(*this == rhs); }
+        bool operator < (Hash128 const& rhs) const { return hi < rhs.hi || (hi == rhs.hi && lo < rhs.lo); }
+
+        // Returns 32 character hex representation
+        std::string ToString() const;
+    };
+
+    // Computes MurmurHash3 (x64, 128-bit variant) of a memory block
+    Hash128 ComputeHash128(void const* data, std::size_t size, std::uint64_t seed = 0);
+
+    inline Hash128 ComputeHash128(std::string const& str, std::uint64_t seed = 0)
+    {
+        return ComputeHash128(str.data(), str.size(), seed);
+    }
+
+    ///< Incremental 128-bit hasher, hash depends both on the appended data and on how it was split
+    ///< into Append calls, so composite keys can't collide by shifting bytes between fields.
+    ///<
+    class Hasher
+    {
+    public:
+        Hasher& Append(void const* data, std::size_t size);
+        Hasher& Append(std::string const& str) { return Append(str.data(), str.size()); }
+        Hasher& Append(Hash128 const& hash);
+
+        template <typename T> Hasher& AppendValue(T const& value)
+        {
+            return Append(&value, sizeof(T));
+        }
+
+        Hash128 GetHash() const { return m_hash; }
+
+    private:
+        Hash128 m_hash;
+    };
+
+    struct Hash128Hasher
+    {
+        std::size_t operator () (Hash128 const& hash) const
+        {
+            return static_cast<std::size_t>(hash.lo ^ hash.hi);
+        }
+    };
+}
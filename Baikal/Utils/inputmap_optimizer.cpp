@@ -0,0 +1,554 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "inputmap_optimizer.h"
+#include "SceneGraph/inputmaps.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace Baikal
+{
+    namespace
+    {
+        using Value = std::array<float, 4>;
+
+        template <typename F>
+        Value Map(Value const& a, F f)
+        {
+            return {{ f(a[0]), f(a[1]), f(a[2]), f(a[3]) }};
+        }
+
+        template <typename F>
+        Value Map(Value const& a, Value const& b, F f)
+        {
+            return {{ f(a[0], b[0]), f(a[1], b[1]), f(a[2], b[2]), f(a[3], b[3]) }};
+        }
+
+        float Dot3(Value const& a, Value const& b)
+        {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        }
+
+        bool IsZero(Value const& a)
+        {
+            return a[0] == 0.f && a[1] == 0.f && a[2] == 0.f && a[3] == 0.f;
+        }
+
+        template <typename T, typename F>
+        InputMap::Ptr RebuildOneArg(InputMap::Ptr const& input, F const& optimize)
+        {
+            auto const& node = static_cast<T const&>(*input);
+            auto arg = optimize(node.GetArg());
+            return arg == node.GetArg() ? input : InputMap::Ptr(T::Create(arg));
+        }
+
+        template <typename T, typename F>
+        InputMap::Ptr RebuildTwoArg(InputMap::Ptr const& input, F const& optimize)
+        {
+            auto const& node = static_cast<T const&>(*input);
+            auto a = optimize(node.GetA());
+            auto b = optimize(node.GetB());
+            return (a == node.GetA() && b == node.GetB()) ? input : InputMap::Ptr(T::Create(a, b));
+        }
+
+        template <typename T>
+        std::vector<InputMap::Ptr> OneArgChildren(InputMap const& input)
+        {
+            return { static_cast<T const&>(input).GetArg() };
+        }
+
+        template <typename T>
+        std::vector<InputMap::Ptr> TwoArgChildren(InputMap const& input)
+        {
+            auto const& node = static_cast<T const&>(input);
+            return { node.GetA(), node.GetB() };
+        }
+
+        void AppendBits(std::string& key, float value)
+        {
+            std::uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            key += std::to_string(bits) + ",";
+        }
+    }
+
+    InputMap::Ptr InputMapOptimizer::Optimize(InputMap::Ptr input)
+    {
+        auto iter = m_optimized.find(input->GetId());
+        if (iter != m_optimized.end())
+        {
+            return iter->second;
+        }
+
+        auto result = RemoveNoOp(Rebuild(input));
+
+        // Constant leafs can't hold non-zero w
+        Value value;
+        if (!result->IsLeaf() && Evaluate(*result, value) && value[3] == 0.f)
+        {
+            result = MakeConstant(value);
+        }
+        else
+        {
+            result = Canonicalize(result);
+        }
+
+        m_optimized.emplace(input->GetId(), result);
+        return result;
+    }
+
+    InputMap::Ptr InputMapOptimizer::Rebuild(InputMap::Ptr input)
+    {
+        auto optimize = [this](InputMap::Ptr arg) { return Optimize(arg); };
+
+        switch (input->m_type)
+        {
+            case InputMap::InputMapType::kAdd: return RebuildTwoArg<InputMap_Add>(input, optimize);
+            case InputMap::InputMapType::kSub: return RebuildTwoArg<InputMap_Sub>(input, optimize);
+            case InputMap::InputMapType::kMul: return RebuildTwoArg<InputMap_Mul>(input, optimize);
+            case InputMap::InputMapType::kDiv: return RebuildTwoArg<InputMap_Div>(input, optimize);
+            case InputMap::InputMapType::kMin: return RebuildTwoArg<InputMap_Min>(input, optimize);
+            case InputMap::InputMapType::kMax: return RebuildTwoArg<InputMap_Max>(input, optimize);
+            case InputMap::InputMapType::kDot3: return RebuildTwoArg<InputMap_Dot3>(input, optimize);
+            case InputMap::InputMapType::kDot4: return RebuildTwoArg<InputMap_Dot4>(input, optimize);
+            case InputMap::InputMapType::kCross3: return RebuildTwoArg<InputMap_Cross3>(input, optimize);
+            case InputMap::InputMapType::kCross4: return RebuildTwoArg<InputMap_Cross4>(input, optimize);
+            case InputMap::InputMapType::kPow: return RebuildTwoArg<InputMap_Pow>(input, optimize);
+            case InputMap::InputMapType::kMod: return RebuildTwoArg<InputMap_Mod>(input, optimize);
+            case InputMap::InputMapType::kSin: return RebuildOneArg<InputMap_Sin>(input, optimize);
+            case InputMap::InputMapType::kCos: return RebuildOneArg<InputMap_Cos>(input, optimize);
+            case InputMap::InputMapType::kTan: return RebuildOneArg<InputMap_Tan>(input, optimize);
+            case InputMap::InputMapType::kAsin: return RebuildOneArg<InputMap_Asin>(input, optimize);
+            case InputMap::InputMapType::kAcos: return RebuildOneArg<InputMap_Acos>(input, optimize);
+            case InputMap::InputMapType::kAtan: return RebuildOneArg<InputMap_Atan>(input, optimize);
+            case InputMap::InputMapType::kLength3: return RebuildOneArg<InputMap_Length3>(input, optimize);
+            case InputMap::InputMapType::kNormalize3: return RebuildOneArg<InputMap_Normalize3>(input, optimize);
+            case InputMap::InputMapType::kFloor: return RebuildOneArg<InputMap_Floor>(input, optimize);
+            case InputMap::InputMapType::kAbs: return RebuildOneArg<InputMap_Abs>(input, optimize);
+            case InputMap::InputMapType::kLerp:
+            {
+                auto const& node = static_cast<InputMap_Lerp const&>(*input);
+                auto a = Optimize(node.GetA());
+                auto b = Optimize(node.GetB());
+                auto control = Optimize(node.GetControl());
+                if (a == node.GetA() && b == node.GetB() && control == node.GetControl())
+                {
+                    return input;
+                }
+                return InputMap_Lerp::Create(a, b, control);
+            }
+            case InputMap::InputMapType::kSelect:
+            {
+                auto const& node = static_cast<InputMap_Select const&>(*input);
+                auto arg = Optimize(node.GetArg());
+                return arg == node.GetArg() ? input : InputMap_Select::Create(arg, node.GetSelection());
+            }
+            case InputMap::InputMapType::kShuffle:
+            {
+                auto const& node = static_cast<InputMap_Shuffle const&>(*input);
+                auto arg = Optimize(node.GetArg());
+                return arg == node.GetArg() ? input : InputMap_Shuffle::Create(arg, node.GetMask());
+            }
+            case InputMap::InputMapType::kShuffle2:
+            {
+                auto const& node = static_cast<InputMap_Shuffle2 const&>(*input);
+                auto a = Optimize(node.GetA());
+                auto b = Optimize(node.GetB());
+                if (a == node.GetA() && b == node.GetB())
+                {
+                    return input;
+                }
+                return InputMap_Shuffle2::Create(a, b, node.GetMask());
+            }
+            case InputMap::InputMapType::kMatMul:
+            {
+                auto const& node = static_cast<InputMap_MatMul const&>(*input);
+                auto arg = Optimize(node.GetArg());
+                return arg == node.GetArg() ? input : InputMap_MatMul::Create(arg, node.GetMatrix());
+            }
+            case InputMap::InputMapType::kRemap:
+            {
+                auto const& node = static_cast<InputMap_Remap const&>(*input);
+                auto source_range = Optimize(node.GetSourceRange());
+                auto destination_range = Optimize(node.GetDestinationRange());
+                auto data = Optimize(node.GetData());
+                if (source_range == node.GetSourceRange() &&
+                    destination_range == node.GetDestinationRange() &&
+                    data == node.GetData())
+                {
+                    return input;
+                }
+                return InputMap_Remap::Create(source_range, destination_range, data);
+            }
+            default:
+                // Leafs
+                return input;
+        }
+    }
+
+    InputMap::Ptr InputMapOptimizer::RemoveNoOp(InputMap::Ptr input) const
+    {
+        auto children = GetChildren(*input);
+        Value value;
+
+        switch (input->m_type)
+        {
+            case InputMap::InputMapType::kAdd:
+            {
+                if (GetConstant(*children[1], value) && IsZero(value)) return children[0];
+                if (GetConstant(*children[0], value) && IsZero(value)) return children[1];
+                break;
+            }
+            case InputMap::InputMapType::kSub:
+            {
+                if (GetConstant(*children[1], value) && IsZero(value)) return children[0];
+                break;
+            }
+            case InputMap::InputMapType::kMin:
+            case InputMap::InputMapType::kMax:
+            case InputMap::InputMapType::kLerp:
+            {
+                // Children are canonical, so equal subgraphs are the same object
+                if (children[0] == children[1]) return children[0];
+                break;
+            }
+            case InputMap::InputMapType::kShuffle:
+            {
+                auto mask = static_cast<InputMap_Shuffle const&>(*input).GetMask();
+                if (mask == std::array<uint32_t, 4>{{ 0, 1, 2, 3 }}) return children[0];
+                break;
+            }
+            case InputMap::InputMapType::kShuffle2:
+            {
+                auto mask = static_cast<InputMap_Shuffle2 const&>(*input).GetMask();
+                if (mask == std::array<uint32_t, 4>{{ 0, 1, 2, 3 }}) return children[0];
+                if (mask == std::array<uint32_t, 4>{{ 4, 5, 6, 7 }}) return children[1];
+                break;
+            }
+            case InputMap::InputMapType::kMatMul:
+            {
+                auto m = static_cast<InputMap_MatMul const&>(*input).GetMatrix();
+                bool identity =
+                    m.m00 == 1.f && m.m01 == 0.f && m.m02 == 0.f && m.m03 == 0.f &&
+                    m.m10 == 0.f && m.m11 == 1.f && m.m12 == 0.f && m.m13 == 0.f &&
+                    m.m20 == 0.f && m.m21 == 0.f && m.m22 == 1.f && m.m23 == 0.f &&
+                    m.m30 == 0.f && m.m31 == 0.f && m.m32 == 0.f && m.m33 == 1.f;
+                if (identity) return children[0];
+                break;
+            }
+            default:
+                break;
+        }
+
+        return input;
+    }
+
+    InputMap::Ptr InputMapOptimizer::Canonicalize(InputMap::Ptr input)
+    {
+        auto result = m_nodes.emplace(GetKey(*input), input);
+        return result.first->second;
+    }
+
+    InputMap::Ptr InputMapOptimizer::MakeConstant(Value const& value)
+    {
+        return Canonicalize(InputMap_ConstantFloat3::Create(RadeonRays::float3(value[0], value[1], value[2])));
+    }
+
+    bool InputMapOptimizer::GetConstant(InputMap const& input, Value& value)
+    {
+        // Constants are read as (value, 0.0f) by generated code
+        switch (input.m_type)
+        {
+            case InputMap::InputMapType::kConstantFloat3:
+            {
+                auto v = static_cast<InputMap_ConstantFloat3 const&>(input).GetValue();
+                value = {{ v.x, v.y, v.z, 0.f }};
+                return true;
+            }
+            case InputMap::InputMapType::kConstantFloat:
+            {
+                auto v = static_cast<InputMap_ConstantFloat const&>(input).GetValue();
+                value = {{ v, v, v, 0.f }};
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool InputMapOptimizer::Evaluate(InputMap const& input, Value& result) const
+    {
+        // Mirrors code generated by CLInputMapGenerator
+        auto children = GetChildren(input);
+        Value args[3];
+
+        for (std::size_t i = 0; i < children.size(); ++i)
+        {
+            if (!GetConstant(*children[i], args[i]))
+            {
+                return false;
+            }
+        }
+
+        auto const& a = args[0];
+        auto const& b = args[1];
+        auto const& c = args[2];
+
+        switch (input.m_type)
+        {
+            case InputMap::InputMapType::kAdd:
+                result = Map(a, b, [](float x, float y) { return x + y; });
+                return true;
+            case InputMap::InputMapType::kSub:
+                result = Map(a, b, [](float x, float y) { return x - y; });
+                return true;
+            case InputMap::InputMapType::kMul:
+                result = Map(a, b, [](float x, float y) { return x * y; });
+                return true;
+            case InputMap::InputMapType::kDiv:
+                result = Map(a, b, [](float x, float y) { return x / y; });
+                return true;
+            case InputMap::InputMapType::kMin:
+                result = Map(a, b, [](float x, float y) { return std::fmin(x, y); });
+                return true;
+            case InputMap::InputMapType::kMax:
+                result = Map(a, b, [](float x, float y) { return std::fmax(x, y); });
+                return true;
+            case InputMap::InputMapType::kMod:
+                result = Map(a, b, [](float x, float y) { return std::fmod(x, y); });
+                return true;
+            case InputMap::InputMapType::kPow:
+            {
+                float exponent = b[0];
+                result = Map(a, [exponent](float x) { return std::pow(x, exponent); });
+                return true;
+            }
+            case InputMap::InputMapType::kDot3:
+                result = {{ Dot3(a, b), 0.f, 0.f, 0.f }};
+                return true;
+            case InputMap::InputMapType::kDot4:
+                result = {{ Dot3(a, b) + a[3] * b[3], 0.f, 0.f, 0.f }};
+                return true;
+            case InputMap::InputMapType::kCross3:
+            case InputMap::InputMapType::kCross4:
+                result = {{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0], 0.f }};
+                return true;
+            case InputMap::InputMapType::kSin:
+                result = Map(a, [](float x) { return std::sin(x); });
+                return true;
+            case InputMap::InputMapType::kCos:
+                result = Map(a, [](float x) { return std::cos(x); });
+                return true;
+            case InputMap::InputMapType::kTan:
+                result = Map(a, [](float x) { return std::tan(x); });
+                return true;
+            case InputMap::InputMapType::kAsin:
+                result = Map(a, [](float x) { return std::asin(x); });
+                return true;
+            case InputMap::InputMapType::kAcos:
+                result = Map(a, [](float x) { return std::acos(x); });
+                return true;
+            case InputMap::InputMapType::kAtan:
+                result = Map(a, [](float x) { return std::atan(x); });
+                return true;
+            case InputMap::InputMapType::kFloor:
+                result = Map(a, [](float x) { return std::floor(x); });
+                return true;
+            case InputMap::InputMapType::kAbs:
+                result = Map(a, [](float x) { return std::fabs(x); });
+                return true;
+            case InputMap::InputMapType::kLength3:
+                result = {{ std::sqrt(Dot3(a, a)), 0.f, 0.f, 0.f }};
+                return true;
+            case InputMap::InputMapType::kNormalize3:
+            {
+                float length = std::sqrt(Dot3(a, a));
+                if (length == 0.f)
+                {
+                    return false;
+                }
+                result = {{ a[0] / length, a[1] / length, a[2] / length, 0.f }};
+                return true;
+            }
+            case InputMap::InputMapType::kLerp:
+                result = {{
+                    a[0] + (b[0] - a[0]) * c[0],
+                    a[1] + (b[1] - a[1]) * c[1],
+                    a[2] + (b[2] - a[2]) * c[2],
+                    a[3] + (b[3] - a[3]) * c[3] }};
+                return true;
+            case InputMap::InputMapType::kSelect:
+            {
+                auto component = a[static_cast<std::size_t>(static_cast<InputMap_Select const&>(input).GetSelection())];
+                result = {{ component, component, component, component }};
+                return true;
+            }
+            case InputMap::InputMapType::kShuffle:
+            {
+                auto mask = static_cast<InputMap_Shuffle const&>(input).GetMask();
+                for (std::size_t i = 0; i < 4; ++i)
+                {
+                    result[i] = a[mask[i] & 3];
+                }
+                return true;
+            }
+            case InputMap::InputMapType::kShuffle2:
+            {
+                auto mask = static_cast<InputMap_Shuffle2 const&>(input).GetMask();
+                for (std::size_t i = 0; i < 4; ++i)
+                {
+                    auto index = mask[i] & 7;
+                    result[i] = index < 4 ? a[index] : b[index - 4];
+                }
+                return true;
+            }
+            case InputMap::InputMapType::kMatMul:
+            {
+                auto m = static_cast<InputMap_MatMul const&>(input).GetMatrix();
+                result = {{
+                    m.m00 * a[0] + m.m01 * a[1] + m.m02 * a[2] + m.m03 * a[3],
+                    m.m10 * a[0] + m.m11 * a[1] + m.m12 * a[2] + m.m13 * a[3],
+                    m.m20 * a[0] + m.m21 * a[1] + m.m22 * a[2] + m.m23 * a[3],
+                    m.m30 * a[0] + m.m31 * a[1] + m.m32 * a[2] + m.m33 * a[3] }};
+                return true;
+            }
+            case InputMap::InputMapType::kRemap:
+            {
+                // Children are source range, destination range and data
+                for (std::size_t i = 0; i < 4; ++i)
+                {
+                    float t = (c[i] - a[0]) / (a[1] - a[0]);
+                    result[i] = b[0] + (b[1] - b[0]) * t;
+                }
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    std::string InputMapOptimizer::GetKey(InputMap const& input)
+    {
+        std::string key = std::to_string(static_cast<int>(input.m_type)) + ":";
+
+        Value value;
+        if (GetConstant(input, value))
+        {
+            // Float and float3 constants with equal values are interchangeable
+            key = "c:";
+            AppendBits(key, value[0]);
+            AppendBits(key, value[1]);
+            AppendBits(key, value[2]);
+            return key;
+        }
+
+        switch (input.m_type)
+        {
+            case InputMap::InputMapType::kSampler:
+                key += std::to_string(static_cast<InputMap_Sampler const&>(input).GetTexture()->GetId());
+                return key;
+            case InputMap::InputMapType::kSamplerBumpmap:
+                key += std::to_string(static_cast<InputMap_SamplerBumpMap const&>(input).GetTexture()->GetId());
+                return key;
+            case InputMap::InputMapType::kSelect:
+                key += std::to_string(static_cast<int>(static_cast<InputMap_Select const&>(input).GetSelection())) + ",";
+                break;
+            case InputMap::InputMapType::kShuffle:
+                for (auto component : static_cast<InputMap_Shuffle const&>(input).GetMask())
+                {
+                    key += std::to_string(component) + ",";
+                }
+                break;
+            case InputMap::InputMapType::kShuffle2:
+                for (auto component : static_cast<InputMap_Shuffle2 const&>(input).GetMask())
+                {
+                    key += std::to_string(component) + ",";
+                }
+                break;
+            case InputMap::InputMapType::kMatMul:
+            {
+                auto m = static_cast<InputMap_MatMul const&>(input).GetMatrix();
+                for (auto element : { m.m00, m.m01, m.m02, m.m03, m.m10, m.m11, m.m12, m.m13,
+                                      m.m20, m.m21, m.m22, m.m23, m.m30, m.m31, m.m32, m.m33 })
+                {
+                    AppendBits(key, element);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+
+        key += "(";
+        for (auto const& child : GetChildren(input))
+        {
+            key += std::to_string(child->GetId()) + ",";
+        }
+        key += ")";
+        return key;
+    }
+
+    std::vector<InputMap::Ptr> InputMapOptimizer::GetChildren(InputMap const& input)
+    {
+        switch (input.m_type)
+        {
+            case InputMap::InputMapType::kAdd: return TwoArgChildren<InputMap_Add>(input);
+            case InputMap::InputMapType::kSub: return TwoArgChildren<InputMap_Sub>(input);
+            case InputMap::InputMapType::kMul: return TwoArgChildren<InputMap_Mul>(input);
+            case InputMap::InputMapType::kDiv: return TwoArgChildren<InputMap_Div>(input);
+            case InputMap::InputMapType::kMin: return TwoArgChildren<InputMap_Min>(input);
+            case InputMap::InputMapType::kMax: return TwoArgChildren<InputMap_Max>(input);
+            case InputMap::InputMapType::kDot3: return TwoArgChildren<InputMap_Dot3>(input);
+            case InputMap::InputMapType::kDot4: return TwoArgChildren<InputMap_Dot4>(input);
+            case InputMap::InputMapType::kCross3: return TwoArgChildren<InputMap_Cross3>(input);
+            case InputMap::InputMapType::kCross4: return TwoArgChildren<InputMap_Cross4>(input);
+            case InputMap::InputMapType::kPow: return TwoArgChildren<InputMap_Pow>(input);
+            case InputMap::InputMapType::kMod: return TwoArgChildren<InputMap_Mod>(input);
+            case InputMap::InputMapType::kShuffle2: return TwoArgChildren<InputMap_Shuffle2>(input);
+            case InputMap::InputMapType::kSin: return OneArgChildren<InputMap_Sin>(input);
+            case InputMap::InputMapType::kCos: return OneArgChildren<InputMap_Cos>(input);
+            case InputMap::InputMapType::kTan: return OneArgChildren<InputMap_Tan>(input);
+            case InputMap::InputMapType::kAsin: return OneArgChildren<InputMap_Asin>(input);
+            case InputMap::InputMapType::kAcos: return OneArgChildren<InputMap_Acos>(input);
+            case InputMap::InputMapType::kAtan: return OneArgChildren<InputMap_Atan>(input);
+            case InputMap::InputMapType::kLength3: return OneArgChildren<InputMap_Length3>(input);
+            case InputMap::InputMapType::kNormalize3: return OneArgChildren<InputMap_Normalize3>(input);
+            case InputMap::InputMapType::kFloor: return OneArgChildren<InputMap_Floor>(input);
+            case InputMap::InputMapType::kAbs: return OneArgChildren<InputMap_Abs>(input);
+            case InputMap::InputMapType::kSelect: return OneArgChildren<InputMap_Select>(input);
+            case InputMap::InputMapType::kShuffle: return OneArgChildren<InputMap_Shuffle>(input);
+            case InputMap::InputMapType::kMatMul: return OneArgChildren<InputMap_MatMul>(input);
+            case InputMap::InputMapType::kLerp:
+            {
+                auto const& node = static_cast<InputMap_Lerp const&>(input);
+                return { node.GetA(), node.GetB(), node.GetControl() };
+            }
+            case InputMap::InputMapType::kRemap:
+            {
+                auto const& node = static_cast<InputMap_Remap const&>(input);
+                return { node.GetSourceRange(), node.GetDestinationRange(), node.GetData() };
+            }
+            default:
+                return {};
+        }
+    }
+}
@@ -0,0 +1,71 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "SceneGraph/inputmap.h"
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Baikal
+{
+    ///< Simplifies input map graphs before code generation.
+    ///< Subgraphs depending only on constants are folded into constant leafs,
+    ///< no-op nodes (lerp(a, a, t), min(a, a), a + 0, identity shuffles and
+    ///< matrices) are removed and identical subgraphs are merged (hash-consed),
+    ///< so equal graphs of different materials become the same object.
+    ///< Source graphs are never modified, changed nodes are recreated.
+    ///<
+    class InputMapOptimizer
+    {
+    public:
+        // Returns optimized graph for input map
+        InputMap::Ptr Optimize(InputMap::Ptr input);
+
+    private:
+        using Value = std::array<float, 4>;
+
+        // Optimizes children and rebuilds node if needed
+        InputMap::Ptr Rebuild(InputMap::Ptr input);
+        // Returns node input if node doesn't change it, node itself otherwise
+        InputMap::Ptr RemoveNoOp(InputMap::Ptr input) const;
+        // Returns canonical node for its key, registers node if it is new
+        InputMap::Ptr Canonicalize(InputMap::Ptr input);
+        // Returns constant leaf holding value, value.w has to be zero
+        InputMap::Ptr MakeConstant(Value const& value);
+        // Tries to evaluate node with constant inputs, returns false if it can't be folded
+        bool Evaluate(InputMap const& input, Value& result) const;
+        // Gets value of constant leaf
+        static bool GetConstant(InputMap const& input, Value& value);
+        // Builds hash-consing key of node, children have to be canonical
+        static std::string GetKey(InputMap const& input);
+        // Gets node inputs in order of their Create arguments
+        static std::vector<InputMap::Ptr> GetChildren(InputMap const& input);
+
+        // Optimized graphs by source object id
+        std::unordered_map<std::uint32_t, InputMap::Ptr> m_optimized;
+        // Canonical nodes by key
+        std::unordered_map<std::string, InputMap::Ptr> m_nodes;
+    };
+}
@@ -0,0 +1,360 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "kernel_profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+
+namespace Baikal
+{
+    namespace
+    {
+        // Kernel names are identifiers, but keep the output valid JSON anyway
+        std::string EscapeJson(std::string const& str)
+        {
+            std::string result;
+            result.reserve(str.size());
+
+            for (auto c : str)
+            {
+                switch (c)
+                {
+                case '"': result += "\\\""; break;
+                case '\\': result += "\\\\"; break;
+                case '\n': result += "\\n"; break;
+                case '\t': result += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) >= 0x20)
+                    {
+                        result += c;
+                    }
+                    break;
+                }
+            }
+
+            return result;
+        }
+
+        double ToMilliseconds(std::uint64_t ns)
+        {
+            return static_cast<double>(ns) * 1e-6;
+        }
+
+        std::uint64_t GetProfilingInfo(cl_event event, cl_profiling_info info)
+        {
+            cl_ulong value = 0;
+            auto status = clGetEventProfilingInfo(event, info, sizeof(value), &value, nullptr);
+
+            if (status != CL_SUCCESS)
+            {
+                throw std::runtime_error("KernelProfiler: can't get event profiling info, error " + std::to_string(status));
+            }
+
+            return value;
+        }
+
+        bool IsComplete(cl_event event)
+        {
+            cl_int status = CL_COMPLETE;
+            clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+            return status == CL_COMPLETE;
+        }
+    }
+
+    KernelProfile::KernelProfile(std::size_t max_trace_events)
+        : m_max_trace_events(max_trace_events)
+        , m_dropped_trace_events(0)
+    {
+    }
+
+    void KernelProfile::AddTiming(std::string const& name, int bounce, std::uint64_t start, std::uint64_t end)
+    {
+        auto time = end > start ? end - start : 0;
+
+        auto key = std::make_pair(name, bounce);
+        auto iter = m_kernel_index.find(key);
+
+        if (iter == m_kernel_index.end())
+        {
+            iter = m_kernel_index.emplace(key, m_kernels.size()).first;
+            m_kernels.push_back({ name, bounce, 0u, 0u, std::numeric_limits<std::uint64_t>::max(), 0u });
+        }
+
+        auto& stats = m_kernels[iter->second];
+        ++stats.launches;
+        stats.total_time += time;
+        stats.min_time = std::min(stats.min_time, time);
+        stats.max_time = std::max(stats.max_time, time);
+
+        if (m_trace.size() < m_max_trace_events)
+        {
+            m_trace.push_back({ iter->second, start, start + time });
+        }
+        else
+        {
+            ++m_dropped_trace_events;
+        }
+    }
+
+    void KernelProfile::AddActiveRays(int bounce, std::uint64_t count)
+    {
+        auto& stats = m_bounces.emplace(bounce, BounceStats{ bounce, 0u, 0u }).first->second;
+        ++stats.samples;
+        stats.active_rays += count;
+    }
+
+    void KernelProfile::Reset()
+    {
+        m_kernels.clear();
+        m_kernel_index.clear();
+        m_bounces.clear();
+        m_trace.clear();
+        m_dropped_trace_events = 0;
+    }
+
+    std::vector<KernelProfile::BounceStats> KernelProfile::GetBounceStats() const
+    {
+        std::vector<BounceStats> result;
+        result.reserve(m_bounces.size());
+
+        for (auto const& bounce : m_bounces)
+        {
+            result.push_back(bounce.second);
+        }
+
+        return result;
+    }
+
+    void KernelProfile::WriteJson(std::ostream& stream) const
+    {
+        stream << std::setprecision(6) << std::fixed;
+        stream << "{\n  \"kernels\": [";
+
+        for (auto i = 0u; i < m_kernels.size(); ++i)
+        {
+            auto const& stats = m_kernels[i];
+
+            stream << (i ? ",\n" : "\n");
+            stream << "    { \"name\": \"" << EscapeJson(stats.name) << "\""
+                   << ", \"bounce\": " << stats.bounce
+                   << ", \"launches\": " << stats.launches
+                   << ", \"total_ms\": " << ToMilliseconds(stats.total_time)
+                   << ", \"average_ms\": " << ToMilliseconds(stats.total_time) / stats.launches
+                   << ", \"min_ms\": " << ToMilliseconds(stats.min_time)
+                   << ", \"max_ms\": " << ToMilliseconds(stats.max_time) << " }";
+        }
+
+        stream << "\n  ],\n  \"bounces\": [";
+
+        auto first = true;
+        for (auto const& bounce : m_bounces)
+        {
+            auto const& stats = bounce.second;
+
+            stream << (first ? "\n" : ",\n");
+            stream << "    { \"bounce\": " << stats.bounce
+                   << ", \"samples\": " << stats.samples
+                   << ", \"average_active_rays\": " << static_cast<double>(stats.active_rays) / stats.samples << " }";
+            first = false;
+        }
+
+        stream << "\n  ]\n}\n";
+    }
+
+    void KernelProfile::WriteChromeTrace(std::ostream& stream) const
+    {
+        // Timestamps are in microseconds relative to the first event
+        std::uint64_t origin = std::numeric_limits<std::uint64_t>::max();
+        for (auto const& event : m_trace)
+        {
+            origin = std::min(origin, event.start);
+        }
+
+        stream << std::setprecision(3) << std::fixed;
+        stream << "{\"traceEvents\":[";
+
+        for (auto i = 0u; i < m_trace.size(); ++i)
+        {
+            auto const& event = m_trace[i];
+            auto const& stats = m_kernels[event.kernel];
+
+            stream << (i ? ",\n" : "\n");
+            stream << "{\"name\":\"" << EscapeJson(stats.name) << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+                   << ",\"ts\":" << static_cast<double>(event.start - origin) * 1e-3
+                   << ",\"dur\":" << static_cast<double>(event.end - event.start) * 1e-3
+                   << ",\"args\":{\"bounce\":" << stats.bounce << "}}";
+        }
+
+        stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+    KernelProfiler::Scope::Scope(KernelProfiler* profiler, char const* name, int bounce)
+        : m_profiler(profiler && profiler->IsEnabled() ? profiler : nullptr)
+        , m_name(name)
+        , m_bounce(bounce)
+    {
+        if (m_profiler)
+        {
+            m_begin = m_profiler->EnqueueMarker();
+        }
+    }
+
+    KernelProfiler::Scope::~Scope()
+    {
+        if (m_profiler)
+        {
+            m_profiler->RecordRange(m_name, m_bounce, m_begin, m_profiler->EnqueueMarker());
+        }
+    }
+
+    KernelProfiler::KernelProfiler(CLWContext context)
+        : m_context(context)
+        , m_enabled(false)
+    {
+    }
+
+    KernelProfiler::~KernelProfiler()
+    {
+        // Ray counts are read into host memory owned by the profiler
+        for (auto& pending : m_pending_rays)
+        {
+            pending.event.Wait();
+        }
+    }
+
+    void KernelProfiler::SetEnabled(bool enabled)
+    {
+        if (enabled)
+        {
+            cl_command_queue_properties properties = 0;
+            clGetCommandQueueInfo(m_context.GetCommandQueue(0), CL_QUEUE_PROPERTIES, sizeof(properties), &properties, nullptr);
+
+            if (!(properties & CL_QUEUE_PROFILING_ENABLE))
+            {
+                throw std::runtime_error("KernelProfiler: command queue was created without profiling support");
+            }
+        }
+
+        m_enabled = enabled;
+    }
+
+    CLWEvent KernelProfiler::EnqueueMarker() const
+    {
+        cl_event event = nullptr;
+        auto status = clEnqueueMarkerWithWaitList(m_context.GetCommandQueue(0), 0, nullptr, &event);
+
+        if (status != CL_SUCCESS)
+        {
+            throw std::runtime_error("KernelProfiler: can't enqueue marker, error " + std::to_string(status));
+        }
+
+        return CLWEvent::Create(event);
+    }
+
+    void KernelProfiler::Record(char const* name, int bounce, CLWEvent const& event)
+    {
+        if (m_enabled)
+        {
+            m_pending.push_back({ name, bounce, CLWEvent(), event });
+        }
+    }
+
+    void KernelProfiler::RecordRange(char const* name, int bounce, CLWEvent const& begin, CLWEvent const& end)
+    {
+        m_pending.push_back({ name, bounce, begin, end });
+    }
+
+    void KernelProfiler::RecordActiveRays(int bounce, CLWBuffer<int> count)
+    {
+        if (!m_enabled)
+        {
+            return;
+        }
+
+        PendingRayCount pending{ bounce, CLWEvent(), std::make_unique<int>(0) };
+        pending.event = m_context.ReadBuffer(0, count, pending.count.get(), 1);
+        m_pending_rays.push_back(std::move(pending));
+    }
+
+    void KernelProfiler::Resolve(bool wait)
+    {
+        // The queue is in-order, so events complete in the order they were recorded
+        while (!m_pending.empty())
+        {
+            auto const& pending = m_pending.front();
+            cl_event end = pending.end;
+
+            if (!wait && !IsComplete(end))
+            {
+                break;
+            }
+
+            pending.end.Wait();
+
+            if (static_cast<cl_event>(pending.begin))
+            {
+                // Range between the markers: from the end of the first one to the end of the second one
+                m_profile.AddTiming(pending.name,
+                                    pending.bounce,
+                                    GetProfilingInfo(pending.begin, CL_PROFILING_COMMAND_END),
+                                    GetProfilingInfo(end, CL_PROFILING_COMMAND_END));
+            }
+            else
+            {
+                m_profile.AddTiming(pending.name,
+                                    pending.bounce,
+                                    GetProfilingInfo(end, CL_PROFILING_COMMAND_START),
+                                    GetProfilingInfo(end, CL_PROFILING_COMMAND_END));
+            }
+
+            m_pending.pop_front();
+        }
+
+        while (!m_pending_rays.empty())
+        {
+            auto& pending = m_pending_rays.front();
+
+            if (!wait && !IsComplete(pending.event))
+            {
+                break;
+            }
+
+            pending.event.Wait();
+            m_profile.AddActiveRays(pending.bounce, static_cast<std::uint64_t>(std::max(*pending.count, 0)));
+            m_pending_rays.pop_front();
+        }
+    }
+
+    KernelProfile const& KernelProfiler::GetProfile()
+    {
+        Resolve(true);
+        return m_profile;
+    }
+
+    void KernelProfiler::Reset()
+    {
+        Resolve(true);
+        m_profile.Reset();
+    }
+}
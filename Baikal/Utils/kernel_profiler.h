@@ -0,0 +1,176 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "CLW.h"
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Baikal
+{
+    ///< Aggregated GPU timings of a render: per (kernel, bounce) launch times,
+    ///< per bounce active ray counts and an optional timeline for Chrome tracing
+    ///< (chrome://tracing or Perfetto). Times are in nanoseconds of the device clock.
+    ///<
+    class KernelProfile
+    {
+    public:
+        // Bounce value for launches not related to a particular bounce
+        static int constexpr kNoBounce = -1;
+
+        struct KernelStats
+        {
+            std::string name;
+            int bounce;
+            std::uint32_t launches;
+            std::uint64_t total_time;
+            std::uint64_t min_time;
+            std::uint64_t max_time;
+        };
+
+        struct BounceStats
+        {
+            int bounce;
+            // Number of times active rays were counted for the bounce
+            std::uint32_t samples;
+            std::uint64_t active_rays;
+        };
+
+        struct TraceEvent
+        {
+            std::size_t kernel;
+            std::uint64_t start;
+            std::uint64_t end;
+        };
+
+        // Timeline is limited to max_trace_events, aggregated stats are not
+        explicit KernelProfile(std::size_t max_trace_events = 1u << 20);
+
+        void AddTiming(std::string const& name, int bounce, std::uint64_t start, std::uint64_t end);
+        void AddActiveRays(int bounce, std::uint64_t count);
+        void Reset();
+
+        // Stats in the order of the first launch
+        std::vector<KernelStats> const& GetKernelStats() const { return m_kernels; }
+        // Stats ordered by bounce
+        std::vector<BounceStats> GetBounceStats() const;
+        std::vector<TraceEvent> const& GetTraceEvents() const { return m_trace; }
+        std::size_t GetDroppedTraceEvents() const { return m_dropped_trace_events; }
+
+        // Summary: kernels with times in milliseconds and average active rays per bounce
+        void WriteJson(std::ostream& stream) const;
+        // Chrome trace event format, one complete event per launch
+        void WriteChromeTrace(std::ostream& stream) const;
+
+    private:
+        std::vector<KernelStats> m_kernels;
+        std::map<std::pair<std::string, int>, std::size_t> m_kernel_index;
+        std::map<int, BounceStats> m_bounces;
+        std::vector<TraceEvent> m_trace;
+        std::size_t m_max_trace_events;
+        std::size_t m_dropped_trace_events;
+    };
+
+    ///< Collects OpenCL event timings of the launches on queue 0 of a context.
+    ///< Launches are recorded without waiting, timings are read once the events
+    ///< complete (see Resolve), so profiling doesn't serialize the queue.
+    ///< Requires the queue to be created with CL_QUEUE_PROFILING_ENABLE.
+    ///<
+    class KernelProfiler
+    {
+    public:
+        ///< Profiles all commands enqueued during the scope lifetime
+        ///< (for work not represented by a single event, e.g. intersection queries)
+        ///<
+        class Scope
+        {
+        public:
+            // No-op if profiler is nullptr or disabled
+            Scope(KernelProfiler* profiler, char const* name, int bounce);
+            ~Scope();
+
+            Scope(Scope const&) = delete;
+            Scope& operator = (Scope const&) = delete;
+
+        private:
+            KernelProfiler* m_profiler;
+            char const* m_name;
+            int m_bounce;
+            CLWEvent m_begin;
+        };
+
+        explicit KernelProfiler(CLWContext context);
+        ~KernelProfiler();
+
+        // Profiling is disabled by default, throws if the queue doesn't support it
+        void SetEnabled(bool enabled);
+        bool IsEnabled() const { return m_enabled; }
+
+        // Record a single launch
+        void Record(char const* name, int bounce, CLWEvent const& event);
+        // Record a number of active rays stored in count buffer (read asynchronously)
+        void RecordActiveRays(int bounce, CLWBuffer<int> count);
+
+        // Move finished timings to the profile. Stops at the first unfinished one unless wait is set.
+        void Resolve(bool wait);
+
+        // Resolves all recorded launches
+        KernelProfile const& GetProfile();
+        void Reset();
+
+        KernelProfiler(KernelProfiler const&) = delete;
+        KernelProfiler& operator = (KernelProfiler const&) = delete;
+
+    private:
+        struct PendingEvent
+        {
+            std::string name;
+            int bounce;
+            // Marker preceding the range, empty for single launch
+            CLWEvent begin;
+            CLWEvent end;
+        };
+
+        struct PendingRayCount
+        {
+            int bounce;
+            CLWEvent event;
+            std::unique_ptr<int> count;
+        };
+
+        CLWEvent EnqueueMarker() const;
+        void RecordRange(char const* name, int bounce, CLWEvent const& begin, CLWEvent const& end);
+
+        CLWContext m_context;
+        bool m_enabled;
+        std::deque<PendingEvent> m_pending;
+        std::deque<PendingRayCount> m_pending_rays;
+        KernelProfile m_profile;
+    };
+}
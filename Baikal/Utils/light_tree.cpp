@@ -0,0 +1,409 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "light_tree.h"
+#include "math/mathutils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace Baikal
+{
+    using namespace RadeonRays;
+
+    namespace
+    {
+        // Number of centroid bins per axis evaluated when splitting a node
+        int const kNumBins = 12;
+
+        float SafeSqrt(float x)
+        {
+            return std::sqrt(std::max(x, 0.f));
+        }
+
+        float SafeAcos(float x)
+        {
+            return std::acos(std::min(std::max(x, -1.f), 1.f));
+        }
+
+        float GetComponent(float3 const& v, int axis)
+        {
+            return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+        }
+
+        // Rotate vector around unit axis (Rodrigues' formula)
+        float3 Rotate(float3 const& v, float3 const& axis, float angle)
+        {
+            auto cos_a = std::cos(angle);
+            auto sin_a = std::sin(angle);
+            return cos_a * v + sin_a * cross(axis, v) + (dot(axis, v) * (1.f - cos_a)) * axis;
+        }
+
+        // Light bounds with zero power are treated as empty
+        LightTree::LightBounds Union(LightTree::LightBounds const& a, LightTree::LightBounds const& b)
+        {
+            if (a.power == 0.f)
+            {
+                return b;
+            }
+
+            if (b.power == 0.f)
+            {
+                return a;
+            }
+
+            LightTree::LightBounds result = a;
+            result.bounds.grow(b.bounds);
+            result.power = a.power + b.power;
+            result.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+
+            // Find the smallest cone containing both normal cones
+            auto theta_a = SafeAcos(a.cos_theta_o);
+            auto theta_b = SafeAcos(b.cos_theta_o);
+            auto theta_d = SafeAcos(dot(a.axis, b.axis));
+
+            if (std::min(theta_d + theta_b, PI) <= theta_a)
+            {
+                return result;
+            }
+
+            if (std::min(theta_d + theta_a, PI) <= theta_b)
+            {
+                result.axis = b.axis;
+                result.cos_theta_o = b.cos_theta_o;
+                return result;
+            }
+
+            auto theta_o = 0.5f * (theta_a + theta_d + theta_b);
+            auto axis = cross(a.axis, b.axis);
+
+            if (theta_o >= PI || axis.sqnorm() == 0.f)
+            {
+                // Whole sphere of directions
+                result.cos_theta_o = -1.f;
+                return result;
+            }
+
+            result.axis = normalize(Rotate(a.axis, normalize(axis), theta_o - theta_a));
+            result.cos_theta_o = std::cos(theta_o);
+            return result;
+        }
+
+        // Surface area plus squared diagonal, so bounds of coincident
+        // point lights still get a non-zero measure
+        float GetSizeMeasure(bbox const& bounds)
+        {
+            auto e = bounds.extents();
+            return 2.f * (e.x * e.y + e.x * e.z + e.y * e.z) + e.sqnorm();
+        }
+
+        // Surface area orientation heuristic
+        float EvaluateCost(LightTree::LightBounds const& b, bbox const& node_bounds, int axis)
+        {
+            if (b.power == 0.f)
+            {
+                return 0.f;
+            }
+
+            auto theta_o = SafeAcos(b.cos_theta_o);
+            auto theta_e = SafeAcos(b.cos_theta_e);
+            auto theta_w = std::min(theta_o + theta_e, PI);
+            auto sin_theta_o = SafeSqrt(1.f - b.cos_theta_o * b.cos_theta_o);
+            auto m_omega = 2.f * PI * (1.f - b.cos_theta_o) +
+                0.5f * PI * (2.f * theta_w * sin_theta_o - std::cos(theta_o - 2.f * theta_w) -
+                2.f * theta_o * sin_theta_o + b.cos_theta_o);
+
+            // Penalize splits along thin dimensions
+            auto extents = node_bounds.extents();
+            auto max_extent = std::max(extents.x, std::max(extents.y, extents.z));
+            auto extent = GetComponent(extents, axis);
+            auto kr = extent > 0.f ? max_extent / extent : 1.f;
+
+            return b.power * m_omega * kr * GetSizeMeasure(b.bounds);
+        }
+
+        void WriteNode(LightTree::LightBounds const& b, int parent, int child, int light_idx, LightTree::Node& node)
+        {
+            node.pmin = b.bounds.pmin;
+            node.pmax = b.bounds.pmax;
+            node.axis = b.axis;
+            node.power = b.power;
+            node.cos_theta_o = b.cos_theta_o;
+            node.cos_theta_e = b.cos_theta_e;
+            node.child = child;
+            node.light_idx = light_idx;
+            node.parent = parent;
+            node.padding[0] = node.padding[1] = 0;
+        }
+    }
+
+    void LightTree::Clear()
+    {
+        m_nodes.clear();
+        m_leaf_indices.clear();
+    }
+
+    void LightTree::Build(std::vector<LightBounds> const& lights)
+    {
+        Clear();
+
+        m_leaf_indices.assign(lights.size(), -1);
+
+        std::vector<int> indices;
+        indices.reserve(lights.size());
+        for (auto i = 0u; i < lights.size(); ++i)
+        {
+            if (lights[i].power > 0.f)
+            {
+                indices.push_back(static_cast<int>(i));
+            }
+        }
+
+        if (indices.empty())
+        {
+            return;
+        }
+
+        // Binary tree with a single light per leaf
+        m_nodes.reserve(2 * indices.size() - 1);
+        BuildNode(lights, indices, 0, indices.size(), -1);
+    }
+
+    int LightTree::BuildNode(std::vector<LightBounds> const& lights, std::vector<int>& indices,
+                             std::size_t begin, std::size_t end, int parent)
+    {
+        auto node_idx = static_cast<int>(m_nodes.size());
+        m_nodes.emplace_back();
+
+        if (end - begin == 1)
+        {
+            auto light_idx = indices[begin];
+            WriteNode(lights[light_idx], parent, -1, light_idx, m_nodes[node_idx]);
+            m_leaf_indices[light_idx] = node_idx;
+            return node_idx;
+        }
+
+        LightBounds node_bounds = {};
+        bbox centroid_bounds;
+        for (auto i = begin; i < end; ++i)
+        {
+            auto const& light = lights[indices[i]];
+            node_bounds = Union(node_bounds, light);
+            centroid_bounds.grow(light.bounds.center());
+        }
+
+        auto centroid_extents = centroid_bounds.extents();
+        auto get_bin = [&](int light_idx, int axis)
+        {
+            auto offset = (GetComponent(lights[light_idx].bounds.center(), axis) - GetComponent(centroid_bounds.pmin, axis)) /
+                GetComponent(centroid_extents, axis);
+            return std::min(static_cast<int>(offset * kNumBins), kNumBins - 1);
+        };
+
+        // Find the cheapest split between centroid bins
+        auto best_cost = std::numeric_limits<float>::max();
+        auto best_axis = -1;
+        auto best_bin = -1;
+
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            if (GetComponent(centroid_extents, axis) <= 0.f)
+            {
+                continue;
+            }
+
+            LightBounds bins[kNumBins] = {};
+            for (auto i = begin; i < end; ++i)
+            {
+                auto& bin = bins[get_bin(indices[i], axis)];
+                bin = Union(bin, lights[indices[i]]);
+            }
+
+            for (auto split = 1; split < kNumBins; ++split)
+            {
+                LightBounds below = {};
+                LightBounds above = {};
+
+                for (auto b = 0; b < split; ++b)
+                {
+                    below = Union(below, bins[b]);
+                }
+
+                for (auto b = split; b < kNumBins; ++b)
+                {
+                    above = Union(above, bins[b]);
+                }
+
+                if (below.power == 0.f || above.power == 0.f)
+                {
+                    continue;
+                }
+
+                auto cost = EvaluateCost(below, node_bounds.bounds, axis) + EvaluateCost(above, node_bounds.bounds, axis);
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = split;
+                }
+            }
+        }
+
+        // Split in the middle if all centroids coincide
+        auto mid = begin + (end - begin) / 2;
+        if (best_axis != -1)
+        {
+            auto iter = std::partition(indices.begin() + begin, indices.begin() + end,
+                [&](int light_idx) { return get_bin(light_idx, best_axis) < best_bin; });
+            mid = static_cast<std::size_t>(iter - indices.begin());
+        }
+
+        assert(mid > begin && mid < end);
+
+        auto first = BuildNode(lights, indices, begin, mid, node_idx);
+        auto second = BuildNode(lights, indices, mid, end, node_idx);
+        assert(first == node_idx + 1);
+        (void)first;
+
+        WriteNode(node_bounds, parent, second, -1, m_nodes[node_idx]);
+        return node_idx;
+    }
+
+    float LightTree::GetImportance(Node const& node, float3 const& p)
+    {
+        auto center = 0.5f * (node.pmin + node.pmax);
+        auto d = p - center;
+        auto dist2 = d.sqnorm();
+        // Avoid singularity when the point is close to the lights
+        auto ext = node.pmax - node.pmin;
+        auto d2 = std::max(dist2, 0.25f * ext.sqnorm());
+
+        if (d2 <= 0.f)
+        {
+            return node.power;
+        }
+
+        // Cosine of the angle between emission axis and direction to the point
+        auto cos_theta_w = dist2 > 0.f ? dot(node.axis, d) / std::sqrt(dist2) : 1.f;
+        auto sin_theta_w = SafeSqrt(1.f - cos_theta_w * cos_theta_w);
+
+        // Cosine of the angle bounds subtend from the point
+        auto radius2 = (node.pmax - center).sqnorm();
+        auto cos_theta_b = dist2 > radius2 ? SafeSqrt(1.f - radius2 / dist2) : -1.f;
+        auto sin_theta_b = SafeSqrt(1.f - cos_theta_b * cos_theta_b);
+
+        // cos(max(0, theta_w - theta_o))
+        auto sin_theta_o = SafeSqrt(1.f - node.cos_theta_o * node.cos_theta_o);
+        auto cos_theta_x = cos_theta_w > node.cos_theta_o ? 1.f : cos_theta_w * node.cos_theta_o + sin_theta_w * sin_theta_o;
+        auto sin_theta_x = cos_theta_w > node.cos_theta_o ? 0.f : sin_theta_w * node.cos_theta_o - cos_theta_w * sin_theta_o;
+
+        // cos(max(0, theta_w - theta_o - theta_b))
+        auto cos_theta_p = cos_theta_x > cos_theta_b ? 1.f : cos_theta_x * cos_theta_b + sin_theta_x * sin_theta_b;
+
+        if (cos_theta_p <= node.cos_theta_e)
+        {
+            return 0.f;
+        }
+
+        return node.power * cos_theta_p / d2;
+    }
+
+    int LightTree::Sample(float3 const& p, float u, float& pdf) const
+    {
+        pdf = 0.f;
+
+        if (m_nodes.empty() || GetImportance(m_nodes[0], p) == 0.f)
+        {
+            return -1;
+        }
+
+        auto node_idx = 0;
+        auto node_pdf = 1.f;
+
+        while (m_nodes[node_idx].light_idx == -1)
+        {
+            auto first = node_idx + 1;
+            auto second = m_nodes[node_idx].child;
+            auto importance0 = GetImportance(m_nodes[first], p);
+            auto importance1 = GetImportance(m_nodes[second], p);
+
+            if (importance0 == 0.f && importance1 == 0.f)
+            {
+                return -1;
+            }
+
+            auto p0 = importance0 / (importance0 + importance1);
+
+            if (u < p0)
+            {
+                node_idx = first;
+                u = std::min(u / p0, 1.f - std::numeric_limits<float>::epsilon());
+                node_pdf *= p0;
+            }
+            else
+            {
+                node_idx = second;
+                u = std::min((u - p0) / (1.f - p0), 1.f - std::numeric_limits<float>::epsilon());
+                node_pdf *= 1.f - p0;
+            }
+        }
+
+        pdf = node_pdf;
+        return m_nodes[node_idx].light_idx;
+    }
+
+    float LightTree::GetPdf(int light_idx, float3 const& p) const
+    {
+        if (light_idx < 0 || light_idx >= static_cast<int>(m_leaf_indices.size()) || m_leaf_indices[light_idx] == -1)
+        {
+            return 0.f;
+        }
+
+        auto node_idx = m_leaf_indices[light_idx];
+
+        if (GetImportance(m_nodes[0], p) == 0.f)
+        {
+            return 0.f;
+        }
+
+        auto pdf = 1.f;
+
+        while (m_nodes[node_idx].parent != -1)
+        {
+            auto parent = m_nodes[node_idx].parent;
+            auto importance0 = GetImportance(m_nodes[parent + 1], p);
+            auto importance1 = GetImportance(m_nodes[m_nodes[parent].child], p);
+            auto importance = node_idx == parent + 1 ? importance0 : importance1;
+
+            if (importance == 0.f)
+            {
+                return 0.f;
+            }
+
+            pdf *= importance / (importance0 + importance1);
+            node_idx = parent;
+        }
+
+        return pdf;
+    }
+}
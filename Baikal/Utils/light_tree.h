@@ -0,0 +1,102 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "math/bbox.h"
+#include "math/float3.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Baikal
+{
+    ///< Bounding hierarchy over light sources used to select a light proportionally
+    ///< to its estimated contribution at a given point (instead of its power only).
+    ///< Every node bounds light positions, total emitted power and emission directions.
+    ///< Nodes are stored in depth first order: the first child of an inner node
+    ///< directly follows it, the second child is referenced explicitly.
+    ///< Partially taken from Conty Estevez & Kulla "Importance Sampling of Many Lights
+    ///< with Adaptive Tree Splitting" and Pharr & Humphreys (pbrt-v4).
+    ///<
+    class LightTree
+    {
+    public:
+        // Bounds of a single light source
+        struct LightBounds
+        {
+            // Spatial bounds of the emitter
+            RadeonRays::bbox bounds;
+            // Axis of emission normals cone
+            RadeonRays::float3 axis;
+            // Luminance of emitted power
+            float power;
+            // Cosine of the spread of emission normals around the axis
+            float cos_theta_o;
+            // Cosine of the angle emission falls off over beyond the normals spread
+            float cos_theta_e;
+        };
+
+        // Node layout matches LightTreeNode in payload.cl
+        struct Node
+        {
+            RadeonRays::float3 pmin;
+            RadeonRays::float3 pmax;
+            RadeonRays::float3 axis;
+            float power;
+            float cos_theta_o;
+            float cos_theta_e;
+            // Second child index for inner nodes
+            std::int32_t child;
+            // Light index for leaves, -1 for inner nodes
+            std::int32_t light_idx;
+            // Parent node index, -1 for the root
+            std::int32_t parent;
+            std::int32_t padding[2];
+        };
+
+        // Build hierarchy, light index is a position in the array.
+        // Lights with zero power are left out of the tree.
+        void Build(std::vector<LightBounds> const& lights);
+        void Clear();
+
+        std::vector<Node> const& GetNodes() const { return m_nodes; }
+        // Leaf node of every light passed to Build, -1 for lights left out
+        std::vector<int> const& GetLeafIndices() const { return m_leaf_indices; }
+        // Number of lights in the tree
+        std::size_t GetNumLights() const { return (m_nodes.size() + 1) / 2; }
+
+        // Estimate contribution of lights below the node to a point
+        static float GetImportance(Node const& node, RadeonRays::float3 const& p);
+
+        // Select a light for a point, these mirror Scene_SampleLight and
+        // Scene_GetLightPdf in scene.cl (infinite lights are handled there)
+        int Sample(RadeonRays::float3 const& p, float u, float& pdf) const;
+        float GetPdf(int light_idx, RadeonRays::float3 const& p) const;
+
+    private:
+        int BuildNode(std::vector<LightBounds> const& lights, std::vector<int>& indices,
+                      std::size_t begin, std::size_t end, int parent);
+
+        std::vector<Node> m_nodes;
+        std::vector<int> m_leaf_indices;
+    };
+}
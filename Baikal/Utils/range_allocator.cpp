@@ -0,0 +1,144 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "range_allocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace Baikal
+{
+    RangeAllocator::RangeAllocator()
+        : m_capacity(0u)
+        , m_used(0u)
+    {
+    }
+
+    RangeAllocator::RangeAllocator(std::size_t capacity)
+    {
+        Reset(capacity);
+    }
+
+    void RangeAllocator::Reset(std::size_t capacity)
+    {
+        m_free_ranges.clear();
+        m_capacity = capacity;
+        m_used = 0u;
+
+        if (capacity > 0)
+        {
+            m_free_ranges[0] = capacity;
+        }
+    }
+
+    void RangeAllocator::Grow(std::size_t capacity)
+    {
+        assert(capacity >= m_capacity);
+
+        if (capacity > m_capacity)
+        {
+            auto old_capacity = m_capacity;
+            m_capacity = capacity;
+            // Appended space is released as a regular range to get it coalesced with the tail
+            m_used += capacity - old_capacity;
+            Free(old_capacity, capacity - old_capacity);
+        }
+    }
+
+    bool RangeAllocator::Allocate(std::size_t size, std::size_t& offset)
+    {
+        // Zero sized allocations are valid and do not occupy any space
+        if (size == 0)
+        {
+            offset = 0;
+            return true;
+        }
+
+        for (auto iter = m_free_ranges.begin(); iter != m_free_ranges.end(); ++iter)
+        {
+            if (iter->second >= size)
+            {
+                offset = iter->first;
+                auto remaining = iter->second - size;
+
+                m_free_ranges.erase(iter);
+
+                if (remaining > 0)
+                {
+                    m_free_ranges[offset + size] = remaining;
+                }
+
+                m_used += size;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void RangeAllocator::Free(std::size_t offset, std::size_t size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+
+        assert(offset + size <= m_capacity);
+        assert(m_used >= size);
+        m_used -= size;
+
+        auto next = m_free_ranges.lower_bound(offset);
+
+        // Coalesce with the following range
+        if (next != m_free_ranges.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = m_free_ranges.erase(next);
+        }
+
+        // Coalesce with the preceding range
+        if (next != m_free_ranges.begin())
+        {
+            auto prev = std::prev(next);
+
+            if (prev->first + prev->second == offset)
+            {
+                prev->second += size;
+                return;
+            }
+        }
+
+        m_free_ranges[offset] = size;
+    }
+
+    std::size_t RangeAllocator::GetLargestFreeRange() const
+    {
+        std::size_t largest = 0u;
+
+        for (auto const& range : m_free_ranges)
+        {
+            largest = std::max(largest, range.second);
+        }
+
+        return largest;
+    }
+}
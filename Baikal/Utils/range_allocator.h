@@ -0,0 +1,64 @@
+/**********************************************************************
+Copyright (c) 2016 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <map>
+
+namespace Baikal
+{
+    ///< The class manages sub-allocation of ranges inside a linear buffer of fixed capacity.
+    ///< Free space is kept in an offset ordered free list, adjacent free ranges are coalesced
+    ///< on release. Allocation uses first fit strategy.
+    ///<
+    class RangeAllocator
+    {
+    public:
+        RangeAllocator();
+        explicit RangeAllocator(std::size_t capacity);
+
+        // Drop all allocations and set new capacity
+        void Reset(std::size_t capacity);
+        // Increase capacity keeping existing allocations intact
+        void Grow(std::size_t capacity);
+
+        // Allocate size elements, returns false if there is no free range large enough
+        bool Allocate(std::size_t size, std::size_t& offset);
+        // Release previously allocated range
+        void Free(std::size_t offset, std::size_t size);
+
+        // Total capacity in elements
+        std::size_t GetCapacity() const { return m_capacity; }
+        // Number of allocated elements
+        std::size_t GetUsedSize() const { return m_used; }
+        // Largest contiguous free range
+        std::size_t GetLargestFreeRange() const;
+
+    private:
+        // Free ranges: offset -> size
+        std::map<std::size_t, std::size_t> m_free_ranges;
+        // Total capacity
+        std::size_t m_capacity;
+        // Allocated size
+        std::size_t m_used;
+    };
+}
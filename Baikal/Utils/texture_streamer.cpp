@@ -0,0 +1,281 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "texture_streamer.h"
+#include "block_compression.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace Baikal
+{
+    constexpr std::size_t TextureStreamer::kTileSizeInBytes;
+    constexpr std::size_t TextureStreamer::kMinStreamedSizeInBytes;
+    constexpr std::size_t TextureStreamer::kMaxUploadsPerUpdate;
+    constexpr std::size_t TextureStreamer::kInvalidSlot;
+
+    // Size of a texel (uncompressed formats) or a 4x4 block (compressed ones) in bytes
+    static std::size_t GetElementSize(Texture::Format format)
+    {
+        switch (format)
+        {
+        case Texture::Format::kRgba8: return 4;
+        case Texture::Format::kRgba16: return 8;
+        case Texture::Format::kRgba32: return 16;
+        default: return GetBlockSizeInBytes(format);
+        }
+    }
+
+    static std::size_t GetNumTiles(int width, int height, RadeonRays::int2 tile_size)
+    {
+        return static_cast<std::size_t>((width + tile_size.x - 1) / tile_size.x) *
+            static_cast<std::size_t>((height + tile_size.y - 1) / tile_size.y);
+    }
+
+    TextureStreamer::TextureStreamer()
+    {
+        Reset();
+    }
+
+    void TextureStreamer::Reset()
+    {
+        m_textures.clear();
+        m_page_slots.clear();
+        m_page_lru.clear();
+        SetNumSlots(0);
+    }
+
+    void TextureStreamer::SetNumSlots(std::size_t num_slots)
+    {
+        m_lru.clear();
+        std::fill(m_page_slots.begin(), m_page_slots.end(), kInvalidSlot);
+        std::fill(m_page_lru.begin(), m_page_lru.end(), m_lru.end());
+        m_num_slots = num_slots;
+        m_free_slots.resize(num_slots);
+
+        // Slots are taken from the back, so fill the pool from its start
+        for (std::size_t i = 0; i < num_slots; ++i)
+        {
+            m_free_slots[i] = num_slots - i - 1;
+        }
+    }
+
+    RadeonRays::int2 TextureStreamer::GetTileSize(Texture::Format format)
+    {
+        // Keep in sync with Texture_GetTileSize in texture.cl
+        switch (format)
+        {
+        case Texture::Format::kRgba32: return RadeonRays::int2(64, 64);
+        case Texture::Format::kRgba16: return RadeonRays::int2(128, 64);
+        case Texture::Format::kRgba8: return RadeonRays::int2(128, 128);
+        case Texture::Format::kBc1:
+        case Texture::Format::kBc4: return RadeonRays::int2(512, 256);
+        case Texture::Format::kBc3:
+        case Texture::Format::kBc5: return RadeonRays::int2(256, 256);
+        default: return RadeonRays::int2(1, 1);
+        }
+    }
+
+    std::uint32_t TextureStreamer::GetResidentLevel(Texture const& texture)
+    {
+        auto tile_size = GetTileSize(texture.GetFormat());
+        auto size = texture.GetSize();
+        auto level = 0u;
+
+        while (size.x > tile_size.x || size.y > tile_size.y)
+        {
+            size.x = std::max(size.x >> 1, 1);
+            size.y = std::max(size.y >> 1, 1);
+            ++level;
+        }
+
+        return level;
+    }
+
+    bool TextureStreamer::IsStreamable(Texture const& texture)
+    {
+        if (texture.GetSize().z != 1 || texture.GetSizeInBytes() < kMinStreamedSizeInBytes)
+        {
+            return false;
+        }
+
+        // Missing tiles are replaced by resident level, so it has to be present in mip chain
+        auto resident_level = GetResidentLevel(texture);
+        return resident_level > 0 && resident_level < texture.GetMipLevelCount();
+    }
+
+    std::size_t TextureStreamer::GetNumPages(Texture const& texture)
+    {
+        auto tile_size = GetTileSize(texture.GetFormat());
+        auto resident_level = GetResidentLevel(texture);
+        auto width = texture.GetSize().x;
+        auto height = texture.GetSize().y;
+        std::size_t num_pages = 0;
+
+        for (auto level = 0u; level < resident_level; ++level)
+        {
+            num_pages += GetNumTiles(width, height, tile_size);
+            width = std::max(width >> 1, 1);
+            height = std::max(height >> 1, 1);
+        }
+
+        return num_pages;
+    }
+
+    std::size_t TextureStreamer::AddTexture(Texture::Ptr texture)
+    {
+        assert(IsStreamable(*texture));
+
+        auto first_page = m_page_slots.size();
+        auto num_pages = GetNumPages(*texture);
+
+        m_textures.push_back({ texture, first_page, num_pages });
+        m_page_slots.resize(first_page + num_pages, kInvalidSlot);
+        m_page_lru.resize(first_page + num_pages, m_lru.end());
+
+        return first_page;
+    }
+
+    void TextureStreamer::Update(std::uint32_t const* feedback, std::vector<TileUpload>& uploads)
+    {
+        uploads.clear();
+
+        // Pages sampled in this iteration are moved to the back of LRU list,
+        // so only tiles in front of them can be evicted
+        std::vector<std::size_t> missing;
+        std::size_t num_sampled = 0;
+
+        for (std::size_t page = 0; page < GetNumPages(); ++page)
+        {
+            if (!(feedback[page / 32] & (1u << (page % 32))))
+            {
+                continue;
+            }
+
+            if (m_page_slots[page] != kInvalidSlot)
+            {
+                m_lru.splice(m_lru.end(), m_lru, m_page_lru[page]);
+                ++num_sampled;
+            }
+            else
+            {
+                missing.push_back(page);
+            }
+        }
+
+        auto num_evictable = m_lru.size() - num_sampled;
+
+        for (auto page : missing)
+        {
+            if (uploads.size() == kMaxUploadsPerUpdate)
+            {
+                break;
+            }
+
+            std::size_t slot = kInvalidSlot;
+
+            if (!m_free_slots.empty())
+            {
+                slot = m_free_slots.back();
+                m_free_slots.pop_back();
+            }
+            else if (num_evictable > 0)
+            {
+                auto victim = m_lru.front();
+                m_lru.pop_front();
+                --num_evictable;
+
+                slot = m_page_slots[victim];
+                m_page_slots[victim] = kInvalidSlot;
+                m_page_lru[victim] = m_lru.end();
+            }
+            else
+            {
+                // Pool is filled with tiles sampled in this iteration
+                break;
+            }
+
+            m_page_slots[page] = slot;
+            m_page_lru[page] = m_lru.insert(m_lru.end(), page);
+            uploads.push_back({ page, slot });
+        }
+    }
+
+    void TextureStreamer::ReadTile(std::size_t page, char* dst) const
+    {
+        assert(page < GetNumPages());
+
+        // Find texture owning the page
+        auto iter = std::upper_bound(m_textures.cbegin(), m_textures.cend(), page,
+            [](std::size_t value, StreamedTexture const& texture)
+            {
+                return value < texture.first_page;
+            });
+
+        assert(iter != m_textures.cbegin());
+        auto const& streamed = *(--iter);
+        auto const& texture = *streamed.texture;
+
+        // Find level and tile of the page
+        auto format = texture.GetFormat();
+        auto tile_size = GetTileSize(format);
+        auto width = texture.GetSize().x;
+        auto height = texture.GetSize().y;
+        auto tile = page - streamed.first_page;
+        auto level = 0u;
+
+        for (auto num_tiles = GetNumTiles(width, height, tile_size); tile >= num_tiles; num_tiles = GetNumTiles(width, height, tile_size))
+        {
+            tile -= num_tiles;
+            width = std::max(width >> 1, 1);
+            height = std::max(height >> 1, 1);
+            ++level;
+        }
+
+        auto tiles_x = static_cast<std::size_t>((width + tile_size.x - 1) / tile_size.x);
+        auto tile_x = static_cast<int>(tile % tiles_x);
+        auto tile_y = static_cast<int>(tile / tiles_x);
+
+        // Copy rows of elements (texels or 4x4 blocks for compressed formats),
+        // tile is stored as an image of tile_size dimensions in the level format
+        auto block = IsBlockCompressed(format) ? 4 : 1;
+        auto element_size = GetElementSize(format);
+        auto level_row = static_cast<std::size_t>((width + block - 1) / block);
+        auto level_rows = (height + block - 1) / block;
+        auto tile_row = static_cast<std::size_t>(tile_size.x / block);
+        auto tile_rows = tile_size.y / block;
+
+        auto x0 = tile_x * static_cast<int>(tile_row);
+        auto y0 = tile_y * tile_rows;
+        auto row_size = std::min(tile_row, level_row - x0) * element_size;
+        auto num_rows = std::min(tile_rows, level_rows - y0);
+
+        auto src = texture.GetLevelData(level);
+
+        for (auto y = 0; y < num_rows; ++y)
+        {
+            std::memcpy(dst + y * tile_row * element_size,
+                src + ((y0 + y) * level_row + x0) * element_size,
+                row_size);
+        }
+    }
+}
@@ -0,0 +1,121 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include "SceneGraph/texture.h"
+#include "math/int2.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+namespace Baikal
+{
+    ///< The class implements host side of texture streaming. Fine mip levels of large
+    ///< textures are split into tiles of kTileSizeInBytes bytes which are uploaded on
+    ///< demand into a fixed pool of tile slots. Coarse levels fitting into a single tile
+    ///< stay resident and serve as a fallback for missing tiles.
+    ///< Textures are addressed through a page table with one entry per tile. Kernels set
+    ///< a bit per sampled page in a feedback buffer, Update turns these bits into tile
+    ///< uploads evicting tiles which weren't sampled for the longest time.
+    ///<
+    class TextureStreamer
+    {
+    public:
+        // Tile size in bytes (tile dimensions depend on format, see GetTileSize)
+        static constexpr std::size_t kTileSizeInBytes = 65536;
+        // Textures with smaller base level are kept resident
+        static constexpr std::size_t kMinStreamedSizeInBytes = 4 * 1024 * 1024;
+        // Maximum number of tiles uploaded by a single update
+        static constexpr std::size_t kMaxUploadsPerUpdate = 256;
+        // Slot of pages which are not resident
+        static constexpr std::size_t kInvalidSlot = ~std::size_t(0);
+
+        // Tile upload produced by Update
+        struct TileUpload
+        {
+            std::size_t page;
+            std::size_t slot;
+        };
+
+        TextureStreamer();
+
+        // Drop all textures and tiles
+        void Reset();
+        // Drop all tiles and set number of tile slots in the pool
+        void SetNumSlots(std::size_t num_slots);
+
+        // Check if texture is large enough to be streamed and has a resident fallback level
+        static bool IsStreamable(Texture const& texture);
+        // Tile dimensions in texels
+        static RadeonRays::int2 GetTileSize(Texture::Format format);
+        // First mip level fitting into a single tile, finer levels are streamed
+        static std::uint32_t GetResidentLevel(Texture const& texture);
+        // Number of tiles of streamed levels
+        static std::size_t GetNumPages(Texture const& texture);
+
+        // Register streamed texture, returns offset of its pages in the page table
+        std::size_t AddTexture(Texture::Ptr texture);
+
+        // Total number of pages
+        std::size_t GetNumPages() const { return m_page_slots.size(); }
+        // Number of slots in the pool
+        std::size_t GetNumSlots() const { return m_num_slots; }
+        // Number of tiles currently in the pool
+        std::size_t GetNumResidentTiles() const { return m_lru.size(); }
+        // Pool slot of a page, kInvalidSlot if the tile is not resident
+        std::size_t GetSlot(std::size_t page) const { return m_page_slots[page]; }
+
+        // Process feedback (one bit per page packed into 32-bit words) of finished iterations,
+        // returns tiles to upload, slots of evicted tiles are reused by the uploads
+        void Update(std::uint32_t const* feedback, std::vector<TileUpload>& uploads);
+
+        // Copy texels of a page into dst (kTileSizeInBytes bytes), texels outside of
+        // the level are left untouched
+        void ReadTile(std::size_t page, char* dst) const;
+
+    private:
+        struct StreamedTexture
+        {
+            Texture::Ptr texture;
+            std::size_t first_page;
+            std::size_t num_pages;
+        };
+
+        // Pages in least recently sampled first order
+        using LruList = std::list<std::size_t>;
+
+        // Registered textures ordered by first page
+        std::vector<StreamedTexture> m_textures;
+        // Page -> slot
+        std::vector<std::size_t> m_page_slots;
+        // Page -> position in LRU list (valid for resident pages only)
+        std::vector<LruList::iterator> m_page_lru;
+        // Free slots
+        std::vector<std::size_t> m_free_slots;
+        // Resident pages
+        LruList m_lru;
+        // Pool size
+        std::size_t m_num_slots;
+    };
+}
@@ -0,0 +1,114 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+
+namespace Baikal
+{
+    namespace
+    {
+        // Weight of the latest measurement in the moving average
+        double constexpr kSmoothingFactor = 0.5;
+    }
+
+    TileScheduler::TileScheduler(std::size_t num_devices, std::uint32_t granularity)
+        : m_throughput(num_devices, 0.)
+        , m_granularity(std::max(granularity, 1u))
+    {
+        assert(num_devices > 0);
+    }
+
+    void TileScheduler::Reset()
+    {
+        std::fill(m_throughput.begin(), m_throughput.end(), 0.);
+    }
+
+    float TileScheduler::GetShare(std::size_t device) const
+    {
+        // Devices without measurements get the average throughput
+        auto num_measured = std::count_if(m_throughput.cbegin(), m_throughput.cend(), [](double t) { return t > 0.; });
+        auto total = std::accumulate(m_throughput.cbegin(), m_throughput.cend(), 0.);
+        auto average = num_measured ? total / num_measured : 1.;
+
+        auto throughput = [average](double t) { return t > 0. ? t : average; };
+
+        auto sum = 0.;
+        for (auto t : m_throughput)
+        {
+            sum += throughput(t);
+        }
+
+        return static_cast<float>(throughput(m_throughput[device]) / sum);
+    }
+
+    std::vector<TileScheduler::Band> const& TileScheduler::Schedule(std::uint32_t height)
+    {
+        auto num_devices = m_throughput.size();
+        m_bands.resize(num_devices);
+
+        // Keep at least one granule per device while possible so every device
+        // keeps being measured and can regain work when it speeds up
+        auto num_granules = (height + m_granularity - 1) / m_granularity;
+        auto min_granules = num_granules >= num_devices ? 1u : 0u;
+
+        std::uint32_t y = 0;
+        for (std::size_t i = 0; i < num_devices; ++i)
+        {
+            std::uint32_t rows = 0;
+
+            if (i + 1 == num_devices)
+            {
+                rows = height - y;
+            }
+            else
+            {
+                auto granules = static_cast<std::uint32_t>(GetShare(i) * num_granules + 0.5f);
+                // Leave room for the remaining devices
+                auto max_granules = (height - y + m_granularity - 1) / m_granularity;
+                auto reserved = min_granules * static_cast<std::uint32_t>(num_devices - i - 1);
+                granules = std::max(granules, min_granules);
+                granules = std::min(granules, max_granules > reserved ? max_granules - reserved : 0u);
+                rows = std::min(granules * m_granularity, height - y);
+            }
+
+            m_bands[i] = { i, y, rows };
+            y += rows;
+        }
+
+        return m_bands;
+    }
+
+    void TileScheduler::ReportTime(std::size_t device, std::uint32_t rows, double time_ms)
+    {
+        if (rows == 0 || time_ms <= 0.)
+        {
+            return;
+        }
+
+        auto throughput = rows / time_ms;
+        auto& smoothed = m_throughput[device];
+        smoothed = smoothed > 0. ? kSmoothingFactor * throughput + (1. - kSmoothingFactor) * smoothed : throughput;
+    }
+}
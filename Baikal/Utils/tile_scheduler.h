@@ -0,0 +1,68 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Baikal
+{
+    ///< The class splits an image region into horizontal bands, one per device.
+    ///< Band heights are proportional to the throughput (rows per millisecond) measured
+    ///< on previous frames, so faster devices receive more work. Throughput is smoothed
+    ///< with an exponential moving average to tolerate timing noise.
+    ///<
+    class TileScheduler
+    {
+    public:
+        struct Band
+        {
+            // Device index
+            std::size_t device;
+            // First row relative to the scheduled region
+            std::uint32_t y;
+            // Number of rows, 0 if the device got no work
+            std::uint32_t height;
+        };
+
+        // Band heights are rounded to granularity rows (except the last one)
+        explicit TileScheduler(std::size_t num_devices, std::uint32_t granularity = 8);
+
+        // Split height rows between devices, bands are ordered by device index
+        std::vector<Band> const& Schedule(std::uint32_t height);
+        // Report time spent by device rendering its band
+        void ReportTime(std::size_t device, std::uint32_t rows, double time_ms);
+        // Forget measured throughput
+        void Reset();
+
+        // Normalized share of the work assigned to device
+        float GetShare(std::size_t device) const;
+        std::size_t GetDeviceCount() const { return m_throughput.size(); }
+
+    private:
+        // Smoothed rows per millisecond for each device, 0 if not measured yet
+        std::vector<double> m_throughput;
+        std::vector<Band> m_bands;
+        std::uint32_t m_granularity;
+    };
+}
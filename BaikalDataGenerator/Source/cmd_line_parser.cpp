@@ -33,7 +33,8 @@ namespace
         "[-outpute_dir path_to_generate_data]"
         "[-width output_width]"
         "[-height output_height]"
-        "[-gamma enables_gamma_correction]";
+        "[-gamma enables_gamma_correction]"
+        "[-views max_number_of_cameras_rendered_at_once]";
 }
 
 CmdLineParser::CmdLineParser(int argc, char* argv[])
@@ -60,6 +61,8 @@ DGenConfig CmdLineParser::Parse() const
 
     config.gamma_correction = (m_cmd_parser.GetOption<int>("-gamma", 0) == 1);
 
+    config.num_views = m_cmd_parser.GetOption<std::uint32_t>("-views", 1);
+
     return config;
 }
 
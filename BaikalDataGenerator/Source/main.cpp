@@ -28,7 +28,7 @@ void Run(const DGenConfig& config)
 {
     ConfigLoader config_loader(config);
 
-    Render render(config.scene_file, config.width, config.height);
+    Render render(config.scene_file, config.width, config.height, config.num_views);
 
     render.GenerateDataset(config_loader.CamStatesBegin(), config_loader.CamStatesEnd(),
                            config_loader.LightsBegin(), config_loader.LightsEnd(),
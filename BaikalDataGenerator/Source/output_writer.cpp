@@ -0,0 +1,257 @@
+/**********************************************************************
+Copyright (c) 2018 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include "output_writer.h"
+#include "Output/clwoutput.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <fstream>
+
+OutputWriter::OutputWriter(CLWContext context,
+                           std::uint32_t width,
+                           std::uint32_t height,
+                           std::uint32_t view_width,
+                           std::uint32_t view_height,
+                           std::size_t num_staging_buffers,
+                           std::size_t num_threads)
+    : m_context(context)
+    , m_width(width)
+    , m_height(height)
+    , m_view_width(view_width)
+    , m_view_height(view_height)
+    , m_staging_buffers(num_staging_buffers)
+    , m_thread_pool(num_threads)
+{
+    assert(num_staging_buffers);
+
+    if (!m_view_width || !m_view_height ||
+        m_width % m_view_width || m_height % m_view_height)
+    {
+        THROW_EX("output size should be a multiple of the view size");
+    }
+
+    for (auto i = 0u; i < num_staging_buffers; ++i)
+    {
+        m_staging_buffers[i].resize(m_width * m_height);
+        m_free_staging_buffers.push_back(i);
+    }
+}
+
+OutputWriter::~OutputWriter()
+{
+    for (auto& pending : m_pending)
+    {
+        pending.wait();
+    }
+}
+
+std::size_t OutputWriter::AcquireStagingBuffer()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]() { return !m_free_staging_buffers.empty(); });
+
+    auto index = m_free_staging_buffers.back();
+    m_free_staging_buffers.pop_back();
+    return index;
+}
+
+void OutputWriter::ReleaseStagingBuffer(std::size_t index)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free_staging_buffers.push_back(index);
+    }
+
+    m_cv.notify_one();
+}
+
+void OutputWriter::Save(const Baikal::ClwOutput& output,
+                        int channels_num,
+                        bool gamma_correction_enabled,
+                        const std::vector<std::filesystem::path>& file_names)
+{
+    assert(channels_num == 1 || channels_num == 3);
+
+    auto buffer = output.data();
+
+    if (buffer.GetElementCount() != m_width * m_height)
+    {
+        THROW_EX("output size doesn't match the writer size");
+    }
+
+    if (file_names.size() > (m_width / m_view_width) * (m_height / m_view_height))
+    {
+        THROW_EX("too many file names for the output views");
+    }
+
+    // Blocks while all staging buffers are in flight
+    auto staging_buffer = AcquireStagingBuffer();
+
+    // The queue is in-order, so the copy sees the output content as of now
+    // and rendering the next iterations doesn't have to wait for it
+    CLWEvent event;
+    try
+    {
+        event = m_context.ReadBuffer(0,
+                                     buffer,
+                                     m_staging_buffers[staging_buffer].data(),
+                                     buffer.GetElementCount());
+    }
+    catch (...)
+    {
+        ReleaseStagingBuffer(staging_buffer);
+        throw;
+    }
+
+    m_context.Flush(0);
+
+    // Drop finished writes, reporting failures as early as possible
+    auto finished = std::partition(m_pending.begin(), m_pending.end(), [](const std::future<void>& pending)
+    {
+        return pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+    });
+
+    std::vector<std::future<void>> done;
+    std::move(finished, m_pending.end(), std::back_inserter(done));
+    m_pending.erase(finished, m_pending.end());
+
+    m_pending.push_back(m_thread_pool.Submit(
+        [this, event, staging_buffer, channels_num, gamma_correction_enabled, file_names]()
+    {
+        // Return the staging buffer even if the write fails
+        struct Release
+        {
+            OutputWriter* writer;
+            std::size_t index;
+            ~Release() { writer->ReleaseStagingBuffer(index); }
+        } release { this, staging_buffer };
+
+        event.Wait();
+
+        for (auto view = 0u; view < file_names.size(); ++view)
+        {
+            if (!file_names[view].empty())
+            {
+                Write(staging_buffer, view, channels_num, gamma_correction_enabled, file_names[view]);
+            }
+        }
+    }));
+
+    for (auto& future : done)
+    {
+        future.get();
+    }
+}
+
+void OutputWriter::Write(std::size_t staging_buffer,
+                         std::size_t view,
+                         int channels_num,
+                         bool gamma_correction_enabled,
+                         const std::filesystem::path& file_name) const
+{
+    auto const& output_data = m_staging_buffers[staging_buffer];
+
+    // view position in the output grid
+    auto views_x = m_width / m_view_width;
+    auto view_x = static_cast<std::uint32_t>(view % views_x) * m_view_width;
+    auto view_y = static_cast<std::uint32_t>(view / views_x) * m_view_height;
+
+    std::vector<float> image_data(channels_num * m_view_width * m_view_height);
+
+    float* dst_row = image_data.data();
+
+    for (auto y = 0u; y < m_view_height; ++y)
+    {
+        // invert the image
+        auto src_row = &output_data[(view_y + m_view_height - 1 - y) * m_width + view_x];
+
+        for (auto x = 0u; x < m_view_width; ++x)
+        {
+            RadeonRays::float3 val = src_row[x];
+            // "The 4-th pixel component is a count of accumulated samples.
+            // It can be different for every pixel in case of adaptive sampling.
+            // So, we need to normalize pixel values here".
+            val *= (1.f / val.w);
+
+            if (channels_num == 3)
+            {
+                if (gamma_correction_enabled)
+                {
+                    val.x = std::pow(val.x, 1.f / 2.2f);
+                    val.y = std::pow(val.y, 1.f / 2.2f);
+                    val.z = std::pow(val.z, 1.f / 2.2f);
+                }
+
+                dst_row[channels_num * x] = val.x;
+                dst_row[channels_num * x + 1] = val.y;
+                dst_row[channels_num * x + 2] = val.z;
+            }
+            else // channels_num = 1
+            {
+                dst_row[x] = val.x;
+            }
+        }
+        dst_row += channels_num * m_view_width;
+    }
+
+    std::ofstream f(file_name.string(), std::ofstream::binary);
+
+    f.write(reinterpret_cast<const char*>(image_data.data()),
+            sizeof(float) * image_data.size());
+
+    if (!f)
+    {
+        THROW_EX("failed to write " + file_name.string());
+    }
+}
+
+void OutputWriter::Flush()
+{
+    auto pending = std::move(m_pending);
+    m_pending.clear();
+
+    std::exception_ptr error;
+
+    for (auto& future : pending)
+    {
+        try
+        {
+            future.get();
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,103 @@
+/**********************************************************************
+Copyright (c) 2018 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#pragma once
+
+#include "CLW.h"
+#include "math/float3.h"
+#include "Utils/thread_pool.h"
+#include "utils.h"
+
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <vector>
+
+namespace Baikal
+{
+    class ClwOutput;
+}
+
+// Writes renderer outputs to disk without stalling the renderer:
+// device to host copies are enqueued asynchronously into staging buffers
+// and conversion and file writing run on a worker pool.
+// The number of staging buffers bounds the amount of outputs in flight,
+// Save blocks when all of them are busy.
+// An output can hold several views of the same size laid out in a grid
+// (row-major, starting from the first output row), each view goes to its own file.
+class OutputWriter
+{
+public:
+    // 'width', 'height' - output size
+    // 'view_width', 'view_height' - size of a single view, output size should be a multiple of it
+    // 'num_staging_buffers' - max number of outputs being read back or written at once
+    // 'num_threads' - number of worker threads, 0 to use the number of hardware threads
+    OutputWriter(CLWContext context,
+                 std::uint32_t width,
+                 std::uint32_t height,
+                 std::uint32_t view_width,
+                 std::uint32_t view_height,
+                 std::size_t num_staging_buffers,
+                 std::size_t num_threads = 0);
+
+    // Waits for the pending outputs, errors are ignored (call Flush to handle them)
+    ~OutputWriter();
+
+    // Schedules saving of the current output views as raw float images
+    // flipped vertically and normalized by the sample count
+    // 'channels_num' - number of channels to store (1 or 3)
+    // 'gamma_correction_enabled' - apply 2.2 gamma to the stored values
+    // 'file_names' - file per view, views with empty names are not saved
+    void Save(const Baikal::ClwOutput& output,
+              int channels_num,
+              bool gamma_correction_enabled,
+              const std::vector<std::filesystem::path>& file_names);
+
+    // Waits until all scheduled outputs are written, rethrows the first error
+    void Flush();
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator = (const OutputWriter&) = delete;
+
+private:
+    std::size_t AcquireStagingBuffer();
+    void ReleaseStagingBuffer(std::size_t index);
+
+    void Write(std::size_t staging_buffer,
+               std::size_t view,
+               int channels_num,
+               bool gamma_correction_enabled,
+               const std::filesystem::path& file_name) const;
+
+    CLWContext m_context;
+    std::uint32_t m_width, m_height;
+    std::uint32_t m_view_width, m_view_height;
+
+    std::vector<std::vector<RadeonRays::float3>> m_staging_buffers;
+    std::vector<std::size_t> m_free_staging_buffers;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    std::vector<std::future<void>> m_pending;
+    // Declared last so that workers are joined before the members they use are destroyed
+    Baikal::ThreadPool m_thread_pool;
+};
@@ -22,6 +22,7 @@ THE SOFTWARE.
 
 #include "CLW.h"
 #include "Renderers/renderer.h"
+#include "Renderers/monte_carlo_renderer.h"
 #include "RenderFactory/clw_render_factory.h"
 #include "SceneGraph/camera.h"
 #include "scene_io.h"
@@ -29,6 +30,7 @@ THE SOFTWARE.
 
 #include "utils.h"
 #include "render.h"
+#include "output_writer.h"
 #include "scene_io.h"
 #include "material_io.h"
 #include "SceneGraph/light.h"
@@ -47,6 +49,11 @@ namespace
 {
     std::uint32_t constexpr kNumIterations = 4096;
 
+    // Largest output rendered in a single estimator launch,
+    // should match renderer work buffer size
+    std::uint32_t constexpr kMaxBatchWidth = 1920;
+    std::uint32_t constexpr kMaxBatchHeight = 1080;
+
     bool RoughCompare(float x, float y, float epsilon = std::numeric_limits<float>::epsilon())
     {
     return std::abs(x - y) < epsilon;
@@ -93,12 +100,26 @@ const std::vector<OutputInfo> kSingleIteratedOutputs =
 
 Render::Render(const std::filesystem::path& scene_file,
     std::uint32_t output_width,
-    std::uint32_t output_height)
+    std::uint32_t output_height,
+    std::uint32_t num_views)
     : m_width(output_width), m_height(output_height)
 {
     assert(m_width);
     assert(m_height);
 
+    if (num_views == 0)
+    {
+        THROW_EX("number of views should be positive");
+    }
+
+    // pack as many views as fit into a single launch
+    m_views_x = std::min(num_views, std::max(1u, kMaxBatchWidth / m_width));
+    m_views_y = std::min((num_views + m_views_x - 1) / m_views_x,
+                         std::max(1u, kMaxBatchHeight / m_height));
+
+    auto batch_width = m_views_x * m_width;
+    auto batch_height = m_views_y * m_height;
+
     std::vector<CLWPlatform> platforms;
     CLWPlatform::CreateAllPlatforms(platforms);
 
@@ -131,17 +152,28 @@ Render::Render(const std::filesystem::path& scene_file,
     m_renderer = m_factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kUnidirectionalPathTracer);
     m_controller = m_factory->CreateSceneController();
 
+    static_cast<Baikal::MonteCarloRenderer*>(m_renderer.get())->SetViewSize(RadeonRays::int2(m_width, m_height));
+
     for (auto& output_info : kMultipleIteratedOutputs)
     {
-        m_outputs.push_back(m_factory->CreateOutput(output_width, output_height));
+        m_outputs.push_back(m_factory->CreateOutput(batch_width, batch_height));
         m_renderer->SetOutput(output_info.type, m_outputs.back().get());
     }
     for (auto& output_info : kSingleIteratedOutputs)
     {
-        m_outputs.push_back(m_factory->CreateOutput(output_width, output_height));
+        m_outputs.push_back(m_factory->CreateOutput(batch_width, batch_height));
         m_renderer->SetOutput(output_info.type, m_outputs.back().get());
     }
 
+    // two staging buffers per output: one set is written to disk
+    // while the next one is being rendered and read back
+    m_writer = std::make_unique<OutputWriter>(*m_context,
+                                              batch_width,
+                                              batch_height,
+                                              m_width,
+                                              m_height,
+                                              2 * m_outputs.size());
+
     if (!std::filesystem::exists(scene_file))
     {
         THROW_EX("There is no any scene file to load");
@@ -180,114 +212,64 @@ Render::Render(const std::filesystem::path& scene_file,
     }
 }
 
-void Render::UpdateCameraSettings(CameraIterator cam_state)
+void Render::UpdateCameraSettings(Baikal::PerspectiveCamera& camera, CameraIterator cam_state)
 {
-    if (cam_state->aperture != m_camera->GetAperture())
+    if (cam_state->aperture != camera.GetAperture())
     {
-        m_camera->SetAperture(cam_state->aperture);
+        camera.SetAperture(cam_state->aperture);
     }
 
-    if (cam_state->focal_length != m_camera->GetFocalLength())
+    if (cam_state->focal_length != camera.GetFocalLength())
     {
-        m_camera->SetFocalLength(cam_state->focal_length);
+        camera.SetFocalLength(cam_state->focal_length);
     }
 
-    if (cam_state->focus_distance != m_camera->GetFocusDistance())
+    if (cam_state->focus_distance != camera.GetFocusDistance())
     {
-        m_camera->SetFocusDistance(cam_state->focus_distance);
+        camera.SetFocusDistance(cam_state->focus_distance);
     }
 
-    auto cur_pos = m_camera->GetPosition();
-    auto at = m_camera->GetForwardVector();
-    auto up = m_camera->GetUpVector();
+    auto cur_pos = camera.GetPosition();
+    auto at = camera.GetForwardVector();
+    auto up = camera.GetUpVector();
 
     if (!RoughCompare(cur_pos, cam_state->pos) ||
         !RoughCompare(at, cam_state->at) ||
         !RoughCompare(up, cam_state->up))
     {
-        m_camera->LookAt(cam_state->pos, cam_state->at, cam_state->up);
+        camera.LookAt(cam_state->pos, cam_state->at, cam_state->up);
     }
 }
 
 void Render::SaveOutput(const OutputInfo& info,
-                        const std::string& name,
+                        const std::vector<std::string>& names,
                         bool gamma_correction_enabled,
                         const std::filesystem::path& output_dir)
 {
-    OIIO_NAMESPACE_USING;
-
     auto output = m_renderer->GetOutput(info.type);
 
     assert(output);
 
-    auto buffer = static_cast<Baikal::ClwOutput*>(output)->data();
-
-    std::vector<RadeonRays::float3> output_data(buffer.GetElementCount());
-
-    output->GetData(output_data.data());
+    std::vector<std::filesystem::path> file_names;
 
-    std::vector<float> image_data(info.channels_num * m_width * m_height);
-
-    float* dst_row = image_data.data();
-
-    if (gamma_correction_enabled &&
-       (info.type == Renderer::OutputType::kColor) &&
-       (info.channels_num == 3))
+    for (const auto& name : names)
     {
-        for (auto y = 0u; y < m_height; ++y)
+        std::filesystem::path file_name;
+
+        if (!name.empty())
         {
-            for (auto x = 0u; x < m_width; ++x)
-            {
-                float3 val = output_data[(m_height - 1 - y) * m_width + x];
-                // "The 4-th pixel component is a count of accumulated samples.
-                // It can be different for every pixel in case of adaptive sampling.
-                // So, we need to normalize pixel values here".
-                val *= (1.f / val.w);
-                // gamma corection
-                dst_row[info.channels_num * x] = std::pow(val.x, 1.f / 2.2f);
-                dst_row[info.channels_num * x + 1] = std::pow(val.y, 1.f / 2.2f);
-                dst_row[info.channels_num * x + 2] = std::pow(val.z, 1.f / 2.2f);
-            }
-            dst_row += info.channels_num * m_width;
+            file_name = output_dir;
+            file_name.append(name);
         }
-    }
-    else
-    {
-        for (auto y = 0u; y < m_height; ++y)
-        {
-            for (auto x = 0u; x < m_width; ++x)
-            {
-                float3 val = output_data[(m_height - 1 - y) * m_width + x];
-                // "The 4-th pixel component is a count of accumulated samples.
-                // It can be different for every pixel in case of adaptive sampling.
-                // So, we need to normalize pixel values here".
-                val *= (1.f / val.w);
 
-                if (info.channels_num == 3)
-                {
-                    int dst_pixel = y * m_width + x;
-                    // invert the image 
-                    dst_row[info.channels_num * x] = val.x;
-                    dst_row[info.channels_num * x + 1] = val.y;
-                    dst_row[info.channels_num * x + 2] = val.z;
-                }
-                else // info.channels_num = 1
-                {
-                    // invert the image 
-                    dst_row[x] = val.x;
-                }
-            }
-            dst_row += info.channels_num * m_width;
-        }
+        file_names.push_back(file_name);
     }
 
-    std::filesystem::path file_name = output_dir;
-    file_name.append(name);
-
-    std::ofstream f (file_name.string(), std::ofstream::binary);
-
-    f.write(reinterpret_cast<const char*>(image_data.data()),
-            sizeof(float) * image_data.size());
+    // conversion and writing happen asynchronously, see OutputWriter
+    m_writer->Save(*static_cast<Baikal::ClwOutput*>(output),
+                   info.channels_num,
+                   gamma_correction_enabled && (info.type == Renderer::OutputType::kColor),
+                   file_names);
 }
 
 void Render::SetLightConfig(LightsIterator begin, LightsIterator end)
@@ -355,8 +337,8 @@ void Render::GenerateDataset(CameraIterator cam_begin, CameraIterator cam_end,
         THROW_EX("incorrect output directory signature");
     }
 
-    // check if number of samples to render wasn't specified
-    if (spp_begin == spp_end)
+    // check if number of samples to render or cameras weren't specified
+    if (spp_begin == spp_end || cam_begin == cam_end)
     {
         return;
     }
@@ -374,29 +356,42 @@ void Render::GenerateDataset(CameraIterator cam_begin, CameraIterator cam_end,
     }
 
 
-    int cam_index = 1;
-    for (auto cam_state = cam_begin; cam_state != cam_end; ++cam_state)
+    const std::size_t batch_size = m_views_x * m_views_y;
+
+    // create cameras if it wasn't done earlier
+    while (m_cameras.size() < batch_size)
     {
-        // create camera if it wasn't  done earlier
-        if (!m_camera)
-        {
-            m_camera = Baikal::PerspectiveCamera::Create(cam_state->at,
-                                                         cam_state->pos,
-                                                         cam_state->up);
+        auto camera = Baikal::PerspectiveCamera::Create(cam_begin->at,
+                                                        cam_begin->pos,
+                                                        cam_begin->up);
 
-            // default sensor width
-            float sensor_width = 0.036f;
-            float inverserd_aspect_ration = static_cast<float>(m_height) /
-                                            static_cast<float>(m_width);
-            float sensor_height = sensor_width * inverserd_aspect_ration;
+        // default sensor width
+        float sensor_width = 0.036f;
+        float inverserd_aspect_ration = static_cast<float>(m_height) /
+                                        static_cast<float>(m_width);
+        float sensor_height = sensor_width * inverserd_aspect_ration;
 
-            m_camera->SetSensorSize(RadeonRays::float2(0.036f, sensor_height));
-            m_camera->SetDepthRange(RadeonRays::float2(0.0f, 100000.f));
+        camera->SetSensorSize(RadeonRays::float2(0.036f, sensor_height));
+        camera->SetDepthRange(RadeonRays::float2(0.0f, 100000.f));
 
-            m_scene->SetCamera(m_camera);
-        }
+        m_cameras.push_back(camera);
+    }
 
-        UpdateCameraSettings(cam_state);
+    m_scene->SetCamera(m_cameras.front());
+    m_scene->SetViewCameras({ m_cameras.begin(), m_cameras.end() });
+
+    int cam_index = 1;
+    for (auto batch_begin = cam_begin; batch_begin != cam_end;)
+    {
+        auto batch_end = batch_begin + std::min<std::ptrdiff_t>(batch_size, std::distance(batch_begin, cam_end));
+        auto num_cameras = static_cast<std::size_t>(batch_end - batch_begin);
+
+        // views left in the last batch repeat the last camera and aren't saved
+        for (auto i = 0u; i < batch_size; ++i)
+        {
+            auto cam_state = i < num_cameras ? batch_begin + i : batch_end - 1;
+            UpdateCameraSettings(*m_cameras[i], cam_state);
+        }
 
         for (const auto& output: m_outputs)
         {
@@ -409,6 +404,23 @@ void Render::GenerateDataset(CameraIterator cam_begin, CameraIterator cam_end,
 
         auto spp_iter = sorted_spp.begin();
 
+        // file names for every view of the batch
+        auto get_names = [&](const std::string& suffix)
+        {
+            std::vector<std::string> names(batch_size);
+
+            for (auto i = 0u; i < num_cameras; ++i)
+            {
+                std::stringstream ss;
+
+                ss << "cam_" << cam_index + i << "_" << suffix;
+
+                names[i] = ss.str();
+            }
+
+            return names;
+        };
+
         for (auto i = 1; i <= sorted_spp.back(); i++)
         {
             m_renderer->Render(scene);
@@ -417,13 +429,8 @@ void Render::GenerateDataset(CameraIterator cam_begin, CameraIterator cam_end,
             {
                 for (const auto& output : kSingleIteratedOutputs)
                 {
-                    std::stringstream ss;
-
-                    ss << "cam_" << cam_index << "_"
-                        << output.name << ".bin";
-
                     SaveOutput(output,
-                               ss.str(),
+                               get_names(output.name + ".bin"),
                                gamma_correction_enabled,
                                output_dir);
                 }
@@ -435,20 +442,22 @@ void Render::GenerateDataset(CameraIterator cam_begin, CameraIterator cam_end,
                 {
                     std::stringstream ss;
 
-                    ss << "cam_" << cam_index << "_"
-                        << output.name << "_spp_" << i << ".bin";
+                    ss << output.name << "_spp_" << i << ".bin";
 
                     SaveOutput(output,
-                                ss.str(),
-                                gamma_correction_enabled,
-                                output_dir);
+                               get_names(ss.str()),
+                               gamma_correction_enabled,
+                               output_dir);
                 }
                 ++spp_iter;
             }
         }
 
-        cam_index++;
+        cam_index += static_cast<int>(num_cameras);
+        batch_begin = batch_end;
     }
+
+    m_writer->Flush();
 }
 
 Render::~Render() = default;
@@ -46,6 +46,7 @@ namespace Baikal
 }
 
 class CLWContext;
+class OutputWriter;
 
 class Render
 {
@@ -53,9 +54,12 @@ public:
     // 'scene_file' - full path till .obj/.objm or some kind of this files with scene
     // 'output_width' - width of outputs which will be saved on disk
     // 'output_height' - height of outputs which will be saved on disk
+    // 'num_views' - max number of cameras rendered at once, views are packed
+    // into one output so a single launch renders all of them
     Render(const std::filesystem::path& scene_file,
            std::uint32_t output_width,
-           std::uint32_t output_height);
+           std::uint32_t output_height,
+           std::uint32_t num_views = 1);
 
     // This function generates dataset for network training
     // 'cam_begin' - begin iterator on camera states collection
@@ -75,21 +79,25 @@ public:
     ~Render();
 
 private:
-    void UpdateCameraSettings(CameraIterator cam_state);
+    void UpdateCameraSettings(Baikal::PerspectiveCamera& camera, CameraIterator cam_state);
 
     void SetLightConfig(LightsIterator begin, LightsIterator end);
 
+    // 'names' - file name for every view, views with empty names aren't saved
     void SaveOutput(const OutputInfo& info,
-                    const std::string& name,
+                    const std::vector<std::string>& names,
                     bool gamma_correction_enabled,
                     const std::filesystem::path& output_dir);
 
     std::uint32_t m_width, m_height;
+    // views are laid out in a grid of m_views_x * m_views_y
+    std::uint32_t m_views_x, m_views_y;
     std::unique_ptr<Baikal::Renderer> m_renderer;
     std::unique_ptr<Baikal::ClwRenderFactory> m_factory;
     std::unique_ptr<Baikal::SceneController<Baikal::ClwScene>> m_controller;
     std::vector<std::unique_ptr<Baikal::Output>> m_outputs;
     std::shared_ptr<Baikal::Scene1> m_scene;
-    std::shared_ptr<Baikal::PerspectiveCamera> m_camera;
+    std::vector<std::shared_ptr<Baikal::PerspectiveCamera>> m_cameras;
     std::unique_ptr<CLWContext> m_context;
+    std::unique_ptr<OutputWriter> m_writer;
 };
\ No newline at end of file
@@ -43,6 +43,8 @@ struct DGenConfig
     std::filesystem::path spp_file;
     std::filesystem::path output_dir;
     std::uint32_t width, height;
+    // max number of camera views rendered at once
+    std::uint32_t num_views;
     bool gamma_correction;
 };
 
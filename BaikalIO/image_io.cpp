@@ -73,6 +73,14 @@ namespace Baikal
                 }
 
             }
+            else if (spec.nchannels == 3)
+            {
+                // Images without alpha are opaque
+                for (auto i = 3; i < size; i += 4)
+                {
+                    texturedata[i] = static_cast<char>(0xFF);
+                }
+            }
 
             // Close handle
             input->close();
@@ -122,6 +130,11 @@ namespace Baikal
             throw std::runtime_error("Can't create image file on disk");
         }
 
+        if (texture->IsCompressed())
+        {
+            throw std::runtime_error("Can't save block compressed image");
+        }
+
         auto dim = texture->GetSize();
         auto fmt = GetTextureFormat(texture->GetFormat());
 
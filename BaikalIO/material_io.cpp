@@ -310,12 +310,10 @@ namespace Baikal
         Collector mat_collector;
         // Collect materials from shapes first
         mat_collector.Collect(*shape_iter,
-        // This function adds all materials to resulting map
+        // This function adds all materials to the collector
         // recursively via Material dependency API
-        [](SceneObject::Ptr item) -> std::set<SceneObject::Ptr>
+        [](SceneObject::Ptr const& item, Collector& collector)
         {
-            // Resulting material set
-            std::set<SceneObject::Ptr> mats;
             // Material stack
             std::stack<Material::Ptr> material_stack;
 
@@ -336,8 +334,11 @@ namespace Baikal
                 auto m = material_stack.top();
                 material_stack.pop();
 
-                // Emplace into the set
-                mats.emplace(m);
+                // Skip materials collected from other shapes
+                if (!collector.Collect(m))
+                {
+                    continue;
+                }
 
                 // Create dependency iterator
                 std::unique_ptr<Iterator> mat_iter = m->CreateMaterialIterator();
@@ -348,9 +349,6 @@ namespace Baikal
                     material_stack.push(mat_iter->ItemAs<Material>());
                 }
             }
-
-            // Return resulting set
-            return mats;
         });
 
         auto mat_iter = mat_collector.CreateIterator();
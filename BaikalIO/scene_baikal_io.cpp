@@ -0,0 +1,1108 @@
+/**********************************************************************
+Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include "scene_io.h"
+#include "image_io.h"
+#include "SceneGraph/scene1.h"
+#include "SceneGraph/iterator.h"
+#include "SceneGraph/shape.h"
+#include "SceneGraph/material.h"
+#include "SceneGraph/light.h"
+#include "SceneGraph/texture.h"
+#include "SceneGraph/uberv2material.h"
+#include "SceneGraph/inputmaps.h"
+
+#include <cstdio>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#ifdef WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#undef LoadImage
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Utils/log.h"
+
+namespace Baikal
+{
+    namespace
+    {
+        // File layout (little endian, all arrays are 16 byte aligned from the file start):
+        //   header | textures | input maps | materials | shapes | lights | scene properties
+        // Objects reference each other by index in their section, -1 stands for none.
+        // Input maps are stored in dependency order (arguments first), meshes before instances.
+        char const kMagic[8] = { 'B', 'K', 'L', 'S', 'C', 'E', 'N', 'E' };
+        std::uint32_t constexpr kVersion = 1;
+        std::size_t constexpr kArrayAlignment = 16;
+        std::int32_t constexpr kNone = -1;
+
+        enum class TextureSource : std::uint32_t
+        {
+            // Loaded by name relative to the base path
+            kFile,
+            // Texel data is stored in the file
+            kEmbedded
+        };
+
+        enum class ShapeType : std::uint32_t
+        {
+            kMesh,
+            kInstance
+        };
+
+        enum class LightType : std::uint32_t
+        {
+            kPoint,
+            kDirectional,
+            kSpot,
+            kIbl,
+            kArea,
+            kMesh
+        };
+
+        // Read only view of the whole file mapped into memory
+        class MappedFile
+        {
+        public:
+            explicit MappedFile(std::string const& filename);
+            ~MappedFile();
+
+            char const* GetData() const { return m_data; }
+            std::size_t GetSize() const { return m_size; }
+
+            MappedFile(MappedFile const&) = delete;
+            MappedFile& operator = (MappedFile const&) = delete;
+
+        private:
+            char const* m_data = nullptr;
+            std::size_t m_size = 0;
+#ifdef WIN32
+            HANDLE m_file = INVALID_HANDLE_VALUE;
+            HANDLE m_mapping = nullptr;
+#else
+            int m_fd = -1;
+#endif
+        };
+
+#ifdef WIN32
+        MappedFile::MappedFile(std::string const& filename)
+        {
+            m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (m_file == INVALID_HANDLE_VALUE)
+            {
+                throw std::runtime_error("SceneIoBaikal: cannot open " + filename);
+            }
+
+            LARGE_INTEGER size;
+            GetFileSizeEx(m_file, &size);
+            m_size = static_cast<std::size_t>(size.QuadPart);
+
+            if (m_size > 0)
+            {
+                m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                m_data = m_mapping ? static_cast<char const*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+                if (!m_data)
+                {
+                    if (m_mapping) CloseHandle(m_mapping);
+                    CloseHandle(m_file);
+                    throw std::runtime_error("SceneIoBaikal: cannot map " + filename);
+                }
+            }
+        }
+
+        MappedFile::~MappedFile()
+        {
+            if (m_data) UnmapViewOfFile(m_data);
+            if (m_mapping) CloseHandle(m_mapping);
+            CloseHandle(m_file);
+        }
+#else
+        MappedFile::MappedFile(std::string const& filename)
+        {
+            m_fd = open(filename.c_str(), O_RDONLY);
+            if (m_fd < 0)
+            {
+                throw std::runtime_error("SceneIoBaikal: cannot open " + filename);
+            }
+
+            struct stat st;
+            fstat(m_fd, &st);
+            m_size = static_cast<std::size_t>(st.st_size);
+
+            if (m_size > 0)
+            {
+                void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+                if (data == MAP_FAILED)
+                {
+                    close(m_fd);
+                    throw std::runtime_error("SceneIoBaikal: cannot map " + filename);
+                }
+                m_data = static_cast<char const*>(data);
+            }
+        }
+
+        MappedFile::~MappedFile()
+        {
+            if (m_data) munmap(const_cast<char*>(m_data), m_size);
+            close(m_fd);
+        }
+#endif
+
+        class BinaryWriter
+        {
+        public:
+            explicit BinaryWriter(std::ostream& out)
+                : m_out(out)
+                , m_offset(0)
+            {
+            }
+
+            template <typename T> void Write(T const& value)
+            {
+                WriteBytes(&value, sizeof(T));
+            }
+
+            void WriteString(std::string const& str)
+            {
+                Write(static_cast<std::uint32_t>(str.size()));
+                WriteBytes(str.data(), str.size());
+            }
+
+            template <typename T> void WriteArray(T const* data, std::size_t count)
+            {
+                Write(static_cast<std::uint64_t>(count));
+                Align();
+                WriteBytes(data, count * sizeof(T));
+            }
+
+        private:
+            void Align()
+            {
+                static char const kZeros[kArrayAlignment] = {};
+                WriteBytes(kZeros, (kArrayAlignment - m_offset % kArrayAlignment) % kArrayAlignment);
+            }
+
+            void WriteBytes(void const* data, std::size_t size)
+            {
+                m_out.write(static_cast<char const*>(data), size);
+                m_offset += size;
+            }
+
+            std::ostream& m_out;
+            std::size_t m_offset;
+        };
+
+        // Arrays are returned as pointers into the mapped file, nothing is parsed or copied
+        class BinaryReader
+        {
+        public:
+            BinaryReader(char const* data, std::size_t size)
+                : m_data(data)
+                , m_size(size)
+                , m_offset(0)
+            {
+            }
+
+            template <typename T> T Read()
+            {
+                T value;
+                std::memcpy(&value, Advance(sizeof(T)), sizeof(T));
+                return value;
+            }
+
+            std::string ReadString()
+            {
+                auto size = Read<std::uint32_t>();
+                return std::string(Advance(size), size);
+            }
+
+            template <typename T> T const* ReadArray(std::size_t& count)
+            {
+                count = static_cast<std::size_t>(Read<std::uint64_t>());
+                Advance((kArrayAlignment - m_offset % kArrayAlignment) % kArrayAlignment);
+                if (count > (m_size - m_offset) / sizeof(T))
+                {
+                    throw std::runtime_error("SceneIoBaikal: unexpected end of file.");
+                }
+                return reinterpret_cast<T const*>(Advance(count * sizeof(T)));
+            }
+
+        private:
+            char const* Advance(std::size_t size)
+            {
+                if (size > m_size - m_offset)
+                {
+                    throw std::runtime_error("SceneIoBaikal: unexpected end of file.");
+                }
+
+                auto ptr = m_data + m_offset;
+                m_offset += size;
+                return ptr;
+            }
+
+            char const* m_data;
+            std::size_t m_size;
+            std::size_t m_offset;
+        };
+
+        void WriteFloat3(BinaryWriter& writer, RadeonRays::float3 const& v)
+        {
+            writer.Write(v.x);
+            writer.Write(v.y);
+            writer.Write(v.z);
+            writer.Write(v.w);
+        }
+
+        RadeonRays::float3 ReadFloat3(BinaryReader& reader)
+        {
+            RadeonRays::float3 v;
+            v.x = reader.Read<float>();
+            v.y = reader.Read<float>();
+            v.z = reader.Read<float>();
+            v.w = reader.Read<float>();
+            return v;
+        }
+
+        void WriteMatrix(BinaryWriter& writer, RadeonRays::matrix const& m)
+        {
+            for (int i = 0; i < 4; ++i)
+                for (int j = 0; j < 4; ++j)
+                    writer.Write(m.m[i][j]);
+        }
+
+        RadeonRays::matrix ReadMatrix(BinaryReader& reader)
+        {
+            RadeonRays::matrix m;
+            for (int i = 0; i < 4; ++i)
+                for (int j = 0; j < 4; ++j)
+                    m.m[i][j] = reader.Read<float>();
+            return m;
+        }
+
+        // Arguments of an input map node in serialization order
+        std::vector<InputMap::Ptr> GetInputMapArguments(InputMap const& input_map)
+        {
+            switch (input_map.m_type)
+            {
+            case InputMap::InputMapType::kConstantFloat:
+            case InputMap::InputMapType::kConstantFloat3:
+            case InputMap::InputMapType::kSampler:
+            case InputMap::InputMapType::kSamplerBumpmap:
+                return {};
+            case InputMap::InputMapType::kAdd:
+            case InputMap::InputMapType::kSub:
+            case InputMap::InputMapType::kMul:
+            case InputMap::InputMapType::kDiv:
+            case InputMap::InputMapType::kMin:
+            case InputMap::InputMapType::kMax:
+            case InputMap::InputMapType::kDot3:
+            case InputMap::InputMapType::kDot4:
+            case InputMap::InputMapType::kCross3:
+            case InputMap::InputMapType::kCross4:
+            case InputMap::InputMapType::kPow:
+            case InputMap::InputMapType::kMod:
+            case InputMap::InputMapType::kShuffle2:
+            {
+                //It's safe since all this types differs only in id value
+                auto i = static_cast<InputMap_Add const*>(&input_map);
+                return { i->GetA(), i->GetB() };
+            }
+            case InputMap::InputMapType::kLerp:
+            {
+                auto i = static_cast<InputMap_Lerp const*>(&input_map);
+                return { i->GetA(), i->GetB(), i->GetControl() };
+            }
+            case InputMap::InputMapType::kRemap:
+            {
+                auto i = static_cast<InputMap_Remap const*>(&input_map);
+                return { i->GetSourceRange(), i->GetDestinationRange(), i->GetData() };
+            }
+            default:
+            {
+                //Single argument types
+                auto i = static_cast<InputMap_Sin const*>(&input_map);
+                return { i->GetArg() };
+            }
+            }
+        }
+
+        // Serialization state: object to index mappings
+        struct SceneWriteContext
+        {
+            std::vector<Texture::Ptr> textures;
+            std::map<Texture const*, std::int32_t> texture_indices;
+            std::vector<InputMap::Ptr> input_maps;
+            std::map<InputMap const*, std::int32_t> input_map_indices;
+            std::vector<UberV2Material::Ptr> materials;
+            std::map<Material const*, std::int32_t> material_indices;
+
+            std::int32_t AddTexture(Texture::Ptr const& texture)
+            {
+                if (!texture)
+                {
+                    return kNone;
+                }
+
+                auto iter = texture_indices.find(texture.get());
+                if (iter != texture_indices.cend())
+                {
+                    return iter->second;
+                }
+
+                auto index = static_cast<std::int32_t>(textures.size());
+                textures.push_back(texture);
+                texture_indices.emplace(texture.get(), index);
+                return index;
+            }
+
+            // Post order traversal, so arguments always precede the node
+            std::int32_t AddInputMap(InputMap::Ptr const& input_map)
+            {
+                auto iter = input_map_indices.find(input_map.get());
+                if (iter != input_map_indices.cend())
+                {
+                    return iter->second;
+                }
+
+                for (auto const& arg : GetInputMapArguments(*input_map))
+                {
+                    AddInputMap(arg);
+                }
+
+                if (input_map->m_type == InputMap::InputMapType::kSampler ||
+                    input_map->m_type == InputMap::InputMapType::kSamplerBumpmap)
+                {
+                    AddTexture(static_cast<InputMap_Sampler const*>(input_map.get())->GetTexture());
+                }
+
+                auto index = static_cast<std::int32_t>(input_maps.size());
+                input_maps.push_back(input_map);
+                input_map_indices.emplace(input_map.get(), index);
+                return index;
+            }
+
+            std::int32_t AddMaterial(Material::Ptr const& material)
+            {
+                if (!material)
+                {
+                    return kNone;
+                }
+
+                auto iter = material_indices.find(material.get());
+                if (iter != material_indices.cend())
+                {
+                    return iter->second;
+                }
+
+                auto uberv2_material = std::dynamic_pointer_cast<UberV2Material>(material);
+                if (!uberv2_material)
+                {
+                    LogInfo("SceneIoBaikal: only UberV2 materials are supported, skipping ", material->GetName(), "\n");
+                    material_indices.emplace(material.get(), kNone);
+                    return kNone;
+                }
+
+                for (std::size_t i = 0; i < uberv2_material->GetNumInputs(); ++i)
+                {
+                    auto input = uberv2_material->GetInput(i);
+                    if (uberv2_material->IsActive(input) && input.value.input_map_value)
+                    {
+                        AddInputMap(input.value.input_map_value);
+                    }
+                }
+
+                auto index = static_cast<std::int32_t>(materials.size());
+                materials.push_back(uberv2_material);
+                material_indices.emplace(material.get(), index);
+                return index;
+            }
+        };
+
+        void WriteInputMap(BinaryWriter& writer, SceneWriteContext& context, InputMap const& input_map)
+        {
+            writer.Write(static_cast<std::uint32_t>(input_map.m_type));
+            writer.WriteString(input_map.GetName());
+
+            auto args = GetInputMapArguments(input_map);
+            writer.Write(static_cast<std::uint32_t>(args.size()));
+            for (auto const& arg : args)
+            {
+                writer.Write(context.input_map_indices.at(arg.get()));
+            }
+
+            switch (input_map.m_type)
+            {
+            case InputMap::InputMapType::kConstantFloat:
+                writer.Write(static_cast<InputMap_ConstantFloat const&>(input_map).GetValue());
+                break;
+            case InputMap::InputMapType::kConstantFloat3:
+                WriteFloat3(writer, static_cast<InputMap_ConstantFloat3 const&>(input_map).GetValue());
+                break;
+            case InputMap::InputMapType::kSampler:
+            case InputMap::InputMapType::kSamplerBumpmap:
+                writer.Write(context.AddTexture(static_cast<InputMap_Sampler const&>(input_map).GetTexture()));
+                break;
+            case InputMap::InputMapType::kSelect:
+                writer.Write(static_cast<std::uint32_t>(static_cast<InputMap_Select const&>(input_map).GetSelection()));
+                break;
+            case InputMap::InputMapType::kShuffle:
+                for (auto m : static_cast<InputMap_Shuffle const&>(input_map).GetMask())
+                    writer.Write(m);
+                break;
+            case InputMap::InputMapType::kShuffle2:
+                for (auto m : static_cast<InputMap_Shuffle2 const&>(input_map).GetMask())
+                    writer.Write(m);
+                break;
+            case InputMap::InputMapType::kMatMul:
+                WriteMatrix(writer, static_cast<InputMap_MatMul const&>(input_map).GetMatrix());
+                break;
+            default:
+                break;
+            }
+        }
+
+        template <typename T> InputMap::Ptr CreateOneArg(std::vector<InputMap::Ptr> const& args)
+        {
+            return T::Create(args[0]);
+        }
+
+        template <typename T> InputMap::Ptr CreateTwoArg(std::vector<InputMap::Ptr> const& args)
+        {
+            return T::Create(args[0], args[1]);
+        }
+
+        InputMap::Ptr ReadInputMap(BinaryReader& reader, std::vector<InputMap::Ptr> const& input_maps, std::vector<Texture::Ptr> const& textures)
+        {
+            auto type = static_cast<InputMap::InputMapType>(reader.Read<std::uint32_t>());
+            auto name = reader.ReadString();
+
+            auto num_args = reader.Read<std::uint32_t>();
+            std::vector<InputMap::Ptr> args(num_args);
+            for (auto& arg : args)
+            {
+                arg = input_maps.at(reader.Read<std::int32_t>());
+            }
+
+            auto check_args = [&args](std::size_t expected)
+            {
+                if (args.size() != expected)
+                {
+                    throw std::runtime_error("SceneIoBaikal: invalid input map arguments.");
+                }
+            };
+
+            InputMap::Ptr result;
+            switch (type)
+            {
+            case InputMap::InputMapType::kConstantFloat:
+                result = InputMap_ConstantFloat::Create(reader.Read<float>());
+                break;
+            case InputMap::InputMapType::kConstantFloat3:
+                result = InputMap_ConstantFloat3::Create(ReadFloat3(reader));
+                break;
+            case InputMap::InputMapType::kSampler:
+            case InputMap::InputMapType::kSamplerBumpmap:
+            {
+                auto texture_index = reader.Read<std::int32_t>();
+                auto texture = texture_index == kNone ? nullptr : textures.at(texture_index);
+                result = type == InputMap::InputMapType::kSampler ?
+                    InputMap::Ptr(InputMap_Sampler::Create(texture)) :
+                    InputMap::Ptr(InputMap_SamplerBumpMap::Create(texture));
+                break;
+            }
+            case InputMap::InputMapType::kSelect:
+                check_args(1);
+                result = InputMap_Select::Create(args[0], static_cast<InputMap_Select::Selection>(reader.Read<std::uint32_t>()));
+                break;
+            case InputMap::InputMapType::kShuffle:
+            case InputMap::InputMapType::kShuffle2:
+            {
+                std::array<std::uint32_t, 4> mask;
+                for (auto& m : mask)
+                    m = reader.Read<std::uint32_t>();
+
+                if (type == InputMap::InputMapType::kShuffle)
+                {
+                    check_args(1);
+                    result = InputMap_Shuffle::Create(args[0], mask);
+                }
+                else
+                {
+                    check_args(2);
+                    result = InputMap_Shuffle2::Create(args[0], args[1], mask);
+                }
+                break;
+            }
+            case InputMap::InputMapType::kMatMul:
+                check_args(1);
+                result = InputMap_MatMul::Create(args[0], ReadMatrix(reader));
+                break;
+            case InputMap::InputMapType::kLerp:
+                check_args(3);
+                result = InputMap_Lerp::Create(args[0], args[1], args[2]);
+                break;
+            case InputMap::InputMapType::kRemap:
+                check_args(3);
+                result = InputMap_Remap::Create(args[0], args[1], args[2]);
+                break;
+            // Two inputs
+            case InputMap::InputMapType::kAdd: check_args(2); result = CreateTwoArg<InputMap_Add>(args); break;
+            case InputMap::InputMapType::kSub: check_args(2); result = CreateTwoArg<InputMap_Sub>(args); break;
+            case InputMap::InputMapType::kMul: check_args(2); result = CreateTwoArg<InputMap_Mul>(args); break;
+            case InputMap::InputMapType::kDiv: check_args(2); result = CreateTwoArg<InputMap_Div>(args); break;
+            case InputMap::InputMapType::kMin: check_args(2); result = CreateTwoArg<InputMap_Min>(args); break;
+            case InputMap::InputMapType::kMax: check_args(2); result = CreateTwoArg<InputMap_Max>(args); break;
+            case InputMap::InputMapType::kDot3: check_args(2); result = CreateTwoArg<InputMap_Dot3>(args); break;
+            case InputMap::InputMapType::kDot4: check_args(2); result = CreateTwoArg<InputMap_Dot4>(args); break;
+            case InputMap::InputMapType::kCross3: check_args(2); result = CreateTwoArg<InputMap_Cross3>(args); break;
+            case InputMap::InputMapType::kCross4: check_args(2); result = CreateTwoArg<InputMap_Cross4>(args); break;
+            case InputMap::InputMapType::kPow: check_args(2); result = CreateTwoArg<InputMap_Pow>(args); break;
+            case InputMap::InputMapType::kMod: check_args(2); result = CreateTwoArg<InputMap_Mod>(args); break;
+            // Single input
+            case InputMap::InputMapType::kSin: check_args(1); result = CreateOneArg<InputMap_Sin>(args); break;
+            case InputMap::InputMapType::kCos: check_args(1); result = CreateOneArg<InputMap_Cos>(args); break;
+            case InputMap::InputMapType::kTan: check_args(1); result = CreateOneArg<InputMap_Tan>(args); break;
+            case InputMap::InputMapType::kAsin: check_args(1); result = CreateOneArg<InputMap_Asin>(args); break;
+            case InputMap::InputMapType::kAcos: check_args(1); result = CreateOneArg<InputMap_Acos>(args); break;
+            case InputMap::InputMapType::kAtan: check_args(1); result = CreateOneArg<InputMap_Atan>(args); break;
+            case InputMap::InputMapType::kLength3: check_args(1); result = CreateOneArg<InputMap_Length3>(args); break;
+            case InputMap::InputMapType::kNormalize3: check_args(1); result = CreateOneArg<InputMap_Normalize3>(args); break;
+            case InputMap::InputMapType::kFloor: check_args(1); result = CreateOneArg<InputMap_Floor>(args); break;
+            case InputMap::InputMapType::kAbs: check_args(1); result = CreateOneArg<InputMap_Abs>(args); break;
+            default:
+                throw std::runtime_error("SceneIoBaikal: unknown input map type.");
+            }
+
+            result->SetName(name);
+            return result;
+        }
+    }
+
+    // Binary scene format holding everything needed to rebuild Scene1 without parsing:
+    // mesh arrays are stored in the exact layout Mesh and the scene controller consume
+    class SceneIoBaikal : public SceneIo::Loader
+    {
+    public:
+        SceneIoBaikal() : SceneIo::Loader("baikalscene", this)
+        {
+        }
+
+        Scene1::Ptr LoadScene(std::string const& filename, std::string const& basepath) const override;
+        void SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const override;
+    };
+
+    // Create static object to register loader. This object will be used as loader
+    static SceneIoBaikal baikal_scene_loader;
+
+    Scene1::Ptr SceneIoBaikal::LoadScene(std::string const& filename, std::string const& basepath) const
+    {
+        MappedFile file(filename);
+        BinaryReader reader(file.GetData(), file.GetSize());
+
+        char magic[sizeof(kMagic)];
+        for (auto& c : magic)
+        {
+            c = reader.Read<char>();
+        }
+
+        if (std::memcmp(magic, kMagic, sizeof(kMagic)) != 0)
+        {
+            throw std::runtime_error("SceneIoBaikal: " + filename + " is not a Baikal scene.");
+        }
+
+        if (reader.Read<std::uint32_t>() != kVersion)
+        {
+            throw std::runtime_error("SceneIoBaikal: unsupported version of " + filename);
+        }
+
+        auto scene = Scene1::Create();
+        auto image_io(ImageIo::CreateImageIo());
+
+        // Textures
+        std::vector<Texture::Ptr> textures(reader.Read<std::uint32_t>());
+        for (auto& texture : textures)
+        {
+            auto source = static_cast<TextureSource>(reader.Read<std::uint32_t>());
+            auto name = reader.ReadString();
+            auto format = static_cast<Texture::Format>(reader.Read<std::uint32_t>());
+
+            if (source == TextureSource::kFile)
+            {
+                // Block compressed textures are compressed on load with the same format
+                auto is_compressed = format == Texture::Format::kBc1 || format == Texture::Format::kBc3 ||
+                    format == Texture::Format::kBc4 || format == Texture::Format::kBc5;
+                texture = is_compressed ?
+                    SceneIo::Loader::LoadTexture(*image_io, *scene, basepath, name, format) :
+                    SceneIo::Loader::LoadTexture(*image_io, *scene, basepath, name);
+            }
+            else
+            {
+                RadeonRays::int3 size;
+                size.x = reader.Read<std::int32_t>();
+                size.y = reader.Read<std::int32_t>();
+                size.z = reader.Read<std::int32_t>();
+
+                std::size_t data_size = 0;
+                auto data = reader.ReadArray<char>(data_size);
+
+                auto texture_data = new char[data_size];
+                std::memcpy(texture_data, data, data_size);
+                texture = Texture::Create(texture_data, size, format);
+                texture->SetName(name);
+            }
+        }
+
+        // Input maps
+        std::vector<InputMap::Ptr> input_maps(reader.Read<std::uint32_t>());
+        for (auto& input_map : input_maps)
+        {
+            input_map = ReadInputMap(reader, input_maps, textures);
+        }
+
+        // Materials
+        std::vector<Material::Ptr> materials(reader.Read<std::uint32_t>());
+        for (auto& material : materials)
+        {
+            auto uberv2_material = UberV2Material::Create();
+            uberv2_material->SetName(reader.ReadString());
+            uberv2_material->SetThin(reader.Read<std::uint32_t>() != 0);
+            // Layers first, they define which inputs are active
+            uberv2_material->SetLayers(reader.Read<std::uint32_t>());
+            uberv2_material->LinkRefractionIOR(reader.Read<std::uint32_t>() != 0);
+            uberv2_material->SetDoubleSided(reader.Read<std::uint32_t>() != 0);
+            uberv2_material->SetMultiscatter(reader.Read<std::uint32_t>() != 0);
+
+            auto num_inputs = reader.Read<std::uint32_t>();
+            for (auto i = 0u; i < num_inputs; ++i)
+            {
+                auto input_name = reader.ReadString();
+                uberv2_material->SetInputValue(input_name, input_maps.at(reader.Read<std::int32_t>()));
+            }
+
+            material = uberv2_material;
+        }
+
+        // Shapes
+        std::vector<Shape::Ptr> shapes(reader.Read<std::uint32_t>());
+        for (std::size_t i = 0; i < shapes.size(); ++i)
+        {
+            auto& shape = shapes[i];
+            auto type = static_cast<ShapeType>(reader.Read<std::uint32_t>());
+            auto attached = reader.Read<std::uint32_t>() != 0;
+            auto name = reader.ReadString();
+            auto material_index = reader.Read<std::int32_t>();
+            auto transform = ReadMatrix(reader);
+            auto group_id = reader.Read<std::uint32_t>();
+            auto visibility_mask = reader.Read<std::uint32_t>();
+
+            if (type == ShapeType::kMesh)
+            {
+                auto mesh = Mesh::Create();
+
+                std::size_t count = 0;
+                auto vertices = reader.ReadArray<RadeonRays::float3>(count);
+                mesh->SetVertices(vertices, count);
+                auto normals = reader.ReadArray<RadeonRays::float3>(count);
+                mesh->SetNormals(normals, count);
+                auto uvs = reader.ReadArray<RadeonRays::float2>(count);
+                mesh->SetUVs(uvs, count);
+                auto indices = reader.ReadArray<std::uint32_t>(count);
+                mesh->SetIndices(indices, count);
+
+                shape = mesh;
+            }
+            else if (type == ShapeType::kInstance)
+            {
+                // Base shapes always precede their instances
+                auto base_index = reader.Read<std::int32_t>();
+                if (base_index != kNone && static_cast<std::size_t>(base_index) >= i)
+                {
+                    throw std::runtime_error("SceneIoBaikal: invalid instance base shape.");
+                }
+                shape = Instance::Create(base_index == kNone ? nullptr : shapes[base_index]);
+            }
+            else
+            {
+                throw std::runtime_error("SceneIoBaikal: unknown shape type.");
+            }
+
+            shape->SetName(name);
+            shape->SetMaterial(material_index == kNone ? nullptr : materials.at(material_index));
+            shape->SetTransform(transform);
+            shape->SetGroupId(group_id);
+            shape->SetVisibilityMask(visibility_mask);
+
+            if (attached)
+            {
+                scene->AttachShape(shape);
+            }
+        }
+
+        // Lights
+        auto num_lights = reader.Read<std::uint32_t>();
+        for (auto i = 0u; i < num_lights; ++i)
+        {
+            auto type = static_cast<LightType>(reader.Read<std::uint32_t>());
+            auto name = reader.ReadString();
+            auto position = ReadFloat3(reader);
+            auto direction = ReadFloat3(reader);
+            auto radiance = ReadFloat3(reader);
+
+            auto get_texture = [&textures](std::int32_t index)
+            {
+                return index == kNone ? nullptr : textures.at(index);
+            };
+
+            Light::Ptr light;
+            switch (type)
+            {
+            case LightType::kPoint:
+                light = PointLight::Create();
+                break;
+            case LightType::kDirectional:
+                light = DirectionalLight::Create();
+                break;
+            case LightType::kSpot:
+            {
+                auto spot = SpotLight::Create();
+                RadeonRays::float2 cone;
+                cone.x = reader.Read<float>();
+                cone.y = reader.Read<float>();
+                spot->SetConeShape(cone);
+                light = spot;
+                break;
+            }
+            case LightType::kIbl:
+            {
+                auto ibl = ImageBasedLight::Create();
+                ibl->SetTexture(get_texture(reader.Read<std::int32_t>()));
+                ibl->SetReflectionTexture(get_texture(reader.Read<std::int32_t>()));
+                ibl->SetRefractionTexture(get_texture(reader.Read<std::int32_t>()));
+                ibl->SetTransparencyTexture(get_texture(reader.Read<std::int32_t>()));
+                ibl->SetBackgroundTexture(get_texture(reader.Read<std::int32_t>()));
+                ibl->SetMultiplier(reader.Read<float>());
+                ibl->SetMirrorX(reader.Read<std::uint32_t>() != 0);
+                light = ibl;
+                break;
+            }
+            case LightType::kArea:
+            {
+                auto shape_index = reader.Read<std::int32_t>();
+                auto prim_index = reader.Read<std::uint32_t>();
+                light = AreaLight::Create(shapes.at(shape_index), prim_index);
+                break;
+            }
+            case LightType::kMesh:
+            {
+                auto shape_index = reader.Read<std::int32_t>();
+                light = MeshLight::Create(shapes.at(shape_index));
+                break;
+            }
+            default:
+                throw std::runtime_error("SceneIoBaikal: unknown light type.");
+            }
+
+            light->SetName(name);
+            light->SetPosition(position);
+            light->SetDirection(direction);
+            light->SetEmittedRadiance(radiance);
+            scene->AttachLight(light);
+        }
+
+        // Scene properties
+        auto background_index = reader.Read<std::int32_t>();
+        if (background_index != kNone)
+        {
+            scene->SetBackgroundImage(textures.at(background_index));
+        }
+
+        return scene;
+    }
+
+    void SceneIoBaikal::SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath) const
+    {
+        SceneWriteContext context;
+
+        // Meshes go first so instances can reference them, base shapes of
+        // instances which are not attached to the scene are stored as well
+        std::vector<Shape::Ptr> shapes;
+        std::vector<Shape::Ptr> instances;
+        std::map<Shape const*, std::int32_t> shape_indices;
+        std::map<Shape const*, bool> attached;
+
+        auto add_shape = [&shapes, &shape_indices](Shape::Ptr const& shape)
+        {
+            if (shape_indices.emplace(shape.get(), static_cast<std::int32_t>(shapes.size())).second)
+            {
+                shapes.push_back(shape);
+            }
+        };
+
+        for (auto iter = scene.CreateShapeIterator(); iter->IsValid(); iter->Next())
+        {
+            auto shape = iter->ItemAs<Shape>();
+            attached[shape.get()] = true;
+
+            if (auto instance = std::dynamic_pointer_cast<Instance>(shape))
+            {
+                instances.push_back(instance);
+            }
+            else
+            {
+                add_shape(shape);
+            }
+        }
+
+        for (auto const& shape : instances)
+        {
+            auto base = std::static_pointer_cast<Instance>(shape)->GetBaseShape();
+            if (base)
+            {
+                add_shape(base);
+            }
+        }
+
+        for (auto const& shape : instances)
+        {
+            add_shape(shape);
+        }
+
+        // Gather materials, input maps and textures
+        std::vector<std::int32_t> shape_materials;
+        for (auto const& shape : shapes)
+        {
+            shape_materials.push_back(context.AddMaterial(shape->GetMaterial()));
+        }
+
+        std::vector<Light::Ptr> lights;
+        for (auto iter = scene.CreateLightIterator(); iter->IsValid(); iter->Next())
+        {
+            auto light = iter->ItemAs<Light>();
+            lights.push_back(light);
+
+            if (auto ibl = std::dynamic_pointer_cast<ImageBasedLight>(light))
+            {
+                context.AddTexture(ibl->GetTexture());
+                context.AddTexture(ibl->GetReflectionTexture());
+                context.AddTexture(ibl->GetRefractionTexture());
+                context.AddTexture(ibl->GetTransparencyTexture());
+                context.AddTexture(ibl->GetBackgroundTexture());
+            }
+        }
+
+        auto background_index = context.AddTexture(scene.GetBackgroundImage());
+
+        // Write to a temporary file first so readers never see a partially written scene
+        auto tmp_filename = filename + ".tmp";
+        {
+            std::ofstream out(tmp_filename, std::ios::binary | std::ios::out);
+            if (!out)
+            {
+                throw std::runtime_error("SceneIoBaikal: cannot open " + tmp_filename + " for writing.");
+            }
+
+            BinaryWriter writer(out);
+
+            for (auto c : kMagic)
+            {
+                writer.Write(c);
+            }
+            writer.Write(kVersion);
+
+            // Textures
+            writer.Write(static_cast<std::uint32_t>(context.textures.size()));
+            for (auto const& texture : context.textures)
+            {
+                // Textures without a name were generated in memory, keep their texels
+                auto source = texture->GetName().empty() ? TextureSource::kEmbedded : TextureSource::kFile;
+                writer.Write(static_cast<std::uint32_t>(source));
+                writer.WriteString(texture->GetName());
+                writer.Write(static_cast<std::uint32_t>(texture->GetFormat()));
+
+                if (source == TextureSource::kEmbedded)
+                {
+                    auto size = texture->GetSize();
+                    writer.Write(static_cast<std::int32_t>(size.x));
+                    writer.Write(static_cast<std::int32_t>(size.y));
+                    writer.Write(static_cast<std::int32_t>(size.z));
+                    writer.WriteArray(texture->GetData(), texture->GetSizeInBytes());
+                }
+            }
+
+            // Input maps
+            writer.Write(static_cast<std::uint32_t>(context.input_maps.size()));
+            for (auto const& input_map : context.input_maps)
+            {
+                WriteInputMap(writer, context, *input_map);
+            }
+
+            // Materials
+            writer.Write(static_cast<std::uint32_t>(context.materials.size()));
+            for (auto const& material : context.materials)
+            {
+                writer.WriteString(material->GetName());
+                writer.Write(static_cast<std::uint32_t>(material->IsThin()));
+                writer.Write(material->GetLayers());
+                writer.Write(static_cast<std::uint32_t>(material->IsLinkRefractionIOR()));
+                writer.Write(static_cast<std::uint32_t>(material->isDoubleSided()));
+                writer.Write(static_cast<std::uint32_t>(material->IsMultiscatter()));
+
+                std::vector<Material::Input> inputs;
+                for (std::size_t i = 0; i < material->GetNumInputs(); ++i)
+                {
+                    auto input = material->GetInput(i);
+                    if (material->IsActive(input) && input.value.input_map_value)
+                    {
+                        inputs.push_back(input);
+                    }
+                }
+
+                writer.Write(static_cast<std::uint32_t>(inputs.size()));
+                for (auto const& input : inputs)
+                {
+                    writer.WriteString(input.info.name);
+                    writer.Write(context.input_map_indices.at(input.value.input_map_value.get()));
+                }
+            }
+
+            // Shapes
+            writer.Write(static_cast<std::uint32_t>(shapes.size()));
+            for (std::size_t i = 0; i < shapes.size(); ++i)
+            {
+                auto const& shape = shapes[i];
+                auto instance = std::dynamic_pointer_cast<Instance>(shape);
+                auto mesh = std::dynamic_pointer_cast<Mesh>(shape);
+
+                if (!instance && !mesh)
+                {
+                    throw std::runtime_error("SceneIoBaikal: unsupported shape type.");
+                }
+
+                writer.Write(static_cast<std::uint32_t>(mesh ? ShapeType::kMesh : ShapeType::kInstance));
+                writer.Write(static_cast<std::uint32_t>(attached.count(shape.get()) ? 1 : 0));
+                writer.WriteString(shape->GetName());
+                writer.Write(shape_materials[i]);
+                WriteMatrix(writer, shape->GetTransform());
+                writer.Write(shape->GetGroupId());
+                writer.Write(shape->GetVisibilityMask());
+
+                if (mesh)
+                {
+                    writer.WriteArray(mesh->GetVertices(), mesh->GetNumVertices());
+                    writer.WriteArray(mesh->GetNormals(), mesh->GetNumNormals());
+                    writer.WriteArray(mesh->GetUVs(), mesh->GetNumUVs());
+                    writer.WriteArray(mesh->GetIndices(), mesh->GetNumIndices());
+                }
+                else
+                {
+                    auto base = instance->GetBaseShape();
+                    writer.Write(base ? shape_indices.at(base.get()) : kNone);
+                }
+            }
+
+            // Lights
+            writer.Write(static_cast<std::uint32_t>(lights.size()));
+            for (auto const& light : lights)
+            {
+                auto area = std::dynamic_pointer_cast<AreaLight>(light);
+                auto mesh_light = std::dynamic_pointer_cast<MeshLight>(light);
+                auto ibl = std::dynamic_pointer_cast<ImageBasedLight>(light);
+                auto spot = std::dynamic_pointer_cast<SpotLight>(light);
+                auto directional = std::dynamic_pointer_cast<DirectionalLight>(light);
+
+                LightType type = LightType::kPoint;
+                if (area) type = LightType::kArea;
+                else if (mesh_light) type = LightType::kMesh;
+                else if (ibl) type = LightType::kIbl;
+                else if (spot) type = LightType::kSpot;
+                else if (directional) type = LightType::kDirectional;
+
+                writer.Write(static_cast<std::uint32_t>(type));
+                writer.WriteString(light->GetName());
+                WriteFloat3(writer, light->GetPosition());
+                WriteFloat3(writer, light->GetDirection());
+                WriteFloat3(writer, light->GetEmittedRadiance());
+
+                if (spot)
+                {
+                    auto cone = spot->GetConeShape();
+                    writer.Write(cone.x);
+                    writer.Write(cone.y);
+                }
+                else if (ibl)
+                {
+                    writer.Write(context.AddTexture(ibl->GetTexture()));
+                    writer.Write(context.AddTexture(ibl->GetReflectionTexture()));
+                    writer.Write(context.AddTexture(ibl->GetRefractionTexture()));
+                    writer.Write(context.AddTexture(ibl->GetTransparencyTexture()));
+                    writer.Write(context.AddTexture(ibl->GetBackgroundTexture()));
+                    writer.Write(ibl->GetMultiplier());
+                    writer.Write(static_cast<std::uint32_t>(ibl->GetMirrorX()));
+                }
+                else if (area)
+                {
+                    auto shape = shape_indices.find(area->GetShape().get());
+                    if (shape == shape_indices.cend())
+                    {
+                        throw std::runtime_error("SceneIoBaikal: area light shape is not in the scene.");
+                    }
+                    writer.Write(shape->second);
+                    writer.Write(static_cast<std::uint32_t>(area->GetPrimitiveIdx()));
+                }
+                else if (mesh_light)
+                {
+                    auto shape = shape_indices.find(mesh_light->GetShape().get());
+                    if (shape == shape_indices.cend())
+                    {
+                        throw std::runtime_error("SceneIoBaikal: mesh light shape is not in the scene.");
+                    }
+                    writer.Write(shape->second);
+                }
+            }
+
+            // Scene properties
+            writer.Write(background_index);
+
+            if (!out)
+            {
+                throw std::runtime_error("SceneIoBaikal: failed to write " + tmp_filename);
+            }
+        }
+
+        std::remove(filename.c_str());
+        if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(tmp_filename.c_str());
+            throw std::runtime_error("SceneIoBaikal: cannot write " + filename);
+        }
+    }
+}
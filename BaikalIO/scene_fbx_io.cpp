@@ -35,7 +35,9 @@ namespace Baikal
         void LoadMesh(FbxNode* node, std::string const& basepath, Scene1& scene, ImageIo& io) const;
         void LoadLight(FbxNode* node, std::string const& basepath, Scene1& scene, ImageIo& io) const;
         Material::Ptr TranslateMaterial(FbxSurfaceMaterial* material, std::string const& basepath, Scene1& scene, ImageIo& io) const;
-        Texture::Ptr GetTexture(FbxSurfaceMaterial* material, const char* textureType, std::string const& basepath, Scene1& scene, ImageIo& io) const;
+        // Normal maps are compressed to BC5, other textures get format chosen from their data
+        Texture::Ptr GetTexture(FbxSurfaceMaterial* material, const char* textureType, std::string const& basepath, Scene1& scene, ImageIo& io,
+            bool normal_map = false) const;
 
         mutable std::map<FbxSurfaceMaterial*, Material::Ptr> m_material_cache;
     };
@@ -58,7 +60,8 @@ namespace Baikal
         return res;
     }
 
-    Texture::Ptr SceneFbxIo::GetTexture(FbxSurfaceMaterial* material, const char* slot, std::string const& basepath, Scene1& scene, ImageIo& io) const
+    Texture::Ptr SceneFbxIo::GetTexture(FbxSurfaceMaterial* material, const char* slot, std::string const& basepath, Scene1& scene, ImageIo& io,
+        bool normal_map) const
     {
         //return nullptr;
         FbxProperty prop = material->FindProperty(slot);
@@ -73,18 +76,15 @@ namespace Baikal
             }
 
             std::string filepath = texture->GetRelativeFileName();
-            std::string path = "";
 
             try
             {
-                if ((filepath.find(":") != std::string::npos) || (filepath.at(0) == '/'))
-                {
-                    return LoadTexture(io, scene, "", filepath);
-                }
-                else
-                {
-                    return LoadTexture(io, scene, basepath, filepath);
-                }
+                auto absolute = (filepath.find(":") != std::string::npos) || (filepath.at(0) == '/');
+                auto path = absolute ? std::string() : basepath;
+
+                return normal_map ?
+                    LoadTexture(io, scene, path, filepath, Texture::Format::kBc5) :
+                    LoadTexture(io, scene, path, filepath);
             }
             catch (std::exception& e)
             {
@@ -109,7 +109,7 @@ namespace Baikal
             auto albedo = material->FindProperty(FbxSurfaceMaterial::sDiffuse).Get<FbxDouble3>();
             auto mul = material->FindProperty(FbxSurfaceMaterial::sDiffuseFactor).Get<FbxDouble>();
             auto texture = GetTexture(material, FbxSurfaceMaterial::sDiffuse, basepath, scene, io);
-            auto normal = GetTexture(material, FbxSurfaceMaterial::sNormalMap, basepath, scene, io);
+            auto normal = GetTexture(material, FbxSurfaceMaterial::sNormalMap, basepath, scene, io, true);
             auto bump = GetTexture(material, FbxSurfaceMaterial::sBump, basepath, scene, io);
 
             if (texture)
@@ -11,11 +11,126 @@
 #include <map>
 #include <set>
 #include <cassert>
+#include <algorithm>
 
 #include "Utils/log.h"
+#include "Utils/hash.h"
+#include "Utils/mkpath.h"
+#include "Utils/block_compression.h"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+
+#include <sys/types.h>
+#include <sys/stat.h>
 
 namespace Baikal
 {
+    namespace
+    {
+        // Extension of the compiled scene format, see scene_baikal_io.cpp
+        char const* const kCompiledSceneExtension = "baikalscene";
+        // Bump to invalidate cache entries produced by older loaders
+        std::uint32_t constexpr kSceneCacheVersion = 2;
+        // Extension and version of cached block compressed textures
+        char const* const kCompressedTextureExtension = "bctex";
+        std::uint32_t constexpr kCompressedTextureVersion = 1;
+
+        std::string GetSceneCacheFilename(std::string const& cache_path, std::string const& filename,
+            std::string const& basepath, bool texture_compression)
+        {
+            struct stat st;
+            if (stat(filename.c_str(), &st) != 0)
+            {
+                return std::string();
+            }
+
+            Hasher hasher;
+            hasher.Append(filename)
+                .Append(basepath)
+                .AppendValue(static_cast<std::uint64_t>(st.st_size))
+                .AppendValue(static_cast<std::int64_t>(st.st_mtime))
+                .AppendValue(texture_compression)
+                .AppendValue(kSceneCacheVersion);
+
+            return cache_path + "/" + hasher.GetHash().ToString() + "." + kCompiledSceneExtension;
+        }
+
+        // Cached compressed data is keyed by texels of the original texture and the format
+        std::string GetCompressedTextureFilename(std::string const& cache_path, Texture const& texture, Texture::Format format)
+        {
+            auto size = texture.GetSize();
+
+            Hasher hasher;
+            hasher.Append(ComputeHash128(texture.GetData(), texture.GetSizeInBytes()))
+                .AppendValue(size.x)
+                .AppendValue(size.y)
+                .AppendValue(static_cast<std::uint32_t>(format))
+                .AppendValue(texture.IsMipmapEnabled())
+                .AppendValue(kCompressedTextureVersion);
+
+            return cache_path + "/" + hasher.GetHash().ToString() + "." + kCompressedTextureExtension;
+        }
+
+        // Replace texture data with cached compressed data (base level followed by the mip chain)
+        bool LoadCompressedTexture(std::string const& filename, Texture& texture, Texture::Format format)
+        {
+            std::ifstream in(filename, std::ios::in | std::ios::binary);
+            if (!in)
+            {
+                return false;
+            }
+
+            auto size = texture.GetSize();
+            auto data_size = GetBlockCompressedSizeInBytes(format, size.x, size.y);
+
+            std::unique_ptr<char[]> data(new char[data_size]);
+            if (!in.read(data.get(), data_size))
+            {
+                return false;
+            }
+
+            texture.SetData(data.release(), size, format);
+
+            if (texture.GetMipLevelCount() > 1)
+            {
+                auto mip_data_size = texture.GetMipDataSizeInBytes();
+                std::unique_ptr<char[]> mip_data(new char[mip_data_size]);
+
+                // Base level is replaced already, so regenerate mips from it if the entry is truncated
+                if (in.read(mip_data.get(), mip_data_size))
+                {
+                    texture.SetMipData(mip_data.release());
+                }
+            }
+
+            return true;
+        }
+
+        void SaveCompressedTexture(std::string const& filename, Texture const& texture)
+        {
+            // Write to a temporary file first so concurrent loaders never see partial entries
+            auto tmp_filename = filename + ".tmp";
+            {
+                std::ofstream out(tmp_filename, std::ios::out | std::ios::binary);
+                if (!out)
+                {
+                    return;
+                }
+
+                out.write(texture.GetData(), texture.GetSizeInBytes());
+                out.write(texture.GetMipData(), texture.GetMipDataSizeInBytes());
+            }
+
+            std::remove(filename.c_str());
+            if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+            {
+                std::remove(tmp_filename.c_str());
+            }
+        }
+    }
+
     SceneIo* SceneIo::GetInstance()
     {
         static SceneIo instance;
@@ -43,12 +158,53 @@ namespace Baikal
             throw std::runtime_error("No loader for \"" + filename + "\" has been found.");
         }
 
-        return loader_it->second->LoadScene(filename, basepath);
+        auto cache_loader_it = instance->m_loaders.find(kCompiledSceneExtension);
+        if (instance->m_scene_cache_path.empty() || ext == kCompiledSceneExtension ||
+            cache_loader_it == instance->m_loaders.end())
+        {
+            return loader_it->second->LoadScene(filename, basepath);
+        }
+
+        auto cache_filename = GetSceneCacheFilename(instance->m_scene_cache_path, filename, basepath,
+            instance->m_texture_compression);
+        if (cache_filename.empty())
+        {
+            return loader_it->second->LoadScene(filename, basepath);
+        }
+
+        struct stat st;
+        if (stat(cache_filename.c_str(), &st) == 0)
+        {
+            try
+            {
+                LogInfo("Loading cached scene ", cache_filename, "\n");
+                return cache_loader_it->second->LoadScene(cache_filename, basepath);
+            }
+            catch (std::exception& e)
+            {
+                // Stale or corrupted entry, it is overwritten below
+                LogInfo("Failed to load cached scene: ", e.what(), "\n");
+            }
+        }
+
+        auto scene = loader_it->second->LoadScene(filename, basepath);
+
+        try
+        {
+            mkpath(instance->m_scene_cache_path);
+            cache_loader_it->second->SaveScene(*scene, cache_filename, basepath);
+        }
+        catch (std::exception& e)
+        {
+            LogInfo("Failed to cache scene: ", e.what(), "\n");
+        }
+
+        return scene;
     }
 
     void SceneIo::SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath)
     {
-        auto ext = filename.substr(filename.rfind("."));
+        auto ext = filename.substr(filename.rfind(".") + 1);
 
         SceneIo *instance = GetInstance();
         auto loader_it = instance->m_loaders.find(ext);
@@ -60,12 +216,35 @@ namespace Baikal
         return loader_it->second->SaveScene(scene, filename, basepath);
     }
 
+    void SceneIo::SetTextureCompressionEnabled(bool enabled)
+    {
+        GetInstance()->m_texture_compression = enabled;
+    }
+
+    void SceneIo::SetSceneCachePath(std::string const& path)
+    {
+        GetInstance()->m_scene_cache_path = path;
+    }
+
     Texture::Ptr SceneIo::Loader::LoadTexture(ImageIo const& io, Scene1& scene, std::string const& basepath, std::string const& name) const
+    {
+        return LoadTexture(io, basepath, name, nullptr);
+    }
+
+    Texture::Ptr SceneIo::Loader::LoadTexture(ImageIo const& io, Scene1& scene, std::string const& basepath, std::string const& name,
+        Texture::Format compressed_format) const
+    {
+        return LoadTexture(io, basepath, name, &compressed_format);
+    }
+
+    Texture::Ptr SceneIo::Loader::LoadTexture(ImageIo const& io, std::string const& basepath, std::string const& name,
+        Texture::Format const* compressed_format) const
     {
         std::string fname = basepath + name;
         std::replace(fname.begin(), fname.end(), '\\', '/');
 
-        auto iter = m_texture_cache.find(name);
+        auto key = std::make_pair(name, compressed_format ? static_cast<int>(*compressed_format) : -1);
+        auto iter = m_texture_cache.find(key);
 
         if (iter != m_texture_cache.cend())
         {
@@ -78,7 +257,33 @@ namespace Baikal
                 LogInfo("Loading ", name, "\n");
                 auto texture = io.LoadImage(fname);
                 texture->SetName(name);
-                m_texture_cache[name] = texture;
+
+                // HDR data is kept as is since there is no HDR block format
+                auto instance = SceneIo::GetInstance();
+                if (instance->m_texture_compression &&
+                    texture->GetFormat() == Texture::Format::kRgba8 && texture->GetSize().z == 1)
+                {
+                    auto format = compressed_format ? *compressed_format : ChooseCompressedFormat(*texture);
+
+                    if (instance->m_scene_cache_path.empty())
+                    {
+                        texture->Compress(format);
+                    }
+                    else
+                    {
+                        auto cache_filename = GetCompressedTextureFilename(instance->m_scene_cache_path, *texture, format);
+
+                        if (!LoadCompressedTexture(cache_filename, *texture, format))
+                        {
+                            texture->Compress(format);
+
+                            mkpath(instance->m_scene_cache_path);
+                            SaveCompressedTexture(cache_filename, *texture);
+                        }
+                    }
+                }
+
+                m_texture_cache[key] = texture;
                 return texture;
             }
             catch (std::runtime_error)
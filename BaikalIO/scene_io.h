@@ -76,14 +76,24 @@ namespace Baikal
             virtual ~Loader();
 
         protected:
+            // Load texture (cached by name), LDR textures are block compressed if texture
+            // compression is enabled, format is chosen from the texture data
             Texture::Ptr LoadTexture(ImageIo const& io, Scene1& scene, std::string const& basepath, std::string const& name) const;
+            // Same as above, but LDR textures are converted to compressed_format
+            Texture::Ptr LoadTexture(ImageIo const& io, Scene1& scene, std::string const& basepath, std::string const& name,
+                Texture::Format compressed_format) const;
 
         private:
             Loader(const Loader &) = delete;
             Loader& operator= (const Loader &) = delete;
 
+            // Load texture compressing it into the format, nullptr chooses the format from the data
+            Texture::Ptr LoadTexture(ImageIo const& io, std::string const& basepath, std::string const& name,
+                Texture::Format const* compressed_format) const;
+
             std::string m_ext;
-            mutable std::map<std::string, Texture::Ptr> m_texture_cache;
+            // Loaded textures by name and requested compressed format (-1 if chosen from the data)
+            mutable std::map<std::pair<std::string, int>, Texture::Ptr> m_texture_cache;
         };
 
         // Registers extension handler
@@ -95,6 +105,14 @@ namespace Baikal
         static Scene1::Ptr BAIKAL_API_ENTRY LoadScene(std::string const& filename, std::string const& basepath);
         // Saves scene to file using resource base path
         static void BAIKAL_API_ENTRY SaveScene(Scene1 const& scene, std::string const& filename, std::string const& basepath);
+        // Enable block compression of textures loaded with the scene (disabled by default)
+        static void BAIKAL_API_ENTRY SetTextureCompressionEnabled(bool enabled);
+        // Cache loaded scenes as .baikalscene files in the directory (empty path disables caching).
+        // Cache entries are keyed by scene file name, size and modification time, changes
+        // of the referenced textures and material files are not tracked.
+        // Block compressed textures are cached in the same directory keyed by the hash
+        // of their texels and the compressed format.
+        static void BAIKAL_API_ENTRY SetSceneCachePath(std::string const& path);
 
 
     private:
@@ -110,5 +128,7 @@ namespace Baikal
         SceneIo& operator = (SceneIo const&) = delete;
 
         std::map<std::string, SceneIo::Loader*> m_loaders;
+        bool m_texture_compression = false;
+        std::string m_scene_cache_path;
     };
 }
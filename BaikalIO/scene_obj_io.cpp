@@ -194,15 +194,11 @@ namespace Baikal
                 // Attach to the scene
                 scene->AttachShape(mesh);
 
-                // If the mesh has emissive material we need to add area light for it
+                // If the mesh has emissive material we need to add mesh light for it
                 if (used_material >= 0 && emissives.find(materials[used_material]) != emissives.cend())
                 {
-                    // Add area light for each polygon of emissive mesh
-                    for (std::size_t l = 0; l < mesh->GetNumIndices() / 3; ++l)
-                    {
-                        auto light = AreaLight::Create(mesh, l);
-                        scene->AttachLight(light);
-                    }
+                    auto light = MeshLight::Create(mesh);
+                    scene->AttachLight(light);
                 }
             }
         }
@@ -313,7 +309,7 @@ namespace Baikal
         {
             material_layers |= UberV2Material::Layers::kShadingNormalLayer;
 
-            auto texture = LoadTexture(image_io, scene, basepath, mat.bump_texname);
+            auto texture = LoadTexture(image_io, scene, basepath, mat.bump_texname, Texture::Format::kBc4);
             uberv2_set_bump_texture(material, texture);
         }
 
@@ -26,7 +26,7 @@ THE SOFTWARE.
 namespace
 {
     char const* kHelpMessage =
-        "Baikal [-p path_to_models][-f model_name][-b][-r][-ns number_of_shadow_rays][-ao ao_radius][-w window_width][-h window_height][-nb number_of_indirect_bounces]";
+        "Baikal [-p path_to_models][-f model_name][-b][-r][-ns number_of_shadow_rays][-ao ao_radius][-w window_width][-h window_height][-nb number_of_indirect_bounces][-tc][-scene_cache path_to_cache][-profile profile_base_path][-material_sort][-batch job_list.xml]";
 }
 
 namespace Baikal
@@ -142,6 +142,26 @@ namespace Baikal
             s.cmd_line_mode = true;
         }
 
+        if (m_cmd_parser.OptionExists("-tc"))
+        {
+            s.texture_compression = true;
+        }
+
+        s.scene_cache = m_cmd_parser.GetOption("-scene_cache", s.scene_cache);
+
+        s.profile_path = m_cmd_parser.GetOption("-profile", s.profile_path);
+
+        if (m_cmd_parser.OptionExists("-material_sort"))
+        {
+            s.material_sorting = true;
+        }
+
+        if (m_cmd_parser.OptionExists("-batch"))
+        {
+            s.batch_file = m_cmd_parser.GetOption("-batch");
+            s.cmd_line_mode = true;
+        }
+
         return s;
     }
 
@@ -185,6 +205,11 @@ namespace Baikal
         , recording_enabled(false)
         , benchmark(false)
         , gui_visible(true)
+        , texture_compression(false)
+        , scene_cache("")
+        , profile_path("")
+        , material_sorting(false)
+        , batch_file("")
         , time_benchmarked(false)
         , rt_benchmarked(false)
         , time_benchmark(false)
@@ -75,6 +75,15 @@ namespace Baikal
         bool recording_enabled;
         bool benchmark;
         bool gui_visible;
+        bool texture_compression;
+        // Directory for compiled scene cache, empty to disable
+        std::string scene_cache;
+        // Base path for GPU kernel timings (<path>.json and <path>_trace.json), empty to disable
+        std::string profile_path;
+        // Sort surface hits by material before shading
+        bool material_sorting;
+        // Job list for headless batch rendering, empty for interactive mode
+        std::string batch_file;
 
         //bencmark
         Estimator::RayTracingStats stats;
@@ -156,6 +156,7 @@ namespace Baikal
         Baikal::DirectionalLight* directl = dynamic_cast<Baikal::DirectionalLight*>(l.get());
         Baikal::SpotLight* spotl = dynamic_cast<Baikal::SpotLight*>(l.get());
         Baikal::AreaLight* areal = dynamic_cast<Baikal::AreaLight*>(l.get());
+        Baikal::MeshLight* meshl = dynamic_cast<Baikal::MeshLight*>(l.get());
 
         tinyxml2::XMLDocument doc;
 
@@ -167,9 +168,9 @@ namespace Baikal
             doc.InsertFirstChild(root);
         }
 
-        if (areal)
+        if (areal || meshl)
         {
-            //area lights are created when materials load, so ignore it;
+            //area and mesh lights are created when materials load, so ignore it;
             return;
         }
 
@@ -534,6 +535,7 @@ namespace Baikal
         else if (m_settings.samplecount == m_settings.num_samples)
         {
             m_cl->SaveFrameBuffer(m_settings);
+            m_cl->SaveProfile(m_settings);
             std::cout << "Target sample count reached\n";
         }
 
@@ -697,7 +699,7 @@ namespace Baikal
             }
 
         }
-        else
+        else if (m_settings.batch_file.empty())
         {
             m_settings.interop = false;
             m_cl.reset(new AppClRender(m_settings, -1));
@@ -706,6 +708,14 @@ namespace Baikal
 
     void Application::Run()
     {
+        // Batch mode creates its own context and loads scenes per job
+        if (!m_settings.batch_file.empty())
+        {
+            AppBatchRender batch(m_settings);
+            batch.Run(AppBatchRender::LoadJobs(m_settings.batch_file, m_settings));
+            return;
+        }
+
         CollectSceneStats();
 
         if (!m_settings.cmd_line_mode)
@@ -23,6 +23,7 @@
 #pragma once
 
 #include "Application/app_utils.h"
+#include "Application/batch_render.h"
 #include "Application/cl_render.h"
 #include "Application/gl_render.h"
 #include "Application/material_explorer.h"
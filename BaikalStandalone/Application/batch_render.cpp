@@ -0,0 +1,408 @@
+/**********************************************************************
+ Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#include "Application/batch_render.h"
+
+#include "OpenImageIO/imageio.h"
+#include "image_io.h"
+#include "scene_io.h"
+#include "material_io.h"
+#include "SceneGraph/camera.h"
+#include "SceneGraph/light.h"
+#include "Renderers/monte_carlo_renderer.h"
+#include "XML/tinyxml2.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace Baikal
+{
+    namespace
+    {
+        using Clock = std::chrono::high_resolution_clock;
+
+        double GetSeconds(Clock::time_point start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        void QueryFloat3(tinyxml2::XMLElement const* elem, char const* x, char const* y, char const* z, RadeonRays::float3& value)
+        {
+            elem->QueryFloatAttribute(x, &value.x);
+            elem->QueryFloatAttribute(y, &value.y);
+            elem->QueryFloatAttribute(z, &value.z);
+        }
+
+        bool IsHdrFormat(std::string const& name)
+        {
+            auto extension = name.substr(std::min(name.find_last_of('.'), name.size()));
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            return extension == ".exr" || extension == ".hdr";
+        }
+
+        // Normalize by the number of samples and flip vertically,
+        // gamma is applied for LDR formats only (HDR ones keep linear values)
+        void ConvertImage(std::vector<RadeonRays::float3>& data, int width, int height, bool hdr)
+        {
+            float const inv_gamma = 1.f / 2.2f;
+
+            for (auto y = 0; y < height / 2; ++y)
+            {
+                std::swap_ranges(data.begin() + y * width, data.begin() + (y + 1) * width,
+                    data.begin() + (height - 1 - y) * width);
+            }
+
+            for (auto& v : data)
+            {
+                float invw = v.w > 0.f ? 1.f / v.w : 0.f;
+                v.x *= invw;
+                v.y *= invw;
+                v.z *= invw;
+
+                if (!hdr)
+                {
+                    v.x = std::pow(v.x, inv_gamma);
+                    v.y = std::pow(v.y, inv_gamma);
+                    v.z = std::pow(v.z, inv_gamma);
+                }
+            }
+        }
+    }
+
+    AppBatchRender::AppBatchRender(AppSettings const& settings)
+        : m_settings(settings)
+        , m_primary(-1)
+    {
+        ConfigManager::CreateConfigs(
+            settings.mode,
+            false,
+            m_cfgs,
+            settings.num_bounces,
+            settings.platform_index,
+            settings.device_index);
+
+        for (std::size_t i = 0; i < m_cfgs.size(); ++i)
+        {
+            if (m_cfgs[i].type == ConfigManager::kPrimary)
+            {
+                m_primary = static_cast<int>(i);
+                break;
+            }
+        }
+
+        if (m_primary < 0)
+        {
+            throw std::runtime_error("AppBatchRender: no primary device");
+        }
+
+        std::cout << "Batch rendering on " << m_cfgs[m_primary].context.GetDevice(0).GetName() << "\n";
+
+        auto renderer = static_cast<MonteCarloRenderer*>(m_cfgs[m_primary].renderer.get());
+        renderer->SetMaterialSorting(settings.material_sorting);
+
+        if (!settings.profile_path.empty())
+        {
+            renderer->SetProfilingEnabled(true);
+        }
+
+        SceneIo::SetTextureCompressionEnabled(settings.texture_compression);
+        SceneIo::SetSceneCachePath(settings.scene_cache);
+    }
+
+    std::vector<AppBatchRender::Job> AppBatchRender::LoadJobs(std::string const& file_name, AppSettings const& settings)
+    {
+        tinyxml2::XMLDocument doc;
+        doc.LoadFile(file_name.c_str());
+
+        auto root = doc.FirstChildElement("job_list");
+
+        if (!root)
+        {
+            throw std::runtime_error("AppBatchRender: failed to open job list " + file_name);
+        }
+
+        std::vector<Job> jobs;
+
+        for (auto elem = root->FirstChildElement("job"); elem; elem = elem->NextSiblingElement("job"))
+        {
+            Job job;
+            job.scene = settings.path + "/" + settings.modelname;
+            job.envmap = settings.envmapname;
+            job.envmapmul = settings.envmapmul;
+            job.width = settings.width;
+            job.height = settings.height;
+            job.num_samples = settings.num_samples;
+            job.time_budget = 0.f;
+            job.camera_pos = settings.camera_pos;
+            job.camera_at = settings.camera_at;
+            job.camera_up = settings.camera_up;
+            job.camera_sensor_size = settings.camera_sensor_size;
+            job.camera_aperture = settings.camera_aperture;
+            job.camera_focus_distance = settings.camera_focus_distance;
+            job.camera_focal_length = settings.camera_focal_length;
+
+            if (auto scene = elem->Attribute("scene"))
+            {
+                job.scene = scene;
+            }
+
+            if (auto envmap = elem->Attribute("envmap"))
+            {
+                job.envmap = envmap;
+            }
+
+            auto output = elem->Attribute("output");
+            if (!output)
+            {
+                throw std::runtime_error("AppBatchRender: job " + std::to_string(jobs.size()) + " has no output");
+            }
+            job.output = output;
+
+            elem->QueryFloatAttribute("envmapmul", &job.envmapmul);
+            elem->QueryIntAttribute("width", &job.width);
+            elem->QueryIntAttribute("height", &job.height);
+            elem->QueryIntAttribute("spp", &job.num_samples);
+            elem->QueryFloatAttribute("time", &job.time_budget);
+
+            // Same camera attributes as in camera lists saved by the application
+            QueryFloat3(elem, "cpx", "cpy", "cpz", job.camera_pos);
+            QueryFloat3(elem, "tpx", "tpy", "tpz", job.camera_at);
+            QueryFloat3(elem, "upx", "upy", "upz", job.camera_up);
+            elem->QueryFloatAttribute("aperture", &job.camera_aperture);
+            elem->QueryFloatAttribute("focus_dist", &job.camera_focus_distance);
+            elem->QueryFloatAttribute("focal_length", &job.camera_focal_length);
+
+            if (job.width <= 0 || job.height <= 0)
+            {
+                throw std::runtime_error("AppBatchRender: invalid output size of job " + std::to_string(jobs.size()));
+            }
+
+            if (job.num_samples <= 0 && job.time_budget <= 0.f)
+            {
+                throw std::runtime_error("AppBatchRender: job " + std::to_string(jobs.size()) + " needs spp or time budget");
+            }
+
+            jobs.push_back(job);
+        }
+
+        return jobs;
+    }
+
+    Scene1::Ptr AppBatchRender::GetScene(Job const& job)
+    {
+        auto key = job.scene + "|" + job.envmap + "|" + std::to_string(job.envmapmul);
+
+        if (m_scene && key == m_scene_key)
+        {
+            return m_scene;
+        }
+
+        // Drop the previous scene before loading the next one
+        m_scene = nullptr;
+        m_scene_key.clear();
+
+        auto separator = job.scene.find_last_of("/\\");
+        auto basepath = separator == std::string::npos ? std::string("./") : job.scene.substr(0, separator + 1);
+
+        auto scene = SceneIo::LoadScene(job.scene, basepath);
+
+        if (!job.envmap.empty())
+        {
+        #ifdef WIN32
+        #undef LoadImage
+        #endif
+            auto image_io(ImageIo::CreateImageIo());
+            auto ibl = ImageBasedLight::Create();
+            ibl->SetTexture(image_io->LoadImage(job.envmap));
+            ibl->SetMultiplier(job.envmapmul);
+            scene->AttachLight(ibl);
+        }
+
+        // Check if we have material remapping
+        std::ifstream in_materials(basepath + "materials.xml");
+        std::ifstream in_mapping(basepath + "mapping.xml");
+
+        if (in_materials && in_mapping)
+        {
+            in_materials.close();
+            in_mapping.close();
+
+            auto material_io = MaterialIo::CreateMaterialIoXML();
+            auto mats = material_io->LoadMaterials(basepath + "materials.xml");
+            auto mapping = material_io->LoadMaterialMapping(basepath + "mapping.xml");
+
+            material_io->ReplaceSceneMaterials(*scene, *mats, mapping);
+        }
+
+        m_scene = scene;
+        m_scene_key = key;
+        return m_scene;
+    }
+
+    Output* AppBatchRender::GetOutput(Job const& job)
+    {
+        auto& cfg = m_cfgs[m_primary];
+
+        if (!m_output ||
+            m_output->width() != static_cast<std::uint32_t>(job.width) ||
+            m_output->height() != static_cast<std::uint32_t>(job.height))
+        {
+            cfg.renderer->SetOutput(Renderer::OutputType::kColor, nullptr);
+            m_output = cfg.factory->CreateOutput(job.width, job.height);
+            cfg.renderer->SetOutput(Renderer::OutputType::kColor, m_output.get());
+        }
+
+        cfg.renderer->Clear(RadeonRays::float3(0.f, 0.f, 0.f), *m_output);
+        return m_output.get();
+    }
+
+    void AppBatchRender::SetupCamera(Job const& job, Scene1& scene) const
+    {
+        auto camera = PerspectiveCamera::Create(job.camera_pos, job.camera_at, job.camera_up);
+
+        // Keep sensor aspect ratio equal to the output one
+        auto sensor_size = job.camera_sensor_size;
+        sensor_size.y = sensor_size.x * job.height / job.width;
+
+        camera->SetSensorSize(sensor_size);
+        camera->SetDepthRange(m_settings.camera_zcap);
+        camera->SetFocalLength(job.camera_focal_length);
+        camera->SetFocusDistance(job.camera_focus_distance);
+        camera->SetAperture(job.camera_aperture);
+
+        scene.SetCamera(camera);
+    }
+
+    std::future<double> AppBatchRender::SaveAsync(Job const& job, Output& output)
+    {
+        std::vector<RadeonRays::float3> data(job.width * job.height);
+        output.GetData(data.data());
+
+        auto name = job.output;
+        auto width = job.width;
+        auto height = job.height;
+
+        return std::async(std::launch::async, [name, width, height](std::vector<RadeonRays::float3> data)
+        {
+            OIIO_NAMESPACE_USING;
+
+            auto start = Clock::now();
+
+            ConvertImage(data, width, height, IsHdrFormat(name));
+
+            std::unique_ptr<ImageOutput> out(ImageOutput::create(name));
+
+            if (!out)
+            {
+                throw std::runtime_error("AppBatchRender: can't create image file " + name);
+            }
+
+            // LDR formats get 8 bits per channel, OIIO converts and clamps
+            ImageSpec spec(width, height, 3, IsHdrFormat(name) ? TypeDesc::FLOAT : TypeDesc::UINT8);
+
+            if (!out->open(name, spec))
+            {
+                throw std::runtime_error("AppBatchRender: can't create image file " + name);
+            }
+
+            out->write_image(TypeDesc::FLOAT, data.data(), sizeof(RadeonRays::float3));
+            out->close();
+
+            return GetSeconds(start);
+        }, std::move(data));
+    }
+
+    void AppBatchRender::Run(std::vector<Job> const& jobs)
+    {
+        auto& cfg = m_cfgs[m_primary];
+        auto renderer = static_cast<MonteCarloRenderer*>(cfg.renderer.get());
+
+        std::vector<JobStats> stats(jobs.size());
+        std::vector<std::future<double>> saves;
+        saves.reserve(jobs.size());
+
+        auto batch_start = Clock::now();
+
+        for (std::size_t i = 0; i < jobs.size(); ++i)
+        {
+            auto const& job = jobs[i];
+
+            std::cout << "Job " << i << ": " << job.scene << " -> " << job.output << "\n";
+
+            auto setup_start = Clock::now();
+
+            auto scene = GetScene(job);
+            SetupCamera(job, *scene);
+            auto output = GetOutput(job);
+
+            cfg.controller->CompileScene(scene);
+            auto& clw_scene = cfg.controller->GetCachedScene(scene);
+
+            stats[i].setup_time = GetSeconds(setup_start);
+
+            // Render until either budget is exhausted
+            auto render_start = Clock::now();
+            auto num_samples = 0;
+            while ((job.num_samples <= 0 || num_samples < job.num_samples) &&
+                (job.time_budget <= 0.f || GetSeconds(render_start) < job.time_budget))
+            {
+                renderer->Render(clw_scene);
+                ++num_samples;
+
+                // Time budget needs the queue to be drained to be measured
+                if (job.time_budget > 0.f)
+                {
+                    cfg.context.Finish(0);
+                }
+            }
+
+            cfg.context.Finish(0);
+
+            stats[i].render_time = GetSeconds(render_start);
+            stats[i].num_samples = num_samples;
+
+            saves.push_back(SaveAsync(job, *output));
+        }
+
+        for (std::size_t i = 0; i < saves.size(); ++i)
+        {
+            stats[i].save_time = saves[i].get();
+        }
+
+        std::cout << "Batch results:\n";
+        std::cout << std::fixed << std::setprecision(3);
+        for (std::size_t i = 0; i < jobs.size(); ++i)
+        {
+            std::cout << "\t" << jobs[i].output <<
+                ": setup " << stats[i].setup_time << "s" <<
+                ", render " << stats[i].render_time << "s (" << stats[i].num_samples << " spp" <<
+                ", " << stats[i].render_time * 1000.0 / std::max(stats[i].num_samples, 1) << " ms/spp)" <<
+                ", save " << stats[i].save_time << "s\n";
+        }
+        std::cout << "\tTotal: " << GetSeconds(batch_start) << "s\n";
+    }
+}
@@ -0,0 +1,99 @@
+
+/**********************************************************************
+ Copyright (c) 2017 Advanced Micro Devices, Inc. All rights reserved.
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ ********************************************************************/
+#pragma once
+
+#include "Application/app_utils.h"
+#include "Utils/config_manager.h"
+#include "Output/output.h"
+#include "SceneGraph/scene1.h"
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Baikal
+{
+    // Headless renderer processing a list of jobs with a single device context,
+    // so compiled programs and scenes are reused between jobs
+    class AppBatchRender
+    {
+    public:
+        struct Job
+        {
+            // Model and environment map
+            std::string scene;
+            std::string envmap;
+            float envmapmul;
+            // Output image, format is deduced from the extension
+            std::string output;
+            int width;
+            int height;
+            // Sample and time (seconds) budgets, the job stops at whichever comes first
+            int num_samples;
+            float time_budget;
+            // Camera
+            RadeonRays::float3 camera_pos;
+            RadeonRays::float3 camera_at;
+            RadeonRays::float3 camera_up;
+            RadeonRays::float2 camera_sensor_size;
+            float camera_aperture;
+            float camera_focus_distance;
+            float camera_focal_length;
+        };
+
+        struct JobStats
+        {
+            // Scene loading (if not cached) and compilation time
+            double setup_time;
+            double render_time;
+            double save_time;
+            int num_samples;
+        };
+
+        AppBatchRender(AppSettings const& settings);
+
+        // Load job list, attributes missing in the file are taken from settings
+        static std::vector<Job> LoadJobs(std::string const& file_name, AppSettings const& settings);
+
+        // Render the jobs in order and print per-job timings
+        void Run(std::vector<Job> const& jobs);
+
+    private:
+        Scene1::Ptr GetScene(Job const& job);
+        Output* GetOutput(Job const& job);
+        void SetupCamera(Job const& job, Scene1& scene) const;
+
+        // Convert the output and write it on a separate thread
+        std::future<double> SaveAsync(Job const& job, Output& output);
+
+        AppSettings m_settings;
+        std::vector<ConfigManager::Config> m_cfgs;
+        int m_primary;
+
+        // Last loaded scene, consecutive jobs with the same scene reuse it
+        std::string m_scene_key;
+        Scene1::Ptr m_scene;
+        std::unique_ptr<Output> m_output;
+    };
+}
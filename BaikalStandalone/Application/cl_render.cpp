@@ -123,6 +123,7 @@ namespace Baikal
             }
 #endif
             m_cfgs[i].renderer->SetOutput(Baikal::Renderer::OutputType::kColor, m_outputs[i].output.get());
+            static_cast<Baikal::MonteCarloRenderer*>(m_cfgs[i].renderer.get())->SetMaterialSorting(settings.material_sorting);
 
             m_outputs[i].fdata.resize(settings.width * settings.height);
             m_outputs[i].udata.resize(settings.width * settings.height * 4);
@@ -133,6 +134,11 @@ namespace Baikal
             }
         }
 
+        if (!settings.profile_path.empty())
+        {
+            static_cast<Baikal::MonteCarloRenderer*>(m_cfgs[m_primary].renderer.get())->SetProfilingEnabled(true);
+        }
+
         m_shape_id_data.output = m_cfgs[m_primary].factory->CreateOutput(m_width, m_height);
         m_cfgs[m_primary].renderer->Clear(RadeonRays::float3(0, 0, 0), *m_outputs[m_primary].output);
         m_cfgs[m_primary].renderer->Clear(RadeonRays::float3(0, 0, 0), *m_shape_id_data.output);
@@ -149,6 +155,8 @@ namespace Baikal
         std::string filename = basepath + settings.modelname;
 
         {
+            Baikal::SceneIo::SetTextureCompressionEnabled(settings.texture_compression);
+            Baikal::SceneIo::SetSceneCachePath(settings.scene_cache);
             m_scene = Baikal::SceneIo::LoadScene(filename, basepath);
 
             {
@@ -442,6 +450,24 @@ namespace Baikal
         SaveImage(oss.str(), settings.width, settings.height, data.data());
     }
 
+    void AppClRender::SaveProfile(AppSettings const& settings)
+    {
+        if (settings.profile_path.empty())
+        {
+            return;
+        }
+
+        auto& profile = static_cast<Baikal::MonteCarloRenderer*>(m_cfgs[m_primary].renderer.get())->GetProfiler().GetProfile();
+
+        std::ofstream summary(settings.profile_path + ".json");
+        profile.WriteJson(summary);
+
+        std::ofstream trace(settings.profile_path + "_trace.json");
+        profile.WriteChromeTrace(trace);
+
+        std::cout << "Kernel timings saved to " << settings.profile_path << ".json\n";
+    }
+
     void AppClRender::SaveImage(const std::string& name, int width, int height, const RadeonRays::float3* data)
     {
         OIIO_NAMESPACE_USING;
@@ -91,6 +91,8 @@ namespace Baikal
         //save cl frame buffer to file
         void SaveFrameBuffer(AppSettings& settings);
         void SaveImage(const std::string& name, int width, int height, const RadeonRays::float3* data);
+        //save kernel timings of primary device
+        void SaveProfile(AppSettings const& settings);
 
         inline Baikal::Camera::Ptr GetCamera() { return m_camera; };
         inline Baikal::Scene1::Ptr GetScene() { return m_scene; };
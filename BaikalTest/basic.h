@@ -25,6 +25,8 @@ THE SOFTWARE.
 
 #include "CLW.h"
 #include "Renderers/renderer.h"
+#include "Renderers/monte_carlo_renderer.h"
+#include "Renderers/adaptive_renderer.h"
 #include "RenderFactory/clw_render_factory.h"
 #include "Output/output.h"
 #include "SceneGraph/camera.h"
@@ -252,6 +254,12 @@ public:
     }
 
     bool CompareToReference(std::string const& file_name)
+    {
+        return CompareToReference(file_name, file_name);
+    }
+
+    // Compare the output to the reference image of another test
+    bool CompareToReference(std::string const& file_name, std::string const& reference_file_name)
     {
         if (m_generate)
             return true;
@@ -259,7 +267,7 @@ public:
         std::string path_to_output = m_output_path;
         path_to_output.append(file_name);
         std::string path_to_reference = m_reference_path;
-        path_to_reference.append(file_name);
+        path_to_reference.append(reference_file_name);
 
         std::vector<char> output_data;
         std::vector<char> reference_data;
@@ -340,6 +348,224 @@ TEST_F(BasicTest, RenderTestScene)
     ASSERT_TRUE(CompareToReference(test_name() + ".png"));
 }
 
+// Save the test scene to the compiled format, reload and render it
+TEST_F(BasicTest, CompiledSceneRoundTrip)
+{
+    ClearOutput();
+
+    auto filename = m_output_path + test_name() + ".baikalscene";
+    ASSERT_NO_THROW(Baikal::SceneIo::SaveScene(*m_scene, filename, ""));
+
+    Baikal::Scene1::Ptr scene;
+    ASSERT_NO_THROW(scene = Baikal::SceneIo::LoadScene(filename, ""));
+    ASSERT_EQ(m_scene->GetNumShapes(), scene->GetNumShapes());
+    ASSERT_EQ(m_scene->GetNumLights(), scene->GetNumLights());
+
+    auto src_iter = m_scene->CreateShapeIterator();
+    auto dst_iter = scene->CreateShapeIterator();
+    for (; src_iter->IsValid(); src_iter->Next(), dst_iter->Next())
+    {
+        auto src = src_iter->ItemAs<Baikal::Mesh>();
+        auto dst = dst_iter->ItemAs<Baikal::Mesh>();
+        ASSERT_TRUE(src && dst);
+        ASSERT_EQ(src->GetNumVertices(), dst->GetNumVertices());
+        ASSERT_EQ(src->GetNumIndices(), dst->GetNumIndices());
+        ASSERT_TRUE(std::equal(src->GetIndices(), src->GetIndices() + src->GetNumIndices(), dst->GetIndices()));
+    }
+
+    scene->SetCamera(m_camera);
+    ASSERT_NO_THROW(m_controller->CompileScene(scene));
+
+    auto& compiled_scene = m_controller->GetCachedScene(scene);
+
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(compiled_scene));
+    }
+
+    SaveOutput(test_name() + ".png");
+    ASSERT_TRUE(CompareToReference(test_name() + ".png"));
+}
+
+TEST_F(BasicTest, MaterialSorting)
+{
+    ClearOutput();
+
+    // Sorting only changes the shading order, so the image should match RenderTestScene
+    ASSERT_NO_THROW(static_cast<Baikal::MonteCarloRenderer*>(m_renderer.get())->SetMaterialSorting(true));
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+
+    SaveOutput(test_name() + ".png");
+    ASSERT_TRUE(CompareToReference(test_name() + ".png", "RenderTestScene.png"));
+}
+
+
+
+
+
+TEST_F(BasicTest, RussianRoulette)
+{
+    ClearOutput();
+
+    // Terminate low throughput paths right after the first bounce
+    auto renderer = static_cast<Baikal::MonteCarloRenderer*>(m_renderer.get());
+    ASSERT_NO_THROW(renderer->SetRussianRouletteDepth(1u));
+    ASSERT_NO_THROW(renderer->SetRussianRouletteThreshold(1.f));
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+
+    SaveOutput(test_name() + ".png");
+    ASSERT_TRUE(CompareToReference(test_name() + ".png"));
+}
+
+// Scene compilation failed on memory budget should succeed once budget is raised
+TEST_F(BasicTest, MemoryBudgetRecovery)
+{
+    auto memory_manager = static_cast<Baikal::ClwRenderFactory*>(m_factory.get())->GetMemoryManager();
+
+    // Work buffers alone take more than 1MB, so scene buffers don't fit
+    memory_manager->SetBudget(1024u * 1024u);
+    ASSERT_THROW(m_controller->CompileScene(m_scene), Baikal::MemoryBudgetError);
+
+    memory_manager->SetBudget(0u);
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    ASSERT_GT(scene.num_lights, 0);
+    ASSERT_GT(scene.shapes.GetElementCount(), 0u);
+
+    ClearOutput();
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+
+    SaveOutput(test_name() + ".png");
+    ASSERT_TRUE(CompareToReference(test_name() + ".png"));
+}
+
+// Detaching a shape should keep intersection API shapes of other shapes
+TEST_F(BasicTest, ShapeDetachReattach)
+{
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto shape_iter = m_scene->CreateShapeIterator();
+    ASSERT_TRUE(shape_iter->IsValid());
+    auto shape = shape_iter->ItemAs<Baikal::Shape>();
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    auto isect_shapes = scene.intersector_shapes;
+
+    m_scene->DetachShape(shape);
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    ASSERT_EQ(scene.intersector_shapes.size(), isect_shapes.size() - 1);
+    ASSERT_EQ(scene.intersector_shapes.count(shape->GetId()), 0u);
+    for (auto const& iter : scene.intersector_shapes)
+    {
+        ASSERT_EQ(iter.second.shape, isect_shapes[iter.first].shape);
+    }
+
+    m_scene->AttachShape(shape);
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+    ASSERT_EQ(scene.intersector_shapes.size(), isect_shapes.size());
+
+    ClearOutput();
+    for (auto i = 0u; i < kNumIterations; ++i)
+    {
+        ASSERT_NO_THROW(m_renderer->Render(scene));
+    }
+
+    SaveOutput(test_name() + ".png");
+    ASSERT_TRUE(CompareToReference(test_name() + ".png"));
+}
+
+// Adaptive renderer should stop sampling once every pixel is below the noise threshold
+TEST_F(BasicTest, AdaptiveSamplingConverges)
+{
+    std::unique_ptr<Baikal::Renderer> renderer;
+    ASSERT_NO_THROW(renderer = m_factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kAdaptivePathTracer));
+
+    auto adaptive = static_cast<Baikal::AdaptiveRenderer*>(renderer.get());
+    adaptive->SetNoiseThreshold(0.1f);
+    adaptive->SetMinSamples(16u);
+
+    auto mask = m_factory->CreateOutput(kOutputWidth, kOutputHeight);
+    ASSERT_NO_THROW(renderer->SetOutput(Baikal::Renderer::OutputType::kColor, m_output.get()));
+    ASSERT_NO_THROW(renderer->SetOutput(Baikal::Renderer::OutputType::kConvergence, mask.get()));
+    ASSERT_NO_THROW(renderer->SetRandomSeed(0));
+    ASSERT_NO_THROW(renderer->Clear(RadeonRays::float3(), *m_output));
+    ASSERT_NO_THROW(renderer->Clear(RadeonRays::float3(), *mask));
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    auto const max_iterations = 4096u;
+    auto i = 0u;
+    for (; i < max_iterations && !adaptive->IsConverged(); ++i)
+    {
+        ASSERT_NO_THROW(renderer->Render(scene));
+    }
 
+    ASSERT_LT(i, max_iterations);
 
+    // Every pixel is marked as converged
+    std::vector<RadeonRays::float3> data(kOutputWidth * kOutputHeight);
+    mask->GetData(&data[0]);
+    for (auto const& v : data)
+    {
+        ASSERT_EQ(v.x, 1.f);
+    }
+}
 
+// Adaptive renderer should accumulate exactly one sample per active pixel each frame
+TEST_F(BasicTest, AdaptiveSamplingSampleCount)
+{
+    std::unique_ptr<Baikal::Renderer> renderer;
+    ASSERT_NO_THROW(renderer = m_factory->CreateRenderer(Baikal::ClwRenderFactory::RendererType::kAdaptivePathTracer));
+
+    // Zero threshold is never reached, so every pixel stays active
+    auto adaptive = static_cast<Baikal::AdaptiveRenderer*>(renderer.get());
+    adaptive->SetNoiseThreshold(0.f);
+    adaptive->SetMinSamples(4u);
+
+    ASSERT_NO_THROW(renderer->SetOutput(Baikal::Renderer::OutputType::kColor, m_output.get()));
+    ASSERT_NO_THROW(renderer->SetRandomSeed(0));
+    ASSERT_NO_THROW(renderer->Clear(RadeonRays::float3(), *m_output));
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+
+    auto const num_iterations = 16u;
+    for (auto i = 0u; i < num_iterations; ++i)
+    {
+        ASSERT_NO_THROW(renderer->Render(scene));
+    }
+
+    ASSERT_FALSE(adaptive->IsConverged());
+
+    // Sample count is kept in w component of accumulated radiance
+    std::vector<RadeonRays::float3> data(kOutputWidth * kOutputHeight);
+    m_output->GetData(&data[0]);
+    for (auto const& v : data)
+    {
+        ASSERT_EQ(v.w, static_cast<float>(num_iterations));
+    }
+}
@@ -629,3 +629,38 @@ TEST_F(InputMapsTest, InputMap_Normal)
 
     RunAndSave(material, "quad");
 }
+
+TEST_F(InputMapsTest, InputMap_StreamedTexture)
+{
+    // Large enough to be streamed, coarse levels average the checker out
+    int const size = 1024;
+    auto data = new char[size * size * 4];
+    for (auto y = 0; y < size; ++y)
+    {
+        for (auto x = 0; x < size; ++x)
+        {
+            auto texel = data + 4 * (y * size + x);
+            texel[0] = texel[1] = texel[2] = (((x >> 5) + (y >> 5)) & 1) ? (char)255 : 0;
+            texel[3] = (char)255;
+        }
+    }
+
+    auto texture = Baikal::Texture::Create(data, RadeonRays::int3(size, size, 1), Baikal::Texture::Format::kRgba8);
+    ASSERT_TRUE(Baikal::TextureStreamer::IsStreamable(*texture));
+
+    auto material = Baikal::UberV2Material::Create();
+    material->SetInputValue("uberv2.diffuse.color", Baikal::InputMap_Sampler::Create(texture));
+    material->SetLayers(Baikal::UberV2Material::Layers::kDiffuseLayer);
+
+    ClearOutput();
+    ApplyMaterialToObject("sphere", material);
+
+    ASSERT_NO_THROW(m_controller->CompileScene(m_scene));
+
+    auto& scene = m_controller->GetCachedScene(m_scene);
+    ASSERT_EQ(scene.texture_streamer.GetNumResidentTiles(), 0u);
+
+    // Renderer streams in the tiles itself
+    ASSERT_NO_THROW(m_renderer->Render(scene));
+    ASSERT_GT(scene.texture_streamer.GetNumResidentTiles(), 0u);
+}
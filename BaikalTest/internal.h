@@ -21,7 +21,30 @@ THE SOFTWARE.
 ********************************************************************/
 #include "gtest/gtest.h"
 
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <sstream>
+
 #include "Utils/distribution1d.h"
+#include "Utils/distribution2d.h"
+#include "Utils/range_allocator.h"
+#include "Utils/block_compression.h"
+#include "Utils/hash.h"
+#include "Utils/cl_program_cache.h"
+#include "Utils/thread_pool.h"
+#include "Utils/tile_scheduler.h"
+#include "Utils/kernel_profiler.h"
+#include "Utils/light_tree.h"
+#include "Utils/cl_inputmap_generator.h"
+#include "Utils/inputmap_optimizer.h"
+#include "Utils/texture_streamer.h"
+#include "SceneGraph/texture.h"
+#include "SceneGraph/light.h"
+#include "SceneGraph/inputmaps.h"
+#include "SceneGraph/scene1.h"
+#include "SceneGraph/iterator.h"
+#include "SceneGraph/Collector/collector.h"
 #include "math/mathutils.h"
 
 class InternalTest : public ::testing::Test
@@ -47,3 +70,816 @@ TEST_F(InternalTest, Distribuiton1D)
 
     cnts[0] += cnts[1];
 }
+
+TEST_F(InternalTest, Distribution2D)
+{
+    // Single bright cell in the otherwise black 4x2 map
+    float vals[] = { 0, 0, 0, 0,
+                     0, 0, 8, 0 };
+    Baikal::Distribution2D dist(vals, 4, 2);
+
+    for (auto i = 0u; i < 1000; ++i)
+    {
+        float pdf = 0.f;
+        auto uv = dist.Sample2D(RadeonRays::float2(RadeonRays::rand_float(), RadeonRays::rand_float()), pdf);
+
+        ASSERT_EQ(std::min((int)(uv.x * 4), 3), 2);
+        ASSERT_EQ(std::min((int)(uv.y * 2), 1), 1);
+        ASSERT_NEAR(pdf, dist.pdf(uv), 1e-3f);
+    }
+
+    // Serialized size should match the layout expected by kernels
+    std::vector<int> data(dist.GetSerializedSize());
+    auto end = dist.Write(&data[0]);
+    ASSERT_EQ(static_cast<std::size_t>(end - &data[0]), data.size());
+}
+
+TEST_F(InternalTest, RangeAllocator)
+{
+    Baikal::RangeAllocator allocator(16);
+
+    std::size_t a = 0, b = 0, c = 0;
+    ASSERT_TRUE(allocator.Allocate(8, a));
+    ASSERT_TRUE(allocator.Allocate(4, b));
+    ASSERT_TRUE(allocator.Allocate(4, c));
+    ASSERT_EQ(a, 0u);
+    ASSERT_EQ(b, 8u);
+    ASSERT_EQ(c, 12u);
+
+    // No space left
+    std::size_t d = 0;
+    ASSERT_FALSE(allocator.Allocate(1, d));
+
+    // Released neighbours should be coalesced
+    allocator.Free(b, 4);
+    allocator.Free(a, 8);
+    ASSERT_EQ(allocator.GetLargestFreeRange(), 12u);
+    ASSERT_TRUE(allocator.Allocate(12, d));
+    ASSERT_EQ(d, 0u);
+
+    // Growing appends free space at the end
+    allocator.Grow(32);
+    ASSERT_TRUE(allocator.Allocate(16, d));
+    ASSERT_EQ(d, 16u);
+    ASSERT_EQ(allocator.GetUsedSize(), 32u);
+}
+
+TEST_F(InternalTest, TextureMipmaps)
+{
+    // 4x2 RGBA32 texture with texel value equal to its index
+    auto data = new float[4 * 2 * 4];
+    for (auto i = 0; i < 4 * 2; ++i)
+    {
+        data[4 * i] = data[4 * i + 1] = data[4 * i + 2] = data[4 * i + 3] = (float)i;
+    }
+
+    auto texture = Baikal::Texture::Create(reinterpret_cast<char*>(data), RadeonRays::int3(4, 2, 1), Baikal::Texture::Format::kRgba32);
+
+    // 4x2, 2x1 and 1x1 levels
+    ASSERT_EQ(texture->GetMipLevelCount(), 3u);
+    ASSERT_EQ(texture->GetMipDataSizeInBytes(), 3u * 4u * sizeof(float));
+
+    auto mips = reinterpret_cast<float const*>(texture->GetMipData());
+    ASSERT_FLOAT_EQ(mips[0], 2.5f);
+    ASSERT_FLOAT_EQ(mips[4], 4.5f);
+    ASSERT_FLOAT_EQ(mips[8], 3.5f);
+
+    texture->SetMipmapEnabled(false);
+    ASSERT_EQ(texture->GetMipLevelCount(), 1u);
+    ASSERT_EQ(texture->GetMipDataSizeInBytes(), 0u);
+}
+
+TEST_F(InternalTest, TextureBlockCompression)
+{
+    int const width = 13;
+    int const height = 9;
+
+    for (auto format : { Baikal::Texture::Format::kBc1, Baikal::Texture::Format::kBc3, Baikal::Texture::Format::kBc4, Baikal::Texture::Format::kBc5 })
+    {
+        // Smooth RGBA8 gradient (texture takes ownership of the data).
+        // BC1 approximates each block with a line segment in RGB space,
+        // so it gets a color ramp along x instead of independent channels.
+        // BC3 stores the same color block and alpha ramp along y.
+        auto bc3 = format == Baikal::Texture::Format::kBc3;
+        auto bc1 = format == Baikal::Texture::Format::kBc1 || bc3;
+        auto data = new std::uint8_t[width * height * 4];
+        for (auto y = 0; y < height; ++y)
+        {
+            for (auto x = 0; x < width; ++x)
+            {
+                auto texel = data + 4 * (y * width + x);
+                texel[0] = (std::uint8_t)(x * 255 / (width - 1));
+                texel[1] = bc1 ? (std::uint8_t)(255 - texel[0]) : (std::uint8_t)(y * 255 / (height - 1));
+                texel[2] = 128;
+                texel[3] = bc3 ? (std::uint8_t)(y * 255 / (height - 1)) : 255;
+            }
+        }
+
+        auto texture = Baikal::Texture::Create(reinterpret_cast<char*>(data), RadeonRays::int3(width, height, 1), Baikal::Texture::Format::kRgba8);
+
+        std::vector<RadeonRays::float3> original;
+        for (auto y = 0; y < height; ++y)
+        {
+            for (auto x = 0; x < width; ++x)
+            {
+                original.push_back(texture->GetTexel(x, y));
+            }
+        }
+
+        texture->Compress(format);
+        ASSERT_TRUE(texture->IsCompressed());
+        ASSERT_EQ(texture->GetSizeInBytes(), Baikal::GetBlockCompressedSizeInBytes(format, width, height));
+        ASSERT_LT(texture->GetSizeInBytes(), texture->GetUncompressedSizeInBytes());
+
+        // Palettes have 4 (BC1) or 8 (BC4) entries per block
+        auto tolerance = bc1 ? 0.03f : 0.02f;
+        auto error = 0.f;
+
+        for (auto y = 0; y < height; ++y)
+        {
+            for (auto x = 0; x < width; ++x)
+            {
+                auto expected = original[y * width + x];
+                auto actual = texture->GetTexel(x, y);
+                error += (actual.x - expected.x) * (actual.x - expected.x);
+
+                if (format != Baikal::Texture::Format::kBc4)
+                {
+                    error += (actual.y - expected.y) * (actual.y - expected.y);
+                }
+
+                if (bc3)
+                {
+                    error += (actual.w - expected.w) * (actual.w - expected.w);
+                }
+            }
+        }
+
+        // RMS error
+        ASSERT_LT(std::sqrt(error / (width * height)), tolerance);
+
+        // Mip levels are block compressed as well
+        ASSERT_NE(texture->GetMipData(), nullptr);
+    }
+}
+
+TEST_F(InternalTest, TextureCompressedFormatChoice)
+{
+    int const size = 8;
+
+    // Fill RGBA8 texture with the value of a texel function
+    auto create_texture = [size](std::function<void(int, int, std::uint8_t*)> texel_func)
+    {
+        auto data = new std::uint8_t[size * size * 4];
+        for (auto y = 0; y < size; ++y)
+        {
+            for (auto x = 0; x < size; ++x)
+            {
+                texel_func(x, y, data + 4 * (y * size + x));
+            }
+        }
+
+        return Baikal::Texture::Create(reinterpret_cast<char*>(data), RadeonRays::int3(size, size, 1), Baikal::Texture::Format::kRgba8);
+    };
+
+    auto color = create_texture([](int x, int y, std::uint8_t* texel)
+    {
+        texel[0] = (std::uint8_t)(x * 30); texel[1] = (std::uint8_t)(y * 30); texel[2] = 20; texel[3] = 255;
+    });
+    ASSERT_EQ(Baikal::ChooseCompressedFormat(*color), Baikal::Texture::Format::kBc1);
+
+    auto cutout = create_texture([](int x, int y, std::uint8_t* texel)
+    {
+        texel[0] = (std::uint8_t)(x * 30); texel[1] = (std::uint8_t)(y * 30); texel[2] = 20; texel[3] = x < 4 ? 0 : 255;
+    });
+    ASSERT_EQ(Baikal::ChooseCompressedFormat(*cutout), Baikal::Texture::Format::kBc3);
+
+    // Single channel images are replicated into all channels including alpha
+    auto grayscale = create_texture([](int x, int y, std::uint8_t* texel)
+    {
+        texel[0] = texel[1] = texel[2] = texel[3] = (std::uint8_t)(x * 30);
+    });
+    ASSERT_EQ(Baikal::ChooseCompressedFormat(*grayscale), Baikal::Texture::Format::kBc4);
+
+    // Three channel images are loaded with opaque alpha
+    auto rgb_grayscale = create_texture([](int x, int y, std::uint8_t* texel)
+    {
+        texel[0] = texel[1] = texel[2] = (std::uint8_t)(y * 30); texel[3] = 255;
+    });
+    ASSERT_EQ(Baikal::ChooseCompressedFormat(*rgb_grayscale), Baikal::Texture::Format::kBc4);
+
+    // Color without blue channel is still color, BC5 is never chosen automatically
+    auto red_green = create_texture([](int x, int y, std::uint8_t* texel)
+    {
+        texel[0] = (std::uint8_t)(x * 30); texel[1] = (std::uint8_t)(y * 30); texel[2] = 0; texel[3] = 255;
+    });
+    ASSERT_EQ(Baikal::ChooseCompressedFormat(*red_green), Baikal::Texture::Format::kBc1);
+}
+
+TEST_F(InternalTest, TextureStreamer)
+{
+    // Texels encode their coordinates
+    int const size = 1024;
+    auto data = new std::uint8_t[size * size * 4];
+    for (auto y = 0; y < size; ++y)
+    {
+        for (auto x = 0; x < size; ++x)
+        {
+            auto texel = data + 4 * (y * size + x);
+            texel[0] = (std::uint8_t)(x & 255);
+            texel[1] = (std::uint8_t)(y & 255);
+            texel[2] = (std::uint8_t)((x >> 8) | ((y >> 8) << 4));
+            texel[3] = 255;
+        }
+    }
+
+    auto texture = Baikal::Texture::Create(reinterpret_cast<char*>(data), RadeonRays::int3(size, size, 1), Baikal::Texture::Format::kRgba8);
+    auto small_texture = Baikal::Texture::Create(new char[256 * 256 * 4](), RadeonRays::int3(256, 256, 1), Baikal::Texture::Format::kRgba8);
+
+    ASSERT_TRUE(Baikal::TextureStreamer::IsStreamable(*texture));
+    ASSERT_FALSE(Baikal::TextureStreamer::IsStreamable(*small_texture));
+
+    // 128x128 RGBA8 tiles, levels 0-2 are streamed (8x8, 4x4 and 2x2 tiles)
+    ASSERT_EQ(Baikal::TextureStreamer::GetResidentLevel(*texture), 3u);
+    ASSERT_EQ(Baikal::TextureStreamer::GetNumPages(*texture), 84u);
+
+    Baikal::TextureStreamer streamer;
+    ASSERT_EQ(streamer.AddTexture(texture), 0u);
+    ASSERT_EQ(streamer.GetNumPages(), 84u);
+    streamer.SetNumSlots(4);
+
+    std::vector<std::uint32_t> feedback((streamer.GetNumPages() + 31) / 32);
+    std::vector<Baikal::TextureStreamer::TileUpload> uploads;
+
+    auto set_feedback = [&feedback](std::initializer_list<std::size_t> pages)
+    {
+        std::fill(feedback.begin(), feedback.end(), 0u);
+        for (auto page : pages)
+        {
+            feedback[page / 32] |= 1u << (page % 32);
+        }
+    };
+
+    // Missing tiles go into free slots
+    set_feedback({ 0, 1, 2 });
+    streamer.Update(feedback.data(), uploads);
+    ASSERT_EQ(uploads.size(), 3u);
+    ASSERT_EQ(streamer.GetNumResidentTiles(), 3u);
+    ASSERT_NE(streamer.GetSlot(1), Baikal::TextureStreamer::kInvalidSlot);
+    ASSERT_EQ(streamer.GetSlot(3), Baikal::TextureStreamer::kInvalidSlot);
+
+    // Full pool evicts the least recently sampled tile, sampled ones are kept
+    set_feedback({ 2, 10, 11 });
+    streamer.Update(feedback.data(), uploads);
+    ASSERT_EQ(uploads.size(), 2u);
+    ASSERT_EQ(streamer.GetNumResidentTiles(), 4u);
+    ASSERT_EQ(streamer.GetSlot(0), Baikal::TextureStreamer::kInvalidSlot);
+    ASSERT_NE(streamer.GetSlot(1), Baikal::TextureStreamer::kInvalidSlot);
+    ASSERT_NE(streamer.GetSlot(2), Baikal::TextureStreamer::kInvalidSlot);
+
+    // Nothing is evicted while all resident tiles are in use
+    set_feedback({ 1, 2, 10, 11, 20 });
+    streamer.Update(feedback.data(), uploads);
+    ASSERT_TRUE(uploads.empty());
+    ASSERT_EQ(streamer.GetSlot(20), Baikal::TextureStreamer::kInvalidSlot);
+
+    // Tiles are stored as 128x128 images
+    std::vector<std::uint8_t> tile(Baikal::TextureStreamer::kTileSizeInBytes);
+    streamer.ReadTile(9, reinterpret_cast<char*>(tile.data()));
+    auto texel = tile.data() + 4 * (7 * 128 + 5);
+    ASSERT_EQ(texel[0], 128 + 5);
+    ASSERT_EQ(texel[1], 128 + 7);
+    ASSERT_EQ(texel[2], 0);
+
+    // The first tile of level 1
+    streamer.ReadTile(64, reinterpret_cast<char*>(tile.data()));
+    auto level = reinterpret_cast<std::uint8_t const*>(texture->GetLevelData(1));
+    ASSERT_EQ(level, reinterpret_cast<std::uint8_t const*>(texture->GetMipData()));
+    ASSERT_EQ(std::memcmp(tile.data() + 4 * (3 * 128), level + 4 * (3 * 512), 4 * 128), 0);
+}
+
+TEST_F(InternalTest, Hash128)
+{
+    // MurmurHash3 x64 128 reference value
+    auto hash = Baikal::ComputeHash128(std::string("The quick brown fox jumps over the lazy dog"));
+    ASSERT_EQ(hash.lo, 0xe34bbc7bbc071b6cull);
+    ASSERT_EQ(hash.hi, 0x7a433ca9c49a9347ull);
+
+    auto str = hash.ToString();
+    ASSERT_EQ(str, "7a433ca9c49a9347e34bbc7bbc071b6c");
+
+    // Composite keys depend on field boundaries
+    auto a = Baikal::Hasher().Append("ab").Append("c").GetHash();
+    auto b = Baikal::Hasher().Append("a").Append("bc").GetHash();
+    ASSERT_NE(a, b);
+}
+
+TEST_F(InternalTest, ProgramCache)
+{
+    std::string const path = "program_cache_test";
+
+    auto make_key = [](int i)
+    {
+        return Baikal::Hasher().AppendValue(i).GetHash();
+    };
+
+    // Leftovers from previous runs
+    for (auto i = 0; i < 4; ++i)
+    {
+        std::remove((path + "/" + make_key(i).ToString() + ".bin").c_str());
+    }
+    std::remove((path + "/index.txt").c_str());
+
+    std::vector<std::uint8_t> binary(100, 0xab);
+    {
+        // Room for two binaries only
+        Baikal::CLProgramCache cache(path, 250);
+
+        std::vector<std::uint8_t> data;
+        ASSERT_FALSE(cache.Load(make_key(0), data));
+
+        cache.Store(make_key(0), "program0", binary);
+        cache.Store(make_key(1), "program1", binary);
+
+        ASSERT_TRUE(cache.Load(make_key(0), data));
+        ASSERT_EQ(data, binary);
+
+        // Program 1 is least recently used now
+        cache.Store(make_key(2), "program2", binary);
+        ASSERT_EQ(cache.GetSizeInBytes(), 200u);
+        ASSERT_FALSE(cache.Load(make_key(1), data));
+        ASSERT_TRUE(cache.Load(make_key(2), data));
+    }
+
+    {
+        // Index is persistent
+        Baikal::CLProgramCache cache(path, 250);
+        ASSERT_EQ(cache.GetSizeInBytes(), 200u);
+
+        std::vector<std::uint8_t> data;
+        ASSERT_TRUE(cache.Load(make_key(0), data));
+
+        cache.Remove(make_key(0));
+        ASSERT_FALSE(cache.Load(make_key(0), data));
+        ASSERT_EQ(cache.GetSizeInBytes(), 100u);
+    }
+}
+
+TEST_F(InternalTest, ThreadPool)
+{
+    std::vector<std::future<int>> results;
+
+    {
+        Baikal::ThreadPool pool(4);
+        ASSERT_EQ(pool.GetThreadCount(), 4u);
+
+        for (auto i = 0; i < 64; ++i)
+        {
+            results.push_back(pool.Submit([i]() { return i * i; }));
+        }
+
+        auto failed = pool.Submit([]() -> int { throw std::runtime_error("Task failed"); });
+        ASSERT_THROW(failed.get(), std::runtime_error);
+
+        // Pool is destroyed with tasks possibly still queued, they must be finished
+    }
+
+    for (auto i = 0; i < 64; ++i)
+    {
+        ASSERT_EQ(results[i].get(), i * i);
+    }
+}
+
+TEST_F(InternalTest, Collector)
+{
+    std::vector<Baikal::Texture::Ptr> textures;
+    for (auto i = 0; i < 100; ++i)
+    {
+        textures.push_back(Baikal::Texture::Create());
+    }
+
+    Baikal::Collector collector;
+
+    // Duplicates are collected once
+    for (auto i = 0; i < 100; ++i)
+    {
+        ASSERT_TRUE(collector.Collect(textures[i]));
+        ASSERT_FALSE(collector.Collect(textures[i]));
+    }
+    collector.Commit();
+    ASSERT_EQ(collector.GetNumItems(), 100u);
+
+    std::vector<std::uint32_t> indices;
+    for (auto const& texture : textures)
+    {
+        indices.push_back(collector.GetItemIndex(texture));
+    }
+
+    std::unique_ptr<Baikal::Bundle> bundle(collector.CreateBundle());
+    auto not_changed = [](Baikal::SceneObject::Ptr) { return false; };
+
+    // Same objects in other order keep their indices
+    collector.StartCollection();
+    for (auto i = 100; i-- > 0;)
+    {
+        ASSERT_TRUE(collector.Collect(textures[i]));
+    }
+    collector.Commit();
+    ASSERT_FALSE(collector.NeedsUpdate(bundle.get(), not_changed));
+
+    for (auto i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(collector.GetItemIndex(textures[i]), indices[i]);
+    }
+
+    // Drop every third object and add new ones
+    auto new_texture = Baikal::Texture::Create();
+    collector.StartCollection();
+    for (auto i = 0; i < 100; ++i)
+    {
+        if (i % 3 != 0)
+        {
+            collector.Collect(textures[i]);
+        }
+    }
+    collector.Collect(new_texture);
+    collector.Commit();
+    ASSERT_EQ(collector.GetNumItems(), 67u);
+    ASSERT_TRUE(collector.NeedsUpdate(bundle.get(), not_changed));
+    ASSERT_THROW(collector.GetItemIndex(textures[0]), std::runtime_error);
+
+    // Indices are dense, match iteration order and are preserved for objects within the new range
+    std::uint32_t index = 0;
+    auto iter = collector.CreateIterator();
+    for (; iter->IsValid(); iter->Next(), ++index)
+    {
+        ASSERT_EQ(collector.GetItemIndex(iter->Item()), index);
+    }
+    ASSERT_EQ(index, 67u);
+
+    for (auto i = 0; i < 100; ++i)
+    {
+        if (i % 3 != 0 && indices[i] < 67u)
+        {
+            ASSERT_EQ(collector.GetItemIndex(textures[i]), indices[i]);
+        }
+    }
+}
+
+TEST_F(InternalTest, TileScheduler)
+{
+    auto check_coverage = [](std::vector<Baikal::TileScheduler::Band> const& bands, std::uint32_t height)
+    {
+        std::uint32_t y = 0;
+        for (auto const& band : bands)
+        {
+            ASSERT_EQ(band.y, y);
+            y += band.height;
+        }
+        ASSERT_EQ(y, height);
+    };
+
+    Baikal::TileScheduler scheduler(2, 8);
+
+    // Without measurements the work is split evenly
+    auto bands = scheduler.Schedule(256);
+    check_coverage(bands, 256);
+    ASSERT_EQ(bands[0].height, 128u);
+    ASSERT_EQ(bands[1].height, 128u);
+
+    // Device 0 is three times faster
+    scheduler.ReportTime(0, 128, 10.);
+    scheduler.ReportTime(1, 128, 30.);
+    ASSERT_NEAR(scheduler.GetShare(0), 0.75f, 1e-5f);
+
+    bands = scheduler.Schedule(256);
+    check_coverage(bands, 256);
+    ASSERT_EQ(bands[0].height, 192u);
+    ASSERT_EQ(bands[1].height, 64u);
+
+    // Slow device still gets a granule once the average converges
+    for (auto i = 0; i < 32; ++i)
+    {
+        scheduler.ReportTime(1, 64, 100000.);
+    }
+    bands = scheduler.Schedule(256);
+    check_coverage(bands, 256);
+    ASSERT_EQ(bands[1].height, 8u);
+
+    // Odd heights and tiny regions are covered
+    bands = scheduler.Schedule(13);
+    check_coverage(bands, 13);
+    bands = scheduler.Schedule(3);
+    check_coverage(bands, 3);
+
+    scheduler.Reset();
+    ASSERT_NEAR(scheduler.GetShare(1), 0.5f, 1e-5f);
+}
+
+TEST_F(InternalTest, KernelProfile)
+{
+    Baikal::KernelProfile profile(3);
+
+    profile.AddTiming("ShadeSurfaceUberV2", 0, 1000, 3000);
+    profile.AddTiming("QueryIntersection", 0, 3000, 4000);
+    profile.AddTiming("ShadeSurfaceUberV2", 1, 4000, 4500);
+    profile.AddTiming("ShadeSurfaceUberV2", 0, 5000, 9000);
+
+    profile.AddActiveRays(0, 100);
+    profile.AddActiveRays(0, 50);
+    profile.AddActiveRays(1, 20);
+
+    // Stats are kept per kernel and bounce in the order of the first launch
+    auto const& kernels = profile.GetKernelStats();
+    ASSERT_EQ(kernels.size(), 3u);
+    ASSERT_EQ(kernels[0].name, "ShadeSurfaceUberV2");
+    ASSERT_EQ(kernels[0].bounce, 0);
+    ASSERT_EQ(kernels[0].launches, 2u);
+    ASSERT_EQ(kernels[0].total_time, 6000u);
+    ASSERT_EQ(kernels[0].min_time, 2000u);
+    ASSERT_EQ(kernels[0].max_time, 4000u);
+    ASSERT_EQ(kernels[1].name, "QueryIntersection");
+    ASSERT_EQ(kernels[2].bounce, 1);
+
+    auto bounces = profile.GetBounceStats();
+    ASSERT_EQ(bounces.size(), 2u);
+    ASSERT_EQ(bounces[0].samples, 2u);
+    ASSERT_EQ(bounces[0].active_rays, 150u);
+    ASSERT_EQ(bounces[1].active_rays, 20u);
+
+    // Timeline is limited, aggregated stats are not
+    ASSERT_EQ(profile.GetTraceEvents().size(), 3u);
+    ASSERT_EQ(profile.GetDroppedTraceEvents(), 1u);
+
+    std::ostringstream json;
+    profile.WriteJson(json);
+    ASSERT_NE(json.str().find("\"name\": \"QueryIntersection\", \"bounce\": 0, \"launches\": 1"), std::string::npos);
+    ASSERT_NE(json.str().find("\"average_active_rays\": 75.000000"), std::string::npos);
+
+    std::ostringstream trace;
+    profile.WriteChromeTrace(trace);
+    ASSERT_NE(trace.str().find("\"ts\":0.000,\"dur\":2.000"), std::string::npos);
+
+    profile.Reset();
+    ASSERT_TRUE(profile.GetKernelStats().empty());
+    ASSERT_TRUE(profile.GetBounceStats().empty());
+}
+
+TEST_F(InternalTest, LightTree)
+{
+    using RadeonRays::float3;
+
+    // Grid of one-sided emitters facing +y with a few point lights and
+    // a zero power light which should be left out of the tree
+    std::vector<Baikal::LightTree::LightBounds> lights;
+    for (auto i = 0; i < 64; ++i)
+    {
+        Baikal::LightTree::LightBounds light;
+        auto p = float3((float)(i % 8), 2.f, (float)(i / 8));
+        light.bounds = RadeonRays::bbox(p);
+        light.bounds.grow(p + float3(0.5f, 0.f, 0.5f));
+        light.axis = float3(0.f, 1.f, 0.f);
+        light.power = 1.f + (float)(i % 3);
+        light.cos_theta_o = 1.f;
+        light.cos_theta_e = 0.f;
+        lights.push_back(light);
+    }
+
+    for (auto i = 0; i < 4; ++i)
+    {
+        Baikal::LightTree::LightBounds light;
+        light.bounds = RadeonRays::bbox(float3(2.f * i, -1.f, 0.f));
+        light.axis = float3(0.f, 0.f, 1.f);
+        light.power = i == 3 ? 0.f : 10.f;
+        light.cos_theta_o = -1.f;
+        light.cos_theta_e = 0.f;
+        lights.push_back(light);
+    }
+
+    Baikal::LightTree tree;
+    tree.Build(lights);
+
+    auto const& nodes = tree.GetNodes();
+    auto const& leaves = tree.GetLeafIndices();
+    ASSERT_EQ(tree.GetNumLights(), lights.size() - 1);
+    ASSERT_EQ(nodes.size(), 2 * tree.GetNumLights() - 1);
+    ASSERT_EQ(leaves.back(), -1);
+
+    // Every light is referenced by exactly one leaf, inner nodes carry power of their children
+    for (auto i = 0u; i < nodes.size(); ++i)
+    {
+        auto const& node = nodes[i];
+        if (node.light_idx != -1)
+        {
+            ASSERT_EQ(leaves[node.light_idx], (int)i);
+        }
+        else
+        {
+            ASSERT_EQ(nodes[i + 1].parent, (int)i);
+            ASSERT_EQ(nodes[node.child].parent, (int)i);
+            ASSERT_NEAR(node.power, nodes[i + 1].power + nodes[node.child].power, 1e-3f);
+        }
+    }
+
+    float3 points[] = { float3(3.f, 4.f, 3.f), float3(3.f, -4.f, 3.f), float3(20.f, 2.5f, -5.f) };
+    for (auto const& p : points)
+    {
+        // Selection probabilities should sum up to one
+        auto sum = 0.f;
+        for (auto i = 0u; i < lights.size(); ++i)
+        {
+            sum += tree.GetPdf(i, p);
+        }
+        ASSERT_NEAR(sum, 1.f, 1e-3f);
+
+        for (auto i = 0u; i < 1000; ++i)
+        {
+            auto pdf = 0.f;
+            auto light_idx = tree.Sample(p, RadeonRays::rand_float(), pdf);
+            ASSERT_NE(light_idx, -1);
+            ASSERT_NEAR(pdf, tree.GetPdf(light_idx, p), 1e-4f);
+        }
+    }
+
+    // Emitters facing away from the point should never be selected
+    auto pdf = 0.f;
+    auto light_idx = tree.Sample(float3(3.f, -4.f, 3.f), 0.5f, pdf);
+    ASSERT_GE(light_idx, 64);
+    ASSERT_EQ(tree.GetPdf(0, float3(3.f, -4.f, 3.f)), 0.f);
+}
+
+TEST_F(InternalTest, MeshLight)
+{
+    using RadeonRays::float3;
+
+    // Unit quad and a triangle of twice the quad area
+    std::vector<float3> vertices = { float3(0.f, 0.f, 0.f), float3(1.f, 0.f, 0.f), float3(1.f, 0.f, 1.f), float3(0.f, 0.f, 1.f),
+                                     float3(0.f, 1.f, 0.f), float3(4.f, 1.f, 0.f), float3(0.f, 1.f, 1.f) };
+    std::vector<std::uint32_t> indices = { 0, 1, 2, 0, 2, 3, 4, 5, 6 };
+
+    auto mesh = Baikal::Mesh::Create();
+    mesh->SetVertices(vertices.data(), vertices.size());
+    mesh->SetIndices(indices.data(), indices.size());
+
+    auto scene = Baikal::Scene1::Create();
+    scene->AttachShape(mesh);
+
+    // Single mesh light should emit as much as area lights for all of its primitives
+    auto mesh_light = Baikal::MeshLight::Create(mesh);
+    ASSERT_EQ(mesh_light->GetShape(), mesh);
+
+    float3 power;
+    for (auto i = 0u; i < mesh->GetNumIndices() / 3; ++i)
+    {
+        power += Baikal::AreaLight::Create(mesh, i)->GetPower(*scene);
+    }
+
+    auto mesh_power = mesh_light->GetPower(*scene);
+    ASSERT_NEAR(mesh_power.x, power.x, 1e-4f);
+    ASSERT_NEAR(mesh_power.x, 3.f * PI, 1e-4f);
+
+    // Area is measured in world space
+    mesh->SetTransform(RadeonRays::scale(float3(2.f, 1.f, 2.f)));
+    ASSERT_NEAR(mesh_light->GetArea(), 12.f, 1e-4f);
+    ASSERT_NEAR(mesh_light->GetPower(*scene).x, 12.f * PI, 1e-3f);
+
+    // Degenerate and empty meshes have zero area, so they are skipped by scene controllers
+    mesh->SetTransform(RadeonRays::scale(float3(0.f, 1.f, 1.f)));
+    ASSERT_EQ(mesh_light->GetArea(), 0.f);
+    ASSERT_EQ(Baikal::MeshLight::Create(Baikal::Mesh::Create())->GetArea(), 0.f);
+}
+
+TEST_F(InternalTest, InputMapStructureSharing)
+{
+    using namespace Baikal;
+
+    auto create_graph = [](float a, float b)
+    {
+        return InputMap_Add::Create(InputMap_ConstantFloat::Create(a), InputMap_ConstantFloat::Create(b));
+    };
+
+    auto graph0 = create_graph(1.f, 2.f);
+    auto graph1 = create_graph(3.f, 4.f);
+    auto graph2 = InputMap_Mul::Create(graph0, InputMap_ConstantFloat3::Create(RadeonRays::float3(1.f, 2.f, 3.f)));
+
+    Collector leafs;
+    for (auto const& graph : std::initializer_list<InputMap::Ptr>{ graph0, graph1, graph2 })
+    {
+        std::set<InputMap::Ptr> graph_leafs;
+        graph->GetLeafs(graph_leafs);
+        for (auto const& leaf : graph_leafs)
+        {
+            leafs.Collect(leaf);
+        }
+    }
+    leafs.Commit();
+
+    // Each input map takes header, leaf references and bytecode
+    CLInputMapGenerator generator;
+    ASSERT_EQ(generator.AddInputMap(graph0), 0);
+    ASSERT_EQ(generator.AddInputMap(graph1), 7);
+    ASSERT_EQ(generator.AddInputMap(graph0), 0);
+    ASSERT_EQ(generator.AddInputMap(graph2), 14);
+    // Constants 1, 2, 3, 4 and (1, 2, 3) are pooled after input maps
+    ASSERT_EQ(generator.GetLeafsOffset(), 29u);
+    ASSERT_TRUE(generator.IsInterpretable());
+    generator.Generate();
+
+    // Same structures added in other order produce the same source
+    CLInputMapGenerator other;
+    other.AddInputMap(graph2);
+    other.AddInputMap(create_graph(5.f, 6.f));
+    other.Generate();
+    ASSERT_EQ(generator.GetGeneratedSource(), other.GetGeneratedSource());
+
+    // Input map data union isn't default constructible on host
+    using InputMapStorage = std::aligned_storage<sizeof(ClwScene::InputMapData), alignof(ClwScene::InputMapData)>::type;
+    std::vector<InputMapStorage> storage(generator.GetLeafsOffset());
+    auto data = reinterpret_cast<ClwScene::InputMapData*>(storage.data());
+    generator.WriteInputMaps(leafs, data);
+
+    // Headers select generated function by structure hash
+    ASSERT_EQ(data[0].int_values.idx, data[7].int_values.idx);
+    ASSERT_NE(data[0].int_values.idx, data[14].int_values.idx);
+    char function[32];
+    std::snprintf(function, sizeof(function), "ReadInputMap_%08x", static_cast<std::uint32_t>(data[0].int_values.idx));
+    ASSERT_NE(generator.GetGeneratedSource().find(function), std::string::npos);
+
+    // Leaf references
+    ASSERT_EQ(data[1].int_values.idx, 24);
+    ASSERT_EQ(data[9].int_values.idx, 27);
+    ASSERT_EQ(data[15].int_values.idx, data[1].int_values.idx);
+    ASSERT_EQ(data[27].float_value.value.x, 4.f);
+    ASSERT_EQ(data[28].float_value.value.z, 3.f);
+
+    // Samplers are read from collector leafs
+    auto texture = Texture::Create();
+    auto sampler = InputMap_Sampler::Create(texture);
+    Collector sampler_leafs;
+    sampler_leafs.Collect(sampler);
+    sampler_leafs.Commit();
+    CLInputMapGenerator sampler_generator;
+    sampler_generator.AddInputMap(InputMap_Mul::Create(sampler, InputMap_ConstantFloat::Create(2.f)));
+    ASSERT_EQ(sampler_generator.GetLeafsOffset(), 8u);
+    std::vector<InputMapStorage> sampler_storage(sampler_generator.GetLeafsOffset());
+    auto sampler_data = reinterpret_cast<ClwScene::InputMapData*>(sampler_storage.data());
+    sampler_generator.WriteInputMaps(sampler_leafs, sampler_data);
+    ASSERT_EQ(sampler_data[1].int_values.idx, 8);
+    ASSERT_EQ(sampler_data[2].int_values.idx, 7);
+
+    // Bytecode follows leaf references
+    ASSERT_EQ(data[0].int_values.placeholder[0], 3);
+    ASSERT_EQ(data[3].instruction.op, ClwScene::kInputMapOpConstant);
+    ASSERT_EQ(data[3].instruction.args[0], data[1].int_values.idx);
+    ASSERT_EQ(data[4].instruction.args[0], data[2].int_values.idx);
+    ASSERT_EQ(data[5].instruction.op, ClwScene::kInputMapOpAdd);
+    ASSERT_EQ(data[6].instruction.op, ClwScene::kInputMapOpReturn);
+    ASSERT_EQ(data[14].int_values.placeholder[0], 18);
+    ASSERT_EQ(data[22].instruction.op, ClwScene::kInputMapOpMul);
+
+    // Graphs deeper than interpreter stack are left to generated code
+    InputMap::Ptr deep = InputMap_ConstantFloat::Create(0.f);
+    for (auto i = 0; i < INPUT_MAP_STACK_SIZE; ++i)
+    {
+        deep = InputMap_Add::Create(InputMap_ConstantFloat::Create(1.f), deep);
+    }
+    auto deep_offset = other.AddInputMap(deep);
+    ASSERT_FALSE(other.IsInterpretable());
+    // Header and leaf references only, pool has 6 constants
+    ASSERT_EQ(other.GetLeafsOffset(), static_cast<std::size_t>(deep_offset) + INPUT_MAP_STACK_SIZE + 2 + 6);
+}
+
+TEST_F(InternalTest, InputMapOptimization)
+{
+    using namespace Baikal;
+
+    auto texture = Texture::Create();
+    auto sampler = InputMap_Sampler::Create(texture);
+    auto create_graph = [sampler]()
+    {
+        auto scale = InputMap_Mul::Create(InputMap_ConstantFloat::Create(2.f), InputMap_ConstantFloat::Create(3.f));
+        return InputMap_Mul::Create(sampler, scale);
+    };
+
+    InputMapOptimizer optimizer;
+
+    // Constant subgraphs are folded
+    auto graph0 = optimizer.Optimize(create_graph());
+    ASSERT_EQ(graph0->m_type, InputMap::InputMapType::kMul);
+    auto scale = std::static_pointer_cast<InputMap_Mul>(graph0)->GetB();
+    ASSERT_EQ(scale->m_type, InputMap::InputMapType::kConstantFloat3);
+    ASSERT_EQ(std::static_pointer_cast<InputMap_ConstantFloat3>(scale)->GetValue().y, 6.f);
+
+    // Identical graphs are merged
+    ASSERT_EQ(optimizer.Optimize(create_graph()), graph0);
+
+    // No-op nodes are removed
+    auto lerp = InputMap_Lerp::Create(create_graph(), create_graph(), InputMap_ConstantFloat::Create(0.5f));
+    ASSERT_EQ(optimizer.Optimize(lerp), graph0);
+    auto add = InputMap_Add::Create(sampler, InputMap_ConstantFloat3::Create(RadeonRays::float3(0.f, 0.f, 0.f)));
+    ASSERT_EQ(optimizer.Optimize(add), sampler);
+
+    // Constants with non-zero w can't be folded
+    auto select = InputMap_Select::Create(InputMap_ConstantFloat::Create(1.f), InputMap_Select::Selection::kX);
+    ASSERT_EQ(optimizer.Optimize(select)->m_type, InputMap::InputMapType::kSelect);
+}
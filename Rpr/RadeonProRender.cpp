@@ -125,6 +125,9 @@ rpr_int rprContextGetInfo(rpr_context in_context, rpr_context_info in_context_in
     case RPR_CONTEXT_RENDER_STATISTICS:
         context->GetRenderStatistics(out_data, out_size_ret);
         break;
+    case RPR_CONTEXT_MEMORY_STATISTICS:
+        context->GetMemoryStatistics(out_data, out_size_ret);
+        break;
     case RPR_CONTEXT_PARAMETER_COUNT:
         break;
     case RPR_OBJECT_NAME:
@@ -349,7 +352,18 @@ rpr_int rprContextRender(rpr_context in_context)
         return RPR_ERROR_INVALID_CONTEXT;
     }
 
-    context->Render();
+    try
+    {
+        context->Render();
+    }
+    catch (Baikal::MemoryBudgetError&)
+    {
+        return RPR_ERROR_OUT_OF_VIDEO_MEMORY;
+    }
+    catch (Exception& e)
+    {
+        return e.m_error;
+    }
 
     return RPR_SUCCESS;
 }
@@ -363,14 +377,33 @@ rpr_int rprContextRenderTile(rpr_context in_context, rpr_uint xmin, rpr_uint xma
         return RPR_ERROR_INVALID_CONTEXT;
     }
 
-    context->RenderTile(xmin, xmax, ymin, ymax);
+    try
+    {
+        context->RenderTile(xmin, xmax, ymin, ymax);
+    }
+    catch (Baikal::MemoryBudgetError&)
+    {
+        return RPR_ERROR_OUT_OF_VIDEO_MEMORY;
+    }
+    catch (Exception& e)
+    {
+        return e.m_error;
+    }
 
     return RPR_SUCCESS;
 }
 
-rpr_int rprContextClearMemory(rpr_context context)
+rpr_int rprContextClearMemory(rpr_context in_context)
 {
-    UNIMLEMENTED_FUNCTION
+    //cast data
+    ContextObject* context = WrapObject::Cast<ContextObject>(in_context);
+    if (!context)
+    {
+        return RPR_ERROR_INVALID_CONTEXT;
+    }
+
+    context->ClearMemory();
+    return RPR_SUCCESS;
 }
 
 rpr_int rprContextCreateImage(rpr_context in_context, rpr_image_format const in_format, rpr_image_desc const * in_image_desc, void const * in_data, rpr_image * out_image)
@@ -1280,7 +1313,8 @@ rpr_int rprMeshGetInfo(rpr_shape in_mesh, rpr_mesh_info in_mesh_info, size_t in_
     {
     case RPR_MESH_POLYGON_COUNT:
     {
-        uint64_t value = mesh->GetVertexCount() / 3;
+        //vertices are shared between triangles, count them by indices
+        uint64_t value = mesh->GetIndicesCount() / 3;
         size_ret = sizeof(value);
         data.resize(size_ret);
         memcpy(&data[0], &value, size_ret);
@@ -186,9 +186,13 @@ extern "C" {
 #define RPR_CONTEXT_TRANSPARENT_BACKGROUND 0x13F 
 #define RPR_CONTEXT_MAX_DEPTH_SHADOW 0x140 
 #define RPR_CONTEXT_RANDOM_SEED 0x141 
+#define RPR_CONTEXT_RUSSIAN_ROULETTE_DEPTH 0x142 
+#define RPR_CONTEXT_RUSSIAN_ROULETTE_THRESHOLD 0x143 
+#define RPR_CONTEXT_GPU_MEMORY_BUDGET 0x144 
+#define RPR_CONTEXT_MEMORY_STATISTICS 0x145 
 
 /* last of the RPR_CONTEXT_* */
-#define RPR_CONTEXT_MAX 0x142 
+#define RPR_CONTEXT_MAX 0x146 
 
 /*rpr_camera_info*/
 #define RPR_CAMERA_TRANSFORM 0x201 
@@ -842,6 +846,21 @@ extern "C" {
 
     typedef _rpr_render_statistics rpr_render_statistics;
 
+    /* Device memory allocated by context per category, summed over devices */
+    struct _rpr_memory_statistics
+    {
+        rpr_longlong geometry;
+        rpr_longlong textures;
+        rpr_longlong materials;
+        rpr_longlong lights;
+        rpr_longlong work_buffers;
+        rpr_longlong other;
+        /* 0 if no budget is set */
+        rpr_longlong budget;
+    };
+
+    typedef _rpr_memory_statistics rpr_memory_statistics;
+
     struct _rpr_image_format
     {
         rpr_uint num_components;
@@ -24,6 +24,8 @@ THE SOFTWARE.
 #include "CLW.h"
 #include "RenderFactory/render_factory.h"
 #include <list>
+#include <cstdlib>
+#include <algorithm>
 
 #ifndef APP_BENCHMARK
 
@@ -72,6 +74,9 @@ void ConfigManager::CreateConfigs(
     bool interop = (flags & RPR_CREATION_FLAGS_ENABLE_GL_INTEROP) == RPR_CREATION_FLAGS_ENABLE_GL_INTEROP;
     bool hasprimary = false;
 
+    char const* replicas_env = std::getenv("BAIKAL_DEVICE_REPLICAS");
+    int num_replicas = replicas_env ? std::max(std::atoi(replicas_env), 1) : 1;
+
     rpr_uint gpu_counter = 0;
 
     for (std::size_t i = 0; i < platforms.size(); ++i)
@@ -143,6 +148,16 @@ void ConfigManager::CreateConfigs(
             }
 
             configs.push_back(std::move(cfg));
+
+            //expose the same device several times, used to test multi device rendering on one device
+            for (int r = 1; r < num_replicas; ++r)
+            {
+                Config replica;
+                replica.caninterop = false;
+                replica.context = CLWContext::Create(platforms[i].GetDevice(d));
+                replica.type = kSecondary;
+                configs.push_back(std::move(replica));
+            }
         }
     }
 
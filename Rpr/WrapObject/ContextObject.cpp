@@ -36,6 +36,10 @@ THE SOFTWARE.
 #include "SceneGraph/light.h"
 
 #include "RenderFactory/render_factory.h"
+#include "Output/clwoutput.h"
+
+#include <chrono>
+#include <exception>
 
 namespace
 {
@@ -94,6 +98,9 @@ namespace
     { RPR_CONTEXT_GPU7_NAME,{ "gpu7name", "Name of the GPU index 7 in context. Constant value.", RPR_PARAMETER_TYPE_STRING } },
     { RPR_CONTEXT_CPU_NAME,{ "cpuname", "Name of the CPU in context. Constant value.", RPR_PARAMETER_TYPE_STRING } },
     { RPR_CONTEXT_RANDOM_SEED,{ "randseed", "Random seed", RPR_PARAMETER_TYPE_UINT } },
+    { RPR_CONTEXT_RUSSIAN_ROULETTE_DEPTH,{ "rrdepth", "Bounce Russian roulette starts at", RPR_PARAMETER_TYPE_UINT } },
+    { RPR_CONTEXT_RUSSIAN_ROULETTE_THRESHOLD,{ "rrthreshold", "Path throughput Russian roulette is applied below", RPR_PARAMETER_TYPE_FLOAT } },
+    { RPR_CONTEXT_GPU_MEMORY_BUDGET,{ "gpumemorybudget", "Device memory budget per device in megabytes, 0 for no limit", RPR_PARAMETER_TYPE_UINT } },
     };
 
     std::map<uint32_t, Baikal::Renderer::OutputType> kOutputTypeMap = { {RPR_AOV_COLOR, Baikal::Renderer::OutputType::kColor},
@@ -107,10 +114,17 @@ namespace
                                                                         {RPR_AOV_OPACITY, Baikal::Renderer::OutputType::kOpacity},
                                                                         };
 
+    //max tile size MonteCarloRenderer can render in one pass
+    int constexpr kMaxTileWidth = 1920;
+    int constexpr kMaxTileHeight = 1080;
+    //band heights are multiple of this value
+    std::uint32_t constexpr kBandGranularity = 16;
+
 }// anonymous
 
 ContextObject::ContextObject(rpr_creation_flags creation_flags)
     : m_current_scene(nullptr)
+    , m_primary(0)
 {
     rpr_int result = RPR_SUCCESS;
 
@@ -128,24 +142,35 @@ ContextObject::ContextObject(rpr_creation_flags creation_flags)
     {
         throw Exception(result, "");
     }
+
+    auto primary = std::find_if(m_cfgs.cbegin(), m_cfgs.cend(), [](ConfigManager::Config const& c) { return c.type == ConfigManager::kPrimary; });
+    m_primary = primary != m_cfgs.cend() ? std::distance(m_cfgs.cbegin(), primary) : 0;
+
+    if (m_cfgs.size() > 1)
+    {
+        m_device_outputs.resize(m_cfgs.size());
+        m_device_readback.resize(m_cfgs.size());
+        m_scheduler = std::make_unique<Baikal::TileScheduler>(m_cfgs.size(), kBandGranularity);
+        m_thread_pool = std::make_unique<Baikal::ThreadPool>(m_cfgs.size() - 1);
+    }
 }
 
 void ContextObject::GetRenderStatistics(void * out_data, size_t * out_size_ret) const
 {
     if (out_data)
     {
-        //TODO: more statistics
         rpr_render_statistics* rs = static_cast<rpr_render_statistics*>(out_data);
         rs->gpumem_usage = 0;
         rs->gpumem_total = 0;
         rs->gpumem_max_allocation = 0;
-        //for (const auto& cfg : m_cfgs)
-        //{
-            // TODO: implement me
-            //rs->gpumem_usage += cfg.renderer->GetWorkingSetSize();
-            //rs->gpumem_total += cfg.renderer->GetWorkingSetSize();
-            //rs->gpumem_max_allocation += cfg.renderer->GetWorkingSetSize();
-        //}
+        rs->sysmem_usage = 0;
+        for (const auto& cfg : m_cfgs)
+        {
+            auto memory_manager = static_cast<Baikal::ClwRenderFactory*>(cfg.factory.get())->GetMemoryManager();
+            rs->gpumem_usage += memory_manager->GetUsage();
+            rs->gpumem_total += memory_manager->GetDeviceMemorySize();
+            rs->gpumem_max_allocation = std::max<rpr_longlong>(rs->gpumem_max_allocation, memory_manager->GetMaxAllocation());
+        }
     }
     if (out_size_ret)
     {
@@ -153,6 +178,40 @@ void ContextObject::GetRenderStatistics(void * out_data, size_t * out_size_ret)
     }
 }
 
+void ContextObject::GetMemoryStatistics(void * out_data, size_t * out_size_ret) const
+{
+    using Category = Baikal::CLMemoryManager::Category;
+
+    if (out_data)
+    {
+        rpr_memory_statistics* ms = static_cast<rpr_memory_statistics*>(out_data);
+        *ms = {};
+        for (const auto& cfg : m_cfgs)
+        {
+            auto memory_manager = static_cast<Baikal::ClwRenderFactory*>(cfg.factory.get())->GetMemoryManager();
+            ms->geometry += memory_manager->GetUsage(Category::kGeometry);
+            ms->textures += memory_manager->GetUsage(Category::kTextures);
+            ms->materials += memory_manager->GetUsage(Category::kMaterials);
+            ms->lights += memory_manager->GetUsage(Category::kLights);
+            ms->work_buffers += memory_manager->GetUsage(Category::kWorkBuffers);
+            ms->other += memory_manager->GetUsage(Category::kOther);
+            ms->budget += memory_manager->GetBudget();
+        }
+    }
+    if (out_size_ret)
+    {
+        *out_size_ret = sizeof(rpr_memory_statistics);
+    }
+}
+
+void ContextObject::ClearMemory()
+{
+    for (auto& cfg : m_cfgs)
+    {
+        cfg.controller->ClearCache();
+    }
+}
+
 void ContextObject::SetAOV(rpr_int in_aov, FramebufferObject* buffer)
 {
     FramebufferObject* old_buf = GetAOV(in_aov);
@@ -163,9 +222,21 @@ void ContextObject::SetAOV(rpr_int in_aov, FramebufferObject* buffer)
         throw Exception(RPR_ERROR_UNIMPLEMENTED, "Context: requested AOV not implemented.");
     }
     
-    for (auto& c : m_cfgs)
+    Baikal::Output* out = buffer->GetOutput();
+    m_cfgs[m_primary].renderer->SetOutput(aov->second, out);
+
+    //secondary devices render into own outputs merged into the framebuffer later
+    for (std::size_t i = 0; i < m_cfgs.size(); ++i)
     {
-        c.renderer->SetOutput(aov->second, buffer->GetOutput());
+        if (i == m_primary)
+        {
+            continue;
+        }
+
+        auto& c = m_cfgs[i];
+        auto device_out = c.factory->CreateOutput(out->width(), out->height());
+        c.renderer->SetOutput(aov->second, device_out.get());
+        m_device_outputs[i][aov->second] = std::move(device_out);
     }
 
     //update registered output framebuffer
@@ -182,7 +253,7 @@ FramebufferObject* ContextObject::GetAOV(rpr_int in_aov)
         throw Exception(RPR_ERROR_UNIMPLEMENTED, "Context: requested AOV not implemented.");
     }
 
-    Baikal::Output* out = m_cfgs[0].renderer->GetOutput(aov->second);
+    Baikal::Output* out = m_cfgs[m_primary].renderer->GetOutput(aov->second);
     if (!out)
     {
         return nullptr;
@@ -205,12 +276,22 @@ void ContextObject::Render()
 {
     PrepareScene();
 
-    //render
-    for (auto& c : m_cfgs)
+    if (m_cfgs.size() == 1)
     {
+        auto& c = m_cfgs[0];
         auto& scene = c.controller->GetCachedScene(m_current_scene->GetScene());
         c.renderer->Render(scene);
     }
+    else
+    {
+        auto out = GetFirstOutput();
+        if (!out)
+        {
+            throw Exception(RPR_ERROR_INVALID_PARAMETER, "Context: no AOV set.");
+        }
+
+        RenderRegion(RadeonRays::int2(), RadeonRays::int2(out->width(), out->height()), true);
+    }
     PostRender();
 }
 
@@ -221,14 +302,197 @@ void ContextObject::RenderTile(rpr_uint xmin, rpr_uint xmax, rpr_uint ymin, rpr_
     const RadeonRays::int2 origin = { (int)xmin, (int)ymin };
     const RadeonRays::int2 size = { (int)xmax - (int)xmin, (int)ymax - (int)ymin };
     //render
-    for (auto& c : m_cfgs)
+    if (m_cfgs.size() == 1)
     {
+        auto& c = m_cfgs[0];
         auto& scene = c.controller->GetCachedScene(m_current_scene->GetScene());
         c.renderer->RenderTile(scene, origin, size);
     }
+    else
+    {
+        RenderRegion(origin, size, false);
+    }
     PostRender();
 }
 
+void ContextObject::RenderRegion(RadeonRays::int2 const& origin, RadeonRays::int2 const& size, bool frame)
+{
+    auto const& bands = m_scheduler->Schedule(static_cast<std::uint32_t>(size.y));
+
+    //devices without rows still finish the frame so sample counters stay in sync
+    if (frame)
+    {
+        for (auto const& band : bands)
+        {
+            if (band.height == 0)
+            {
+                auto& c = m_cfgs[band.device];
+                auto& scene = c.controller->GetCachedScene(m_current_scene->GetScene());
+                static_cast<Baikal::MonteCarloRenderer*>(c.renderer.get())->RenderFrame(scene, []() {});
+            }
+        }
+    }
+
+    //secondary devices run in parallel with the primary one
+    std::vector<std::future<double>> elapsed(m_cfgs.size());
+    for (auto const& band : bands)
+    {
+        if (band.device != m_primary && band.height > 0)
+        {
+            elapsed[band.device] = m_thread_pool->Submit([this, band, origin, size, frame]()
+            {
+                return RenderBand(band, origin, size, frame);
+            });
+        }
+    }
+
+    auto const& primary_band = bands[m_primary];
+    std::exception_ptr primary_error;
+    try
+    {
+        if (primary_band.height > 0)
+        {
+            m_scheduler->ReportTime(m_primary, primary_band.height, RenderBand(primary_band, origin, size, frame));
+        }
+    }
+    catch (...)
+    {
+        primary_error = std::current_exception();
+    }
+
+    //wait for all devices before rethrowing so no task outlives this call
+    for (auto& e : elapsed)
+    {
+        if (e.valid())
+        {
+            e.wait();
+        }
+    }
+
+    if (primary_error)
+    {
+        std::rethrow_exception(primary_error);
+    }
+
+    for (auto const& band : bands)
+    {
+        if (!elapsed[band.device].valid())
+        {
+            continue;
+        }
+
+        m_scheduler->ReportTime(band.device, band.height, elapsed[band.device].get());
+        MergeBand(band, origin);
+    }
+}
+
+double ContextObject::RenderBand(Baikal::TileScheduler::Band const& band, RadeonRays::int2 const& origin, RadeonRays::int2 const& size, bool frame)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    auto& c = m_cfgs[band.device];
+    auto& scene = c.controller->GetCachedScene(m_current_scene->GetScene());
+    bool secondary = band.device != m_primary;
+
+    //device outputs hold only the current render
+    if (secondary)
+    {
+        for (auto& out : m_device_outputs[band.device])
+        {
+            out.second->Clear(RadeonRays::float3(0.f, 0.f, 0.f, 0.f));
+        }
+    }
+
+    auto render_tiles = [&]()
+    {
+        for (int y = 0; y < static_cast<int>(band.height); y += kMaxTileHeight)
+        {
+            for (int x = 0; x < size.x; x += kMaxTileWidth)
+            {
+                RadeonRays::int2 tile_origin(origin.x + x, origin.y + static_cast<int>(band.y) + y);
+                RadeonRays::int2 tile_size(std::min(kMaxTileWidth, size.x - x), std::min(kMaxTileHeight, static_cast<int>(band.height) - y));
+                c.renderer->RenderTile(scene, tile_origin, tile_size);
+            }
+        }
+    };
+
+    if (frame)
+    {
+        static_cast<Baikal::MonteCarloRenderer*>(c.renderer.get())->RenderFrame(scene, render_tiles);
+    }
+    else
+    {
+        render_tiles();
+    }
+
+    if (secondary)
+    {
+        //whole rows are read back, pixels outside of the region are zero
+        for (auto& out : m_device_outputs[band.device])
+        {
+            auto width = out.second->width();
+            auto offset = static_cast<std::size_t>(origin.y + band.y) * width;
+            auto count = static_cast<std::size_t>(band.height) * width;
+
+            auto& data = m_device_readback[band.device][out.first];
+            data.resize(count);
+            out.second->GetData(data.data(), offset, count);
+        }
+    }
+    else
+    {
+        c.context.Finish(0);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void ContextObject::MergeBand(Baikal::TileScheduler::Band const& band, RadeonRays::int2 const& origin)
+{
+    auto& primary = m_cfgs[m_primary];
+    auto accumulate_kernel = static_cast<Baikal::MonteCarloRenderer*>(primary.renderer.get())->GetAccumulateRegionKernel();
+
+    for (auto const& data : m_device_readback[band.device])
+    {
+        auto out = static_cast<Baikal::ClwOutput*>(primary.renderer->GetOutput(data.first));
+        if (!out || data.second.empty())
+        {
+            continue;
+        }
+
+        auto count = data.second.size();
+        if (m_merge_buffer.GetElementCount() < count)
+        {
+            m_merge_buffer = primary.context.CreateBuffer<RadeonRays::float3>(count, CL_MEM_READ_ONLY);
+        }
+
+        primary.context.WriteBuffer(0, m_merge_buffer, data.second.data(), count).Wait();
+
+        int argc = 0;
+        accumulate_kernel.SetArg(argc++, m_merge_buffer);
+        accumulate_kernel.SetArg(argc++, static_cast<cl_int>(count));
+        accumulate_kernel.SetArg(argc++, static_cast<cl_int>((origin.y + band.y) * out->width()));
+        accumulate_kernel.SetArg(argc++, out->data());
+
+        primary.context.Launch1D(0, ((count + 63) / 64) * 64, 64, accumulate_kernel);
+    }
+}
+
+Baikal::Output* ContextObject::GetFirstOutput() const
+{
+    auto& renderer = m_cfgs[m_primary].renderer;
+    for (auto const& aov : kOutputTypeMap)
+    {
+        if (auto out = renderer->GetOutput(aov.second))
+        {
+            return out;
+        }
+    }
+
+    return nullptr;
+}
+
 
 SceneObject* ContextObject::CreateScene()
 {
@@ -295,12 +559,8 @@ FramebufferObject* ContextObject::CreateFrameBuffer(rpr_framebuffer_format const
         throw Exception(RPR_ERROR_UNIMPLEMENTED, "ContextObject: only 4 component RPR_COMPONENT_TYPE_FLOAT32 implemented now.");
     }
 
-    //TODO:: implement for several devices
-    if (m_cfgs.size() != 1)
-    {
-        throw Exception(RPR_ERROR_UNIMPLEMENTED, "ContextObject: invalid config count.");
-    }
-    auto& c = m_cfgs[0];
+    //framebuffers live on the primary device, other devices results are merged into it
+    auto& c = m_cfgs[m_primary];
     Baikal::Output* out = c.factory->CreateOutput(in_fb_desc->fb_width, in_fb_desc->fb_height).release();
     FramebufferObject* result = new FramebufferObject(out);
     return result;
@@ -308,12 +568,7 @@ FramebufferObject* ContextObject::CreateFrameBuffer(rpr_framebuffer_format const
 
 FramebufferObject* ContextObject::CreateFrameBufferFromGLTexture(rpr_GLenum target, rpr_GLint miplevel, rpr_GLuint texture)
 {
-    //TODO:: implement for several devices
-    if (m_cfgs.size() != 1)
-    {
-        throw Exception(RPR_ERROR_INTERNAL_ERROR, "ContextObject: invalid config count.");
-    }
-    auto& c = m_cfgs[0];
+    auto& c = m_cfgs[m_primary];
     auto copykernel = static_cast<Baikal::MonteCarloRenderer*>(c.renderer.get())->GetCopyKernel();
     FramebufferObject* result = new FramebufferObject(c.context, copykernel, target, miplevel, texture);
     std::uint32_t w = static_cast<std::uint32_t>(result->Width());
@@ -345,6 +600,18 @@ void ContextObject::SetParameter(const std::string& input, rpr_uint value)
             c.renderer->SetRandomSeed(value);
         }
         break;
+    case RPR_CONTEXT_RUSSIAN_ROULETTE_DEPTH:
+        for (auto& c : m_cfgs)
+        {
+            static_cast<Baikal::MonteCarloRenderer*>(c.renderer.get())->SetRussianRouletteDepth(value);
+        }
+        break;
+    case RPR_CONTEXT_GPU_MEMORY_BUDGET:
+        for (auto& c : m_cfgs)
+        {
+            static_cast<Baikal::ClwRenderFactory*>(c.factory.get())->GetMemoryManager()->SetBudget(static_cast<std::size_t>(value) * 1024u * 1024u);
+        }
+        break;
     default:
         throw Exception(RPR_ERROR_UNIMPLEMENTED, "ContextObject: requested parameter is not implemented");
     }
@@ -357,12 +624,27 @@ void ContextObject::SetParameter(const std::string& input, float x, float y, flo
     {
         throw Exception(RPR_ERROR_INVALID_TAG, "ContextObject: invalid context input parameter.");
     }
-
-    it = std::find_if(kContextParameterDescriptions.begin(), kContextParameterDescriptions.end(), [input](std::pair<uint32_t, ParameterDesc> desc){ return desc.second.type == RPR_PARAMETER_TYPE_FLOAT; });
-    if (it == kContextParameterDescriptions.end())
+    else if (it->second.type != RPR_PARAMETER_TYPE_FLOAT)
     {
         throw Exception(RPR_ERROR_INVALID_PARAMETER_TYPE, "ContextObject: invalid context input type.");
     }
+
+    switch (it->first)
+    {
+    case RPR_CONTEXT_RUSSIAN_ROULETTE_THRESHOLD:
+        if (x <= 0.f)
+        {
+            throw Exception(RPR_ERROR_INVALID_PARAMETER, "ContextObject: Russian roulette threshold should be positive.");
+        }
+        for (auto& c : m_cfgs)
+        {
+            static_cast<Baikal::MonteCarloRenderer*>(c.renderer.get())->SetRussianRouletteThreshold(x);
+        }
+        break;
+    default:
+        //TODO: other float parameters are accepted but not used yet
+        break;
+    }
 }
 
 void ContextObject::SetParameter(const std::string& input, const std::string& value)
@@ -25,9 +25,13 @@ THE SOFTWARE.
 #include "WrapObject/LightObject.h"
 
 #include "Utils/config_manager.h"
+#include "Utils/tile_scheduler.h"
+#include "Utils/thread_pool.h"
 #include "Renderers/monte_carlo_renderer.h"
 
 #include <vector>
+#include <map>
+#include <memory>
 #include "RadeonProRender.h"
 #include "RadeonProRender_GL.h"
 
@@ -52,6 +56,7 @@ public:
     
     //context info
     void GetRenderStatistics(void * out_data, size_t * out_size_ret) const;
+    void GetMemoryStatistics(void * out_data, size_t * out_size_ret) const;
     void SetParameter(const std::string& input, rpr_uint value);
     void SetParameter(const std::string& input, float x, float y = 0.f, float z = 0.f, float w = 0.f);
     void SetParameter(const std::string& input, const std::string& value);
@@ -63,6 +68,8 @@ public:
     //render
     void Render();
     void RenderTile(rpr_uint xmin, rpr_uint xmax, rpr_uint ymin, rpr_uint ymax);
+    //drop cached scenes other than the current one
+    void ClearMemory();
 
     //create methods
     SceneObject* CreateScene();
@@ -87,8 +94,28 @@ private:
     //after render update
     void PostRender();
 
+    //multi device rendering: split region between devices and merge results into primary AOVs,
+    //whole frames go through the renderer frame steps (texture streaming prepass)
+    void RenderRegion(RadeonRays::int2 const& origin, RadeonRays::int2 const& size, bool frame);
+    //render band on a device, returns elapsed time in ms
+    double RenderBand(Baikal::TileScheduler::Band const& band, RadeonRays::int2 const& origin, RadeonRays::int2 const& size, bool frame);
+    //accumulate band rendered by secondary device into primary AOVs
+    void MergeBand(Baikal::TileScheduler::Band const& band, RadeonRays::int2 const& origin);
+    Baikal::Output* GetFirstOutput() const;
+
     //render configs
     std::vector<ConfigManager::Config> m_cfgs;
+    //index of the device owning framebuffers
+    std::size_t m_primary;
+    //AOV outputs of secondary devices, merged into primary framebuffers after each render
+    std::vector<std::map<Baikal::Renderer::OutputType, std::unique_ptr<Baikal::Output>>> m_device_outputs;
+    //host copies of rendered bands for each secondary device
+    std::vector<std::map<Baikal::Renderer::OutputType, std::vector<RadeonRays::float3>>> m_device_readback;
+    //primary device buffer band data is uploaded to before merge
+    CLWBuffer<RadeonRays::float3> m_merge_buffer;
+    std::unique_ptr<Baikal::TileScheduler> m_scheduler;
+    //runs secondary devices, primary renders on the calling thread
+    std::unique_ptr<Baikal::ThreadPool> m_thread_pool;
     //know framefubbers used as AOV outputs
     std::set<FramebufferObject*> m_output_framebuffers;
     SceneObject* m_current_scene;
@@ -169,13 +169,10 @@ void SceneObject::AddEmissive()
         //fine shapes with emissive material
         if (mat->HasEmission())
         {
-            // Add area light for each polygon of emissive mesh
-            for (std::size_t l = 0; l < mesh->GetNumIndices() / 3; ++l)
-            {
-                auto light = Baikal::AreaLight::Create(mesh, l);
-                m_scene->AttachLight(light);
-                m_emmisive_lights.push_back(light);
-            }
+            // Add mesh light covering all polygons of emissive mesh
+            auto light = Baikal::MeshLight::Create(mesh);
+            m_scene->AttachLight(light);
+            m_emmisive_lights.push_back(light);
         }
     }
 }
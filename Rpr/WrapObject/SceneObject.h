@@ -86,7 +86,7 @@ public:
 private:
     Baikal::Scene1::Ptr m_scene;
     CameraObject* m_current_camera = nullptr;
-    std::vector<Baikal::AreaLight::Ptr> m_emmisive_lights;//area lights fro emissive shapes
+    std::vector<Baikal::MeshLight::Ptr> m_emmisive_lights;//mesh lights for emissive shapes
     std::vector<ShapeObject*> m_shapes;
     std::vector<LightObject*> m_lights;
     MaterialObject *m_background_image = nullptr;
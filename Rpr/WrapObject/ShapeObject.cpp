@@ -22,6 +22,8 @@ THE SOFTWARE.
 
 #include <vector>
 #include <iostream>
+#include <unordered_map>
+#include <functional>
 
 #include "WrapObject/ShapeObject.h"
 #include "WrapObject/Exception.h"
@@ -32,42 +34,60 @@ using namespace Baikal;
 
 namespace
 {
-    template<typename T, int size = 3> std::vector<T> merge(const T* in_data, size_t in_data_num, rpr_int in_data_stride,
-        rpr_int const * in_data_indices, rpr_int in_didx_stride,
-        rpr_int const * in_num_face_vertices, size_t in_num_faces)
+    // Attribute indices of a single face vertex, -1 marks a missing attribute
+    struct FaceVertex
     {
-        std::vector<T> result;
-        if (!in_data || !in_data_indices)
+        rpr_int v;
+        rpr_int n;
+        rpr_int t;
+
+        bool operator == (FaceVertex const& rhs) const
         {
-            std::cout << "Warning: missing mesh data, fill it with NULL.\n";
-            int count = 0;
-            for (std::size_t i = 0; i < in_num_faces; ++i)
-            {
-                count += in_num_face_vertices[i];
-            }
-            result.resize(count * size);
-            std::fill(result.begin(), result.end(), 0.f);
+            return v == rhs.v && n == rhs.n && t == rhs.t;
+        }
+    };
 
-            return result;
+    struct FaceVertexHash
+    {
+        std::size_t operator () (FaceVertex const& fv) const
+        {
+            std::size_t h = std::hash<rpr_int>()(fv.v);
+            h ^= std::hash<rpr_int>()(fv.n) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            h ^= std::hash<rpr_int>()(fv.t) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            return h;
+        }
+    };
+
+    // Strided accessor for one vertex attribute stream (strides are in bytes)
+    template<typename T, int size> struct AttributeStream
+    {
+        T const* data;
+        rpr_int data_stride;
+        rpr_int const* indices;
+        rpr_int idx_stride;
+
+        bool IsValid() const
+        {
+            return data && indices;
         }
 
-        int indent = 0;
-        for (std::size_t i = 0; i < in_num_faces; ++i)
+        rpr_int GetIndex(std::size_t f) const
         {
-            int face = in_num_face_vertices[i];
-            for (int f = indent; f < face + indent; ++f)
+            return IsValid() ? indices[f * idx_stride / sizeof(rpr_int)] : -1;
+        }
+
+        void Append(rpr_int index, std::vector<T>& out) const
+        {
+            if (index < 0)
             {
-                int index = in_data_stride / sizeof(T) * in_data_indices[f*in_didx_stride / sizeof(rpr_int)];
-                for (int s = 0; s < size; ++s)
-                {
-                    result.push_back(in_data[index + s]);
-                }
+                out.insert(out.end(), size, T(0));
+                return;
             }
 
-            indent += face;
+            auto src = data + data_stride / sizeof(T) * index;
+            out.insert(out.end(), src, src + size);
         }
-        return result;
-    }
+    };
 }
 
 ShapeObject::ShapeObject(Baikal::Shape::Ptr shape, ShapeObject* base_shape_obj)
@@ -107,41 +127,82 @@ ShapeObject* ShapeObject::CreateMesh(rpr_float const * in_vertices, size_t in_nu
                         rpr_int const * in_texcoord_indices, rpr_int in_tidx_stride,
                         rpr_int const * in_num_face_vertices, size_t in_num_faces)
 {
-    //merge data
-    std::vector<float> verts = merge(in_vertices, in_num_vertices, in_vertex_stride,
-        in_vertex_indices, in_vidx_stride,
-        in_num_face_vertices, in_num_faces);
-    std::vector<float> normals = merge(in_normals, in_num_normals, in_normal_stride,
-        in_normal_indices, in_nidx_stride,
-        in_num_face_vertices, in_num_faces);
-    std::vector<float> uvs = merge<float, 2>(in_texcoords, in_num_texcoords, in_texcoord_stride,
-        in_texcoord_indices, in_tidx_stride,
-        in_num_face_vertices, in_num_faces);
-
-    //generate indices
-    std::vector<std::uint32_t> inds;
-    std::uint32_t indent = 0;
-    for (std::uint32_t i = 0; i < in_num_faces; ++i)
+    AttributeStream<rpr_float, 3> positions{ in_vertices, in_vertex_stride, in_vertex_indices, in_vidx_stride };
+    AttributeStream<rpr_float, 3> normals_stream{ in_normals, in_normal_stride, in_normal_indices, in_nidx_stride };
+    AttributeStream<rpr_float, 2> uvs_stream{ in_texcoords, in_texcoord_stride, in_texcoord_indices, in_tidx_stride };
+
+    if (!positions.IsValid())
     {
-        inds.push_back(indent);
-        inds.push_back(indent + 1);
-        inds.push_back(indent + 2);
+        throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: missing vertex data.");
+    }
+
+    if (!normals_stream.IsValid() || !uvs_stream.IsValid())
+    {
+        std::cout << "Warning: missing mesh data, fill it with NULL.\n";
+    }
 
+    //count face vertices and triangles to pre-size the buffers
+    std::size_t num_face_vertices = 0;
+    std::size_t num_triangles = 0;
+    for (std::size_t i = 0; i < in_num_faces; ++i)
+    {
+        int face = in_num_face_vertices[i];
+
+        //degenerate faces can't be triangulated
+        if (face < 3)
+        {
+            throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: invalid face value.");
+        }
+
+        num_face_vertices += face;
+        num_triangles += face - 2;
+    }
+
+    std::vector<float> verts;
+    std::vector<float> normals;
+    std::vector<float> uvs;
+    verts.reserve(num_face_vertices * 3);
+    normals.reserve(num_face_vertices * 3);
+    uvs.reserve(num_face_vertices * 2);
+
+    std::vector<std::uint32_t> inds;
+    inds.reserve(num_triangles * 3);
+
+    //weld face vertices sharing the same (position, normal, uv) indices
+    std::unordered_map<FaceVertex, std::uint32_t, FaceVertexHash> welded;
+    welded.reserve(num_face_vertices);
+
+    std::vector<std::uint32_t> face_indices;
+    std::size_t indent = 0;
+    for (std::size_t i = 0; i < in_num_faces; ++i)
+    {
         int face = in_num_face_vertices[i];
 
-        //triangulation
-        if (face == 4)
+        face_indices.clear();
+        for (std::size_t f = indent; f < indent + face; ++f)
         {
-            inds.push_back(indent + 0);
-            inds.push_back(indent + 2);
-            inds.push_back(indent + 3);
+            FaceVertex fv = { positions.GetIndex(f), normals_stream.GetIndex(f), uvs_stream.GetIndex(f) };
+
+            auto next_index = static_cast<std::uint32_t>(welded.size());
+            auto res = welded.emplace(fv, next_index);
+            if (res.second)
+            {
+                positions.Append(fv.v, verts);
+                normals_stream.Append(fv.n, normals);
+                uvs_stream.Append(fv.t, uvs);
+            }
 
+            face_indices.push_back(res.first->second);
         }
-        //only triangles and quads supported
-        else if (face != 3)
+
+        //fan triangulation (convex polygons)
+        for (int k = 1; k < face - 1; ++k)
         {
-            throw Exception(RPR_ERROR_INVALID_PARAMETER, "ShapeObject: invalid face value.");
+            inds.push_back(face_indices[0]);
+            inds.push_back(face_indices[k]);
+            inds.push_back(face_indices[k + 1]);
         }
+
         indent += face;
     }
 
@@ -150,7 +211,7 @@ ShapeObject* ShapeObject::CreateMesh(rpr_float const * in_vertices, size_t in_nu
     mesh->SetVertices(verts.data(), verts.size() / 3);
     mesh->SetNormals(normals.data(), normals.size() / 3);
     mesh->SetUVs(uvs.data(), uvs.size() / 2);
-    mesh->SetIndices(inds.data(), inds.size());
+    mesh->SetIndices(std::move(inds));
 
     return new ShapeObject(mesh, nullptr);
 }
@@ -723,18 +723,55 @@ protected:
 // Memstat test
 TEST_F(BasicTest, Basic_MemoryStatistics)
 {
-    rpr_render_statistics rs;
-    rs.gpumem_usage = 0;
-    rs.gpumem_total = 0;
-    rs.gpumem_max_allocation = 0;
+    rpr_render_statistics rs = {};
 
-    //create context and check there is no used resources
+    //context only holds estimator work buffers before scene is compiled
     ASSERT_EQ(rprContextGetInfo(m_context, RPR_CONTEXT_RENDER_STATISTICS, sizeof(rpr_render_statistics), &rs, NULL), RPR_SUCCESS);
 
-    ASSERT_EQ(rs.gpumem_usage, 0);
-    ASSERT_EQ(rs.gpumem_total, 0);
-    ASSERT_EQ(rs.gpumem_max_allocation, 0);
+    ASSERT_GT(rs.gpumem_total, 0);
+    ASSERT_GT(rs.gpumem_max_allocation, 0);
+    auto work_buffers_usage = rs.gpumem_usage;
 
+    CreateScene(SceneType::kSphereAndPlane);
+    Render(1);
+
+    ASSERT_EQ(rprContextGetInfo(m_context, RPR_CONTEXT_RENDER_STATISTICS, sizeof(rpr_render_statistics), &rs, NULL), RPR_SUCCESS);
+    ASSERT_GT(rs.gpumem_usage, work_buffers_usage);
+    ASSERT_LE(rs.gpumem_usage, rs.gpumem_total);
+
+    //usage is split into categories
+    rpr_memory_statistics ms = {};
+    ASSERT_EQ(rprContextGetInfo(m_context, RPR_CONTEXT_MEMORY_STATISTICS, sizeof(rpr_memory_statistics), &ms, NULL), RPR_SUCCESS);
+    ASSERT_GT(ms.geometry, 0);
+    ASSERT_GT(ms.work_buffers, 0);
+    ASSERT_EQ(ms.geometry + ms.textures + ms.materials + ms.lights + ms.work_buffers + ms.other, rs.gpumem_usage);
+    ASSERT_EQ(ms.budget, 0);
+
+    //current scene stays resident
+    ASSERT_EQ(rprContextClearMemory(m_context), RPR_SUCCESS);
+    Render(1);
+}
+
+// Memory budget test
+TEST_F(BasicTest, Basic_MemoryBudget)
+{
+    //work buffers alone take more than 1MB, so scene buffers don't fit
+    ASSERT_EQ(rprContextSetParameter1u(m_context, "gpumemorybudget", 1u), RPR_SUCCESS);
+
+    CreateScene(SceneType::kSphereAndPlane);
+    ClearFramebuffer();
+    ASSERT_EQ(rprContextRender(m_context), RPR_ERROR_OUT_OF_VIDEO_MEMORY);
+}
+
+// Float context parameters without implementation are accepted
+TEST_F(BasicTest, Basic_FloatParameters)
+{
+    ASSERT_EQ(rprContextSetParameter1f(m_context, "displaygamma", 2.2f), RPR_SUCCESS);
+    ASSERT_EQ(rprContextSetParameter1f(m_context, "texturegamma", 1.f), RPR_SUCCESS);
+    ASSERT_EQ(rprContextSetParameter1f(m_context, "radianceclamp", 10.f), RPR_SUCCESS);
+    ASSERT_EQ(rprContextSetParameter1f(m_context, "imagefilter.gaussian.radius", 1.5f), RPR_SUCCESS);
+    ASSERT_EQ(rprContextSetParameter1f(m_context, "rrthreshold", 0.5f), RPR_SUCCESS);
+    ASSERT_EQ(rprContextSetParameter1f(m_context, "rrthreshold", 0.f), RPR_ERROR_INVALID_PARAMETER);
 }
 
 // Tiled render test
@@ -752,6 +789,44 @@ TEST_F(BasicTest, Basic_TiledRender)
     SaveAndCompare();
 
 }
+
+// Frame split between two devices (the test device exposed twice)
+TEST_F(BasicTest, Basic_MultiDeviceRender)
+{
+    ASSERT_EQ(rprObjectDelete(m_framebuffer), RPR_SUCCESS);
+    m_framebuffer = nullptr;
+    ASSERT_EQ(rprObjectDelete(m_context), RPR_SUCCESS);
+    m_context = nullptr;
+
+#ifdef WIN32
+    _putenv_s("BAIKAL_DEVICE_REPLICAS", "2");
+#else
+    setenv("BAIKAL_DEVICE_REPLICAS", "2", 1);
+#endif
+    auto status = rprCreateContext(RPR_API_VERSION, nullptr, 0, GetCreationFlags(), nullptr, nullptr, &m_context);
+#ifdef WIN32
+    _putenv_s("BAIKAL_DEVICE_REPLICAS", "");
+#else
+    unsetenv("BAIKAL_DEVICE_REPLICAS");
+#endif
+    ASSERT_EQ(status, RPR_SUCCESS);
+    ASSERT_EQ(rprContextSetParameter1u(m_context, "randseed", 0u), RPR_SUCCESS);
+
+    CreateFramebuffer();
+    CreateScene(SceneType::kSphereAndPlane);
+    AddEnvironmentLight("../Resources/Textures/studio015.hdr");
+
+    Render();
+    SaveAndCompare("full");
+
+    ClearFramebuffer();
+    for (std::size_t i = 0; i < kRenderIterations; ++i)
+    {
+        ASSERT_EQ(rprContextRenderTile(m_context, 0, 128, 0, 128), RPR_SUCCESS);
+    }
+    SaveAndCompare("tile");
+}
+
 // Add instancing test
 // Instancing doesn't work on osx
 #ifndef __APPLE__
@@ -841,3 +916,75 @@ TEST_F(BasicTest, Basic_MultiUV)
         texcoord_indices, tidx_stride,
         num_face_vertices, num_faces, &mesh), RPR_ERROR_UNIMPLEMENTED);
 }
+
+// Mesh import welds face vertices with identical attribute indices and fan-triangulates n-gons
+TEST_F(BasicTest, Basic_MeshWelding)
+{
+    // Hexagon with a center point
+    rpr_float vertices[] =
+    {
+         1.0f,  0.0f,   0.0f,
+         0.5f,  0.866f, 0.0f,
+        -0.5f,  0.866f, 0.0f,
+        -1.0f,  0.0f,   0.0f,
+        -0.5f, -0.866f, 0.0f,
+         0.5f, -0.866f, 0.0f,
+         0.0f,  0.0f,   0.0f
+    };
+
+    rpr_float normals[] =
+    {
+        0.0f, 0.0f, 1.0f
+    };
+
+    rpr_float uvs[] =
+    {
+        1.0f, 0.5f,
+        0.75f, 1.0f,
+        0.25f, 1.0f,
+        0.0f, 0.5f,
+        0.25f, 0.0f,
+        0.75f, 0.0f,
+        0.5f, 0.5f
+    };
+
+    // One hexagon and two triangles sharing its vertices,
+    // the last one uses a different uv for the center vertex (uv seam)
+    rpr_int vertex_indices[] = { 0, 1, 2, 3, 4, 5,  0, 1, 6,  2, 3, 6 };
+    rpr_int normal_indices[] = { 0, 0, 0, 0, 0, 0,  0, 0, 0,  0, 0, 0 };
+    rpr_int uv_indices[]     = { 0, 1, 2, 3, 4, 5,  0, 1, 6,  2, 3, 0 };
+    rpr_int num_face_vertices[] = { 6, 3, 3 };
+
+    rpr_shape mesh = nullptr;
+    ASSERT_EQ(rprContextCreateMesh(m_context,
+        vertices, 7, sizeof(rpr_float) * 3,
+        normals, 1, sizeof(rpr_float) * 3,
+        uvs, 7, sizeof(rpr_float) * 2,
+        vertex_indices, sizeof(rpr_int),
+        normal_indices, sizeof(rpr_int),
+        uv_indices, sizeof(rpr_int),
+        num_face_vertices, 3, &mesh), RPR_SUCCESS);
+
+    std::uint64_t num_vertices = 0;
+    std::uint64_t num_polygons = 0;
+    ASSERT_EQ(rprMeshGetInfo(mesh, RPR_MESH_VERTEX_COUNT, sizeof(num_vertices), &num_vertices, nullptr), RPR_SUCCESS);
+    ASSERT_EQ(rprMeshGetInfo(mesh, RPR_MESH_POLYGON_COUNT, sizeof(num_polygons), &num_polygons, nullptr), RPR_SUCCESS);
+
+    // 7 unique (position, normal, uv) triples plus one for the seam
+    ASSERT_EQ(num_vertices, 8u);
+    // Hexagon is split into 4 triangles
+    ASSERT_EQ(num_polygons, 6u);
+
+    ASSERT_EQ(rprObjectDelete(mesh), RPR_SUCCESS);
+
+    // Faces with less than 3 vertices can't be triangulated
+    rpr_int bad_face[] = { 2 };
+    ASSERT_EQ(rprContextCreateMesh(m_context,
+        vertices, 7, sizeof(rpr_float) * 3,
+        normals, 1, sizeof(rpr_float) * 3,
+        uvs, 7, sizeof(rpr_float) * 2,
+        vertex_indices, sizeof(rpr_int),
+        normal_indices, sizeof(rpr_int),
+        uv_indices, sizeof(rpr_int),
+        bad_face, 1, &mesh), RPR_ERROR_INVALID_PARAMETER);
+}